@@ -0,0 +1,54 @@
+# run the alignment functions from several python threads, which
+# only run in parallel if the bindings release the interpreter lock;
+# bindings that keep the lock are emulated by serializing all calls
+# with a global lock, so both cases are measured with the same build
+# ------------------------------------------------------------------------------
+
+import Queue
+import threading
+import time
+
+from tfbayes.alignment import *
+from tfbayes.interface import *
+from tfbayes.phylotree import *
+
+tree      = pt_root_t  ("alignment-test.nh")
+alignment = alignment_t("alignment-test.fa", tree)
+counts    = matrix([ [ 1.0, 1.0, 1.0, 1.0, 1.0 ] for i in range(10) ])
+jobs      = 1024
+
+interpreter_lock = threading.Lock()
+
+def work(queue, hold):
+    while True:
+        queue.get()
+        if hold:
+            interpreter_lock.acquire()
+        try:
+            approximate(tree, alignment)
+            scan(tree, alignment, counts)
+        finally:
+            if hold:
+                interpreter_lock.release()
+        queue.task_done()
+
+def run(n, hold):
+    queue = Queue.Queue()
+    for i in range(n):
+        t = threading.Thread(target = work, args = (queue, hold))
+        t.setDaemon(True)
+        t.start()
+    start = time.time()
+    for i in range(jobs):
+        queue.put(i)
+    queue.join()
+    return time.time() - start
+
+reference = run(1, False)
+
+print "                 lock held           lock released"
+print "threads   time (s)   speedup   time (s)   speedup"
+for n in [1, 2, 4, 8]:
+    t_hold    = run(n, True)
+    t_release = run(n, False)
+    print "%7d %10.3f %9.2f %10.3f %9.2f" % (n, t_hold, reference/t_hold, t_release, reference/t_release)
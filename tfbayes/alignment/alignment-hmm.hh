@@ -22,21 +22,42 @@
 #include <tfbayes/config.h>
 #endif /* HAVE_CONFIG_H */
 
+#include <algorithm>
 #include <cmath>
+#include <vector>
+
+#include <boost/unordered_map.hpp>
 
 #include <tfbayes/alignment/alignment.hh>
 #include <tfbayes/phylotree/phylotree.hh>
 #include <tfbayes/phylotree/parser.hh>
 #include <tfbayes/phylotree/polynomial.hh>
 #include <tfbayes/phylotree/marginal-likelihood.hh>
+#include <tfbayes/phylotree/column-cache.hh>
 #include <tfbayes/uipac/alphabet.hh>
 #include <tfbayes/utility/linalg.hh>
+#include <tfbayes/utility/thread-pool.hh>
+
+// Hidden Markov model on the columns of an alignment, where every
+// state emits columns according to the phylogenetic tree with its own
+// Dirichlet pseudocounts. The initial state x_0 has distribution px_0
+// and the state of the first column is obtained by one transition.
+//
+// The emission probabilities are computed once for every distinct
+// column of an alignment and state (and shared between alignments
+// through a column cache). They are scaled by their maximum over all
+// states, and the forward and backward variables are normalized at
+// every column, so that the recursions work with probabilities in
+// linear space without underflow. The log likelihood of the alignment
+// is recovered from the scaling factors.
+////////////////////////////////////////////////////////////////////////////////
 
 template <size_t AS, typename AC = alphabet_code_t, typename PC = double>
 class phylotree_hmm_t : public std::matrix<double>
 {
 public:
         typedef std::vector<exponent_t<AS, PC> > priors_t;
+        typedef pt_column_cache_t<AS, AC, PC> cache_t;
 
         using std::matrix<double>::operator=;
 
@@ -47,95 +68,164 @@ public:
                 : std::matrix<double>(),
                   px_0(px_0),
                   transition(transition),
-                  priors(priors) {
+                  priors(priors),
+                  m_log_likelihood(0.0) {
 
                 dim = px_0.size();
         }
 
+        // compute the posterior marginals of all columns, which are
+        // stored in this matrix
         void run(const pt_root_t& tree, const alignment_t<AC>& alignment) {
-                // initialize data structures
-                likelihood = std::matrix<double>();
-                prediction = std::matrix<double>();
-                forward    = std::matrix<double>();
-                // run forward and backward algorithm
-                run_forward (tree, alignment);
-                run_backward();
-                // compute posterior marginals
-                size_t length = likelihood.size();
-                operator=(std::matrix<double>(length-1, dim));
-                for (size_t k = 1; k < likelihood.size(); k++) {
-                        for (size_t i = 0; i < dim; i++) {
-                                operator[](k-1)[i] = forward[k][i]*backward[k][i];
-                        }
-                        normalize(operator[](k-1));
-                }
+                cache_t cache(tree);
+                run(tree, alignment, cache);
+        }
+        // use a cache of column likelihoods that was created for
+        // this tree
+        void run(const pt_root_t& tree, const alignment_t<AC>& alignment, cache_t& cache) {
+                m_log_likelihood = posterior(tree, alignment, cache, *this);
+        }
+        // log likelihood of the alignment given to the last call of
+        // run()
+        double log_likelihood() const {
+                return m_log_likelihood;
         }
 
-protected:
-        void run_forward(const pt_root_t& tree, const alignment_t<AC>& alignment) {
-
-                likelihood.push_back(std::vector<double>(dim, 1.0));
-                prediction.push_back(std::vector<double>(dim, 0.0));
-                // initialize prediction
-                for (size_t i = 0; i < dim; i++) {
-                        for (size_t j = 0; j < dim; j++) {
-                                prediction.back()[i] += transition[j][i]*px_0[j];
+        // posterior marginals of all columns of an alignment, returns
+        // the log likelihood of the alignment
+        double posterior(
+                const pt_root_t& tree,
+                const alignment_t<AC>& alignment,
+                cache_t& cache,
+                std::matrix<double>& result) const {
+
+                const size_t n = alignment.length();
+                // distinct column of each position
+                std::vector<size_t> index(n);
+                // scaled emission probabilities of all distinct
+                // columns and the logarithm of their scale
+                std::vector<double> emission;
+                std::vector<double> scale;
+                emissions(tree, alignment, cache, index, emission, scale);
+
+                result = std::matrix<double>(n, dim);
+                double ll = 0.0;
+                // forward recursion, the filtered distributions
+                // p(x_k | z_1:k) are stored in the result
+                std::vector<double> tmp(dim);
+                const std::vector<double>* previous = &px_0;
+                for (size_t k = 0; k < n; k++) {
+                        const double* e = &emission[index[k]*dim];
+                        std::vector<double>& forward = result[k];
+                        for (size_t i = 0; i < dim; i++) {
+                                double prediction = 0.0;
+                                for (size_t j = 0; j < dim; j++) {
+                                        prediction += (*previous)[j]*transition[j][i];
+                                }
+                                forward[i] = prediction*e[i];
                         }
+                        ll += std::log(normalize(forward)) + scale[index[k]];
+                        previous = &forward;
                 }
-                forward.push_back(px_0);
-
-                for (typename alignment_t<AC>::const_iterator it = alignment.begin(); it != alignment.end(); it++) {
-                        std::vector<double> likelihood_k(dim, 0.0); // p(z_k | x_k)
-                        std::vector<double> prediction_k(dim, 0.0); // p(x_k | z_1:k-1)
-                        std::vector<double> forward_k(dim, 0.0);
-
-                        // compute likelihood
-                        for (size_t j = 0; j < dim; j++) {
-                                likelihood_k[j] = exp(pt_marginal_likelihood(tree, *it, priors[j]));
+                // backward recursion, where backward[i] is
+                // proportional to p(z_k+1:n | x_k = i)
+                std::vector<double> backward(dim, 1.0);
+                for (size_t k = n; k > 0; k--) {
+                        std::vector<double>& marginal = result[k-1];
+                        for (size_t i = 0; i < dim; i++) {
+                                marginal[i] *= backward[i];
                         }
-
-                        // compute prediction
+                        normalize(marginal);
+                        if (k == 1) {
+                                break;
+                        }
+                        const double* e = &emission[index[k-1]*dim];
                         for (size_t i = 0; i < dim; i++) {
+                                tmp[i] = 0.0;
                                 for (size_t j = 0; j < dim; j++) {
-                                        prediction_k[i] +=
-                                                transition[j][i]*likelihood.back()[j]*prediction.back()[j];
+                                        tmp[i] += transition[i][j]*e[j]*backward[j];
                                 }
                         }
-                        normalize(prediction_k);
-
-                        // save result
-                        likelihood.push_back(likelihood_k);
-                        prediction.push_back(prediction_k);
+                        backward.swap(tmp);
+                        normalize(backward);
+                }
+                return ll;
+        }
+        // posterior marginals of the alignments [first, last) of a
+        // set, which are processed in parallel, returns the log
+        // likelihoods of the alignments
+        std::vector<double> posterior(
+                const pt_root_t& tree,
+                const alignment_set_t<AC>& alignment_set,
+                size_t first, size_t last,
+                cache_t& cache,
+                thread_pool_t& thread_pool,
+                std::vector<std::matrix<double> >& result) const {
+
+                std::vector<double> ll(last - first, 0.0);
+                result.resize(last - first);
+                thread_pool.parallel_for(first, last, 1,
+                        posterior_t(*this, tree, alignment_set, first, cache, result, ll));
+                return ll;
+        }
 
-                        // compute p(x_k | z_1:k)
+protected:
+        class posterior_t {
+        public:
+                posterior_t(const phylotree_hmm_t& hmm,
+                            const pt_root_t& tree,
+                            const alignment_set_t<AC>& alignment_set,
+                            size_t first,
+                            cache_t& cache,
+                            std::vector<std::matrix<double> >& result,
+                            std::vector<double>& ll)
+                        : hmm(hmm), tree(tree), alignment_set(alignment_set), first(first),
+                          cache(cache), result(result), ll(ll)
+                        { }
+                void operator()(size_t i) const {
+                        ll[i-first] = hmm.posterior(tree, alignment_set[i], cache, result[i-first]);
+                }
+        protected:
+                const phylotree_hmm_t& hmm;
+                const pt_root_t& tree;
+                const alignment_set_t<AC>& alignment_set;
+                size_t first;
+                cache_t& cache;
+                std::vector<std::matrix<double> >& result;
+                std::vector<double>& ll;
+        };
+
+        void emissions(
+                const pt_root_t& tree,
+                const alignment_t<AC>& alignment,
+                cache_t& cache,
+                std::vector<size_t>& index,
+                std::vector<double>& emission,
+                std::vector<double>& scale) const {
+
+                typedef boost::unordered_map<std::vector<AC>, size_t> column_map_t;
+                column_map_t columns;
+                std::vector<double> tmp(dim);
+
+                for (size_t k = 0; k < alignment.length(); k++) {
+                        std::pair<typename column_map_t::iterator, bool> result =
+                                columns.insert(std::make_pair(alignment[k], columns.size()));
+                        index[k] = result.first->second;
+                        if (!result.second) {
+                                continue;
+                        }
                         for (size_t j = 0; j < dim; j++) {
-                                forward_k[j] = likelihood_k[j] * prediction_k[j];
+                                tmp[j] = cache.marginal_likelihood(tree, alignment[k], priors[j]);
                         }
-                        normalize(forward_k);
-
-                        forward.push_back(forward_k);
-                }
-        }
-        void run_backward() {
-                size_t length = likelihood.size();
-                backward = std::matrix<double>(length, dim);
-                backward[length-1] = likelihood[length-1];
-                normalize(backward[length-1]);
-                // loop backwards (we don't need the alignment here)
-                for (size_t k = 1; k < length; k++) {
-                        std::vector<double>& backward_k   = backward  [length-k-1];
-                        std::vector<double>& likelihood_k = likelihood[length-k-1];
-                        // loop over states
-                        for (size_t i = 0; i < dim; i++) {
-                                for (size_t j = 0; j < dim; j++) {
-                                        backward_k[i] += likelihood_k[i]*transition[i][j]*backward[length-k][j];
-                                }
+                        const double m = *std::max_element(tmp.begin(), tmp.end());
+                        for (size_t j = 0; j < dim; j++) {
+                                emission.push_back(std::exp(tmp[j] - m));
                         }
-                        // normalize to keep numerical precision
-                        normalize(backward_k);
+                        scale.push_back(m);
                 }
         }
-        void normalize(std::vector<double>& vector) const {
+        // normalize a vector and return the normalization constant
+        static double normalize(std::vector<double>& vector) {
                 double normalization = 0.0;
 
                 for (size_t i = 0; i < vector.size(); i++) {
@@ -144,6 +234,7 @@ protected:
                 for (size_t i = 0; i < vector.size(); i++) {
                         vector[i] /= normalization;
                 }
+                return normalization;
         }
 
         size_t dim;
@@ -152,10 +243,7 @@ protected:
         std::matrix<double> transition;
         priors_t priors;
 
-        std::matrix<double> likelihood;
-        std::matrix<double> prediction;
-        std::matrix<double> forward;
-        std::matrix<double> backward;
+        double m_log_likelihood;
 };
 
 #endif /* __TFBAYES_ALIGNMENT_PHYLOTREE_HMM_HH__ */
@@ -317,105 +317,91 @@ protected:
 };
 
 
+// read the alignments of a fasta file one after another, so that
+// large files do not have to be kept in memory; alignments are
+// separated by a line of `>' characters or by a taxon that occurs a
+// second time
 template <typename AC = alphabet_code_t>
-class alignment_set_t : public std::vector<alignment_t<AC> > {
+class alignment_reader_t {
 public:
-        using std::vector<alignment_t<AC> >::push_back;
-
         // Typedefs
         ////////////////////////////////////////////////////////////////////////
-        typedef std::vector<alignment_t<AC> > base_t;
         typedef boost::unordered_map<std::string, pt_node_t::id_t> taxon_map_t;
 
         // Constructors
         ////////////////////////////////////////////////////////////////////////
-        alignment_set_t()
-                : base_t()
-                { };
-        alignment_set_t(const std::string& filename,
-                        boost::optional<const pt_root_t&> tree = boost::optional<const pt_root_t&>(),
-                        alphabet_t alphabet = nucleotide_alphabet_t(),
-                        bool verbose = false)
-                : base_t() {
-                /* first check what species are available */
-                taxon_map_t taxon_map = tree ?
-                        create_taxon_map(*tree   ):
-                        create_taxon_map(filename);
-
-                /* number of species */
-                size_t n = taxon_map.size();
-
-                /* exit if this file is empty */
-                if (n == 0) return;
-
-                /* this automatically parses the fasta file format */
-                FastaParser parser(filename);
-
-                /* storage for a single line */
-                std::string line;
+        alignment_reader_t(const std::string& filename,
+                           boost::optional<const pt_root_t&> tree = boost::optional<const pt_root_t&>(),
+                           alphabet_t alphabet = nucleotide_alphabet_t(),
+                           bool verbose = false)
+                : _taxon_map (tree ?
+                              create_taxon_map(*tree   ):
+                              create_taxon_map(filename)),
+                  _parser    (filename),
+                  _alphabet  (alphabet),
+                  _verbose   (verbose),
+                  _n         (0),
+                  // an empty file contains no alignments
+                  _done      (_taxon_map.size() == 0),
+                  _pending   (false)
+                { }
 
+        // Operators
+        ////////////////////////////////////////////////////////////////////////
+        /* return true if not all alignments were read */
+        operator bool() const {
+                return !_done;
+        }
+        /* read the next alignment */
+        alignment_t<AC> operator()() {
+                /* current alignment */
+                std::matrix<AC> sequences(_taxon_map.size(), 0);
                 /* remember which species already occured */
                 std::set<std::string> occurred;
 
-                /* current alignment */
-                std::matrix<AC> sequences(n, 0);
-
+                /* the first sequence of this alignment was already
+                 * read with the previous alignment */
+                if (_pending) {
+                        insert(sequences, occurred, _pending_taxon, _pending_line);
+                        _pending = false;
+                }
                 /* the fasta parser returns a single line for each
                  * sequence */
-                for (size_t i = 1; parser;) {
-                        line = parser();
-                        if (parser.description().size() == 0) {
+                while (_parser) {
+                        const std::string line = _parser();
+                        if (_parser.description().size() == 0) {
                                 std::cerr << "Warning: sequence without description found... skipping."
                                           << std::endl;
                                 continue;
                         }
-                        if (occurred.find(parser.taxon()) != occurred.end() ||
-                            parser.description()[0] == ">>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>") {
-                                // push alignment
-                                push_back(alignment_t<AC>(sequences, taxon_map, alphabet, verbose));
-                                if (verbose) {
-                                        std::cerr << boost::format("Finished parsing alignment %d...") % i++
-                                                  << std::endl;
+                        const bool separator = _parser.description()[0] ==
+                                ">>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>";
+                        if (occurred.find(_parser.taxon()) != occurred.end() || separator) {
+                                // keep the sequence for the next
+                                // alignment
+                                if (!separator) {
+                                        _pending       = true;
+                                        _pending_taxon = _parser.taxon();
+                                        _pending_line  = line;
                                 }
-                                // reset occurrences
-                                occurred.clear();
-                                // start new alignment
-                                sequences = std::matrix<AC>(n, 0);
-                                continue;
-                        }
-                        if (line == "") {
-                                std::cerr << "Warning: empty sequence found... skipping."
-                                          << std::endl;
-                                continue;
-                        }
-                        taxon_map_t::const_iterator it = taxon_map.find(parser.taxon());
-                        if (it != taxon_map.end()) {
-                                occurred.insert(parser.taxon());
-                                sequences[it->second] = sequence_t<AC>(line, alphabet);
-                        }
-                        else {
-                                std::cerr << boost::format("Warning: taxon `%s' not found in the phylogenetic tree.") % parser.taxon()
-                                          << std::endl;
+                                return finish(sequences);
                         }
+                        insert(sequences, occurred, _parser.taxon(), line);
                 }
-                push_back(alignment_t<AC>(sequences, taxon_map, alphabet, verbose));
-                if (verbose) {
-                        std::cerr << boost::format("Finished parsing alignment %d...") % (base_t::size())
-                                  << std::endl;
-                }
+                _done = !_pending;
+                return finish(sequences);
         }
-        // use the access operator from base class to read/write columns
-        using base_t::operator[];
-        alignment_t<AC> operator[](const range_t& range) const {
-                index_t index(range.index()[1]);
-                range_t tmp(index, range.length());
-                return base_t::operator[](range.index()[0])[tmp];
+
+        // Access Methods
+        ////////////////////////////////////////////////////////////////////////
+        const taxon_map_t& taxon_map() const {
+                return _taxon_map;
         }
 
 protected:
         // Methods for Initializations
         ////////////////////////////////////////////////////////////////////////
-        taxon_map_t create_taxon_map(const pt_root_t& tree) {
+        static taxon_map_t create_taxon_map(const pt_root_t& tree) {
                 taxon_map_t taxon_map;
 
                 for (pt_node_t::leaves_t::const_iterator it = tree.begin_leaves();
@@ -424,7 +410,7 @@ protected:
                 }
                 return taxon_map;
         }
-        taxon_map_t create_taxon_map(const std::string& filename) {
+        static taxon_map_t create_taxon_map(const std::string& filename) {
                 /* this automatically parses the fasta file format */
                 FastaParser parser(filename);
                 std::set<std::string> species;
@@ -443,6 +429,80 @@ protected:
                 }
                 return taxon_map;
         }
+        void insert(std::matrix<AC>& sequences, std::set<std::string>& occurred,
+                    const std::string& taxon, const std::string& line) const {
+                if (line == "") {
+                        std::cerr << "Warning: empty sequence found... skipping."
+                                  << std::endl;
+                        return;
+                }
+                taxon_map_t::const_iterator it = _taxon_map.find(taxon);
+                if (it != _taxon_map.end()) {
+                        occurred.insert(taxon);
+                        sequences[it->second] = sequence_t<AC>(line, _alphabet);
+                }
+                else {
+                        std::cerr << boost::format("Warning: taxon `%s' not found in the phylogenetic tree.") % taxon
+                                  << std::endl;
+                }
+        }
+        alignment_t<AC> finish(const std::matrix<AC>& sequences) {
+                _n++;
+                if (_verbose) {
+                        std::cerr << boost::format("Finished parsing alignment %d...") % _n
+                                  << std::endl;
+                }
+                return alignment_t<AC>(sequences, _taxon_map, _alphabet, _verbose);
+        }
+
+        // Fields
+        ////////////////////////////////////////////////////////////////////////
+        taxon_map_t _taxon_map;
+        FastaParser _parser;
+        alphabet_t _alphabet;
+        bool _verbose;
+        // number of alignments read so far
+        size_t _n;
+        bool _done;
+        // first sequence of the next alignment
+        bool _pending;
+        std::string _pending_taxon;
+        std::string _pending_line;
+};
+
+template <typename AC = alphabet_code_t>
+class alignment_set_t : public std::vector<alignment_t<AC> > {
+public:
+        using std::vector<alignment_t<AC> >::push_back;
+
+        // Typedefs
+        ////////////////////////////////////////////////////////////////////////
+        typedef std::vector<alignment_t<AC> > base_t;
+        typedef boost::unordered_map<std::string, pt_node_t::id_t> taxon_map_t;
+
+        // Constructors
+        ////////////////////////////////////////////////////////////////////////
+        alignment_set_t()
+                : base_t()
+                { };
+        alignment_set_t(const std::string& filename,
+                        boost::optional<const pt_root_t&> tree = boost::optional<const pt_root_t&>(),
+                        alphabet_t alphabet = nucleotide_alphabet_t(),
+                        bool verbose = false)
+                : base_t() {
+                alignment_reader_t<AC> reader(filename, tree, alphabet, verbose);
+
+                while (reader) {
+                        push_back(reader());
+                }
+        }
+        // use the access operator from base class to read/write columns
+        using base_t::operator[];
+        alignment_t<AC> operator[](const range_t& range) const {
+                index_t index(range.index()[1]);
+                range_t tmp(index, range.length());
+                return base_t::operator[](range.index()[0])[tmp];
+        }
 };
 
 // data structure optimized for computing likelihoods
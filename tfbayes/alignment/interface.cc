@@ -30,9 +30,11 @@
 #include <tfbayes/alignment/alignment.hh>
 #include <tfbayes/phylotree/phylotree.hh>
 #include <tfbayes/phylotree/approximation.hh>
+#include <tfbayes/phylotree/column-cache.hh>
 #include <tfbayes/phylotree/marginal-likelihood.hh>
 #include <tfbayes/phylotree/utility.hh>
 #include <tfbayes/interface/exceptions.hh>
+#include <tfbayes/interface/gil.hh>
 #include <tfbayes/interface/utility.hh>
 
 using namespace boost::python;
@@ -77,8 +79,15 @@ alignment_t<>* alignment_from_alignio(object a, const pt_root_t& tree)
         return new alignment_t<>(tmp, tree);
 }
 
+alignment_t<>* alignment_constructor(std::string filename, const pt_root_t& tree)
+{
+        release_gil_t gil;
+        return new alignment_t<>(filename, tree);
+}
+
 alignment_set_t<>* alignment_set_constructor(std::string filename)
 {
+        release_gil_t gil;
         return new alignment_set_t<>(filename);
 }
 
@@ -153,45 +162,37 @@ std::string pretty_print_alignment(alignment_t<>& a)
 // alignment functions
 // -----------------------------------------------------------------------------
 
+// all functions on alignments look up the likelihoods of columns in a
+// cache, which is either given by the caller or used only for a single
+// alignment; the bindings release the interpreter lock, so that
+// several Python threads may call them at the same time, also with a
+// shared cache
+
 template<size_t AS, typename AC, typename PC>
 std::matrix<double> approximate(
         const pt_root_t& tree,
-        const alignment_t<AC>& alignment)
+        const alignment_t<AC>& alignment,
+        pt_column_cache_t<AS, AC, PC>& cache)
 {
         std::matrix<double> result(alignment.length(), AS);
 
         for (size_t i = 0; i < alignment.length(); i++) {
-                // compute the polynomial
-                polynomial_t<AS, PC> poly = pt_likelihood<AS, AC, PC>(tree, alignment[i]);
-                polynomial_t<AS, PC> variational
-                        = dkl_approximate<AS, PC>(poly);
+                const exponent_t<AS, PC> counts = cache.approximation(
+                        tree, alignment[i], dkl_approximate_t<AS, PC>());
 
                 for (size_t j = 0; j < AS; j++) {
-                        result[i][j] = variational.begin()->exponent()[j];
+                        result[i][j] = counts[j];
                 }
         }
         return result;
 }
 
-template<typename AC, typename PC>
-std::matrix<double> approximate(
-        const pt_root_t& tree,
-        const alignment_t<AC>& alignment)
-{
-        switch (alignment.alphabet().size()) {
-        case 5: return approximate<5, AC, PC>(tree, alignment); break;
-        default: 
-                std::cerr << "scan(): Invalid alphabet size."
-                          << std::endl;
-                exit(EXIT_FAILURE);
-        }
-}
-
 template<size_t AS, typename AC, typename PC>
 std::vector<double> scan(
         const pt_root_t& tree,
         const alignment_t<AC>& alignment,
-        std::matrix<PC>& counts)
+        std::matrix<PC>& counts,
+        pt_column_cache_t<AS, AC, PC>& cache)
 {
         std::vector<double> result(alignment.length(), 0);
         std::vector<exponent_t<AS, PC> > exponents;
@@ -211,33 +212,19 @@ std::vector<double> scan(
                         continue;
                 }
                 for (typename alignment_t<AC>::const_iterator is(it); is < it + counts.size(); is++) {
-                        result[it - alignment.begin()] += pt_marginal_likelihood<AS, AC, PC>(
+                        result[it - alignment.begin()] += cache.marginal_likelihood(
                                 tree, *is, exponents[is-it]);
                 }
         }
         return result;
 }
 
-template<typename AC, typename PC>
-std::vector<double> scan(
-        const pt_root_t& tree,
-        const alignment_t<AC>& alignment,
-        std::matrix<PC>& counts)
-{
-        switch (alignment.alphabet().size()) {
-        case 5: return scan<5, AC, PC>(tree, alignment, counts); break;
-        default: 
-                std::cerr << "scan(): Invalid alphabet size."
-                          << std::endl;
-                exit(EXIT_FAILURE);
-        }
-}
-
 template<size_t AS, typename AC, typename PC>
 std::vector<double> marginal_likelihood(
         const pt_root_t& tree,
         const alignment_t<AC>& alignment,
-        const std::matrix<PC>& prior)
+        const std::matrix<PC>& prior,
+        pt_column_cache_t<AS, AC, PC>& cache)
 {
         std::vector<double> result;
 
@@ -249,32 +236,17 @@ std::vector<double> marginal_likelihood(
                 exponent_t<AS, PC> alpha(prior[i%prior.size()].begin(),
                                          prior[i%prior.size()].end  ());
 
-                result.push_back(pt_marginal_likelihood<AS, AC, PC>
-                                 (tree, *it, alpha));
+                result.push_back(cache.marginal_likelihood(tree, *it, alpha));
         }
         return result;
 }
 
-template<typename AC, typename PC>
-std::vector<double> marginal_likelihood(
-        const pt_root_t& tree,
-        const alignment_t<AC>& alignment,
-        const std::matrix<PC>& prior)
-{
-        switch (alignment.alphabet().size()) {
-        case 5: return marginal_likelihood<5, AC, PC>(tree, alignment, prior); break;
-        default:
-                std::cerr << "scan(): Invalid alphabet size."
-                          << std::endl;
-                exit(EXIT_FAILURE);
-        }
-}
-
 template<size_t AS, typename AC, typename PC>
 std::matrix<double> expectation(
         const pt_root_t& tree,
         const alignment_t<AC>& alignment,
-        const std::matrix<PC>& prior)
+        const std::matrix<PC>& prior,
+        pt_column_cache_t<AS, AC, PC>& cache)
 {
         std::matrix<double> result;
         polynomial_term_t<AS> term(1.0);
@@ -286,8 +258,8 @@ std::matrix<double> expectation(
                 exponent_t<AS, PC> alpha(prior[i%prior.size()].begin(),
                                          prior[i%prior.size()].end  ());
 
-                double ml = pt_marginal_likelihood<AS, AC, PC>(tree, *it, alpha);
-                pt_polynomial_t<AS, PC> poly = pt_likelihood<AS, AC, PC>(tree, *it);
+                double ml = cache.marginal_likelihood(tree, *it, alpha);
+                pt_polynomial_t<AS, PC> poly = cache.likelihood(tree, *it);
 
                 for (size_t i = 0; i < AS; i++) {
                         term.exponent()[i] = 1;
@@ -300,14 +272,156 @@ std::matrix<double> expectation(
         return result;
 }
 
+// functions with a column cache
+// -----------------------------------------------------------------------------
+
+typedef pt_column_cache_t<5, alphabet_code_t, double> column_cache_t;
+
+column_cache_t* column_cache_constructor(
+        const pt_root_t& tree, size_t max_bytes)
+{
+        return new column_cache_t(tree, max_bytes);
+}
+
+void column_cache_save(const column_cache_t& cache, const std::string& filename)
+{
+        release_gil_t gil;
+        cache.save(filename);
+}
+
+bool column_cache_load(column_cache_t& cache, const std::string& filename)
+{
+        release_gil_t gil;
+        return cache.load(filename);
+}
+
+void column_cache_check(
+        const pt_root_t& tree,
+        const alignment_t<>& alignment,
+        const column_cache_t& cache)
+{
+        if (alignment.alphabet().size() != 5) {
+                raise_ValueError("Invalid alphabet size.");
+        }
+        if (!cache.valid(tree)) {
+                raise_ValueError("The column cache belongs to a different tree.");
+        }
+}
+
+std::matrix<double> approximate_cached(
+        const pt_root_t& tree,
+        const alignment_t<>& alignment,
+        column_cache_t& cache)
+{
+        column_cache_check(tree, alignment, cache);
+        release_gil_t gil;
+        return approximate(tree, alignment, cache);
+}
+
+std::vector<double> scan_cached(
+        const pt_root_t& tree,
+        const alignment_t<>& alignment,
+        std::matrix<double>& counts,
+        column_cache_t& cache)
+{
+        column_cache_check(tree, alignment, cache);
+        release_gil_t gil;
+        return scan(tree, alignment, counts, cache);
+}
+
+std::vector<double> marginal_likelihood_cached(
+        const pt_root_t& tree,
+        const alignment_t<>& alignment,
+        const std::matrix<double>& prior,
+        column_cache_t& cache)
+{
+        column_cache_check(tree, alignment, cache);
+        release_gil_t gil;
+        return marginal_likelihood(tree, alignment, prior, cache);
+}
+
+std::matrix<double> expectation_cached(
+        const pt_root_t& tree,
+        const alignment_t<>& alignment,
+        const std::matrix<double>& prior,
+        column_cache_t& cache)
+{
+        column_cache_check(tree, alignment, cache);
+        release_gil_t gil;
+        return expectation(tree, alignment, prior, cache);
+}
+
+// functions without a column cache
+// -----------------------------------------------------------------------------
+
+template<typename AC, typename PC>
+std::matrix<double> approximate(
+        const pt_root_t& tree,
+        const alignment_t<AC>& alignment)
+{
+        release_gil_t gil;
+        switch (alignment.alphabet().size()) {
+        case 5: {
+                pt_column_cache_t<5, AC, PC> cache(tree);
+                return approximate<5, AC, PC>(tree, alignment, cache);
+        }
+        default: 
+                std::cerr << "scan(): Invalid alphabet size."
+                          << std::endl;
+                exit(EXIT_FAILURE);
+        }
+}
+
+template<typename AC, typename PC>
+std::vector<double> scan(
+        const pt_root_t& tree,
+        const alignment_t<AC>& alignment,
+        std::matrix<PC>& counts)
+{
+        release_gil_t gil;
+        switch (alignment.alphabet().size()) {
+        case 5: {
+                pt_column_cache_t<5, AC, PC> cache(tree);
+                return scan<5, AC, PC>(tree, alignment, counts, cache);
+        }
+        default: 
+                std::cerr << "scan(): Invalid alphabet size."
+                          << std::endl;
+                exit(EXIT_FAILURE);
+        }
+}
+
+template<typename AC, typename PC>
+std::vector<double> marginal_likelihood(
+        const pt_root_t& tree,
+        const alignment_t<AC>& alignment,
+        const std::matrix<PC>& prior)
+{
+        release_gil_t gil;
+        switch (alignment.alphabet().size()) {
+        case 5: {
+                pt_column_cache_t<5, AC, PC> cache(tree);
+                return marginal_likelihood<5, AC, PC>(tree, alignment, prior, cache);
+        }
+        default:
+                std::cerr << "scan(): Invalid alphabet size."
+                          << std::endl;
+                exit(EXIT_FAILURE);
+        }
+}
+
 template<typename AC, typename PC>
 std::matrix<double> expectation(
         const pt_root_t& tree,
         const alignment_t<AC>& alignment,
         const std::matrix<PC>& prior)
 {
+        release_gil_t gil;
         switch (alignment.alphabet().size()) {
-        case 5: return expectation<5, AC, PC>(tree, alignment, prior); break;
+        case 5: {
+                pt_column_cache_t<5, AC, PC> cache(tree);
+                return expectation<5, AC, PC>(tree, alignment, prior, cache);
+        }
         default:
                 std::cerr << "scan(): Invalid alphabet size."
                           << std::endl;
@@ -351,7 +465,7 @@ BOOST_PYTHON_MODULE(interface)
                  * alignment_from_alignio() is very general */
                 .def("__init__",             make_constructor(alignment_from_alignio))
                 /* this constructor needs to come last */
-                .def(init<std::string, pt_root_t>())
+                .def("__init__",             make_constructor(alignment_constructor))
                 .def("__iter__",             boost::python::iterator<alignment_t<> >())
                 .def("__getitem__",          alignment_getsequence)
                 .def("__getitem__",          alignment_getitem)
@@ -368,12 +482,30 @@ BOOST_PYTHON_MODULE(interface)
                 .def("__getitem__",          alignment_set_getslice)
                 .def("__len__",              &alignment_set_t<>::size)
                 ;
+        class_<column_cache_t>("column_cache_t", no_init)
+                .def("__init__",             make_constructor(column_cache_constructor))
+                .def(init<pt_root_t>())
+                .def("__len__",              &column_cache_t::size)
+                .def("valid",                &column_cache_t::valid)
+                .def("clear",                &column_cache_t::clear)
+                .def("save",                 column_cache_save)
+                .def("load",                 column_cache_load)
+                .add_property("bytes",       &column_cache_t::bytes)
+                .add_property("max_bytes",   &column_cache_t::max_bytes)
+                .add_property("hits",        &column_cache_t::hits)
+                .add_property("misses",      &column_cache_t::misses)
+                .add_property("hit_rate",    &column_cache_t::hit_rate)
+                ;
                 
         // functions on alignments
         def("approximate",            &approximate        <alphabet_code_t, double>);
         def("marginal_likelihood",    &marginal_likelihood<alphabet_code_t, double>);
         def("scan",                   &scan               <alphabet_code_t, double>);
         def("expectation",            &expectation        <alphabet_code_t, double>);
+        def("approximate",            &approximate_cached                          );
+        def("marginal_likelihood",    &marginal_likelihood_cached                  );
+        def("scan",                   &scan_cached                                 );
+        def("expectation",            &expectation_cached                          );
         def("tree_prior",             &tree_prior                                  );
         def("pretty_print_alignment", &pretty_print_alignment                      );
 }
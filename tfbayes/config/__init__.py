@@ -25,5 +25,19 @@ from tools import *
 from results   import default_results_config
 from results   import parse_results_config
 from results   import save_results_config
+from results   import is_history_file
+from results   import parse_history_file
+from results   import read_history_records
+from results   import read_history_partitions
+from results   import read_last_history_partitions
+from results   import read_partition_file
+from results   import read_last_partitions
 from sampler   import parse_sampler_config
 from sampler   import default_sampler_config
+
+# binary partition files
+# ------------------------------------------------------------------------------
+
+from interface import is_partition_file
+from interface import partition_file_t
+from interface import save_partition_list
@@ -25,9 +25,27 @@
 #include <boost/python/def.hpp>
 
 #include <tfbayes/config/partition-lexer.hh>
+#include <tfbayes/dpm/dpm-partition-file.hh>
 
 using namespace boost::python;
 
+// partition files
+// -----------------------------------------------------------------------------
+
+static
+dpm_partition_t partition_file_getitem(const partition_file_t& file, ssize_t k)
+{
+        // allow negative indices as in python lists
+        if (k < 0) {
+                k += file.size();
+        }
+        if (k < 0 || static_cast<size_t>(k) >= file.size()) {
+                PyErr_SetString(PyExc_IndexError, "Index out of range.");
+                throw_error_already_set();
+        }
+        return file[k];
+}
+
 // interface
 // -----------------------------------------------------------------------------
 
@@ -35,4 +53,12 @@ BOOST_PYTHON_MODULE(interface)
 {
         def("parse_partition_list", parse_partition_list_str);
         def("parse_partition",      parse_partition_str);
+        def("save_partition_list",  save_partition_list);
+        def("is_partition_file",    is_partition_file);
+
+        class_<partition_file_t, boost::noncopyable>("partition_file_t", init<std::string>())
+                .def("__len__",         &partition_file_t::size)
+                .def("__getitem__",     &partition_file_getitem)
+                .def("partition_list",  &partition_file_t::partition_list)
+                ;
 }
@@ -17,11 +17,14 @@
 # Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 
 import ConfigParser
+import os
+import struct
 
 from tools import *
 
 from interface   import parse_partition
 from interface   import parse_partition_list
+from interface   import partition_file_t
 from ..interface import *
 from ..dpm       import *
 
@@ -33,7 +36,9 @@ def default_results_config():
         'sampling_history' : sampling_history_t(),
         'map_partition'    : dpm_partition_t(),
         'mean_partition'   : dpm_partition_t(),
-        'median_partition' : dpm_partition_t()
+        'median_partition' : dpm_partition_t(),
+        'partition_file'   : '',
+        'history_file'     : ''
         }
     return results_config
 
@@ -59,6 +64,15 @@ def parse_results_config(config_file, results_config, parse_partitions=True):
         results_config['sampling_history'].switches = read_matrix(config_parser, 'Result', 'switches', float)
     if config_parser.has_option('Result', 'partitions') and parse_partitions:
         results_config['sampling_history'].partitions = parse_partition_list(config_parser.get('Result', 'partitions'))
+    if config_parser.has_option('Result', 'partition-file'):
+        results_config['partition_file'] = config_parser.get('Result', 'partition-file').strip()
+        if parse_partitions:
+            results_config['sampling_history'].partitions = read_partition_file(results_config['partition_file'])
+    if config_parser.has_option('Result', 'history-file'):
+        # the history file contains all samples, whereas only the
+        # last partition of each chain is stored in memory
+        results_config['history_file'] = config_parser.get('Result', 'history-file').strip()
+        parse_history_file(results_config['history_file'], results_config, parse_partitions)
     if config_parser.has_option('Result', 'map_partition'):
         results_config['map_partition'] = parse_partition(config_parser.get('Result', 'map_partition'))
     if config_parser.has_option('Result', 'mean_partition'):
@@ -66,6 +80,201 @@ def parse_results_config(config_file, results_config, parse_partitions=True):
     if config_parser.has_option('Result', 'median_partition'):
         results_config['median_partition'] = parse_partition(config_parser.get('Result', 'median_partition'))
 
+# read binary partition file (see dpm-partition-file.hh)
+# ------------------------------------------------------------------------------
+
+def read_partition_file(filename, indices=None):
+    """Read all partitions from a binary partition file. If a list of
+       indices is given, only those partitions are decoded and all
+       others are left empty."""
+    partition_file = partition_file_t(filename)
+    if indices is None:
+        return partition_file.partition_list()
+    indices    = set(indices)
+    partitions = dpm_partition_list_t()
+    for k in range(len(partition_file)):
+        if k in indices:
+            partitions.append(partition_file[k])
+        else:
+            partitions.append(dpm_partition_t())
+    return partitions
+
+def read_last_partitions(filename, n):
+    """Read only the last n partitions from a binary partition file."""
+    partition_file = partition_file_t(filename)
+    if len(partition_file) < n:
+        raise IOError("Partition file `%s' contains less than %d partitions." % (filename, n))
+    partitions = dpm_partition_list_t()
+    for k in range(len(partition_file)-n, len(partition_file)):
+        partitions.append(partition_file[k])
+    return partitions
+
+# parse binary sampling history (see dpm-sampling-history-sink.hh)
+# ------------------------------------------------------------------------------
+
+history_magic   = 'TFBH'
+history_version = 1
+
+def is_history_file(filename):
+    with open(filename, 'rb') as fp:
+        header = fp.read(8)
+    if len(header) != 8:
+        return False
+    return header[0:4] == history_magic and struct.unpack('<I', header[4:8])[0] == history_version
+
+def read_history_data(filename):
+    """Generator over the raw data of all complete records of a
+       history file (without their sizes). Records are read one at a
+       time, so that the file never has to fit into memory."""
+    with open(filename, 'rb') as fp:
+        header = fp.read(8)
+        if len(header) != 8 or not header[0:4] == history_magic or not struct.unpack('<I', header[4:8])[0] == history_version:
+            raise IOError("Invalid sampling history file `%s'." % filename)
+        while True:
+            tmp = fp.read(4)
+            if len(tmp) != 4:
+                break
+            size = struct.unpack('<I', tmp)[0]
+            data = fp.read(size)
+            if len(data) != size:
+                # last record is incomplete
+                break
+            yield data
+
+def read_history_records(filename, parse_partitions=True):
+    """Generator over all complete records of a history file, each
+       record is returned as a dictionary. Partitions are only decoded
+       if parse_partitions is true."""
+    for data in read_history_data(filename):
+        yield parse_history_record(data, parse_partitions)
+
+def history_record_chain(data):
+    """Chain id of a record, without decoding the record."""
+    return struct.unpack_from('<I', data, 0)[0]
+
+def parse_history_record(data, parse_partition=True):
+    """Decode a single record of a history file (without its size)."""
+    pos    = 0
+    record = {}
+    record['chain'], record['switches'] = struct.unpack_from('<II', data, pos); pos += 8
+    record['likelihood'], record['posterior'], record['temperature'] = struct.unpack_from('<ddd', data, pos); pos += 24
+    record['components'], n = struct.unpack_from('<II', data, pos); pos += 8
+    record['cluster_sizes'] = list(struct.unpack_from('<%dI' % n, data, pos)); pos += 4*n
+    if not parse_partition:
+        return record
+    m = struct.unpack_from('<I', data, pos)[0]; pos += 4
+    record['partition'] = []
+    for i in range(m):
+        k = struct.unpack_from('<I', data, pos)[0]; pos += 4
+        name = data[pos:pos+k]; pos += k
+        length, k = struct.unpack_from('<II', data, pos); pos += 8
+        ranges = []
+        for j in range(k):
+            ranges.append(struct.unpack_from('<IIIB', data, pos)); pos += 13
+        record['partition'].append((name, length, ranges))
+    return record
+
+def history_partition(partition):
+    """Convert a partition of a history record to a dpm_partition_t."""
+    result = dpm_partition_t()
+    for name, length, ranges in partition:
+        model_id = model_id_t()
+        model_id.name   = name
+        model_id.length = length
+        subset = dpm_subset_t(model_id)
+        for sequence, position, length, reverse in ranges:
+            subset.insert(range_t(index_t(sequence, position), length, bool(reverse)))
+        result.append(subset)
+    return result
+
+def check_history_chain(filename, c, n):
+    if c >= n:
+        raise IOError("History file `%s' contains samples of chain %d, but only %d chains are expected." % (filename, c, n))
+
+def check_history_chains(filename, counts):
+    """Check that every chain has samples, where counts[c] is the
+       number of samples of chain c."""
+    for c in range(len(counts)):
+        if counts[c] == 0:
+            raise IOError("History file `%s' contains no samples of chain %d." % (filename, c))
+
+def read_history_partitions(filename, n, indices=None):
+    """Read all partitions of n chains from a history file, ordered by
+       sample and then by chain. If a list of indices is given, only
+       those partitions are decoded and all others are left empty.
+       Chain ids must be 0, ..., n-1."""
+    if not indices is None:
+        indices = set(indices)
+    records = [ [] for c in range(n) ]
+    for data in read_history_data(filename):
+        c = history_record_chain(data)
+        check_history_chain(filename, c, n)
+        k = len(records[c])*n + c
+        if indices is None or k in indices:
+            records[c].append(history_partition(parse_history_record(data)['partition']))
+        else:
+            records[c].append(dpm_partition_t())
+    if any(records):
+        check_history_chains(filename, [ len(records[c]) for c in range(n) ])
+    m = min([ len(records[c]) for c in range(n) ]) if n > 0 else 0
+    partitions = dpm_partition_list_t()
+    for j in range(m):
+        for c in range(n):
+            partitions.append(records[c][j])
+    return partitions
+
+def read_last_history_partitions(filename, n):
+    """Read only the last partition of each of n chains from a history
+       file, ordered by chain. All other records are skipped without
+       reading them and only these n records are decoded."""
+    last = [ None for c in range(n) ]
+    with open(filename, 'rb') as fp:
+        header = fp.read(8)
+        if len(header) != 8 or not header[0:4] == history_magic or not struct.unpack('<I', header[4:8])[0] == history_version:
+            raise IOError("Invalid sampling history file `%s'." % filename)
+        filesize = os.fstat(fp.fileno()).st_size
+        offset   = 8
+        while offset + 8 <= filesize:
+            fp.seek(offset)
+            size, c = struct.unpack('<II', fp.read(8))
+            if offset + 4 + size > filesize:
+                # last record is incomplete
+                break
+            check_history_chain(filename, c, n)
+            last[c] = (offset + 4, size)
+            offset += 4 + size
+        check_history_chains(filename, [ 0 if last[c] is None else 1 for c in range(n) ])
+        partitions = dpm_partition_list_t()
+        for c in range(n):
+            fp.seek(last[c][0])
+            data = fp.read(last[c][1])
+            partitions.append(history_partition(parse_history_record(data)['partition']))
+    return partitions
+
+def parse_history_file(filename, results_config, parse_partitions=True):
+    records = {}
+    for record in read_history_records(filename, False):
+        records.setdefault(record['chain'], []).append(record)
+    # chain ids are used as indices
+    n = max(records.keys()) + 1 if records else 0
+    check_history_chains(filename, [ len(records.get(c, [])) for c in range(n) ])
+    chains  = range(n)
+    history = results_config['sampling_history']
+    # an interrupted run may have more samples for some chains, only
+    # samples that exist for all chains are used
+    m = min([ len(records[c]) for c in chains ]) if chains else 0
+    history.components  = [ [ r['components']  for r in records[c][0:m] ] for c in chains ]
+    history.likelihood  = [ [ r['likelihood']  for r in records[c][0:m] ] for c in chains ]
+    history.posterior   = [ [ r['posterior']   for r in records[c][0:m] ] for c in chains ]
+    history.temperature = [ [ r['temperature'] for r in records[c][0:m] ] for c in chains ]
+    history.switches    = [ [ r['switches']    for r in records[c][0:m] ] for c in chains ]
+    # cluster sizes and partitions are ordered by sample and then
+    # by chain
+    history.cluster_sizes = [ records[c][j]['cluster_sizes'] for j in range(m) for c in chains ]
+    if parse_partitions:
+        history.partitions = read_history_partitions(filename, n)
+
+
 # save results config
 # ------------------------------------------------------------------------------
 
@@ -78,7 +287,14 @@ def save_results_config(config_file, results_config):
     write_matrix(config_parser, 'Result', 'posterior',     results_config['sampling_history'].posterior)
     write_matrix(config_parser, 'Result', 'switches',      results_config['sampling_history'].switches, int)
     write_matrix(config_parser, 'Result', 'temperature',   results_config['sampling_history'].temperature)
-    config_parser.set('Result', 'partitions', results_config['sampling_history'].partitions)
+    if results_config.has_key('history_file') and results_config['history_file']:
+        # all samples are stored in the history file
+        config_parser.set('Result', 'history-file', results_config['history_file'])
+    elif results_config.has_key('partition_file') and results_config['partition_file']:
+        # partitions are stored in a separate binary file
+        config_parser.set('Result', 'partition-file', results_config['partition_file'])
+    else:
+        config_parser.set('Result', 'partitions', results_config['sampling_history'].partitions)
     if results_config.has_key('map_partition') and results_config['map_partition']:
         config_parser.set('Result', 'map_partition', results_config['map_partition'])
     if results_config.has_key('mean_partition') and results_config['mean_partition']:
@@ -55,8 +55,13 @@ def default_sampler_config():
     sampler_config.baseline_priors      = []
     sampler_config.baseline_weights     = []
     sampler_config.socket_file          = ""
+    sampler_config.history_file         = ""
+    sampler_config.history_resume       = False
+    sampler_config.partition_file       = ""
     sampler_config.samples              = (1000,100)
     sampler_config.threads              = 1
+    sampler_config.gibbs_shards         = 1
+    sampler_config.seed                 = 0
     sampler_config.save                 = ""
     sampler_config.verbose              = 0
     return sampler_config
@@ -135,6 +140,14 @@ def parse_sampler_config(config_file, sampler_config):
         sampler_config.threads = int(config_parser.get('TFBS-Sampler', 'threads'))
         if (sampler_config.threads <= 0):
             raise IOError("Invalid number of threads")
+    if config_parser.has_option('TFBS-Sampler', 'gibbs-shards'):
+        sampler_config.gibbs_shards = int(config_parser.get('TFBS-Sampler', 'gibbs-shards'))
+        if (sampler_config.gibbs_shards <= 0):
+            raise IOError("Invalid number of Gibbs shards")
+    if config_parser.has_option('TFBS-Sampler', 'seed'):
+        sampler_config.seed = int(config_parser.get('TFBS-Sampler', 'seed'))
+        if (sampler_config.seed < 0):
+            raise IOError("Invalid seed")
     if config_parser.has_option('TFBS-Sampler', 'save'):
         sampler_config.save = config_parser.get('TFBS-Sampler', 'save')
     if config_parser.has_option('TFBS-Sampler', 'samples'):
@@ -170,4 +183,8 @@ def parse_sampler_config(config_file, sampler_config):
         generate_baseline(sampler_config)
     if config_parser.has_option('TFBS-Sampler', 'socket-file'):
         sampler_config.socket_file = config_parser.get('TFBS-Sampler', 'socket-file').strip()
+    if config_parser.has_option('TFBS-Sampler', 'history-file'):
+        sampler_config.history_file = config_parser.get('TFBS-Sampler', 'history-file').strip()
+    if config_parser.has_option('TFBS-Sampler', 'partition-file'):
+        sampler_config.partition_file = config_parser.get('TFBS-Sampler', 'partition-file').strip()
     return sampler_config
@@ -77,7 +77,7 @@ public:
         component_model_t& model();
         const component_model_t& model() const;
         elements_t elements() const;
-        void update() { model().update(); }
+        void update() { model().update(); notify(cluster_event_update); }
 
 private:
         component_model_t* m_model;
@@ -48,6 +48,7 @@ public:
                 swap(first._size,                 second._size);
                 swap(first._bg_cluster_tag,       second._bg_cluster_tag);
                 swap(first._precomputed_marginal, second._precomputed_marginal);
+                swap(first._log_likelihood,       second._log_likelihood);
                 swap(first._data,                 second._data);
         }
 
@@ -87,6 +88,11 @@ public:
         const sequence_data_t<data_tfbs_t::code_t>& data() const {
                 return *_data;
         }
+        // the marginal may be a mapped cache file, which is
+        // therefore only read through a const reference
+        const sequence_data_t<double>& precomputed_marginal() const {
+                return _precomputed_marginal;
+        }
 
         friend std::ostream& operator<< (std::ostream& o, const independence_background_t& pd);
 
@@ -97,6 +103,9 @@ protected:
 
         sequence_data_t<double> _precomputed_marginal;
 
+        // log likelihood of all positions assigned to this model
+        double _log_likelihood;
+
         const sequence_data_t<data_tfbs_t::code_t>* _data;
 };
 
@@ -124,6 +133,7 @@ public:
                 swap(first._size,                 second._size);
                 swap(first._bg_cluster_tag,       second._bg_cluster_tag);
                 swap(first._precomputed_marginal, second._precomputed_marginal);
+                swap(first._log_likelihood,       second._log_likelihood);
                 swap(first._data,                 second._data);
         }
 
@@ -162,6 +172,9 @@ protected:
 
         sequence_data_t<double> _precomputed_marginal;
 
+        // log likelihood of all positions assigned to this model
+        double _log_likelihood;
+
         const sequence_data_t<data_tfbs_t::code_t>* _data;
 };
 
@@ -226,6 +239,11 @@ public:
         const sequence_data_t<data_tfbs_t::code_t>& data() const {
                 return *m_data;
         }
+        // the marginal may be a mapped cache file, which is
+        // therefore only read through a const reference
+        const sequence_data_t<double>& precomputed_marginal() const {
+                return m_precomputed_marginal;
+        }
 
         friend std::ostream& operator<< (std::ostream& o, const entropy_background_t& pd);
 
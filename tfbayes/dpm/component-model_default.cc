@@ -154,11 +154,11 @@ default_background_t::compute_marginal()
                         const size_t k = m_component_assignments[index];
                         /* recompute marginal at this position */
                         m_marginal_probability[index] =
-                                  mbeta_log(m_alpha[k], data()[index])
+                                  mbeta_log(m_alpha[k], data().element(index))
                                 - mbeta_log(m_alpha[k]);
                         /* if this position is assigned to the
                          * background, update the log likelihood */
-                        if (cluster_assignments()[index] == m_bg_cluster_tag) {
+                        if (cluster_assignments().element(index) == m_bg_cluster_tag) {
                                 m_log_likelihood += m_marginal_probability[index];
                         }
                 }
@@ -171,9 +171,9 @@ default_background_t::gradient(
         size_t i, size_t j,
         double alpha_sum)
 {
-        const double sum = accumulate(data()[index].begin(), data()[index].end(), 0.0);
+        const double sum = accumulate(data().element(index).begin(), data().element(index).end(), 0.0);
 
-        m_g[i][j] += boost::math::digamma(data()[index][j]+m_alpha[i][j])
+        m_g[i][j] += boost::math::digamma(data().element(index)[j]+m_alpha[i][j])
                 - boost::math::digamma(sum+alpha_sum);
 }
 
@@ -204,7 +204,7 @@ default_background_t::gradient()
                         /* the gradient should consider only those
                          * positions that are currently assigned to the
                          * background */
-                        if (cluster_assignments()[index] == m_bg_cluster_tag) {
+                        if (cluster_assignments().element(index) == m_bg_cluster_tag) {
                                 const ssize_t k = m_component_assignments[index];
                                 assert(k != -1);
 
@@ -300,7 +300,7 @@ default_background_t::max_component(const index_t& index) const
         for (size_t i = 0; i < m_size1; i++) {
                 /* counts contains the data count statistic
                  * and the pseudo counts alpha */
-                result[i] = mbeta_log(m_alpha[i], data()[index])
+                result[i] = mbeta_log(m_alpha[i], data().element(index))
                           - mbeta_log(m_alpha[i])
                           + log(m_weights[i]);
         }
@@ -316,7 +316,7 @@ default_background_t::compute_component_assignments_loop()
                 for (size_t j = 0; j < data()[i].size(); j++) {
                         index_t index(i, j);
                         /* update count statistics */
-                        if (cluster_assignments()[index] == m_bg_cluster_tag && 
+                        if (cluster_assignments().element(index) == m_bg_cluster_tag && 
                             m_component_assignments[index] != -1) {
                                 m_n[m_component_assignments[index]] -= 1.0;
                         }
@@ -329,7 +329,7 @@ default_background_t::compute_component_assignments_loop()
                         /* save assignemnt */
                         m_component_assignments[index] = k;
                         /* update count statistics */
-                        if (cluster_assignments()[index] == m_bg_cluster_tag) {
+                        if (cluster_assignments().element(index) == m_bg_cluster_tag) {
                                 m_n[k] += 1.0;
                         }
                 }
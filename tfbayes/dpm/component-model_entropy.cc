@@ -19,83 +19,23 @@
 #include <string>
 #include <vector>
 
+#include <unistd.h>
+
 #include <boost/format.hpp>
 #include <boost/function.hpp>
-#include <boost/archive/binary_oarchive.hpp>
-#include <boost/archive/binary_iarchive.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/random/mersenne_twister.hpp>
 
 #include <tfbayes/dpm/component-model.hh>
+#include <tfbayes/dpm/data-tfbs-file.hh>
 #include <tfbayes/utility/probability.hh>
+#include <tfbayes/utility/random.hh>
 #include <tfbayes/entropy/entropy-multinomial-distribution.hh>
 
 using namespace std;
 
 ////////////////////////////////////////////////////////////////////////////////
 
-class background_cache_t {
-private:
-        friend class boost::serialization::access;
-
-        template<class Archive>
-        void serialize(Archive & ar, const unsigned int version) {
-                ar & id;
-                ar & parameters;
-                ar & data;
-                ar & precomputed_marginal;
-        }
-public:
-        background_cache_t()
-                : id("entropy")
-                { }
-        background_cache_t(
-                const vector<double>& parameters,
-                const sequence_data_t<data_tfbs_t::code_t>& data,
-                const sequence_data_t<double>& precomputed_marginal)
-                : id         ("entropy")
-                , parameters (parameters)
-                , data       (data)
-                , precomputed_marginal(precomputed_marginal)
-                { }
-        bool consistent(
-                const vector<double>& parameters,
-                const sequence_data_t<data_tfbs_t::code_t>& data) {
-                // id
-                if (this->id != "entropy") {
-                        return false;
-                }
-                // parameters
-                if (this->parameters.size() != parameters.size()) {
-                        return false;
-                }
-                for (size_t i = 0; i < parameters.size(); i++) {
-                        if (this->parameters[i] != parameters[i]) {
-                                return false;
-                        }
-                }
-                // check phylogenetic data
-                for (size_t i = 0; i < data.size(); i++) {
-                        if (this->data[i].size() != data[i].size()) {
-                                return false;
-                        }
-                        for (size_t j = 0; j < data[i].size(); j++) {
-                                if (this->data[i][j] != data[i][j]) {
-                                        return false;
-                                }
-                        }
-                }
-                return true;
-        }
-
-        string id;
-        vector<double> parameters;
-        sequence_data_t<data_tfbs_t::code_t> data;
-        sequence_data_t<double> precomputed_marginal;
-};
-
-////////////////////////////////////////////////////////////////////////////////
-
 /* This is an independence background model with Dirichlet
  * prior. If the pseudocounts are set to -1 a Gamma distribution
  * is used to integrate them out. */
@@ -156,24 +96,22 @@ entropy_background_t::load_marginal(
         const vector<double>& parameters,
         const string& cachefile)
 {
-        std::ifstream ifs(cachefile, std::ios::binary);
-        background_cache_t background_cache;
-
-        // try to receive precomputed marginals from cache
-        if (ifs) {
-                boost::archive::binary_iarchive ia(ifs);
-                ia >> background_cache;
-                if (background_cache.consistent(parameters, data())) {
-                        m_precomputed_marginal = background_cache.precomputed_marginal;
-                        return true;
-                }
-                if (m_verbose >= 1) {
-                        flockfile(stderr);
-                        cerr << "Background cache is inconsistent... recomputing!"
-                             << endl;
-                        fflush(stderr);
-                        funlockfile(stderr);
-                }
+        if (cachefile == "") {
+                return false;
+        }
+        const background_cache_key_t key = background_cache_key("entropy", parameters, data());
+        const string filename = background_cache_file(cachefile, key);
+
+        // try to map precomputed marginals from cache
+        if (map_background_cache(filename, key, m_precomputed_marginal)) {
+                return true;
+        }
+        if (m_verbose >= 1 && access(filename.c_str(), F_OK) == 0) {
+                flockfile(stderr);
+                cerr << "Background cache is inconsistent... recomputing!"
+                     << endl;
+                fflush(stderr);
+                funlockfile(stderr);
         }
         return false;
 }
@@ -183,18 +121,24 @@ entropy_background_t::save_marginal(
         const vector<double>& parameters,
         const string& cachefile)
 {
-        std::ofstream ofs(cachefile);
-        if (ofs) {
-                boost::archive::binary_oarchive oa(ofs);
-                const background_cache_t tmp(parameters, data(), m_precomputed_marginal);
-                oa << tmp;
+        if (cachefile == "") {
+                return false;
+        }
+        const background_cache_key_t key = background_cache_key("entropy", parameters, data());
+        const string filename = background_cache_file(cachefile, key);
+
+        if (save_background_cache(filename, key, m_precomputed_marginal)) {
                 if (m_verbose >= 1) {
                         flockfile(stderr);
-                        cerr << boost::format("Background cache saved to `%s'.") % cachefile
+                        cerr << boost::format("Background cache saved to `%s'.") % filename
                              << endl;
                         fflush(stderr);
                         funlockfile(stderr);
                 }
+                // use the mapped file instead of the private copy,
+                // which is shared with other processes
+                map_background_cache(filename, key, m_precomputed_marginal);
+
                 return true;
         }
         return false;
@@ -202,12 +146,6 @@ entropy_background_t::save_marginal(
 
 class precompute_marginal_functor
 {
-        template <typename T>
-        void seed_rng(T& rng) {
-                struct timeval tv;
-                gettimeofday(&tv, NULL);
-                rng.seed(tv.tv_sec*tv.tv_usec);
-        }
         typedef double real_t;
         // the marginal entropy distribution requires a special
         // probability type
@@ -232,6 +170,25 @@ protected:
         marginal_entropy_distribution_t<real_t, p_t> m_dist;
 };
 
+// compute the marginal at a single position of the data
+class precompute_marginal_position_t
+{
+public:
+        precompute_marginal_position_t(
+                const precompute_marginal_functor& functor,
+                const data_tfbs_t::code_t* data,
+                double* result)
+                : m_functor(functor), m_data(data), m_result(result)
+                { }
+        void operator()(size_t i) const {
+                m_result[i] = m_functor(m_data[i]);
+        }
+protected:
+        const precompute_marginal_functor& m_functor;
+        const data_tfbs_t::code_t* m_data;
+        double* m_result;
+};
+
 void
 entropy_background_t::precompute_marginal(
         const vector<double>& parameters,
@@ -247,32 +204,24 @@ entropy_background_t::precompute_marginal(
                 fflush(stderr);
                 funlockfile(stderr);
         }
-        // go through the data and precompute the marginal distribution
-        for(size_t i = 0; i < data().size(); i++) {
-                future_vector_t<double> futures(data()[i].size());
-
-                for(size_t j = 0; j < data()[i].size(); j++) {
-                        boost::function<double ()> f = boost::bind(
-                                boost::cref(functor), boost::cref(data()[i][j]));
-
-                        futures[j] = thread_pool.schedule(f);
-                }
-                for(size_t j = 0; j < data()[i].size(); j++) {
-                        /* compute percentage by linearly
-                         * interpolating two values */
-                        const double p = j/(double)data()[i].size();
-                        const double q = (p*(i+1.0) + (1.0-p)*i)/(double)data().size();
-
-                        if (m_verbose >= 1) {
-                                flockfile(stderr);
-                                cerr.precision(2);
-                                cerr << "\rPrecomputing background... " << setw(6) << fixed
-                                     << q*100.0 << "%"                  << flush;
-                                fflush(stderr);
-                                funlockfile(stderr);
-                        }
-                        m_precomputed_marginal[i][j] = futures[j].get();
+        // go through the data and precompute the marginal
+        // distribution, blocks of positions are processed in
+        // parallel so that the progress can be reported
+        const size_t n     = data().linear_size();
+        const size_t block = 1 << 16;
+        precompute_marginal_position_t position(
+                functor, data().linear_begin(), m_precomputed_marginal.linear_begin());
+
+        for (size_t i = 0; i < n; i += block) {
+                if (m_verbose >= 1) {
+                        flockfile(stderr);
+                        cerr.precision(2);
+                        cerr << "\rPrecomputing background... " << setw(6) << fixed
+                             << 100.0*i/n << "%"                << flush;
+                        fflush(stderr);
+                        funlockfile(stderr);
                 }
+                thread_pool.parallel_for(i, min(i+block, n), 256, position);
         }
         if (m_verbose >= 1) {
                 flockfile(stderr);
@@ -290,7 +239,7 @@ entropy_background_t::add(const range_t& range) {
 
         for (size_t i = 0; i < length; i++) {
                 const index_t index(sequence, position+i);
-                m_log_likelihood += m_precomputed_marginal[index];
+                m_log_likelihood += precomputed_marginal().element(index);
         }
 
         return length;
@@ -304,7 +253,7 @@ entropy_background_t::remove(const range_t& range) {
 
         for (size_t i = 0; i < length; i++) {
                 const index_t index(sequence, position+i);
-                m_log_likelihood -= m_precomputed_marginal[index];
+                m_log_likelihood -= precomputed_marginal().element(index);
         }
 
         return length;
@@ -337,7 +286,7 @@ double entropy_background_t::log_predictive(const range_t& range) {
 
                 /* counts contains the data count statistic
                  * and the pseudo counts alpha */
-                result += m_precomputed_marginal[index];
+                result += precomputed_marginal().element(index);
         }
 
         return result;
@@ -360,7 +309,7 @@ double entropy_background_t::log_predictive(const vector<range_t>& range_set) {
                         /* all positions in the alignment are fully
                          * independent, hence we do not need to sum
                          * any counts */
-                        result += m_precomputed_marginal[index];
+                        result += precomputed_marginal().element(index);
                 }
         }
 
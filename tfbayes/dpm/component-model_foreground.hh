@@ -25,6 +25,8 @@
 #include <algorithm>
 #include <vector>
 
+#include <tfbayes/fastarithmetics/fast-lnbeta.hh>
+
 // Multinomial/Dirichlet Model
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -36,12 +38,10 @@ public:
                 const model_id_t& model_id,
                 const S& a_alpha,
                 const T& lengths,
-                const sequence_data_t<data_tfbs_t::code_t>& data,
-                const sequence_data_t<data_tfbs_t::code_t>& complement_data)
+                const sequence_data_t<data_tfbs_t::code_t>& data)
                 : component_model_t (model_id)
                 , m_lengths         (lengths.begin(), lengths.end())
-                , m_data            (&data)
-                , m_complement_data (&complement_data) {
+                , m_data            (&data) {
                 // make sure the counts vector has a single column
                 assert(a_alpha   .size() == 1);
                 assert(a_alpha[0].size() == size2());
@@ -55,6 +55,13 @@ public:
                                 m_alpha_default[j] = a_alpha[0][j];
                         }
                 }
+                m_counts_sum   .resize(size1(), 0.0);
+                m_counts_lnbeta.resize(size1(), 0.0);
+                m_log_likelihood = 0.0;
+                for (size_t i = 0; i < size1(); i++) {
+                        m_update_normalizer(i);
+                        m_log_likelihood -= fast_lnbeta(m_alpha[i]);
+                }
                 // the lengths should be sorted so that proposals are
                 // similar in length
                 std::sort(m_lengths.begin(), m_lengths.end());
@@ -70,11 +77,13 @@ public:
                      static_cast<component_model_t&>(second));
                 swap(first.m_alpha,           second.m_alpha);
                 swap(first.m_counts,          second.m_counts);
+                swap(first.m_counts_sum,      second.m_counts_sum);
+                swap(first.m_counts_lnbeta,   second.m_counts_lnbeta);
+                swap(first.m_log_likelihood,  second.m_log_likelihood);
                 swap(first.m_alpha_default,   second.m_alpha_default);
                 swap(first.m_lengths,         second.m_lengths);
                 swap(first.m_tmp_counts,      second.m_tmp_counts);
                 swap(first.m_data,            second.m_data);
-                swap(first.m_complement_data, second.m_complement_data);
         }
 
         product_dirichlet_t& operator=(const component_model_t& component_model);
@@ -98,8 +107,9 @@ public:
         const sequence_data_t<data_tfbs_t::code_t>& data() const {
                 return *m_data;
         }
-        const sequence_data_t<data_tfbs_t::code_t>& complement_data() const {
-                return *m_complement_data;
+        // reverse complement of the entry at the given position
+        data_tfbs_t::code_t complement_data(const index_t& index) const {
+                return data_tfbs_t::complement(m_data->element(index));
         }
 
         friend std::ostream& operator<< (std::ostream& o, const product_dirichlet_t& pd);
@@ -107,6 +117,14 @@ public:
 protected:
         std::vector<counts_t> m_alpha;
         std::vector<counts_t> m_counts;
+        // sum and log beta of each column of m_counts, which are
+        // required by every call of log_predictive and therefore
+        // updated whenever counts are added or removed
+        std::vector<double> m_counts_sum;
+        std::vector<double> m_counts_lnbeta;
+        // log likelihood of the model, which changes only in the
+        // columns that are updated by m_update_normalizer
+        double m_log_likelihood;
         // pseudocounts for resizing the model
         counts_t m_alpha_default;
         // feasible lengths of this model
@@ -114,11 +132,12 @@ protected:
 
         counts_t m_tmp_counts;
 
+        void m_update_normalizer(size_t i);
+
         size_t size1() const { return component_model_t::m_model_id.length; }
         size_t size2() const { return data_tfbs_t::alphabet_size;          }
 
         const sequence_data_t<data_tfbs_t::code_t>* m_data;
-        const sequence_data_t<data_tfbs_t::code_t>* m_complement_data;
 };
 
 #endif /* __TFBAYES_DPM_COMPONENT_MODEL_FOREGROUND_HH__ */
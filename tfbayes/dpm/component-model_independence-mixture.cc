@@ -43,6 +43,7 @@ independence_mixture_background_t::independence_mixture_background_t(
           _size(data_tfbs_t::alphabet_size),
           _bg_cluster_tag(0),
           _precomputed_marginal(_data.sizes(), 0),
+          _log_likelihood(0.0),
           _data(&_data)
 {
         vector<counts_t> alpha(_alpha.size(), counts_t());
@@ -64,6 +65,7 @@ independence_mixture_background_t::independence_mixture_background_t(const indep
           _size(distribution._size),
           _bg_cluster_tag(distribution._bg_cluster_tag),
           _precomputed_marginal(distribution._precomputed_marginal),
+          _log_likelihood(distribution._log_likelihood),
           _data(distribution._data)
 {
 }
@@ -101,8 +103,7 @@ independence_mixture_background_t::precompute_marginal(
         for(size_t i = 0; i < data().size(); i++) {
                 for(size_t j = 0; j < data()[i].size(); j++) {
                         for (size_t c = 0; c < alpha.size(); c++) {
-                                tmp[c] = fast_lnbeta(alpha[c], data()[i][j])
-                                       - fast_lnbeta(alpha[c])
+                                tmp[c] = fast_lnbeta_ratio(alpha[c], data()[i][j])
                                        + log(weights[c]);
                         }
                         size_t c = distance(tmp.begin(),
@@ -124,12 +125,30 @@ independence_mixture_background_t::precompute_marginal(
 
 size_t
 independence_mixture_background_t::add(const range_t& range) {
-        return range.length();
+        const size_t sequence = range.index()[0];
+        const size_t position = range.index()[1];
+        const size_t length   = range.length();
+
+        for (size_t i = 0; i < length; i++) {
+                const index_t index(sequence, position+i);
+                _log_likelihood += _precomputed_marginal[index];
+        }
+
+        return length;
 }
 
 size_t
 independence_mixture_background_t::remove(const range_t& range) {
-        return range.length();
+        const size_t sequence = range.index()[0];
+        const size_t position = range.index()[1];
+        const size_t length   = range.length();
+
+        for (size_t i = 0; i < length; i++) {
+                const index_t index(sequence, position+i);
+                _log_likelihood -= _precomputed_marginal[index];
+        }
+
+        return length;
 }
 
 size_t
@@ -191,19 +210,9 @@ double independence_mixture_background_t::log_predictive(const vector<range_t>&
  *  p(x) = Beta(n(x) + alpha) / Beta(alpha)
  */
 double independence_mixture_background_t::log_likelihood() const {
-        double result = 0;
-
-        /* counts contains the data count statistic
-         * and the pseudo counts alpha */
-        for(size_t i = 0; i < cluster_assignments().size(); i++) {
-                for(size_t j = 0; j < cluster_assignments()[i].size(); j++) {
-                        if (cluster_assignments()[i][j] == _bg_cluster_tag) {
-                                const index_t index(i, j);
-                                result += _precomputed_marginal[index];
-                        }
-                }
-        }
-        return result;
+        /* the likelihood is updated whenever positions are added
+         * or removed */
+        return _log_likelihood;
 }
 
 string
@@ -66,7 +66,7 @@ mixture_dirichlet_t::max_component(const index_t& index) const
         for (size_t i = 0; i < m_size1; i++) {
                 /* counts contains the data count statistic
                  * and the pseudo counts alpha */
-                result[i] = mbeta_log(counts[i], data()[index])
+                result[i] = mbeta_log(counts[i], data().element(index))
                           - mbeta_log(counts[i])
                           + log(weights[i]);
         }
@@ -157,7 +157,7 @@ mixture_dirichlet_t::add(const index_t& index)
 
         /* add counts to the max component */
         for (size_t k = 0; k < data_tfbs_t::alphabet_size; k++) {
-                counts[i][k] += data()[index][k];
+                counts[i][k] += data().element(index)[k];
         }
 
         return 1;
@@ -183,7 +183,7 @@ mixture_dirichlet_t::remove(const index_t& index)
 
         /* substract counts from the max component */
         for (size_t k = 0; k < data_tfbs_t::alphabet_size; k++) {
-                counts[i][k] -= data()[index][k];
+                counts[i][k] -= data().element(index)[k];
         }
 
         return 1;
@@ -223,7 +223,7 @@ double mixture_dirichlet_t::log_predictive(const index_t& index) {
 
         /* counts contains the data count statistic
          * and the pseudo counts alpha */
-        double result = mbeta_log(counts[i], data()[index])
+        double result = mbeta_log(counts[i], data().element(index))
                       - mbeta_log(counts[i]);
 
         return result;
@@ -362,7 +362,11 @@ markov_chain_mixture_t::markov_chain_mixture_t(
         }
         /* compute context */
         for (size_t i = 0; i < _data.size(); i++) {
-                const sequence_t<double>& seq = (const sequence_t<double>&)_data[i];
+                // the context is computed on the flat list of counts
+                sequence_t<double> seq;
+                for (size_t j = 0; j < _data[i].size(); j++) {
+                        seq.insert(seq.end(), _data[i][j].begin(), _data[i][j].end());
+                }
                 _context.push_back(seq_context_t(seq, _max_context, alphabet_size));
         }
 }
@@ -30,10 +30,12 @@ product_dirichlet_t::product_dirichlet_t(const product_dirichlet_t& distribution
         : component_model_t (distribution)
         , m_alpha           (distribution.m_alpha)
         , m_counts          (distribution.m_counts)
+        , m_counts_sum      (distribution.m_counts_sum)
+        , m_counts_lnbeta   (distribution.m_counts_lnbeta)
+        , m_log_likelihood  (distribution.m_log_likelihood)
         , m_alpha_default   (distribution.m_alpha_default)
         , m_lengths         (distribution.m_lengths)
         , m_data            (distribution.m_data)
-        , m_complement_data (distribution.m_complement_data)
 { }
 
 product_dirichlet_t::~product_dirichlet_t()
@@ -53,6 +55,18 @@ product_dirichlet_t::operator=(const component_model_t& component_model)
         return *this;
 }
 
+void
+product_dirichlet_t::m_update_normalizer(size_t i)
+{
+        m_counts_sum[i] = 0.0;
+        for (size_t k = 0; k < data_tfbs_t::alphabet_size; k++) {
+                m_counts_sum[i] += m_counts[i][k];
+        }
+        m_log_likelihood  -= m_counts_lnbeta[i];
+        m_counts_lnbeta[i] = fast_lnbeta(m_counts[i]);
+        m_log_likelihood  += m_counts_lnbeta[i];
+}
+
 size_t
 product_dirichlet_t::add(const range_t& range)
 {
@@ -66,17 +80,20 @@ product_dirichlet_t::add(const range_t& range)
                 for (size_t i = 0; i < length; i++) {
                         const index_t index(sequence, position+i);
                         for (size_t k = 0; k < data_tfbs_t::alphabet_size; k++) {
-                                m_counts[i][k] += data()[index][k];
+                                m_counts[i][k] += data().element(index)[k];
                         }
+                        m_update_normalizer(i);
                 }
         }
         // reverse complement
         else {
                 for (size_t i = 0; i < length; i++) {
                         const index_t index(sequence, position+length-i-1);
+                        const counts_t entry = complement_data(index);
                         for (size_t k = 0; k < data_tfbs_t::alphabet_size; k++) {
-                                m_counts[i][k] += complement_data()[index][k];
+                                m_counts[i][k] += entry[k];
                         }
+                        m_update_normalizer(i);
                 }
         }
         return 1;
@@ -95,19 +112,22 @@ product_dirichlet_t::remove(const range_t& range)
                 for (size_t i = 0; i < length; i++) {
                         const index_t index(sequence, position+i);
                         for (size_t k = 0; k < data_tfbs_t::alphabet_size; k++) {
-                                m_counts[i][k] -= data()[index][k];
+                                m_counts[i][k] -= data().element(index)[k];
                                 assert(m_counts[i][k] >= 0.0);
                         }
+                        m_update_normalizer(i);
                 }
         }
         // reverse complement
         else {
                 for (size_t i = 0; i < length; i++) {
                         const index_t index(sequence, position+length-i-1);
+                        const counts_t entry = complement_data(index);
                         for (size_t k = 0; k < data_tfbs_t::alphabet_size; k++) {
-                                m_counts[i][k] -= complement_data()[index][k];
+                                m_counts[i][k] -= entry[k];
                                 assert(m_counts[i][k] >= 0.0);
                         }
+                        m_update_normalizer(i);
                 }
         }
         return 1;
@@ -145,8 +165,8 @@ double product_dirichlet_t::log_predictive(const range_t& range) {
 
                         /* counts contains the data count statistic
                          * and the pseudo counts alpha */
-                        result += fast_lnbeta(m_counts[i], data()[index])
-                                - fast_lnbeta(m_counts[i]);
+                        result += fast_lnbeta_ratio(m_counts[i], data().element(index),
+                                                    m_counts_sum[i], m_counts_lnbeta[i]);
                 }
         }
         // reverse complement
@@ -156,8 +176,8 @@ double product_dirichlet_t::log_predictive(const range_t& range) {
 
                         /* counts contains the data count statistic
                          * and the pseudo counts alpha */
-                        result += fast_lnbeta(m_counts[i], complement_data()[index])
-                                - fast_lnbeta(m_counts[i]);
+                        result += fast_lnbeta_ratio(m_counts[i], complement_data(index),
+                                                    m_counts_sum[i], m_counts_lnbeta[i]);
                 }
         }
 
@@ -191,7 +211,7 @@ double product_dirichlet_t::log_predictive(const vector<range_t>& range_set) {
 
                                 /* add counts of this subsequence to m_tmp_counts */
                                 for (size_t j = 0; j < data_tfbs_t::alphabet_size; j++) {
-                                        m_tmp_counts[j] += data()[index][j];
+                                        m_tmp_counts[j] += data().element(index)[j];
                                 }
                         }
                 }
@@ -202,15 +222,16 @@ double product_dirichlet_t::log_predictive(const vector<range_t>& range_set) {
                                 const size_t sequence = range_set[k].index()[0];
                                 const size_t position = range_set[k].index()[1];
                                 const index_t index(sequence, position+length-i-1);
+                                const counts_t entry = complement_data(index);
 
                                 /* add counts of this subsequence to m_tmp_counts */
                                 for (size_t j = 0; j < data_tfbs_t::alphabet_size; j++) {
-                                        m_tmp_counts[j] += complement_data()[index][j];
+                                        m_tmp_counts[j] += entry[j];
                                 }
                         }
                 }
-                result += fast_lnbeta(m_counts[i], m_tmp_counts)
-                        - fast_lnbeta(m_counts[i]);
+                result += fast_lnbeta_ratio(m_counts[i], m_tmp_counts,
+                                            m_counts_sum[i], m_counts_lnbeta[i]);
         }
 
         return result;
@@ -220,15 +241,9 @@ double product_dirichlet_t::log_predictive(const vector<range_t>& range_set) {
  *  p(x) = Beta(n(x) + alpha) / Beta(alpha)
  */
 double product_dirichlet_t::log_likelihood() const {
-        double result = 0;
-
-        for (size_t i = 0; i < size1(); i++) {
-                /* counts contains the data count statistic
-                 * and the pseudo counts alpha */
-                result += fast_lnbeta(m_counts[i])
-                        - fast_lnbeta(m_alpha [i]);
-        }
-        return result;
+        /* counts contains the data count statistic
+         * and the pseudo counts alpha */
+        return m_log_likelihood;
 }
 
 string
@@ -23,6 +23,8 @@
 #include <gsl/gsl_randist.h>
 
 #include <tfbayes/dpm/data-gaussian.hh>
+#include <tfbayes/utility/boost-random-shuffle.hh>
+#include <tfbayes/utility/random.hh>
 
 using namespace std;
 
@@ -95,7 +97,11 @@ data_gaussian_t::data_gaussian_t(
 
 void
 data_gaussian_t::shuffle() {
-        random_shuffle(sampling_indices.begin(), sampling_indices.end());
+        // seeded from the global seed, so that runs with a fixed
+        // seed are reproducible
+        rng_t gen;
+        seed_rng(gen);
+        boost::random::random_shuffle(sampling_indices.begin(), sampling_indices.end(), gen);
 }
 
 size_t
@@ -0,0 +1,94 @@
+/* Copyright (C) 2013 Philipp Benner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <tfbayes/config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/format.hpp>
+
+#include <unistd.h>
+
+#include <tfbayes/dpm/data-tfbs-file.hh>
+#include <tfbayes/dpm/dpm-tfbs.hh>
+
+using namespace std;
+
+// check that a memory mapped data file is shared and not copied while
+// the data is only read, and that it is copied on the first write
+////////////////////////////////////////////////////////////////////////////////
+
+static bool
+check(bool condition, const string& msg)
+{
+        if (!condition) {
+                cerr << "FAILED: " << msg << endl;
+        }
+        return condition;
+}
+
+int main(int argc, char *argv[])
+{
+        const char* filename = argc > 1 ? argv[1] : "test-dpm-tfbs.approximation.fa";
+        const string datafile = boost::str(boost::format("data-tfbs-file-test.%d.tfbd") % getpid());
+        bool result = true;
+
+        const sequence_data_t<data_tfbs_t::code_t> sequences = data_tfbs_t::read_fasta(filename);
+        save_data_tfbs_file(datafile, sequences);
+
+        tfbs_options_t options = tfbs_options_t();
+        options.background_model = "independence-dirichlet";
+        options.background_alpha = matrix<double>(1, data_tfbs_t::alphabet_size, 1.0);
+        options.background_gamma = vector<double>(2, 1.0);
+        options.threads          = 1;
+        options.baseline_lengths.push_back(vector<double>(1, 10));
+        options.baseline_names  .push_back("baseline-default");
+        options.baseline_priors .push_back(matrix<double>(1, data_tfbs_t::alphabet_size, 1.0));
+        options.baseline_weights.push_back(1.0);
+        {
+                // data_tfbs_t is not const while it is constructed
+                data_tfbs_t data(datafile);
+
+                result &= check(data.external(), "data is copied by the constructor");
+                result &= check(data.offsets() == sequences.offsets(),
+                                "offsets differ from the fasta file");
+                result &= check(equal(sequences.linear_begin(), sequences.linear_end(),
+                                      static_cast<const data_tfbs_t&>(data).linear_begin()),
+                                "counts differ from the fasta file");
+
+                dpm_tfbs_t dpm(options, data);
+                result &= check(data.external(), "data is copied by the sampler");
+
+                // a copy shares the buffer until it is modified
+                sequence_data_t<data_tfbs_t::code_t> copy(data);
+                result &= check(copy.external(), "copy does not share the buffer");
+                copy.element(index_t(0, 0))[0] += 1.0;
+                result &= check(!copy.external(), "modified copy still uses the buffer");
+                result &= check(data.external(), "original is copied on write");
+                result &= check(static_cast<const data_tfbs_t&>(data).element(index_t(0, 0))[0] ==
+                                sequences.element(index_t(0, 0))[0],
+                                "modification of the copy is visible in the original");
+        }
+        unlink(datafile.c_str());
+
+        return result ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,314 @@
+/* Copyright (C) 2013 Philipp Benner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <tfbayes/config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <stdint.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <boost/format.hpp>
+#include <boost/static_assert.hpp>
+
+#include <tfbayes/dpm/data-tfbs-file.hh>
+#include <tfbayes/utility/little-endian.hh>
+
+using namespace std;
+
+// the counts are mapped directly, which requires that a position is
+// stored as a plain array of doubles
+BOOST_STATIC_ASSERT(sizeof(data_tfbs_t::code_t) == data_tfbs_t::alphabet_size*sizeof(double));
+
+static const char     magic[4] = { 'T', 'F', 'B', 'D' };
+static const uint32_t version  = 1;
+
+static const char     cache_magic[4] = { 'T', 'F', 'B', 'G' };
+static const uint32_t cache_version  = 1;
+
+// doubles are written and mapped as they are stored in memory
+static
+void check_byte_order(const string& filename)
+{
+        const uint32_t x = 1;
+        if (*reinterpret_cast<const char*>(&x) != 1) {
+                throw runtime_error(boost::str(boost::format("Cannot use data file `%s': "
+                                                             "binary data files require a little endian machine.")
+                                               % filename));
+        }
+}
+
+// memory mapping
+////////////////////////////////////////////////////////////////////////////////
+
+class data_tfbs_mapping_t {
+public:
+        data_tfbs_mapping_t(void* data, size_t length)
+                : m_data(data), m_length(length)
+                { }
+        ~data_tfbs_mapping_t() {
+                munmap(m_data, m_length);
+        }
+protected:
+        void*  m_data;
+        size_t m_length;
+};
+
+// map a whole file read-only, sequence_data_t copies the data before
+// it is modified; empty files are not mapped and NULL is returned
+static
+void* map_file(const string& filename, size_t& length)
+{
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd == -1) {
+                throw runtime_error(boost::str(boost::format("Could not open file `%s': %s")
+                                        % filename % strerror(errno)));
+        }
+        struct stat sb;
+        if (fstat(fd, &sb) == -1) {
+                close(fd);
+                throw runtime_error(boost::str(boost::format("Could not stat file `%s': %s")
+                                        % filename % strerror(errno)));
+        }
+        length = sb.st_size;
+        if (length == 0) {
+                close(fd);
+                return NULL;
+        }
+        void* ptr = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+        if (ptr == MAP_FAILED) {
+                close(fd);
+                throw runtime_error(boost::str(boost::format("Could not map file `%s': %s")
+                                        % filename % strerror(errno)));
+        }
+        // the mapping remains valid after closing the file
+        close(fd);
+
+        return ptr;
+}
+
+// read n+1 offsets of sequences, which must start at zero and
+// increase monotonically
+static
+bool read_offsets(const char* buffer, uint64_t n, vector<size_t>& offsets)
+{
+        offsets.resize(n+1);
+        for (size_t i = 0; i <= n; i++) {
+                offsets[i] = read_uint64(buffer + 8*i);
+                if ((i == 0 && offsets[i] != 0) || (i > 0 && offsets[i] < offsets[i-1])) {
+                        return false;
+                }
+        }
+        return true;
+}
+
+// data files
+////////////////////////////////////////////////////////////////////////////////
+
+void save_data_tfbs_file(const string& filename, const sequence_data_t<data_tfbs_t::code_t>& data)
+{
+        check_byte_order(filename);
+
+        string header(magic, sizeof(magic));
+        write_uint32(header, version);
+        write_uint32(header, data_tfbs_t::alphabet_size);
+        write_uint32(header, 0);
+        write_uint64(header, data.size());
+        for (size_t i = 0; i < data.offsets().size(); i++) {
+                write_uint64(header, data.offsets()[i]);
+        }
+        ofstream file(filename.c_str(), ios::out | ios::binary | ios::trunc);
+        file.write(header.data(), header.size());
+        file.write(reinterpret_cast<const char*>(data.linear_begin()),
+                   data.linear_size()*sizeof(data_tfbs_t::code_t));
+        file.close();
+        if (!file) {
+                throw runtime_error(boost::str(boost::format("Could not write data file `%s'.") % filename));
+        }
+}
+
+bool is_data_tfbs_file(const string& filename)
+{
+        ifstream file(filename.c_str(), ios::in | ios::binary);
+        char buffer[8];
+
+        if (!file.read(buffer, 8)) {
+                return false;
+        }
+        return memcmp(buffer, magic, sizeof(magic)) == 0 &&
+                read_uint32(buffer+4) == version;
+}
+
+sequence_data_t<data_tfbs_t::code_t> map_data_tfbs_file(const string& filename)
+{
+        check_byte_order(filename);
+
+        size_t length;
+        void* ptr = map_file(filename, length);
+        if (length < 24) {
+                if (ptr) {
+                        munmap(ptr, length);
+                }
+                throw runtime_error(boost::str(boost::format("`%s' is not a data file.") % filename));
+        }
+        boost::shared_ptr<void> mapping(new data_tfbs_mapping_t(ptr, length));
+        const char* data = static_cast<const char*>(ptr);
+
+        if (memcmp(data, magic, sizeof(magic)) != 0 || read_uint32(data+4) != version) {
+                throw runtime_error(boost::str(boost::format("`%s' is not a data file.") % filename));
+        }
+        if (read_uint32(data+8) != data_tfbs_t::alphabet_size) {
+                throw runtime_error(boost::str(boost::format("Data file `%s' has wrong alphabet size.") % filename));
+        }
+        const uint64_t n = read_uint64(data+16);
+        // size of the header
+        const uint64_t offset = 24 + 8*(n+1);
+
+        if (n > length/8 || offset > length) {
+                throw runtime_error(boost::str(boost::format("Data file `%s' is corrupt.") % filename));
+        }
+        vector<size_t> offsets;
+        if (!read_offsets(data + 24, n, offsets)) {
+                throw runtime_error(boost::str(boost::format("Data file `%s' is corrupt.") % filename));
+        }
+        if (offsets[n] > (length - offset)/sizeof(data_tfbs_t::code_t)) {
+                throw runtime_error(boost::str(boost::format("Data file `%s' is corrupt.") % filename));
+        }
+        const data_tfbs_t::code_t* begin = reinterpret_cast<const data_tfbs_t::code_t*>(data + offset);
+
+        return sequence_data_t<data_tfbs_t::code_t>(begin, offsets, mapping);
+}
+
+// background cache files
+////////////////////////////////////////////////////////////////////////////////
+
+background_cache_key_t background_cache_key(
+        const string& id,
+        const vector<double>& parameters,
+        const sequence_data_t<data_tfbs_t::code_t>& data)
+{
+        string header(id);
+        header.push_back('\0');
+        write_uint32(header, cache_version);
+        write_uint32(header, data_tfbs_t::alphabet_size);
+        write_uint64(header, parameters.size());
+        write_uint64(header, data.size());
+        for (size_t i = 0; i < data.offsets().size(); i++) {
+                write_uint64(header, data.offsets()[i]);
+        }
+        sha256_t sha256;
+        sha256.update(header);
+        // parameters and counts are hashed as they are stored in
+        // memory, which is the same on all little endian machines
+        sha256.update(parameters.data(), parameters.size()*sizeof(double));
+        sha256.update(data.linear_begin(), data.linear_size()*sizeof(data_tfbs_t::code_t));
+
+        return sha256.digest();
+}
+
+string background_cache_file(const string& path, const background_cache_key_t& key)
+{
+        struct stat sb;
+        if (path != "" && stat(path.c_str(), &sb) == 0 && S_ISDIR(sb.st_mode)) {
+                return path + "/" + sha256_t::hex(key);
+        }
+        return path;
+}
+
+bool save_background_cache(
+        const string& filename,
+        const background_cache_key_t& key,
+        const sequence_data_t<double>& marginal)
+{
+        check_byte_order(filename);
+
+        string header(cache_magic, sizeof(cache_magic));
+        write_uint32(header, cache_version);
+        header.append(reinterpret_cast<const char*>(key.data()), key.size());
+        write_uint64(header, marginal.size());
+        for (size_t i = 0; i < marginal.offsets().size(); i++) {
+                write_uint64(header, marginal.offsets()[i]);
+        }
+        const string tmpfile = boost::str(boost::format("%s.%d.tmp") % filename % getpid());
+
+        ofstream file(tmpfile.c_str(), ios::out | ios::binary | ios::trunc);
+        if (!file) {
+                return false;
+        }
+        file.write(header.data(), header.size());
+        file.write(reinterpret_cast<const char*>(marginal.linear_begin()),
+                   marginal.linear_size()*sizeof(double));
+        file.close();
+        if (!file || rename(tmpfile.c_str(), filename.c_str()) != 0) {
+                unlink(tmpfile.c_str());
+                return false;
+        }
+        return true;
+}
+
+bool map_background_cache(
+        const string& filename,
+        const background_cache_key_t& key,
+        sequence_data_t<double>& marginal)
+{
+        check_byte_order(filename);
+
+        if (filename == "" || access(filename.c_str(), F_OK) != 0) {
+                return false;
+        }
+        size_t length;
+        void* ptr = map_file(filename, length);
+        if (length < 48) {
+                if (ptr) {
+                        munmap(ptr, length);
+                }
+                return false;
+        }
+        boost::shared_ptr<void> mapping(new data_tfbs_mapping_t(ptr, length));
+        const char* data = static_cast<const char*>(ptr);
+
+        if (memcmp(data, cache_magic, sizeof(cache_magic)) != 0 ||
+            read_uint32(data+4) != cache_version ||
+            memcmp(data+8, key.data(), key.size()) != 0) {
+                return false;
+        }
+        const uint64_t n = read_uint64(data+40);
+        // size of the header
+        const uint64_t offset = 48 + 8*(n+1);
+
+        vector<size_t> offsets;
+        // a truncated cache is recomputed like any other
+        // inconsistent cache
+        if (n > length/8 || offset > length || !read_offsets(data + 48, n, offsets) ||
+            offsets[n] > (length - offset)/sizeof(double)) {
+                return false;
+        }
+        const double* begin = reinterpret_cast<const double*>(data + offset);
+
+        marginal = sequence_data_t<double>(begin, offsets, mapping);
+
+        return true;
+}
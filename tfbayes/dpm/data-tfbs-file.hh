@@ -0,0 +1,96 @@
+/* Copyright (C) 2013 Philipp Benner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __TFBAYES_DPM_DATA_TFBS_FILE_HH__
+#define __TFBAYES_DPM_DATA_TFBS_FILE_HH__
+
+#ifdef HAVE_CONFIG_H
+#include <tfbayes/config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <string>
+#include <vector>
+
+#include <tfbayes/dpm/data.hh>
+#include <tfbayes/dpm/data-tfbs.hh>
+#include <tfbayes/utility/sha256.hh>
+
+// Binary data files contain the approximated counts of an alignment
+// (see tfbayes-approximate) in a form that can be mapped into memory
+// and used without any parsing. Pages of the mapping are shared
+// with the page cache as long as they are not modified, so several
+// samplers on the same machine use a single copy of the data.
+//
+// The file starts with the magic string "TFBD", the format version
+// (uint32), the alphabet size (uint32), four bytes of padding, the
+// number of sequences n (uint64), and n+1 offsets (uint64), which
+// give the position of the first element of each sequence, where the
+// last offset is the total number of positions. The header is
+// followed by the counts of all positions (alphabet size doubles
+// each), which are aligned to eight bytes.
+//
+// All numbers are stored in little endian byte order.
+////////////////////////////////////////////////////////////////////////////////
+
+void save_data_tfbs_file(const std::string& filename, const sequence_data_t<data_tfbs_t::code_t>& data);
+
+bool is_data_tfbs_file(const std::string& filename);
+
+// map the file into memory, the mapping is released when the
+// returned data and all of its copies are destroyed
+sequence_data_t<data_tfbs_t::code_t> map_data_tfbs_file(const std::string& filename);
+
+// Background cache files contain the precomputed marginal likelihood
+// of every position under a background model. A cache is identified
+// by a key, which is the SHA-256 of the model id, the parameters of
+// the prior, and the data (offsets and counts), so that a cache is
+// reused only for exactly the same input.
+//
+// The file starts with the magic string "TFBG" (column caches use
+// "TFBC"), the format version (uint32), the key (32 bytes), the
+// number of sequences n (uint64), and n+1 offsets (uint64) as in data
+// files. The header is followed by the marginals of all positions
+// (one double each).
+////////////////////////////////////////////////////////////////////////////////
+
+typedef sha256_t::digest_t background_cache_key_t;
+
+background_cache_key_t background_cache_key(
+        const std::string& id,
+        const std::vector<double>& parameters,
+        const sequence_data_t<data_tfbs_t::code_t>& data);
+
+// name of the cache file, if the given path is a directory the
+// file is named after the key, otherwise the path is used as it is
+std::string background_cache_file(const std::string& path, const background_cache_key_t& key);
+
+// the file is written to a temporary file first and renamed
+// afterwards, so that concurrent processes never see a partial
+// cache; returns false if the file could not be written
+bool save_background_cache(
+        const std::string& filename,
+        const background_cache_key_t& key,
+        const sequence_data_t<double>& marginal);
+
+// map the marginals into memory, returns false if the file does not
+// exist or belongs to a different key
+bool map_background_cache(
+        const std::string& filename,
+        const background_cache_key_t& key,
+        sequence_data_t<double>& marginal);
+
+#endif /* __TFBAYES_DPM_DATA_TFBS_FILE_HH__ */
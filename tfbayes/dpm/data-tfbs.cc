@@ -33,33 +33,24 @@
 
 #include <tfbayes/fasta/fasta.hh>
 #include <tfbayes/dpm/data-tfbs.hh>
+#include <tfbayes/dpm/data-tfbs-file.hh>
+#include <tfbayes/utility/boost-random-shuffle.hh>
+#include <tfbayes/utility/random.hh>
 
 using namespace std;
 
 const alphabet_t data_tfbs_t::alphabet = nucleotide_alphabet_t();
 
 data_tfbs_t::data_tfbs_t(const string& phylogenetic_input)
-        : sequence_data_t<code_t>(read_fasta(phylogenetic_input)),
+        : sequence_data_t<code_t>(read(phylogenetic_input)),
           _n_sequences(size()),
           _elements(0)
 {
-        _complements = sequence_data_t<code_t>(*this);
-        // compute complements
+        // add indices, only const accessors are used so that a
+        // memory mapped buffer is not copied
         for(size_t i = 0; i < _n_sequences; i++) {
                 // loop over elements in a sequence
-                for(size_t j = 0; j < operator[](i).size(); j++) {
-                        // generate an index of this position
-                        index_t index(i,j);
-                        for (size_t k = 0; k < alphabet_size; k++) {
-                                _complements[index][alphabet.complement(k)]
-                                        = operator[](index)[k];
-                        }
-                }
-        }
-        // add indices
-        for(size_t i = 0; i < _n_sequences; i++) {
-                // loop over elements in a sequence
-                for(size_t j = 0; j < operator[](i).size(); j++) {
+                for(size_t j = 0; j < size(i); j++) {
                         // generate an index of this position
                         index_t index(i,j);
                         // push a new index to the list of indices
@@ -71,23 +62,32 @@ data_tfbs_t::data_tfbs_t(const string& phylogenetic_input)
                 // increment the number of nucleotides
                 _elements++;
         }
-        shuffle();
+        // the sampling indices are not shuffled here, since the
+        // data is constructed before the global seed is set; the
+        // samplers shuffle their own copy in every sweep
 }
 
 void
 data_tfbs_t::shuffle() {
-        random_shuffle(sampling_indices.begin(), sampling_indices.end());
-}
-
-const sequence_data_t<__CODE_TYPE__>&
-data_tfbs_t::complements() const
-{
-        return _complements;
+        // seeded from the global seed, so that runs with a fixed
+        // seed are reproducible
+        rng_t gen;
+        seed_rng(gen);
+        boost::random::random_shuffle(sampling_indices.begin(), sampling_indices.end(), gen);
 }
 
 #include <boost/regex.hpp>
 #include <tfbayes/utility/strtools.hh>
 
+sequence_data_t<data_tfbs_t::code_t>
+data_tfbs_t::read(const string& file_name)
+{
+        if (is_data_tfbs_file(file_name)) {
+                return map_data_tfbs_file(file_name);
+        }
+        return read_fasta(file_name);
+}
+
 sequence_data_t<data_tfbs_t::code_t>
 data_tfbs_t::read_fasta(const string& file_name)
 {
@@ -77,16 +77,26 @@ public:
         ////////////////////////////////////////////////////////////////////////
         size_t elements() const { return _elements; };
         void shuffle();
-        const sequence_data_t<__CODE_TYPE__>& complements() const;
 
+        // the complementary strand is not stored, instead entries
+        // are complemented when they are accessed
+        static code_t complement(const code_t& entry) {
+                code_t result;
+                for (size_t k = 0; k < alphabet_size; k++) {
+                        result[alphabet.complement(k)] = entry[k];
+                }
+                return result;
+        }
+
+        // read either a binary data file or the output of
+        // tfbayes-approximate
+        static sequence_data_t<data_tfbs_t::code_t> read(const std::string& file_name);
         static sequence_data_t<data_tfbs_t::code_t> read_fasta(const std::string& file_name);
 
 private:
         // all nucleotide positions in a vector (used for the gibbs sampler)
         std::vector<index_t> indices;
         std::vector<index_t> sampling_indices;
-        // complements
-        sequence_data_t<__CODE_TYPE__> _complements;
 
         // number of sequences and nucleotides
         size_t _n_sequences;
@@ -26,12 +26,15 @@
 #include <vector>
 #include <string>
 #include <algorithm>
+#include <cassert>
 
 #include <tfbayes/dpm/index.hh>
 #include <tfbayes/dpm/datatypes.hh>
 #include <tfbayes/utility/clonable.hh>
 
+#include <boost/shared_ptr.hpp>
 #include <boost/serialization/base_object.hpp>
+#include <boost/serialization/split_member.hpp>
 #include <boost/serialization/vector.hpp>
 
 // data_t and iterator_t
@@ -198,38 +201,118 @@ private:
         }
 };
 
+// Sequence data is stored in a single contiguous buffer, where the
+// offset table gives the position of the first element of each
+// sequence in the buffer (the last entry is the total number of
+// elements). The element() accessors are not virtual and should be
+// used in inner loops where the type of the data is known.
+//
+// The buffer may also be owned by another object, e.g. a read-only
+// memory mapped file. Such buffers are shared between copies and
+// are never modified, instead the data is copied to the storage
+// of this object before the first non-const access.
 template <typename T>
-class sequence_data_t : public data_i<T>, public std::vector<std::vector<T> >
+class sequence_data_t : public data_i<T>
 {
 public:
-        typedef std::vector<std::vector<T> > base_t;
         typedef typename data_i<T>::iterator_t iterator_t;
         typedef typename data_i<T>::const_iterator_t const_iterator_t;
-        using base_t::size;
-        using base_t::push_back;
-        using base_t::operator[];
-        using base_t::operator=;
+        // iterators over all elements of all sequences, i.e. the
+        // linear index of an element is its position in the buffer
+        typedef T* linear_iterator;
+        typedef const T* const_linear_iterator;
 
-        sequence_data_t() : base_t() {
+        // view on a single sequence
+        template <typename S>
+        class basic_row_t {
+        public:
+                basic_row_t(S* ptr, size_t n)
+                        : m_ptr(ptr), m_size(n)
+                        { }
+                S& operator[](size_t j) const {
+                        return m_ptr[j];
+                }
+                size_t size() const {
+                        return m_size;
+                }
+                S* begin() const {
+                        return m_ptr;
+                }
+                S* end() const {
+                        return m_ptr + m_size;
+                }
+                operator std::vector<T>() const {
+                        return std::vector<T>(begin(), end());
+                }
+        protected:
+                S* m_ptr;
+                size_t m_size;
+        };
+        typedef basic_row_t<T> row_t;
+        typedef basic_row_t<const T> const_row_t;
+
+        sequence_data_t()
+                : m_offsets(1, 0)
+                , m_ptr    (NULL) {
         }
         sequence_data_t(const std::vector<size_t> n, const T init)
-                : base_t() {
+                : m_offsets(1, 0) {
                 for (size_t i = 0; i < n.size(); i++) {
-                        push_back(std::vector<T>(n[i], init));
+                        m_offsets.push_back(m_offsets.back() + n[i]);
                 }
+                m_data.resize(m_offsets.back(), init);
+                m_ptr = m_begin();
+        }
+        // use a read-only buffer that is owned by another object,
+        // which is kept alive as long as this object or any of its
+        // copies exist
+        sequence_data_t(const T* data, const std::vector<size_t>& offsets, boost::shared_ptr<void> owner)
+                : m_offsets(offsets)
+                , m_ptr    (const_cast<T*>(data))
+                , m_owner  (owner) {
+                assert(m_offsets.size() > 0 && m_offsets[0] == 0);
         }
         sequence_data_t(const sequence_data_t& sequence_data)
-                : base_t(sequence_data)
+                : m_data   (sequence_data.m_data)
+                , m_offsets(sequence_data.m_offsets)
+                , m_ptr    (sequence_data.m_owner ? sequence_data.m_ptr : m_begin())
+                , m_owner  (sequence_data.m_owner)
                 { }
 
         virtual sequence_data_t<T>* clone() const {
                 return new sequence_data_t<T>(*this);
         }
 
+        friend void swap(sequence_data_t& first, sequence_data_t& second) {
+                using std::swap;
+                swap(first.m_data,    second.m_data);
+                swap(first.m_offsets, second.m_offsets);
+                swap(first.m_ptr,     second.m_ptr);
+                swap(first.m_owner,   second.m_owner);
+        }
         sequence_data_t& operator=(const sequence_data_t& sequence_data) {
-                base_t::operator=(sequence_data);
+                sequence_data_t tmp(sequence_data);
+                swap(*this, tmp);
                 return *this;
         }
+        // append a sequence, external buffers are copied first
+        void push_back(const std::vector<T>& sequence) {
+                m_detach();
+                m_data.insert(m_data.end(), sequence.begin(), sequence.end());
+                m_offsets.push_back(m_data.size());
+                m_ptr = m_begin();
+        }
+        // number of sequences
+        size_t size() const {
+                return m_offsets.size() - 1;
+        }
+        inline row_t operator[](size_t i) {
+                m_detach();
+                return row_t(m_ptr + m_offsets[i], m_offsets[i+1] - m_offsets[i]);
+        }
+        inline const_row_t operator[](size_t i) const {
+                return const_row_t(m_ptr + m_offsets[i], m_offsets[i+1] - m_offsets[i]);
+        }
         virtual inline const_iterator_t operator[](const range_t& range) const GCC_ATTRIBUTE_HOT {
                 return const_iterator_t(*this, range.index(), range.length());
         }
@@ -237,28 +320,102 @@ public:
                 return iterator_t(*this, range.index(), range.length());
         }
         virtual inline const T& operator[](const index_t& index) const GCC_ATTRIBUTE_HOT {
-                return base_t::operator[](index[0])[index[1]];
+                return element(index);
         }
         virtual inline T& operator[](const index_t& index) GCC_ATTRIBUTE_HOT {
-                return base_t::operator[](index[0])[index[1]];
+                return element(index);
+        }
+        inline const T& element(const index_t& index) const {
+                return m_ptr[linear_index(index)];
+        }
+        inline T& element(const index_t& index) {
+                m_detach();
+                return m_ptr[linear_index(index)];
+        }
+        inline size_t linear_index(const index_t& index) const {
+                return m_offsets[index[0]] + index[1];
+        }
+        // total number of elements
+        size_t linear_size() const {
+                return m_offsets.back();
+        }
+        linear_iterator linear_begin() {
+                m_detach();
+                return m_ptr;
+        }
+        linear_iterator linear_end() {
+                m_detach();
+                return m_ptr + linear_size();
+        }
+        const_linear_iterator linear_begin() const {
+                return m_ptr;
+        }
+        const_linear_iterator linear_end() const {
+                return m_ptr + linear_size();
+        }
+        const std::vector<size_t>& offsets() const {
+                return m_offsets;
+        }
+        // true if the data is still in a buffer owned by another
+        // object, i.e. it was not yet copied
+        bool external() const {
+                return m_owner.get() != NULL;
         }
         virtual size_t size(size_t i) const {
-                return operator[](i).size();
+                return m_offsets[i+1] - m_offsets[i];
         }
         virtual std::vector<size_t> sizes() const {
                 std::vector<size_t> lengths;
                 for (size_t i = 0; i < size(); i++) {
-                        lengths.push_back(operator[](i).size());
+                        lengths.push_back(size(i));
                 }
                 return lengths;
         }
         friend std::ostream& operator<< <> (std::ostream& o, const sequence_data_t<T>& sd);
 private:
+        T* m_begin() {
+                return m_data.empty() ? NULL : &m_data[0];
+        }
+        // copy an external buffer before it is modified
+        void m_detach() {
+                if (m_owner) {
+                        m_data.assign(m_ptr, m_ptr + linear_size());
+                        m_owner.reset();
+                        m_ptr = m_begin();
+                }
+        }
+        // storage, which is empty if an external buffer is used
+        std::vector<T> m_data;
+        std::vector<size_t> m_offsets;
+        // pointer to the first element of either the storage or
+        // the external buffer, which must not be written to
+        T* m_ptr;
+        boost::shared_ptr<void> m_owner;
+
+        // the data is serialized as a vector of sequences to remain
+        // compatible with existing files
         friend class boost::serialization::access;
         template<class Archive>
-        void serialize(Archive & ar, const unsigned int version) {
-                ar & boost::serialization::base_object<base_t>(*this);
+        void save(Archive & ar, const unsigned int version) const {
+                std::vector<std::vector<T> > sequences;
+                for (size_t i = 0; i < size(); i++) {
+                        sequences.push_back(operator[](i));
+                }
+                ar & sequences;
+        }
+        template<class Archive>
+        void load(Archive & ar, const unsigned int version) {
+                std::vector<std::vector<T> > sequences;
+                ar & sequences;
+                m_data.clear();
+                m_offsets.assign(1, 0);
+                m_owner.reset();
+                for (size_t i = 0; i < sequences.size(); i++) {
+                        push_back(sequences[i]);
+                }
+                m_ptr = m_begin();
         }
+        BOOST_SERIALIZATION_SPLIT_MEMBER()
 };
 
 #endif /* __TFBAYES_DPM_DATA_HH__ */
@@ -54,7 +54,8 @@ struct model_id_t {
 
 typedef enum {
         cluster_event_empty, cluster_event_nonempty,
-        cluster_event_add_word, cluster_event_remove_word
+        cluster_event_add_word, cluster_event_remove_word,
+        cluster_event_update
 } cluster_event_t;
 
 #endif /* __TFBAYES_DPM_DATATYPES_HH__ */
@@ -0,0 +1,353 @@
+/* Copyright (C) 2013 Philipp Benner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <tfbayes/config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <algorithm>
+#include <cassert>
+
+#include <boost/unordered/unordered_set.hpp>
+#include <boost/numeric/ublas/matrix_sparse.hpp>
+
+#include <tfbayes/dpm/dpm-partition-distance.hh>
+#include <tfbayes/dpm/dpm-tfbs.hh>
+
+using namespace std;
+
+// utilities for computing distances
+// -----------------------------------------------------------------------------
+
+static void
+init_data(const dpm_partition_t& partition, sequence_data_t<cluster_tag_t>& data)
+{
+        /* Cluster labeling convention:
+         * The kth cluster gets all labels from k*foreground_length + 1 to
+         * k*foreground_length + foreground_length. Hence, each site in a
+         * cluster gets a unique label. The label 0 is reserved for
+         * the background */
+        cluster_tag_t k = 0;
+
+        for (dpm_partition_t::const_iterator it = partition.begin();
+             it != partition.end(); it++, k++) {
+                for (dpm_subset_t::const_iterator is = it->begin();
+                     is != it->end(); is++) {
+                        const index_t& index = is->index();
+                        for (size_t i = 0; i < is->length(); i++) {
+                                data[index[0]][index[1]+i] = k*is->length()+i+1;
+                        }
+                }
+        }
+}
+
+static void
+clean_data(const dpm_partition_t& partition, sequence_data_t<cluster_tag_t>& data)
+{
+        for (dpm_partition_t::const_iterator it = partition.begin();
+             it != partition.end(); it++) {
+                for (dpm_subset_t::const_iterator is = it->begin();
+                     is != it->end(); is++) {
+                        const index_t& index = is->index();
+                        for (size_t i = 0; i < is->length(); i++) {
+                                data[index[0]][index[1]+i] = 0;
+                        }
+                }
+        }
+}
+
+// naive distance function (for debugging purposes)
+// -----------------------------------------------------------------------------
+
+GCC_ATTRIBUTE_UNUSED
+static size_t
+naive_distance(const dpm_partition_t& pi_a,
+               const dpm_partition_t& pi_b,
+               sequence_data_t<cluster_tag_t>& a,
+               sequence_data_t<cluster_tag_t>& b,
+               const dpm_tfbs_t& dpm)
+{
+        boost::unordered_set<index_t> indices;
+        // resulting distance
+        size_t d = 0;
+
+        // initialize auxiliary cluster information
+        init_data(pi_a, a);
+        init_data(pi_b, b);
+
+        for (indexer_t::const_iterator it = dpm.data().begin();
+             it != dpm.data().end(); it++) {
+                for (indexer_t::const_iterator is = it+1;
+                     is != dpm.data().end(); is++) {
+                        const index_t& i = *it;
+                        const index_t& j = *is;
+                        if ((a[i] == a[j] && b[i] != b[j]) ||
+                            (a[i] != a[j] && b[i] == b[j])) {
+                                d += 1;
+                        }
+                }
+        }
+
+        // clean data
+        clean_data(pi_a, a);
+        clean_data(pi_b, b);
+
+        return d;
+}
+
+// a slightly less naive implementation of a distance function
+// bug still quadratic in the number of foreground indices!
+// -----------------------------------------------------------------------------
+
+GCC_ATTRIBUTE_UNUSED
+static size_t
+distance1(const boost::unordered_set<index_t>& indices,
+          const sequence_data_t<cluster_tag_t>& a,
+          const sequence_data_t<cluster_tag_t>& b,
+          size_t bg_size)
+{
+        size_t d = 0, bg = 0;
+
+        for (boost::unordered_set<index_t>::const_iterator it = indices.begin();
+             it != indices.end(); it++) {
+                for (boost::unordered_set<index_t>::const_iterator is = it;
+                     is != indices.end(); is++) {
+                        if ((a[*it] == a[*is] && b[*it] != b[*is]) ||
+                            (a[*it] != a[*is] && b[*it] == b[*is])) {
+                                d++;
+                        }
+                }
+                if (a[*it] == 0 || b[*it] == 0) {
+                        bg++;
+                }
+        }
+        return d + bg*bg_size;
+}
+
+// highly optimized distance function (formulas can be found in
+// Lawrence Hubert. Comparing Partitions. Journal of
+// Classification, 1985)
+// -----------------------------------------------------------------------------
+
+static double
+distance2(const vector<index_t>& indices,
+          const dpm_partition_t& pi_a,
+          const dpm_partition_t& pi_b,
+          const sequence_data_t<cluster_tag_t>& a,
+          const sequence_data_t<cluster_tag_t>& b,
+          size_t bg_size)
+{
+        // boost sparse matrices
+        using namespace boost::numeric::ublas;
+
+        // resulting distance
+        double result = 0;
+
+        // number of clusters
+        size_t la = 1; // start at one for the
+        size_t lb = 1; // background model
+        for (dpm_partition_t::const_iterator it = pi_a.begin();
+             it != pi_a.end(); it++) {
+                la += it->begin()->length();
+        }
+        for (dpm_partition_t::const_iterator it = pi_b.begin();
+             it != pi_b.end(); it++) {
+                lb += it->begin()->length();
+        }
+
+        // contingency table
+        mapped_matrix<double> m(la, lb);
+        std::vector<double> ma(la, 0.0);
+        std::vector<double> mb(lb, 0.0);
+
+        for (std::vector<index_t>::const_iterator it = indices.begin();
+             it != indices.end(); it++) {
+                m(a[*it], b[*it]) += 1.0;
+                ma[a[*it]] += 1.0;
+                mb[b[*it]] += 1.0;
+        }
+
+        // compute distance from contingency table
+        for (size_t i = 0; i < la; i++) {
+                result += 1.0/2.0*ma[i]*ma[i];
+        }
+        for (size_t j = 0; j < lb; j++) {
+                result += 1.0/2.0*mb[j]*mb[j];
+        }
+        for (mapped_matrix<double>::const_iterator1 it = m.begin1();
+             it != m.end1(); it++) {
+                for (mapped_matrix<double>::const_iterator2 is = it.begin();
+                     is != it.end(); is++) {
+                        result -= (*is)*(*is);
+                }
+        }
+        return result + (ma[0]+mb[0])*bg_size;
+}
+
+static void
+init_sites(const dpm_partition_t& partition, vector<index_t>& sites)
+{
+        for (dpm_partition_t::const_iterator it = partition.begin();
+             it != partition.end(); it++) {
+                for (dpm_subset_t::const_iterator is = it->begin();
+                     is != it->end(); is++) {
+                        const index_t& tmp = is->index();
+                        for (size_t i = 0; i < is->length(); i++) {
+                                sites.push_back(index_t(tmp[0], tmp[1]+i));
+                        }
+                }
+        }
+}
+
+double
+partition_distance_dense(const dpm_partition_t& pi_a,
+                         const dpm_partition_t& pi_b,
+                         sequence_data_t<cluster_tag_t>& a,
+                         sequence_data_t<cluster_tag_t>& b,
+                         size_t elements)
+{
+        // set of indices that are actually used in clusters
+        vector<index_t> indices;
+
+        // initialize auxiliary cluster information
+        init_data(pi_a, a);
+        init_data(pi_b, b);
+
+        // record all positions that are assigned to a cluster
+        init_sites(pi_a, indices);
+        init_sites(pi_b, indices);
+        sort(indices.begin(), indices.end());
+        indices.erase(unique(indices.begin(), indices.end()), indices.end());
+
+        // size of the background cluster
+        size_t bg_size = elements - indices.size();
+
+        // compute the distance
+        double d = distance2(indices, pi_a, pi_b, a, b, bg_size);
+
+        // clean data
+        clean_data(pi_a, a);
+        clean_data(pi_b, b);
+
+        return d;
+}
+
+// distance by a linear merge of sorted labels
+// -----------------------------------------------------------------------------
+
+static bool
+site_less(const partition_labels_t::sites_t::value_type& a,
+          const partition_labels_t::sites_t::value_type& b)
+{
+        return a.first < b.first;
+}
+
+static bool
+site_equal(const partition_labels_t::sites_t::value_type& a,
+           const partition_labels_t::sites_t::value_type& b)
+{
+        return a.first == b.first;
+}
+
+partition_labels_t::partition_labels_t()
+        : m_sites  ()
+        , m_squares(0.0)
+{ }
+
+partition_labels_t::partition_labels_t(const dpm_partition_t& partition)
+        : m_sites  ()
+        , m_squares(0.0)
+{
+        // number of positions with a specific label
+        vector<double> counts(1, 0.0);
+        cluster_tag_t k = 0;
+
+        for (dpm_partition_t::const_iterator it = partition.begin();
+             it != partition.end(); it++, k++) {
+                for (dpm_subset_t::const_iterator is = it->begin();
+                     is != it->end(); is++) {
+                        const index_t& index = is->index();
+                        for (size_t i = 0; i < is->length(); i++) {
+                                const cluster_tag_t label = k*is->length()+i+1;
+                                m_sites.push_back(make_pair(index_t(index[0], index[1]+i), label));
+                        }
+                }
+        }
+        stable_sort(m_sites.begin(), m_sites.end(), site_less);
+        m_sites.erase(unique(m_sites.begin(), m_sites.end(), site_equal), m_sites.end());
+
+        for (sites_t::const_iterator it = m_sites.begin(); it != m_sites.end(); it++) {
+                if (static_cast<size_t>(it->second) >= counts.size()) {
+                        counts.resize(it->second+1, 0.0);
+                }
+                counts[it->second] += 1.0;
+        }
+        for (size_t i = 0; i < counts.size(); i++) {
+                m_squares += counts[i]*counts[i];
+        }
+}
+
+double
+partition_distance(const partition_labels_t& a,
+                   const partition_labels_t& b,
+                   size_t elements,
+                   vector<uint64_t>& scratch)
+{
+        typedef partition_labels_t::sites_t::const_iterator iterator;
+
+        const partition_labels_t::sites_t& sites_a = a.sites();
+        const partition_labels_t::sites_t& sites_b = b.sites();
+
+        // number of positions that are assigned to the background in
+        // only one of both partitions
+        double ma0 = 0.0;
+        double mb0 = 0.0;
+
+        // collect pairs of labels of all positions that are used
+        // in at least one partition
+        scratch.clear();
+        iterator it = sites_a.begin();
+        iterator is = sites_b.begin();
+        while (it != sites_a.end() || is != sites_b.end()) {
+                uint64_t la = 0, lb = 0;
+                if (is == sites_b.end() || (it != sites_a.end() && it->first < is->first)) {
+                        la = (it++)->second; mb0 += 1.0;
+                }
+                else if (it == sites_a.end() || is->first < it->first) {
+                        lb = (is++)->second; ma0 += 1.0;
+                }
+                else {
+                        la = (it++)->second;
+                        lb = (is++)->second;
+                }
+                scratch.push_back(la << 32 | lb);
+        }
+        // size of the background cluster
+        const double bg_size = elements - scratch.size();
+
+        // entries of the contingency table are the lengths of runs
+        // of equal label pairs
+        double m = 0.0;
+        sort(scratch.begin(), scratch.end());
+        for (size_t i = 0, j = 0; i < scratch.size(); i = j) {
+                for (j = i+1; j < scratch.size() && scratch[j] == scratch[i]; j++);
+                m += static_cast<double>(j-i)*(j-i);
+        }
+        return 1.0/2.0*(a.squares() + ma0*ma0)
+             + 1.0/2.0*(b.squares() + mb0*mb0)
+             - m + (ma0+mb0)*bg_size;
+}
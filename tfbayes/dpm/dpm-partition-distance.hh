@@ -0,0 +1,84 @@
+/* Copyright (C) 2013 Philipp Benner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __TFBAYES_DPM_DPM_PARTITION_DISTANCE_HH__
+#define __TFBAYES_DPM_DPM_PARTITION_DISTANCE_HH__
+
+#ifdef HAVE_CONFIG_H
+#include <tfbayes/config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <utility>
+#include <vector>
+#include <stdint.h>
+
+#include <tfbayes/dpm/data.hh>
+#include <tfbayes/dpm/datatypes.hh>
+#include <tfbayes/dpm/dpm-partition.hh>
+
+// Distances between partitions count the pairs of positions that
+// are in the same cluster in one partition but not in the other
+// (formulas can be found in Lawrence Hubert. Comparing
+// Partitions. Journal of Classification, 1985).
+//
+// Cluster labeling convention: The kth cluster gets all labels from
+// k*foreground_length + 1 to k*foreground_length +
+// foreground_length. Hence, each site in a cluster gets a unique
+// label. The label 0 is reserved for the background.
+////////////////////////////////////////////////////////////////////////////////
+
+// a partition given as a list of all positions that are assigned to
+// a cluster together with their labels, sorted by position
+class partition_labels_t {
+public:
+        typedef std::vector<std::pair<index_t, cluster_tag_t> > sites_t;
+
+        partition_labels_t();
+        partition_labels_t(const dpm_partition_t& partition);
+
+        const sites_t& sites() const {
+                return m_sites;
+        }
+        // sum of the squared number of positions with the same label
+        double squares() const {
+                return m_squares;
+        }
+
+protected:
+        sites_t m_sites;
+        double  m_squares;
+};
+
+// compute the contingency table of two partitions by a linear merge
+// of their labels, where elements is the total number of positions
+// in the data set; the scratch buffer can be reused between calls
+// to avoid allocations
+double partition_distance(const partition_labels_t& a,
+                          const partition_labels_t& b,
+                          size_t elements,
+                          std::vector<uint64_t>& scratch);
+
+// reference implementation that assigns labels in the auxiliary
+// arrays a and b, which must be zero everywhere and are reset
+// before returning
+double partition_distance_dense(const dpm_partition_t& pi_a,
+                                const dpm_partition_t& pi_b,
+                                sequence_data_t<cluster_tag_t>& a,
+                                sequence_data_t<cluster_tag_t>& b,
+                                size_t elements);
+
+#endif /* __TFBAYES_DPM_DPM_PARTITION_DISTANCE_HH__ */
@@ -0,0 +1,371 @@
+/* Copyright (C) 2013 Philipp Benner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <tfbayes/config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <stdint.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <boost/format.hpp>
+
+#include <tfbayes/dpm/dpm-partition-file.hh>
+#include <tfbayes/utility/little-endian.hh>
+
+using namespace std;
+
+// encoding of numbers
+////////////////////////////////////////////////////////////////////////////////
+
+static
+void write_varint(string& buffer, uint64_t x)
+{
+        while (x >= 0x80) {
+                buffer.push_back(static_cast<char>((x & 0x7F) | 0x80));
+                x >>= 7;
+        }
+        buffer.push_back(static_cast<char>(x));
+}
+
+// reader that checks all accesses against the end of the buffer
+class partition_reader_t {
+public:
+        partition_reader_t(const char* begin, const char* end, const string& filename)
+                : m_pos(begin), m_end(end), m_filename(filename)
+                { }
+
+        uint32_t uint32() {
+                m_check(4);
+                uint32_t x = read_uint32(m_pos);
+                m_pos += 4;
+                return x;
+        }
+        uint64_t uint64() {
+                m_check(8);
+                uint64_t x = read_uint64(m_pos);
+                m_pos += 8;
+                return x;
+        }
+        uint64_t varint() {
+                uint64_t x = 0;
+                for (size_t shift = 0; shift < 64; shift += 7) {
+                        m_check(1);
+                        const unsigned char c = *m_pos++;
+                        x |= static_cast<uint64_t>(c & 0x7F) << shift;
+                        if (!(c & 0x80)) {
+                                return x;
+                        }
+                }
+                m_error();
+                return 0;
+        }
+        string str(size_t n) {
+                m_check(n);
+                string s(m_pos, n);
+                m_pos += n;
+                return s;
+        }
+        const char* pos() const {
+                return m_pos;
+        }
+        size_t remaining() const {
+                return m_end - m_pos;
+        }
+protected:
+        void m_check(size_t n) const {
+                if (static_cast<size_t>(m_end - m_pos) < n) {
+                        m_error();
+                }
+        }
+        void m_error() const {
+                throw runtime_error(boost::str(boost::format("Partition file `%s' is corrupt.") % m_filename));
+        }
+        const char* m_pos;
+        const char* m_end;
+        const string& m_filename;
+};
+
+// writer
+////////////////////////////////////////////////////////////////////////////////
+
+static
+bool range_less(const range_t& a, const range_t& b)
+{
+        if (a.index()[0] != b.index()[0]) return a.index()[0] < b.index()[0];
+        if (a.index()[1] != b.index()[1]) return a.index()[1] < b.index()[1];
+        return a.reverse() < b.reverse();
+}
+
+static
+void encode_subset(string& buffer, const dpm_subset_t& subset, size_t model_index)
+{
+        vector<range_t> ranges(subset.begin(), subset.end());
+        bool lengths = false;
+
+        sort(ranges.begin(), ranges.end(), range_less);
+
+        for (size_t i = 0; i < ranges.size(); i++) {
+                if (ranges[i].length() != subset.model_id().length) {
+                        lengths = true;
+                }
+        }
+        write_varint(buffer, model_index);
+        write_varint(buffer, ranges.size());
+        write_varint(buffer, lengths);
+
+        uint64_t sequence = 0;
+        uint64_t position = 0;
+        for (size_t i = 0; i < ranges.size(); i++) {
+                const uint64_t s = ranges[i].index()[0];
+                const uint64_t p = ranges[i].index()[1];
+                write_varint(buffer, s - sequence);
+                if (s != sequence) {
+                        position = 0;
+                }
+                write_varint(buffer, 2*(p - position) + ranges[i].reverse());
+                if (lengths) {
+                        write_varint(buffer, ranges[i].length());
+                }
+                sequence = s;
+                position = p;
+        }
+}
+
+void save_partition_list(const string& filename, const dpm_partition_list_t& partition_list)
+{
+        typedef map<pair<string, size_t>, size_t> model_table_t;
+        model_table_t table;
+        vector<model_id_t> model_ids;
+
+        // collect all model ids
+        for (size_t k = 0; k < partition_list.size(); k++) {
+                for (dpm_partition_t::const_iterator it = partition_list[k].begin();
+                     it != partition_list[k].end(); it++) {
+                        const model_id_t model_id = it->model_id();
+                        const pair<string, size_t> key(model_id.name, model_id.length);
+                        if (table.find(key) == table.end()) {
+                                table[key] = model_ids.size();
+                                model_ids.push_back(model_id);
+                        }
+                }
+        }
+        // encode partitions
+        string data;
+        vector<uint64_t> offsets;
+        for (size_t k = 0; k < partition_list.size(); k++) {
+                offsets.push_back(data.size());
+                write_varint(data, partition_list[k].size());
+                for (dpm_partition_t::const_iterator it = partition_list[k].begin();
+                     it != partition_list[k].end(); it++) {
+                        const model_id_t model_id = it->model_id();
+                        encode_subset(data, *it, table[make_pair(model_id.name, model_id.length)]);
+                }
+        }
+        offsets.push_back(data.size());
+        // header
+        string header(partition_file_t::magic, sizeof(partition_file_t::magic));
+        write_uint32(header, partition_file_t::version);
+        write_uint32(header, model_ids.size());
+        for (size_t i = 0; i < model_ids.size(); i++) {
+                write_uint32(header, model_ids[i].name.size());
+                header.append(model_ids[i].name);
+                write_uint32(header, model_ids[i].length);
+        }
+        write_uint64(header, partition_list.size());
+        // offsets are relative to the beginning of the file
+        const uint64_t base = header.size() + 8*offsets.size();
+        for (size_t k = 0; k < offsets.size(); k++) {
+                write_uint64(header, base + offsets[k]);
+        }
+        ofstream file(filename.c_str(), ios::out | ios::binary | ios::trunc);
+        file.write(header.data(), header.size());
+        file.write(data  .data(), data  .size());
+        file.close();
+        if (!file) {
+                throw runtime_error(boost::str(boost::format("Could not write partition file `%s'.") % filename));
+        }
+}
+
+bool is_partition_file(const string& filename)
+{
+        ifstream file(filename.c_str(), ios::in | ios::binary);
+        char buffer[8];
+
+        if (!file.read(buffer, 8)) {
+                return false;
+        }
+        return memcmp(buffer, partition_file_t::magic, sizeof(partition_file_t::magic)) == 0 &&
+                read_uint32(buffer+4) == partition_file_t::version;
+}
+
+// partition_file_t
+////////////////////////////////////////////////////////////////////////////////
+
+const char partition_file_t::magic[4] = { 'T', 'F', 'B', 'P' };
+
+partition_file_t::partition_file_t(const string& filename)
+        : m_filename(filename)
+        , m_data    (NULL)
+        , m_length  (0)
+        , m_size    (0)
+        , m_offsets (NULL)
+{
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd == -1) {
+                throw runtime_error(boost::str(boost::format("Could not open file `%s': %s")
+                                        % filename % strerror(errno)));
+        }
+        struct stat sb;
+        if (fstat(fd, &sb) == -1) {
+                close(fd);
+                throw runtime_error(boost::str(boost::format("Could not stat file `%s': %s")
+                                        % filename % strerror(errno)));
+        }
+        m_length = sb.st_size;
+        if (m_length > 0) {
+                void* data = mmap(NULL, m_length, PROT_READ, MAP_SHARED, fd, 0);
+                if (data == MAP_FAILED) {
+                        close(fd);
+                        throw runtime_error(boost::str(boost::format("Could not map file `%s': %s")
+                                                % filename % strerror(errno)));
+                }
+                m_data = static_cast<const char*>(data);
+        }
+        // the mapping remains valid after closing the file
+        close(fd);
+
+        try {
+                partition_reader_t reader(m_data, m_data + m_length, m_filename);
+                if (reader.str(sizeof(magic)) != string(magic, sizeof(magic)) ||
+                    reader.uint32() != version) {
+                        throw runtime_error(boost::str(boost::format("`%s' is not a partition file.") % filename));
+                }
+                for (size_t i = reader.uint32(); i > 0; i--) {
+                        model_id_t model_id;
+                        model_id.name   = reader.str(reader.uint32());
+                        model_id.length = reader.uint32();
+                        m_model_ids.push_back(model_id);
+                }
+                m_size    = reader.uint64();
+                m_offsets = reader.pos();
+                // check that the offset table is complete, without
+                // computing 8*(m_size+1), which may overflow
+                if (m_size >= static_cast<uint64_t>(m_data + m_length - m_offsets)/8) {
+                        throw runtime_error(boost::str(boost::format("Partition file `%s' is corrupt.") % m_filename));
+                }
+        }
+        catch (...) {
+                if (m_data) {
+                        munmap(const_cast<char*>(m_data), m_length);
+                }
+                throw;
+        }
+}
+
+partition_file_t::~partition_file_t()
+{
+        if (m_data) {
+                munmap(const_cast<char*>(m_data), m_length);
+        }
+}
+
+size_t
+partition_file_t::size() const
+{
+        return m_size;
+}
+
+const vector<model_id_t>&
+partition_file_t::model_ids() const
+{
+        return m_model_ids;
+}
+
+dpm_partition_t
+partition_file_t::operator[](size_t k) const
+{
+        if (k >= m_size) {
+                throw out_of_range(boost::str(boost::format("Partition %d does not exist in file `%s'.")
+                                       % k % m_filename));
+        }
+        const uint64_t begin = read_uint64(m_offsets + 8*k);
+        const uint64_t end   = read_uint64(m_offsets + 8*(k+1));
+
+        if (begin > end || end > m_length) {
+                throw runtime_error(boost::str(boost::format("Partition file `%s' is corrupt.") % m_filename));
+        }
+        partition_reader_t reader(m_data + begin, m_data + end, m_filename);
+        dpm_partition_t partition;
+
+        for (size_t i = reader.varint(); i > 0; i--) {
+                const size_t j = reader.varint();
+                if (j >= m_model_ids.size()) {
+                        throw runtime_error(boost::str(boost::format("Partition file `%s' is corrupt.") % m_filename));
+                }
+                const model_id_t& model_id = m_model_ids[j];
+                const size_t n       = reader.varint();
+                const bool   lengths = reader.varint();
+
+                // every range takes at least two bytes, which bounds
+                // the memory allocated for a corrupt file
+                if (n > reader.remaining()/2) {
+                        throw runtime_error(boost::str(boost::format("Partition file `%s' is corrupt.") % m_filename));
+                }
+                partition.push_back(dpm_subset_t(model_id));
+                dpm_subset_t& subset = partition.back();
+                subset.rehash(n);
+
+                uint64_t sequence = 0;
+                uint64_t position = 0;
+                for (size_t r = 0; r < n; r++) {
+                        const uint64_t ds = reader.varint();
+                        if (ds != 0) {
+                                position = 0;
+                        }
+                        sequence += ds;
+                        const uint64_t x = reader.varint();
+                        position += x >> 1;
+                        const size_t length = lengths ? reader.varint() : model_id.length;
+                        subset.insert(range_t(index_t(sequence, position), length, x & 1));
+                }
+        }
+        return partition;
+}
+
+dpm_partition_list_t
+partition_file_t::partition_list() const
+{
+        dpm_partition_list_t partition_list;
+
+        partition_list.reserve(m_size);
+        for (size_t k = 0; k < m_size; k++) {
+                partition_list.push_back(operator[](k));
+        }
+        return partition_list;
+}
@@ -0,0 +1,99 @@
+/* Copyright (C) 2013 Philipp Benner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __TFBAYES_DPM_DPM_PARTITION_FILE_HH__
+#define __TFBAYES_DPM_DPM_PARTITION_FILE_HH__
+
+#ifdef HAVE_CONFIG_H
+#include <tfbayes/config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <string>
+#include <vector>
+
+#include <boost/utility.hpp>
+
+#include <tfbayes/dpm/dpm-partition.hh>
+
+// Binary partition files store a list of partitions much more
+// compactly than the text format and allow to access single
+// partitions without reading the whole file.
+//
+// The file starts with the magic string "TFBP" and the format version
+// (uint32), followed by a table of all model ids that occur in the
+// partitions (uint32 number of ids, each given by the length of the
+// name (uint32), the name, and the length of the model (uint32)), the
+// number of partitions n (uint64), and n+1 offsets (uint64) of the
+// partitions relative to the beginning of the file, where the last
+// offset marks the end of the data.
+//
+// Each partition is a sequence of variable length integers (seven
+// bits per byte, least significant group first):
+//
+//   m, the number of subsets, followed by m subsets, each given by
+//     the index of the model id in the table
+//     k, the number of ranges
+//     a flag that is one if the lengths of the ranges differ from
+//     the length of the model
+//     k ranges, sorted by sequence and position, where each range is
+//     given by the difference to the sequence of the previous range,
+//     the position (or the difference to the previous position if
+//     the sequence is the same) times two plus the reverse flag, and
+//     optionally the length of the range
+//
+// Fixed size numbers are stored in little endian byte order.
+////////////////////////////////////////////////////////////////////////////////
+
+void save_partition_list(const std::string& filename, const dpm_partition_list_t& partition_list);
+
+bool is_partition_file(const std::string& filename);
+
+// the file is mapped into memory and partitions are decoded on
+// demand
+class partition_file_t : boost::noncopyable {
+public:
+         partition_file_t(const std::string& filename);
+        ~partition_file_t();
+
+        // number of partitions
+        size_t size() const;
+
+        // decode the k-th partition
+        dpm_partition_t operator[](size_t k) const;
+
+        // decode all partitions
+        dpm_partition_list_t partition_list() const;
+
+        const std::vector<model_id_t>& model_ids() const;
+
+        static const char   magic[4];
+        static const size_t version = 1;
+
+protected:
+        std::string m_filename;
+
+        const char* m_data;
+        size_t      m_length;
+
+        std::vector<model_id_t> m_model_ids;
+
+        // number of partitions and position of the offset table
+        size_t      m_size;
+        const char* m_offsets;
+};
+
+#endif /* __TFBAYES_DPM_DPM_PARTITION_FILE_HH__ */
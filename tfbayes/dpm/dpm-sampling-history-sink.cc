@@ -0,0 +1,166 @@
+/* Copyright (C) 2013 Philipp Benner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <tfbayes/config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <cstdlib>
+#include <iostream>
+#include <cstring>
+#include <stdint.h>
+#include <unistd.h>
+
+#include <boost/thread/locks.hpp>
+
+#include <tfbayes/dpm/dpm-sampling-history-sink.hh>
+#include <tfbayes/utility/little-endian.hh>
+
+using namespace std;
+
+// encoding of strings
+////////////////////////////////////////////////////////////////////////////////
+
+static
+void write_string(string& buffer, const string& str)
+{
+        write_uint32(buffer, str.size());
+        buffer.append(str);
+}
+
+// sampling_history_sink_t
+////////////////////////////////////////////////////////////////////////////////
+
+const char sampling_history_sink_t::magic[4] = { 'T', 'F', 'B', 'H' };
+
+sampling_history_sink_t::sampling_history_sink_t(const string& filename, bool append)
+{
+        streamoff size;
+
+        if (append && m_check_file(filename, size)) {
+                // remove incomplete records and append new samples
+                if (truncate(filename.c_str(), size) != 0) {
+                        cerr << "Could not truncate history file `" << filename << "'."
+                             << endl;
+                        exit(EXIT_FAILURE);
+                }
+                m_file.open(filename.c_str(), ios::out | ios::binary | ios::app);
+        }
+        else {
+                m_file.open(filename.c_str(), ios::out | ios::binary | ios::trunc);
+                if (m_file) {
+                        string buffer(magic, sizeof(magic));
+                        write_uint32(buffer, version);
+                        m_file.write(buffer.data(), buffer.size());
+                        m_file.flush();
+                }
+        }
+        if (!m_file) {
+                cerr << "Could not open history file `" << filename << "'."
+                     << endl;
+                exit(EXIT_FAILURE);
+        }
+}
+
+bool
+sampling_history_sink_t::m_check_file(const string& filename, streamoff& size)
+{
+        ifstream file(filename.c_str(), ios::in | ios::binary);
+        char buffer[8];
+
+        if (!file.read(buffer, 8)) {
+                return false;
+        }
+        if (memcmp(buffer, magic, sizeof(magic)) != 0 || read_uint32(buffer+4) != version) {
+                return false;
+        }
+        // determine the size of the file
+        file.seekg(0, ios::end);
+        const streamoff total = file.tellg();
+        // skip all complete records
+        for (size = 8; size+4 <= total; ) {
+                file.seekg(size);
+                if (!file.read(buffer, 4)) {
+                        break;
+                }
+                const streamoff n = read_uint32(buffer);
+                if (size+4+n > total) {
+                        break;
+                }
+                size += 4+n;
+        }
+        return true;
+}
+
+sampling_history_sink_t::~sampling_history_sink_t()
+{
+        m_file.close();
+}
+
+void
+sampling_history_sink_t::write(size_t chain, const sampling_history_t& history)
+{
+        string buffer;
+
+        write_uint32(buffer, chain);
+        write_uint32(buffer, history.switches   [0].empty() ? 0   : history.switches   [0].back());
+        write_double(buffer, history.likelihood [0].empty() ? 0.0 : history.likelihood [0].back());
+        write_double(buffer, history.posterior  [0].empty() ? 0.0 : history.posterior  [0].back());
+        write_double(buffer, history.temperature[0].empty() ? 1.0 : history.temperature[0].back());
+        write_uint32(buffer, history.components [0].empty() ? 0   : history.components [0].back());
+        // cluster sizes
+        if (history.cluster_sizes.empty()) {
+                write_uint32(buffer, 0);
+        }
+        else {
+                const vector<double>& sizes = history.cluster_sizes.back();
+                write_uint32(buffer, sizes.size());
+                for (size_t i = 0; i < sizes.size(); i++) {
+                        write_uint32(buffer, sizes[i]);
+                }
+        }
+        // partition
+        if (history.partitions.empty()) {
+                write_uint32(buffer, 0);
+        }
+        else {
+                const dpm_partition_t& partition = history.partitions.back();
+                write_uint32(buffer, partition.size());
+                for (dpm_partition_t::const_iterator it = partition.begin();
+                     it != partition.end(); it++) {
+                        write_string(buffer, it->model_id().name);
+                        write_uint32(buffer, it->model_id().length);
+                        write_uint32(buffer, it->size());
+                        for (dpm_subset_t::const_iterator is = it->begin();
+                             is != it->end(); is++) {
+                                write_uint32(buffer, is->index()[0]);
+                                write_uint32(buffer, is->index()[1]);
+                                write_uint32(buffer, is->length());
+                                write_uint8 (buffer, is->reverse());
+                        }
+                }
+        }
+        // write record
+        string size;
+        write_uint32(size, buffer.size());
+        {
+                boost::lock_guard<boost::mutex> lock(m_mutex);
+                m_file.write(size  .data(), size  .size());
+                m_file.write(buffer.data(), buffer.size());
+                m_file.flush();
+        }
+}
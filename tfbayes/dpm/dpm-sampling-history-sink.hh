@@ -0,0 +1,82 @@
+/* Copyright (C) 2013 Philipp Benner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __TFBAYES_DPM_SAMPLING_HISTORY_SINK_HH__
+#define __TFBAYES_DPM_SAMPLING_HISTORY_SINK_HH__
+
+#ifdef HAVE_CONFIG_H
+#include <tfbayes/config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <fstream>
+#include <string>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/utility.hpp>
+
+#include <tfbayes/dpm/dpm-sampling-history.hh>
+
+// A sampling history sink appends every sample to a binary file as
+// soon as it is produced, so that long runs neither need to keep all
+// partitions in memory nor lose them if the sampler is interrupted.
+//
+// The file starts with the magic string "TFBH" followed by the format
+// version (uint32). Each sample is stored as a record that is
+// prefixed with its size in bytes (uint32), which allows readers to
+// detect a truncated last record:
+//
+//   uint32 chain
+//   uint32 switches
+//   double likelihood
+//   double posterior
+//   double temperature
+//   uint32 components
+//   uint32 n, followed by n cluster sizes (uint32)
+//   uint32 m, followed by m subsets of the partition, each given by
+//     uint32 length of the name, followed by the name
+//     uint32 length of the model
+//     uint32 k, followed by k ranges (uint32 sequence, uint32
+//     position, uint32 length, uint8 reverse)
+//
+// All numbers are stored in little endian byte order. An existing
+// file is overwritten unless the sampler resumes from it, in which
+// case new samples are appended and an incomplete last record (i.e.
+// of an interrupted run) is removed first.
+////////////////////////////////////////////////////////////////////////////////
+
+class sampling_history_sink_t : boost::noncopyable {
+public:
+         sampling_history_sink_t(const std::string& filename, bool append = false);
+        ~sampling_history_sink_t();
+
+        // append the last sample of a history to the file, this
+        // method may be called by several samplers at the same time
+        void write(size_t chain, const sampling_history_t& history);
+
+        static const char   magic[4];
+        static const size_t version = 1;
+
+protected:
+        // check if filename is an existing history file and return
+        // the size of all complete records including the header
+        static bool m_check_file(const std::string& filename, std::streamoff& size);
+
+        std::ofstream m_file;
+        boost::mutex  m_mutex;
+};
+
+#endif /* __TFBAYES_DPM_SAMPLING_HISTORY_SINK_HH__ */
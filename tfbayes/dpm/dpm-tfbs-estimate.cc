@@ -18,254 +18,124 @@
 #define __STDC_LIMIT_MACROS
 
 #include <stdint.h>
+#include <algorithm>
 #include <cmath> /* abs */
+#include <numeric>
 
+#include <boost/bind.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
 #include <boost/unordered/unordered_set.hpp>
-#include <boost/numeric/ublas/matrix_sparse.hpp>
-#include <boost/numeric/ublas/io.hpp>
 
+#include <tfbayes/dpm/dpm-partition-distance.hh>
 #include <tfbayes/dpm/dpm-tfbs.hh>
 #include <tfbayes/dpm/dpm-sampling-history.hh>
 #include <tfbayes/utility/progress.hh>
 #include <tfbayes/utility/statistics.hh>
+#include <tfbayes/utility/thread-pool.hh>
 
 using namespace std;
 
 // utilities for computing means and medians
 // -----------------------------------------------------------------------------
 
-static void
-init_data(const dpm_partition_t& partition, sequence_data_t<cluster_tag_t>& data)
+static vector<partition_labels_t>
+init_labels(const dpm_partition_list_t& partitions)
 {
-        /* Cluster labeling convention:
-         * The kth cluster gets all labels from k*foreground_length + 1 to
-         * k*foreground_length + foreground_length. Hence, each site in a
-         * cluster gets a unique label. The label 0 is reserved for
-         * the background */
-        cluster_tag_t k = 0;
-
-        for (dpm_partition_t::const_iterator it = partition.begin();
-             it != partition.end(); it++, k++) {
-                for (dpm_subset_t::const_iterator is = it->begin();
-                     is != it->end(); is++) {
-                        const index_t& index = is->index();
-                        for (size_t i = 0; i < is->length(); i++) {
-                                data[index[0]][index[1]+i] = k*is->length()+i+1;
-                        }
-                }
-        }
-}
+        vector<partition_labels_t> labels(partitions.size());
 
-static void
-clean_data(const dpm_partition_t& partition, sequence_data_t<cluster_tag_t>& data)
-{
-        for (dpm_partition_t::const_iterator it = partition.begin();
-             it != partition.end(); it++) {
-                for (dpm_subset_t::const_iterator is = it->begin();
-                     is != it->end(); is++) {
-                        const index_t& index = is->index();
-                        for (size_t i = 0; i < is->length(); i++) {
-                                data[index[0]][index[1]+i] = 0;
-                        }
-                }
+        for (size_t i = 0; i < partitions.size(); i++) {
+                labels[i] = partition_labels_t(partitions[i]);
         }
+        return labels;
 }
 
-// naive distance function (for debugging purposes)
+// distances between sets of partitions, where the work is
+// distributed among the threads of a pool
 // -----------------------------------------------------------------------------
 
-GCC_ATTRIBUTE_UNUSED
-static size_t
-naive_distance(const dpm_partition_t& pi_a,
-               const dpm_partition_t& pi_b,
-               sequence_data_t<cluster_tag_t>& a,
-               sequence_data_t<cluster_tag_t>& b,
-               const dpm_tfbs_t& dpm)
+static void
+distance_worker(const vector<partition_labels_t>* labels,
+                const partition_labels_t* pi,
+                vector<vector<uint64_t> >* scratch,
+                size_t elements,
+                vector<double>* results, size_t offset)
 {
-        boost::unordered_set<index_t> indices;
-        // resulting distance
-        size_t d = 0;
-
-        // initialize auxiliary cluster information
-        init_data(pi_a, a);
-        init_data(pi_b, b);
-
-        for (indexer_t::const_iterator it = dpm.data().begin();
-             it != dpm.data().end(); it++) {
-                for (indexer_t::const_iterator is = it+1;
-                     is != dpm.data().end(); is++) {
-                        const index_t& i = *it;
-                        const index_t& j = *is;
-                        if ((a[i] == a[j] && b[i] != b[j]) ||
-                            (a[i] != a[j] && b[i] == b[j])) {
-                                d += 1;
-                        }
-                }
-        }
-
-        // clean data
-        clean_data(pi_a, a);
-        clean_data(pi_b, b);
-
-        return d;
-}
-
-// a slightly less naive implementation of a distance function
-// bug still quadratic in the number of foreground indices!
-// -----------------------------------------------------------------------------
+        const size_t stride = scratch->size();
+        double d = 0.0;
 
-GCC_ATTRIBUTE_UNUSED
-static size_t
-distance1(const boost::unordered_set<index_t>& indices,
-          const sequence_data_t<cluster_tag_t>& a,
-          const sequence_data_t<cluster_tag_t>& b,
-          size_t bg_size)
-{
-        size_t d = 0, bg = 0;
-
-        for (boost::unordered_set<index_t>::const_iterator it = indices.begin();
-             it != indices.end(); it++) {
-                for (boost::unordered_set<index_t>::const_iterator is = it;
-                     is != indices.end(); is++) {
-                        if ((a[*it] == a[*is] && b[*it] != b[*is]) ||
-                            (a[*it] != a[*is] && b[*it] == b[*is])) {
-                                d++;
-                        }
-                }
-                if (a[*it] == 0 || b[*it] == 0) {
-                        bg++;
-                }
+        for (size_t i = offset; i < labels->size(); i += stride) {
+                d += partition_distance((*labels)[i], *pi, elements, (*scratch)[offset]);
         }
-        return d + bg*bg_size;
+        (*results)[offset] = d;
 }
 
-// highly optimized distance function (formulas can be found in
-// Lawrence Hubert. Comparing Partitions. Journal of
-// Classification, 1985)
-// -----------------------------------------------------------------------------
-
+// sum of distances between pi and all partitions, the partitions
+// are split into one stripe for each scratch buffer
 static double
-distance2(const boost::unordered_set<index_t>& indices,
-          const dpm_partition_t& pi_a,
-          const dpm_partition_t& pi_b,
-          const sequence_data_t<cluster_tag_t>& a,
-          const sequence_data_t<cluster_tag_t>& b,
-          size_t bg_size)
+distance(const vector<partition_labels_t>& labels,
+         const dpm_partition_t& pi,
+         vector<vector<uint64_t> >& scratch,
+         thread_pool_t& thread_pool,
+         const dpm_tfbs_t& dpm)
 {
-        // boost sparse matrices
-        using namespace boost::numeric::ublas;
-
-        // resulting distance
-        double result = 0;
-
-        // number of clusters
-        size_t la = 1; // start at one for the
-        size_t lb = 1; // background model
-        for (dpm_partition_t::const_iterator it = pi_a.begin();
-             it != pi_a.end(); it++) {
-                la += it->begin()->length();
-        }
-        for (dpm_partition_t::const_iterator it = pi_b.begin();
-             it != pi_b.end(); it++) {
-                lb += it->begin()->length();
-        }
+        const size_t n = scratch.size();
+        const size_t elements = dpm.data().elements();
+        const partition_labels_t pi_labels(pi);
+        vector<double> results(n, 0.0);
 
-        // contingency table
-        mapped_matrix<double> m(la, lb);
-        std::vector<double> ma(la, 0.0);
-        std::vector<double> mb(lb, 0.0);
+        thread_pool.parallel_for(0, n, 1,
+                boost::bind(distance_worker, &labels, &pi_labels, &scratch,
+                            elements, &results, _1));
 
-        for (boost::unordered_set<index_t>::const_iterator it = indices.begin();
-             it != indices.end(); it++) {
-                m(a[*it], b[*it]) += 1.0;
-                ma[a[*it]] += 1.0;
-                mb[b[*it]] += 1.0;
-        }
-
-        // compute distance from contingency table
-        for (size_t i = 0; i < la; i++) {
-                result += 1.0/2.0*ma[i]*ma[i];
-        }
-        for (size_t j = 0; j < lb; j++) {
-                result += 1.0/2.0*mb[j]*mb[j];
-        }
-        for (mapped_matrix<double>::const_iterator1 it = m.begin1();
-             it != m.end1(); it++) {
-                for (mapped_matrix<double>::const_iterator2 is = it.begin();
-                     is != it.end(); is++) {
-                        result -= (*is)*(*is);
-                }
-        }
-        return result + (ma[0]+mb[0])*bg_size;
+        return accumulate(results.begin(), results.end(), 0.0);
 }
 
-static double
-distance(const dpm_partition_t& pi_a,
-         const dpm_partition_t& pi_b,
-         sequence_data_t<cluster_tag_t>& a,
-         sequence_data_t<cluster_tag_t>& b,
-         const dpm_tfbs_t& dpm)
-{
-        // set of indices that are actually used in clusters
-        boost::unordered_set<index_t> indices;
-
-        // initialize auxiliary cluster information
-        init_data(pi_a, a);
-        init_data(pi_b, b);
-
-        // go through subsets of partition a and record all positions
-        // that are assigned to a cluster
-        for (dpm_partition_t::const_iterator it = pi_a.begin();
-             it != pi_a.end(); it++) {
-                for (dpm_subset_t::const_iterator is = it->begin();
-                     is != it->end(); is++) {
-                        const index_t& tmp = is->index();
-                        for (size_t i = 0; i < is->length(); i++) {
-                                indices.insert(index_t(tmp[0], tmp[1]+i));
-                        }
+// compute the upper triangle of the distance matrix, where each
+// row is a separate task of the thread pool
+class distance_matrix_worker_t {
+public:
+        distance_matrix_worker_t(const vector<partition_labels_t>& labels,
+                                 matrix<size_t>& distances,
+                                 const dpm_tfbs_t& dpm,
+                                 bool verbose)
+                : m_labels    (labels)
+                , m_distances (distances)
+                , m_elements  (dpm.data().elements())
+                , m_verbose   (verbose)
+                , m_pairs     (0)
+                { }
+
+        void operator()(size_t i) {
+                const size_t n = m_labels.size();
+                vector<uint64_t> scratch;
+
+                for (size_t j = i+1; j < n; j++) {
+                        m_distances[i][j] = partition_distance(m_labels[i], m_labels[j],
+                                                               m_elements, scratch);
+                        m_distances[j][i] = m_distances[i][j];
                 }
-        }
-        // go through subsets of partition b and record all positions
-        // that are assigned to a cluster
-        for (dpm_partition_t::const_iterator it = pi_b.begin();
-             it != pi_b.end(); it++) {
-                for (dpm_subset_t::const_iterator is = it->begin();
-                     is != it->end(); is++) {
-                        const index_t& tmp = is->index();
-                        for (size_t i = 0; i < is->length(); i++) {
-                                indices.insert(index_t(tmp[0], tmp[1]+i));
-                        }
+                m_progress(n-i-1);
+        }
+protected:
+        // record the number of pairs that were processed
+        void m_progress(size_t pairs) {
+                boost::lock_guard<boost::mutex> lock(m_mtx);
+                const size_t n = m_labels.size();
+                m_pairs += pairs;
+                if (m_verbose && pairs > 0) {
+                        cerr << progress_t(2.0*m_pairs/(double)(n*n-n));
                 }
         }
-        // size of the background cluster
-        size_t bg_size = dpm.data().elements() - indices.size();
-
-        // compute the distance
-//        size_t d = distance1(indices, a, b, bg_size);
-        double d = distance2(indices, pi_a, pi_b, a, b, bg_size);
-
-        // clean data
-        clean_data(pi_a, a);
-        clean_data(pi_b, b);
-
-        return d;
-}
 
-static double
-distance(const dpm_partition_list_t& partitions,
-         const dpm_partition_t& pi,
-         sequence_data_t<cluster_tag_t>& a,
-         sequence_data_t<cluster_tag_t>& b,
-         const dpm_tfbs_t& dpm)
-{
-        double d = 0.0;
+        const vector<partition_labels_t>& m_labels;
+        matrix<size_t>& m_distances;
+        size_t m_elements;
+        bool m_verbose;
 
-        for (dpm_partition_list_t::const_iterator it = partitions.begin();
-             it != partitions.end(); it++) {
-                d += distance(*it, pi, a, b, dpm);
-        }
-        return d;
-}
+        boost::mutex m_mtx;
+        size_t m_pairs;
+};
 
 static
 double mean_loss(double d)
@@ -281,8 +151,10 @@ double median_loss(double d)
 
 static dpm_partition_t
 dpm_tfbs_estimate(const dpm_partition_list_t& partitions,
+                  const vector<partition_labels_t>& labels,
                   double (*loss)(double),
                   const dpm_tfbs_t& dpm,
+                  thread_pool_t& thread_pool,
                   bool verbose)
 {
         // number of partitions
@@ -293,10 +165,6 @@ dpm_tfbs_estimate(const dpm_partition_list_t& partitions,
                 return dpm_partition_t();
         }
 
-        // auxiliary storage
-        sequence_data_t<cluster_tag_t> a(dpm.data().sizes(), 0);
-        sequence_data_t<cluster_tag_t> b(dpm.data().sizes(), 0);
-
         // matrix of distances between every pair of partitions
         matrix<size_t> distances(n, n);
         vector<size_t> sums(n, 0);
@@ -304,14 +172,11 @@ dpm_tfbs_estimate(const dpm_partition_list_t& partitions,
         // save value and position of minimum distances
         size_t min = SIZE_MAX, argmin = SIZE_MAX;
 
-        for (size_t i = 0, k = 0; i < n; i++) {
-                for (size_t j = i+1; j < n; j++, k++) {
-                        if (verbose && ((k+1) % 100 == 0 || 2*(k+1) == n*n-n)) {
-                                cerr << progress_t(2.0*(k+1)/(double)(n*n-n));
-                        }
-                        distances[i][j] = distance(partitions[i], partitions[j], a, b, dpm);
-                        distances[j][i] = distances[i][j];
-                }
+        {
+                distance_matrix_worker_t worker(labels, distances, dpm, verbose);
+
+                thread_pool.parallel_for(0, n, 1,
+                        boost::bind(&distance_matrix_worker_t::operator(), &worker, _1));
         }
         for (size_t i = 0; i < n; i++) {
                 for (size_t j = 0; j < n; j++) {
@@ -326,16 +191,16 @@ dpm_tfbs_estimate(const dpm_partition_list_t& partitions,
 }
 
 static bool
-dpm_tfbs_optimize_estimate(const dpm_partition_list_t& partitions,
+dpm_tfbs_optimize_estimate(const vector<partition_labels_t>& labels,
                            dpm_partition_t& estimate,
                            double (*loss)(double),
-                           sequence_data_t<cluster_tag_t>& a,
-                           sequence_data_t<cluster_tag_t>& b,
+                           vector<vector<uint64_t> >& scratch,
+                           thread_pool_t& thread_pool,
                            const dpm_tfbs_t& dpm,
                            bool verbose)
 {
         // keep track of losses
-        double old_loss = (*loss)(distance(partitions, estimate, a, b, dpm));
+        double old_loss = (*loss)(distance(labels, estimate, scratch, thread_pool, dpm));
         double new_loss = old_loss;
 
         // did we optimize so far?
@@ -370,7 +235,7 @@ dpm_tfbs_optimize_estimate(const dpm_partition_list_t& partitions,
                         // erase index from subset
                         subset.erase(range);
                         // compute new loss
-                        new_loss = (*loss)(distance(partitions, estimate, a, b, dpm));
+                        new_loss = (*loss)(distance(labels, estimate, scratch, thread_pool, dpm));
                         if (new_loss < old_loss && abs(new_loss - old_loss) > 1e-5) {
                                 // new estimate seems better
                                 old_loss = new_loss;
@@ -400,9 +265,11 @@ dpm_tfbs_optimize_estimate(const dpm_partition_list_t& partitions,
 
 static dpm_partition_t
 dpm_tfbs_optimize_estimate(const dpm_partition_list_t& partitions,
+                           const vector<partition_labels_t>& labels,
                            const dpm_partition_t& estimate,
                            double (*loss)(double),
                            const dpm_tfbs_t& dpm,
+                           thread_pool_t& thread_pool,
                            bool verbose)
 {
         dpm_partition_t current_estimate(estimate);
@@ -412,9 +279,8 @@ dpm_tfbs_optimize_estimate(const dpm_partition_list_t& partitions,
                 return dpm_partition_t();
         }
 
-        // auxiliary storage
-        sequence_data_t<cluster_tag_t> a(dpm.data().sizes(), 0);
-        sequence_data_t<cluster_tag_t> b(dpm.data().sizes(), 0);
+        // auxiliary storage for each thread
+        vector<vector<uint64_t> > scratch(thread_pool.size()+1);
 
         // record if distance was minimized
         bool optimized;
@@ -426,7 +292,7 @@ dpm_tfbs_optimize_estimate(const dpm_partition_list_t& partitions,
         /* loop until no local optimizations are possible */
         do {
                 /* optimize by removing elements from clusters */
-                optimized = dpm_tfbs_optimize_estimate(partitions, current_estimate, loss, a, b, dpm, verbose);
+                optimized = dpm_tfbs_optimize_estimate(labels, current_estimate, loss, scratch, thread_pool, dpm, verbose);
 
         } while (optimized);
 
@@ -438,6 +304,7 @@ dpm_tfbs_estimate(const sampling_history_t& history,
                   ssize_t take,
                   double (*loss)(double),
                   dpm_tfbs_t& dpm,
+                  size_t threads,
                   bool verbose)
 {
         /* number of parallel samplers */
@@ -449,6 +316,8 @@ dpm_tfbs_estimate(const sampling_history_t& history,
         /* number of samples for each sampler */
         size_t m = history.temperature[0].size();
 
+        assert(threads >= 1);
+
         /* list of feasible partitions */
         dpm_partition_list_t partitions;
 
@@ -483,10 +352,14 @@ dpm_tfbs_estimate(const sampling_history_t& history,
                              << endl;
                 }
         }
+        /* sorted labels of all partitions */
+        vector<partition_labels_t> labels = init_labels(partitions);
+        /* the calling thread takes part in all computations */
+        thread_pool_t thread_pool(threads-1);
         /* compute estimate */
-        dpm_partition_t estimate = dpm_tfbs_estimate(partitions, loss, dpm, verbose);
+        dpm_partition_t estimate = dpm_tfbs_estimate(partitions, labels, loss, dpm, thread_pool, verbose);
         /* optimize estimate */
-        estimate = dpm_tfbs_optimize_estimate(partitions, estimate, loss, dpm, verbose);
+        estimate = dpm_tfbs_optimize_estimate(partitions, labels, estimate, loss, dpm, thread_pool, verbose);
 
         return estimate;
 }
@@ -522,8 +395,10 @@ map_local_optimization_move(cluster_t& cluster, cluster_tag_t bg_cluster_tag, dp
                 ss << "moved to the right";
         }
         else {
+                dpm.state().commit();
                 return false;
         }
+        dpm.state().commit();
         if (verbose) {
                 cout << boost::format("Cluster %d %s (%d -> %d)")
                         % cluster.cluster_tag()
@@ -785,7 +660,7 @@ dpm_tfbs_t::mean(const sampling_history_t& history, ssize_t take, bool verbose)
         if (verbose) {
                 cout << "Computing mean partition: ";
         }
-        return dpm_tfbs_estimate(history, take, &mean_loss, dpm, verbose);
+        return dpm_tfbs_estimate(history, take, &mean_loss, dpm, m_threads, verbose);
 }
 
 dpm_partition_t
@@ -797,5 +672,5 @@ dpm_tfbs_t::median(const sampling_history_t& history, ssize_t take, bool verbose
         if (verbose) {
                 cout << "Computing median partition: ";
         }
-        return dpm_tfbs_estimate(history, take, &median_loss, dpm, verbose);
+        return dpm_tfbs_estimate(history, take, &median_loss, dpm, m_threads, verbose);
 }
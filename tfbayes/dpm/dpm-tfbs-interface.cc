@@ -24,6 +24,7 @@
 #include <boost/python.hpp>
 #include <boost/python/def.hpp>
 #include <boost/python/iterator.hpp>
+#include <boost/python/make_constructor.hpp>
 #include <boost/python/suite/indexing/vector_indexing_suite.hpp>
 
 #include <tfbayes/dpm/index.hh>
@@ -31,6 +32,7 @@
 #include <tfbayes/dpm/dpm-sampling-history.hh>
 #include <tfbayes/dpm/dpm-tfbs-options.hh>
 #include <tfbayes/dpm/dpm-tfbs-sampler.hh>
+#include <tfbayes/interface/gil.hh>
 
 using namespace boost::python;
 
@@ -51,6 +53,70 @@ void baseline_names_push_back(
         baseline_names.push_back(s);
 }
 
+// reading the data, computing point estimates and sampling release
+// the interpreter lock, so that other Python threads can run
+// -----------------------------------------------------------------------------
+
+data_tfbs_t* data_tfbs_constructor(const std::string& filename)
+{
+        release_gil_t gil;
+        return new data_tfbs_t(filename);
+}
+
+dpm_partition_t dpm_tfbs_map(
+        const dpm_tfbs_t& dpm,
+        const sampling_history_t& history,
+        bool optimize, bool verbose)
+{
+        release_gil_t gil;
+        return dpm.map(history, optimize, verbose);
+}
+
+dpm_partition_t dpm_tfbs_mean(
+        const dpm_tfbs_t& dpm,
+        const sampling_history_t& history,
+        ssize_t take, bool verbose)
+{
+        release_gil_t gil;
+        return dpm.mean(history, take, verbose);
+}
+
+dpm_partition_t dpm_tfbs_median(
+        const dpm_tfbs_t& dpm,
+        const sampling_history_t& history,
+        ssize_t take, bool verbose)
+{
+        release_gil_t gil;
+        return dpm.median(history, take, verbose);
+}
+
+dpm_tfbs_pmcmc_t* dpm_tfbs_pmcmc_constructor(
+        const tfbs_options_t& options)
+{
+        release_gil_t gil;
+        return new dpm_tfbs_pmcmc_t(options);
+}
+
+dpm_tfbs_pmcmc_t* dpm_tfbs_pmcmc_constructor_history(
+        const tfbs_options_t& options,
+        const sampling_history_t& history)
+{
+        release_gil_t gil;
+        return new dpm_tfbs_pmcmc_t(options, history);
+}
+
+void dpm_tfbs_pmcmc_call(dpm_tfbs_pmcmc_t& sampler, size_t n, size_t burnin)
+{
+        release_gil_t gil;
+        sampler(n, burnin);
+}
+
+void dpm_tfbs_pmcmc_save(const dpm_tfbs_pmcmc_t& sampler, const std::string& filename)
+{
+        release_gil_t gil;
+        sampler.save(filename);
+}
+
 // interface
 // -----------------------------------------------------------------------------
 
@@ -82,6 +148,11 @@ BOOST_PYTHON_MODULE(dpm_tfbs_interface)
                 .def_readwrite("baseline_weights",     &tfbs_options_t::baseline_weights)
                 .def_readwrite("population_size",      &tfbs_options_t::population_size)
                 .def_readwrite("threads",              &tfbs_options_t::threads)
+                .def_readwrite("gibbs_shards",         &tfbs_options_t::gibbs_shards)
+                .def_readwrite("seed",                 &tfbs_options_t::seed)
+                .def_readwrite("history_file",         &tfbs_options_t::history_file)
+                .def_readwrite("history_resume",       &tfbs_options_t::history_resume)
+                .def_readwrite("partition_file",       &tfbs_options_t::partition_file)
                 .def_readwrite("socket_file",          &tfbs_options_t::socket_file)
                 .def_readwrite("verbose",              &tfbs_options_t::verbose)
                 ;
@@ -94,18 +165,18 @@ BOOST_PYTHON_MODULE(dpm_tfbs_interface)
                 .def("append", &baseline_priors_push_back)
                 ;
         class_<data_tfbs_t>("data_tfbs_t", no_init)
-                .def(init<const std::string&>())
+                .def("__init__", make_constructor(data_tfbs_constructor))
                 ;
         class_<dpm_tfbs_t>("dpm_tfbs_t", no_init)
                 .def(init<const tfbs_options_t&, const data_tfbs_t&>())
-                .def("map",     &dpm_tfbs_t::map)
-                .def("mean",    &dpm_tfbs_t::mean)
-                .def("median",  &dpm_tfbs_t::median)
+                .def("map",     &dpm_tfbs_map)
+                .def("mean",    &dpm_tfbs_mean)
+                .def("median",  &dpm_tfbs_median)
                 ;
         class_<dpm_tfbs_pmcmc_t, boost::noncopyable>("dpm_tfbs_pmcmc_t", no_init)
-                .def(init<tfbs_options_t>())
-                .def(init<tfbs_options_t, sampling_history_t>())
-                .def("__call__", &dpm_tfbs_pmcmc_t::operator())
-                .def("save",     &dpm_tfbs_pmcmc_t::save)
+                .def("__init__", make_constructor(dpm_tfbs_pmcmc_constructor))
+                .def("__init__", make_constructor(dpm_tfbs_pmcmc_constructor_history))
+                .def("__call__", &dpm_tfbs_pmcmc_call)
+                .def("save",     &dpm_tfbs_pmcmc_save)
                 ;
 }
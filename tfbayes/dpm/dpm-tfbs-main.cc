@@ -175,6 +175,9 @@ void run_dpm(const char* phylogenetic_data_file, const char* fasta_alignment_fil
         tfbs_options.optimize_period     = 2;
         tfbs_options.initial_temperature = 1.0;
         tfbs_options.threads             = 1;
+        tfbs_options.gibbs_shards        = 1;
+        tfbs_options.seed                = 0;
+        tfbs_options.history_resume      = false;
         tfbs_options.verbose             = 3;
         tfbs_options.baseline_lengths.push_back(vector<double>());
         for (size_t i = options.foreground_length_min; i <= options.foreground_length_max; i++) {
@@ -34,7 +34,12 @@ operator<<(ostream& o, const tfbs_options_t& options) {
           << "-> background model     = " << options.background_model     << endl
           << "-> background context   = " << options.background_context   << endl
           << "-> population_size      = " << options.population_size      << endl
+          << "-> gibbs shards         = " << options.gibbs_shards         << endl
+          << "-> seed                 = " << options.seed                 << endl
           << "-> socket_file          = " << options.socket_file          << endl
+          << "-> history_file         = " << options.history_file         << endl
+          << "-> history_resume       = " << options.history_resume       << endl
+          << "-> partition_file       = " << options.partition_file       << endl
           << "-> verbose              = " << options.verbose              << endl;
         return o;
 }
@@ -60,6 +60,15 @@ typedef struct {
         baseline_weights_t baseline_weights;
         size_t population_size;
         size_t threads;
+        size_t gibbs_shards;
+        // seed for all random number streams, zero means that the
+        // seed is obtained from the system clock
+        size_t seed;
+        std::string history_file;
+        // append samples to an existing history file, which is
+        // only set if the sampler resumes from this file
+        bool history_resume;
+        std::string partition_file;
         std::string socket_file;
         size_t verbose;
 } tfbs_options_t;
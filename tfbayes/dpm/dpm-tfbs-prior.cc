@@ -69,12 +69,9 @@ pitman_yor_prior::joint(const dpm_tfbs_state_t& state) const
 
         double sum = K*log(alpha) + boost::math::lgamma<double>(alpha) - boost::math::lgamma<double>(N + alpha);
 
-        for (cl_iterator it = state.begin(); it != state.end(); it++) {
-                const cluster_t& cluster = **it;
-                if (!state.is_background(cluster)) {
-                        sum += boost::math::lgamma<double>(cluster.size());
-                }
-        }
+        // sum of log Gamma(n) over all cluster sizes n is kept
+        // up to date by the state
+        sum += state.log_gamma_sizes();
 
         return sum;
 }
@@ -20,16 +20,23 @@
 #endif /* HAVE_CONFIG_H */
 
 #include <cmath> /* abs, ceil */
+#include <map>
+#include <set>
 
+#include <boost/bind.hpp>
 #include <boost/function.hpp>
 #include <boost/format.hpp>
 #include <boost/lambda/bind.hpp>
 #include <boost/random/uniform_01.hpp>
 #include <boost/random/uniform_int_distribution.hpp>
+#include <boost/thread.hpp>
 
+#include <tfbayes/dpm/dpm-partition-file.hh>
 #include <tfbayes/dpm/dpm-tfbs-sampler.hh>
+#include <tfbayes/utility/boost-random-shuffle.hh>
 #include <tfbayes/utility/logarithmetic.hh>
 #include <tfbayes/utility/statistics.hh>
+#include <tfbayes/utility/thread-pool.hh>
 
 using namespace std;
 using namespace boost::asio;
@@ -46,6 +53,8 @@ dpm_tfbs_sampler_t::dpm_tfbs_sampler_t(
         : gibbs_sampler_t        (dpm_tfbs, data, "", options.verbose)
         , phylogenetic_data      (&data)
         , m_output_queue         (&output_queue)
+        , m_history_sink         (NULL)
+        , m_chain                (0)
         , m_t0                   (options.initial_temperature)
         , m_block_samples        (options.block_samples)
         , m_block_samples_period (options.block_samples_period)
@@ -57,12 +66,19 @@ dpm_tfbs_sampler_t::dpm_tfbs_sampler_t(
         assert(options.initial_temperature  >= 1.0);
         assert(options.block_samples_period >= 1);
         assert(options.optimize_period >= 1);
+        assert(options.gibbs_shards >= 1);
+
+        if (options.gibbs_shards > 1) {
+                m_init_shards(options.gibbs_shards);
+        }
 }
 
 dpm_tfbs_sampler_t::dpm_tfbs_sampler_t(const dpm_tfbs_sampler_t& sampler)
         : gibbs_sampler_t        (sampler)
         , phylogenetic_data      (sampler.phylogenetic_data)
         , m_output_queue         (sampler.m_output_queue)
+        , m_history_sink         (sampler.m_history_sink)
+        , m_chain                (sampler.m_chain)
         , m_t0                   (sampler.m_t0)
         , m_block_samples        (sampler.m_block_samples)
         , m_block_samples_period (sampler.m_block_samples_period)
@@ -70,6 +86,11 @@ dpm_tfbs_sampler_t::dpm_tfbs_sampler_t(const dpm_tfbs_sampler_t& sampler)
         , m_optimize             (sampler.m_optimize)
         , m_optimize_period      (sampler.m_optimize_period)
         , m_verbose              (sampler.m_verbose)
+        , m_shard_sequences      (sampler.m_shard_sequences)
+        , m_shard_indices        (sampler.m_shard_indices)
+          // workers are created when they are needed
+        , m_workers              ()
+        , m_thread_pool          ()
 { }
 
 dpm_tfbs_sampler_t::~dpm_tfbs_sampler_t()
@@ -81,6 +102,8 @@ swap(dpm_tfbs_sampler_t& first, dpm_tfbs_sampler_t& second) {
         swap(first.phylogenetic_data,      second.phylogenetic_data);
         swap(first.m_command_queue,        second.m_command_queue);
         swap(first.m_output_queue,         second.m_output_queue);
+        swap(first.m_history_sink,         second.m_history_sink);
+        swap(first.m_chain,                second.m_chain);
         swap(first.m_t0,                   second.m_t0);
         swap(first.m_block_samples,        second.m_block_samples);
         swap(first.m_block_samples_period, second.m_block_samples_period);
@@ -88,6 +111,10 @@ swap(dpm_tfbs_sampler_t& first, dpm_tfbs_sampler_t& second) {
         swap(first.m_optimize,             second.m_optimize);
         swap(first.m_optimize_period,      second.m_optimize_period);
         swap(first.m_verbose,              second.m_verbose);
+        swap(first.m_shard_sequences,      second.m_shard_sequences);
+        swap(first.m_shard_indices,        second.m_shard_indices);
+        swap(first.m_workers,              second.m_workers);
+        swap(first.m_thread_pool,          second.m_thread_pool);
 }
 
 dpm_tfbs_sampler_t*
@@ -127,6 +154,13 @@ dpm_tfbs_sampler_t::dpm() const
         return *static_cast<const dpm_tfbs_t*>(m_dpm);
 }
 
+void
+dpm_tfbs_sampler_t::set_history_sink(sampling_history_sink_t* sink, size_t chain)
+{
+        m_history_sink = sink;
+        m_chain        = chain;
+}
+
 // Gibbs samples
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -217,21 +251,236 @@ dpm_tfbs_sampler_t::m_gibbs_sample(const index_t& index, double temp, bool optim
 }
 
 size_t
-dpm_tfbs_sampler_t::m_gibbs_sample(double temp, bool optimize) {
+dpm_tfbs_sampler_t::m_gibbs_sample(const vector<index_t>& indices, double temp, bool optimize) {
         size_t sum = 0;
+        for (vector<index_t>::const_iterator it = indices.begin();
+             it != indices.end(); it++) {
+                if(m_gibbs_sample(*it, temp, optimize)) sum+=1;
+        }
+        return sum;
+}
+
+size_t
+dpm_tfbs_sampler_t::m_gibbs_sample(double temp, bool optimize) {
+        if (m_shard_indices.size() > 1) {
+                return m_gibbs_sample_parallel(temp, optimize);
+        }
         // the indexer needs to be constant since it is shared between
         // processes, so to shuffle the indices we first need to
         // obtain a copy
         vector<index_t> indices(m_indexer->sampling_begin(), m_indexer->sampling_end());
-        random_shuffle(indices.begin(), indices.end());
+        boost::random::random_shuffle(indices.begin(), indices.end(), gen());
         // now sample
-        for (vector<index_t>::const_iterator it = indices.begin();
-             it != indices.end(); it++) {
-                if(m_gibbs_sample(*it, temp, optimize)) sum+=1;
+        return m_gibbs_sample(indices, temp, optimize);
+}
+
+// parallel Gibbs samples
+////////////////////////////////////////////////////////////////////////////////
+
+// The sequences are split into shards that are sampled concurrently,
+// each by a copy of this sampler. Since a shard only sees the
+// cluster statistics of other shards as they were at the beginning
+// of the sweep, the result is an approximation to a full Gibbs sweep
+// (similar to approximate distributed LDA). Tfbs never cross sequence
+// boundaries, so that shards can be merged without conflicts.
+
+void
+dpm_tfbs_sampler_t::m_init_shards(size_t n)
+{
+        // count sampling indices of each sequence
+        map<size_t, vector<index_t> > sequences;
+        for (indexer_t::sampling_iterator it = m_indexer->sampling_begin();
+             it != m_indexer->sampling_end(); it++) {
+                sequences[(*it)[0]].push_back(*it);
+        }
+        // sort sequences by their number of indices
+        vector<pair<size_t, size_t> > sizes;
+        for (map<size_t, vector<index_t> >::const_iterator it = sequences.begin();
+             it != sequences.end(); it++) {
+                sizes.push_back(make_pair(it->second.size(), it->first));
+        }
+        sort(sizes.rbegin(), sizes.rend());
+        // assign each sequence to the shard with the smallest number
+        // of indices
+        m_shard_sequences = vector<vector<size_t>  >(n);
+        m_shard_indices   = vector<vector<index_t> >(n);
+        for (size_t i = 0; i < sizes.size(); i++) {
+                size_t k = 0;
+                for (size_t j = 1; j < n; j++) {
+                        if (m_shard_indices[j].size() < m_shard_indices[k].size()) {
+                                k = j;
+                        }
+                }
+                const vector<index_t>& indices = sequences[sizes[i].second];
+                m_shard_sequences[k].push_back(sizes[i].second);
+                m_shard_indices  [k].insert(m_shard_indices[k].end(), indices.begin(), indices.end());
         }
+}
+
+void
+dpm_tfbs_sampler_t::m_init_workers()
+{
+        const size_t n = m_shard_indices.size();
+
+        for (size_t i = 0; i < n; i++) {
+                boost::shared_ptr<dpm_tfbs_sampler_t> worker(new dpm_tfbs_sampler_t(*this));
+                // workers only sample their shard, they neither keep
+                // a history nor split their sweep any further
+                worker->m_sampling_history = sampling_history_t();
+                worker->m_history_sink     = NULL;
+                worker->m_shard_sequences.clear();
+                worker->m_shard_indices  .clear();
+                m_workers.push_back(worker);
+        }
+        // the calling thread samples one of the shards
+        m_thread_pool = boost::shared_ptr<thread_pool_t>(new thread_pool_t(n-1));
+}
+
+void
+dpm_tfbs_sampler_t::m_gibbs_sample_shard(size_t i, const vector<vector<index_t> >* indices,
+                                         double temp, bool optimize, vector<shard_result_t>* results)
+{
+        dpm_tfbs_sampler_t& worker = *m_workers[i];
+        shard_result_t& result     = (*results)[i];
+        // the state of this sampler is not modified before all
+        // shards are sampled, so workers copy it concurrently; all
+        // other parts of the mixture model are constant and were
+        // copied when the worker was created
+        worker.dpm().state() = dpm().state();
+
+        const dpm_tfbs_state_t& state        = dpm().state();
+        const dpm_tfbs_state_t& worker_state = worker.dpm().state();
+
+        result.switches = 0;
+        for (vector<index_t>::const_iterator it = (*indices)[i].begin();
+             it != (*indices)[i].end(); it++) {
+                if (worker.m_gibbs_sample(*it, temp, optimize)) {
+                        result.switches++;
+                }
+                // a cluster with a single tfbs was empty before it
+                // was sampled, so it is a new cluster even if its
+                // tag was used at the beginning of the sweep
+                if (worker_state.is_tfbs_start_position(*it) &&
+                    worker_state[worker_state[*it]].size() == 1) {
+                        result.clusters.insert(worker_state[*it]);
+                }
+        }
+        // record all positions of this shard that must be merged
+        for (vector<size_t>::const_iterator it = m_shard_sequences[i].begin();
+             it != m_shard_sequences[i].end(); it++) {
+                for (size_t j = 0; j < state.m_data->size(*it); j++) {
+                        const index_t index(*it, j);
+                        if (worker_state[index] != state[index] ||
+                            worker_state.tfbs_start_positions[index] != state.tfbs_start_positions[index] ||
+                           (worker_state.is_tfbs_start_position(index) &&
+                            result.clusters.find(worker_state[index]) != result.clusters.end())) {
+                                result.changes.push_back(index);
+                        }
+                }
+        }
+}
+
+size_t
+dpm_tfbs_sampler_t::m_gibbs_sample_parallel(double temp, bool optimize)
+{
+        const size_t n = m_shard_indices.size();
+        size_t sum = 0;
+
+        if (m_workers.empty()) {
+                m_init_workers();
+        }
+        vector<vector<index_t> > indices(m_shard_indices);
+        vector<shard_result_t> results(n);
+
+        for (size_t i = 0; i < n; i++) {
+                boost::random::random_shuffle(indices[i].begin(), indices[i].end(), gen());
+                // every worker receives its own stream of random
+                // numbers
+                m_workers[i]->gen() = gen().split();
+        }
+        m_thread_pool->parallel_for(0, n, 1,
+                boost::bind(&dpm_tfbs_sampler_t::m_gibbs_sample_shard, this,
+                            _1, &indices, temp, optimize, &results));
+
+        for (size_t i = 0; i < n; i++) {
+                sum += results[i].switches;
+        }
+        m_merge_shards(results);
+
         return sum;
 }
 
+void
+dpm_tfbs_sampler_t::m_merge_shards(const vector<shard_result_t>& results)
+{
+        const vector<boost::shared_ptr<dpm_tfbs_sampler_t> >& workers = m_workers;
+        dpm_tfbs_state_t& state = dpm().state();
+        // foreground clusters that are used at the beginning of the
+        // sweep are shared between all shards, unless a worker
+        // created a new cluster with the same tag; all other
+        // clusters were created by a single shard and must be given
+        // a new tag
+        set<cluster_tag_t> shared;
+        for (cm_iterator it = state.begin(); it != state.end(); it++) {
+                if (!state.is_background(**it)) {
+                        shared.insert((*it)->cluster_tag());
+                }
+        }
+        // only positions that differ between the worker and this
+        // sampler are merged; remove tfbs at these positions and
+        // copy the assignments to background clusters
+        for (size_t k = 0; k < workers.size(); k++) {
+                const dpm_tfbs_state_t& worker_state = workers[k]->dpm().state();
+                const vector<index_t>& changes = results[k].changes;
+
+                for (vector<index_t>::const_iterator it = changes.begin(); it != changes.end(); it++) {
+                        if (state.is_tfbs_start_position(*it)) {
+                                const range_t range(*it, state[state[*it]].model().id().length, false);
+                                state.remove(range);
+                                state.add   (range, state.bg_cluster_tags[0]);
+                        }
+                }
+                for (vector<index_t>::const_iterator it = changes.begin(); it != changes.end(); it++) {
+                        if (worker_state.is_background(*it) && worker_state[*it] != state[*it]) {
+                                const range_t range(*it, 1, false);
+                                state.remove(range);
+                                state.add   (range, worker_state[*it]);
+                        }
+                }
+        }
+        // add tfbs to shared clusters first, so that these clusters
+        // are not reused for new ones
+        for (size_t pass = 0; pass < 2; pass++) {
+                for (size_t k = 0; k < workers.size(); k++) {
+                        const dpm_tfbs_state_t& worker_state = workers[k]->dpm().state();
+                        const vector<index_t>& changes = results[k].changes;
+                        map<cluster_tag_t, cluster_tag_t> tags;
+
+                        for (vector<index_t>::const_iterator it = changes.begin(); it != changes.end(); it++) {
+                                if (!worker_state.is_tfbs_start_position(*it)) {
+                                        continue;
+                                }
+                                const cluster_t& cluster = worker_state[worker_state[*it]];
+                                const bool is_shared     =
+                                        shared.find(cluster.cluster_tag()) != shared.end() &&
+                                        results[k].clusters.find(cluster.cluster_tag()) == results[k].clusters.end();
+                                if (is_shared != (pass == 0)) {
+                                        continue;
+                                }
+                                if (tags.find(cluster.cluster_tag()) == tags.end()) {
+                                        tags[cluster.cluster_tag()] = is_shared
+                                                ? cluster.cluster_tag()
+                                                : state.get_free_cluster(cluster.model().id()).cluster_tag();
+                                }
+                                const size_t length = cluster.model().id().length;
+                                state.remove(range_t(*it, length, false));
+                                state.add   (range_t(*it, length, worker_state.tfbs_start_positions[*it] == -1),
+                                             tags[cluster.cluster_tag()]);
+                        }
+                }
+        }
+}
+
 // Gibbs block samples
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -414,9 +663,11 @@ dpm_tfbs_sampler_t::m_metropolis_sample(cluster_tag_t cluster_tag, double temp,
                 }
                 dpm().state().restore();
         }
+        dpm().state().commit();
         return false;
 
 accepted:
+        dpm().state().commit();
         if (m_verbose >= 2) {
                 flockfile(stderr);
                 cerr << ss.str() << endl;
@@ -535,10 +786,10 @@ dpm_tfbs_sampler_t::m_sample(size_t i, size_t n, bool is_burnin) {
                         // During optimization, local gibbs moves are
                         // used which in some cases might be
                         // incongruent with the global posterior
-                        // probabilities, caused by the approximation
-                        // of the gamma functions. Hence, we cannot
-                        // assume that the posterior probability
-                        // always increases!
+                        // probabilities, caused by the (small)
+                        // approximation error of the gamma
+                        // functions. Hence, we cannot assume that the
+                        // posterior probability always increases!
                 } while (abs(old_posterior - new_posterior) > 1e-4);
         }
         else {
@@ -562,6 +813,17 @@ dpm_tfbs_sampler_t::m_update_sampling_history(size_t switches)
         }
         m_sampling_history.cluster_sizes = cluster_sizes;
         m_sampling_history.cluster_sizes.push_back(tmp);
+
+        if (m_history_sink) {
+                m_history_sink->write(m_chain, m_sampling_history);
+                // the partition is saved, so keep only the last one
+                // which is required to resume sampling
+                if (m_sampling_history.partitions.size() > 1) {
+                        m_sampling_history.partitions.erase(
+                                m_sampling_history.partitions.begin(),
+                                m_sampling_history.partitions.end()-1);
+                }
+        }
 }
 
 // dpm_tfbs_pmcmc_t
@@ -578,9 +840,21 @@ dpm_tfbs_pmcmc_t::dpm_tfbs_pmcmc_t(
         , m_socket_file    (options.socket_file)
         , m_server         (NULL)
         , m_bt             (NULL)
+        , m_history_sink   (NULL)
 {
+        // all samplers draw from streams that are derived from
+        // this seed
+        if (options.seed != 0) {
+                rng_seed_t::set(options.seed);
+        }
+        rng_t rng;
+        seed_rng(rng);
         // initialize dpm_tfbs
         dpm_tfbs_t dpm_tfbs(options, m_data, m_alignment_set);
+        // stream samples to disk
+        if (options.history_file != "") {
+                m_history_sink = new sampling_history_sink_t(options.history_file, options.history_resume);
+        }
 
         for (size_t i = 0; i < m_size; i++) {
                 // check if we have to resume from an old state
@@ -598,11 +872,18 @@ dpm_tfbs_pmcmc_t::dpm_tfbs_pmcmc_t(
                 }
                 // initialize sampler
                 m_population[i] = new dpm_tfbs_sampler_t(options, dpm_tfbs, m_data, m_output_queue);
+                m_population[i]->gen() = rng.split();
+                operator[](i).set_history_sink(m_history_sink, i);
                 // make some noise
                 std::stringstream ss;
                 ss << "Sampler " << i+1;
                 operator[](i).name() = ss.str();
         }
+        // a history without any samples only defines the initial
+        // partitions, which are not part of the new samples
+        if (m_sampling_history.switches[0].empty()) {
+                m_sampling_history.partitions.clear();
+        }
         m_start_server();
 }
 
@@ -617,6 +898,9 @@ dpm_tfbs_pmcmc_t::dpm_tfbs_pmcmc_t(const dpm_tfbs_pmcmc_t& sampler)
 
 dpm_tfbs_pmcmc_t::~dpm_tfbs_pmcmc_t() {
         m_stop_server();
+        if (m_history_sink) {
+                delete(m_history_sink);
+        }
 }
 
 dpm_tfbs_pmcmc_t*
@@ -635,6 +919,7 @@ swap(dpm_tfbs_pmcmc_t& first, dpm_tfbs_pmcmc_t& second) {
         swap(first.m_server,        second.m_server);
         swap(first.m_bt,            second.m_bt);
         swap(first.m_output_queue,  second.m_output_queue);
+        swap(first.m_history_sink,  second.m_history_sink);
 }
 
 dpm_tfbs_pmcmc_t&
@@ -682,6 +967,11 @@ dpm_tfbs_pmcmc_t::m_stop_server() {
 void
 dpm_tfbs_pmcmc_t::save(const string& filename) const
 {
+        // partitions are stored separately in binary format, unless
+        // all samples were already written to the history file
+        if (m_options.partition_file != "" && m_options.history_file == "") {
+                save_partition_list(m_options.partition_file, sampling_history().partitions);
+        }
         if (filename == "") {
                 cout << *this;
         }
@@ -727,8 +1017,18 @@ ostream& operator<< (ostream& o, const dpm_tfbs_pmcmc_t& pmcmc)
           << history.posterior;
         o << "temperature =" << endl
           << history.temperature;
-        o << "partitions =" << endl
-          << history.partitions;
+        // only the last partition of each chain is kept in memory
+        // if samples are streamed to a history file
+        if (pmcmc.options().history_file != "") {
+                o << "history-file = " << pmcmc.options().history_file << endl;
+        }
+        else if (pmcmc.options().partition_file != "") {
+                o << "partition-file = " << pmcmc.options().partition_file << endl;
+        }
+        else {
+                o << "partitions =" << endl
+                  << history.partitions;
+        }
 
         return o;
 }
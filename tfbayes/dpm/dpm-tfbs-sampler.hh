@@ -22,10 +22,15 @@
 #include <tfbayes/config.h>
 #endif /* HAVE_CONFIG_H */
 
+#include <set>
 #include <sstream>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
 
 #include <tfbayes/dpm/dpm-tfbs.hh>
 #include <tfbayes/dpm/dpm-tfbs-state.hh>
+#include <tfbayes/dpm/dpm-sampling-history-sink.hh>
 #include <tfbayes/dpm/sampler.hh>
 #include <tfbayes/dpm/save-queue.hh>
 
@@ -63,6 +68,10 @@ public:
         const dpm_tfbs_t& dpm() const;
               dpm_tfbs_t& dpm();
 
+        // stream samples to a history sink, where only the last
+        // partition is kept in memory
+        void set_history_sink(sampling_history_sink_t* sink, size_t chain);
+
         // auxiliary types
         ////////////////////////////////////////////////////////////////////////
         typedef mixture_state_t::const_iterator cm_iterator;
@@ -78,6 +87,25 @@ protected:
         using gibbs_sampler_t::m_gibbs_sample;
         bool   m_gibbs_sample(const index_t& index, double temp, bool optimize);
         size_t m_gibbs_sample(double temp = 1.0, bool optimize = false);
+        size_t m_gibbs_sample(const std::vector<index_t>& indices, double temp, bool optimize);
+        // parallel Gibbs sweep, where each shard of sequences is
+        // sampled by a worker with its own copy of the mixture model
+        void   m_init_shards(size_t n);
+        void   m_init_workers();
+        size_t m_gibbs_sample_parallel(double temp, bool optimize);
+        // result of a sweep over a single shard, i.e. the number of
+        // switches, the clusters that were created by the worker
+        // (possibly reusing the tag of a cluster that was emptied)
+        // and the positions where the worker differs from this
+        // sampler
+        typedef struct {
+                size_t switches;
+                std::set<cluster_tag_t> clusters;
+                std::vector<index_t> changes;
+        } shard_result_t;
+        void   m_gibbs_sample_shard(size_t i, const std::vector<std::vector<index_t> >* indices,
+                                    double temp, bool optimize, std::vector<shard_result_t>* results);
+        void   m_merge_shards(const std::vector<shard_result_t>& results);
         void m_block_sample(double temp, bool optimize);
         void m_block_sample(cluster_tag_t cluster_tag, double temp, bool optimize);
         bool m_metropolis_proposal_size(cluster_t& cluster, std::stringstream& ss);
@@ -90,6 +118,8 @@ protected:
         void m_update_sampling_history(size_t switches);
         save_queue_t<command_t*> m_command_queue;
         save_queue_t<std::string>* m_output_queue;
+        sampling_history_sink_t* m_history_sink;
+        size_t m_chain;
 
         // initial temperature for simulated annealing
         double m_t0;
@@ -99,6 +129,15 @@ protected:
         bool   m_optimize;
         size_t m_optimize_period;
         size_t m_verbose;
+
+        // sequences and sampling indices of each shard
+        std::vector<std::vector<size_t>  > m_shard_sequences;
+        std::vector<std::vector<index_t> > m_shard_indices;
+        // workers of the parallel Gibbs sweep and the threads that
+        // run them, both are created by the first parallel sweep
+        // and are not copied with the sampler
+        std::vector<boost::shared_ptr<dpm_tfbs_sampler_t> > m_workers;
+        boost::shared_ptr<thread_pool_t> m_thread_pool;
 };
 
 #include <pmcmc.hh>
@@ -152,6 +191,8 @@ protected:
         boost::thread* m_bt;
 
         save_queue_t<std::string> m_output_queue;
+
+        sampling_history_sink_t* m_history_sink;
 };
 
 std::ostream& operator<< (std::ostream& o, const dpm_tfbs_pmcmc_t& pmcmc);
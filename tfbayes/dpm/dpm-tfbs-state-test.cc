@@ -0,0 +1,207 @@
+/* Copyright (C) 2011-2013 Philipp Benner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <tfbayes/config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include <boost/format.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+
+#include <tfbayes/dpm/dpm-tfbs.hh>
+
+using namespace std;
+
+// check that restoring a state after a rejected proposal recovers
+// exactly the partition and (up to rounding) the likelihood that
+// the state had before the proposal
+////////////////////////////////////////////////////////////////////////////////
+
+typedef struct {
+        vector<cluster_tag_t> assignments;
+        vector<short> start_positions;
+        size_t num_tfbs;
+        size_t background_size;
+        double log_likelihood;
+        double posterior;
+} snapshot_t;
+
+static snapshot_t
+snapshot(const dpm_tfbs_t& dpm)
+{
+        const dpm_tfbs_state_t& state = dpm.state();
+        snapshot_t result;
+
+        result.assignments.assign(
+                state.cluster_assignments().linear_begin(),
+                state.cluster_assignments().linear_end());
+        result.start_positions.assign(
+                state.tfbs_start_positions.linear_begin(),
+                state.tfbs_start_positions.linear_end());
+        result.num_tfbs        = state.num_tfbs;
+        result.background_size = state.background_size();
+        result.log_likelihood  = state.log_likelihood();
+        result.posterior       = dpm.posterior();
+
+        return result;
+}
+
+static bool
+equal(double a, double b)
+{
+        return abs(a - b) <= 1e-8*max(1.0, abs(a));
+}
+
+static bool
+compare(const snapshot_t& a, const snapshot_t& b, size_t trial)
+{
+        bool result = true;
+
+        if (a.assignments != b.assignments || a.start_positions != b.start_positions ||
+            a.num_tfbs != b.num_tfbs || a.background_size != b.background_size) {
+                cerr << boost::format("trial %d: partition was not restored") % trial << endl;
+                result = false;
+        }
+        if (!equal(a.log_likelihood, b.log_likelihood)) {
+                cerr << boost::format("trial %d: log likelihood was not restored (%.12f != %.12f)")
+                        % trial % a.log_likelihood % b.log_likelihood << endl;
+                result = false;
+        }
+        if (!equal(a.posterior, b.posterior)) {
+                cerr << boost::format("trial %d: posterior was not restored (%.12f != %.12f)")
+                        % trial % a.posterior % b.posterior << endl;
+                result = false;
+        }
+        return result;
+}
+
+// assign a site starting at the given position to a cluster, in the
+// same way as the Gibbs sampler does
+static bool
+add_site(dpm_tfbs_state_t& state, const index_t& index, bool reverse, cluster_tag_t cluster_tag)
+{
+        size_t length;
+
+        if (!state.is_background(index) || !state.get_free_range(index, length)) {
+                return false;
+        }
+        const range_t range(index, length, reverse);
+        if (!state.valid_foreground_position(range_t(index, state[cluster_tag].model().id().length, reverse))) {
+                return false;
+        }
+        state.remove(range);
+        state.add   (range, cluster_tag);
+
+        return true;
+}
+
+static index_t
+random_index(const data_tfbs_t& data, boost::random::mt19937& gen)
+{
+        boost::random::uniform_int_distribution<size_t> dist_i(0, data.size()-1);
+        const size_t i = dist_i(gen);
+        boost::random::uniform_int_distribution<size_t> dist_j(0, data[i].size()-1);
+
+        return index_t(i, dist_j(gen));
+}
+
+int
+main(int argc, char *argv[])
+{
+        const char* filename = argc > 1 ? argv[1] : "test-dpm-tfbs.approximation.fa";
+        const size_t trials  = 1000;
+
+        tfbs_options_t options = tfbs_options_t();
+        options.alpha            = 0.05;
+        options.lambda           = 0.01;
+        options.process_prior    = "pitman-yor process";
+        options.background_model = "independence-dirichlet";
+        options.background_alpha = matrix<double>(1, data_tfbs_t::alphabet_size, 1.0);
+        options.background_gamma = vector<double>(2, 1.0);
+        options.threads          = 1;
+        options.baseline_lengths.push_back(vector<double>(1, 10));
+        options.baseline_names  .push_back("baseline-default");
+        options.baseline_priors .push_back(matrix<double>(1, data_tfbs_t::alphabet_size, 1.0));
+        options.baseline_weights.push_back(1.0);
+
+        const data_tfbs_t data(filename);
+        dpm_tfbs_t dpm(options, data);
+        dpm_tfbs_state_t& state = dpm.state();
+        boost::random::mt19937 gen;
+        boost::random::uniform_int_distribution<> dist(0, 3);
+
+        // initial state with a few clusters
+        vector<cluster_tag_t> cluster_tags;
+        for (size_t i = 0; i < 4; i++) {
+                cluster_tags.push_back(state.get_free_cluster(0).cluster_tag());
+                for (size_t j = 0; j < 50; j++) {
+                        add_site(state, random_index(data, gen), dist(gen) % 2, cluster_tags.back());
+                }
+        }
+        size_t failures = 0, changes = 0;
+
+        for (size_t trial = 0; trial < trials; trial++) {
+                const snapshot_t before = snapshot(dpm);
+                cluster_t& cluster = state[cluster_tags[trial % cluster_tags.size()]];
+                const cluster_tag_t bg_cluster_tag = state.bg_cluster_tags[0];
+
+                state.save(cluster.cluster_tag(), bg_cluster_tag);
+                switch (dist(gen)) {
+                case 0:
+                        state.move_left (cluster, bg_cluster_tag, 1 + trial % 5);
+                        break;
+                case 1:
+                        state.move_right(cluster, bg_cluster_tag, 1 + trial % 5);
+                        break;
+                default: {
+                        // Gibbs moves of several sites to a new cluster
+                        const cluster_tag_t cluster_tag = state.get_free_cluster(0).cluster_tag();
+                        for (size_t j = 0; j < 10; j++) {
+                                const index_t index = random_index(data, gen);
+                                size_t length;
+                                if (state.is_tfbs_start_position(index) &&
+                                    state.get_free_range(index, length)) {
+                                        const range_t range(index, length, false);
+                                        state.remove(range);
+                                        state.add   (range, bg_cluster_tag);
+                                }
+                                add_site(state, index, dist(gen) % 2, cluster_tag);
+                        }
+                        break;
+                }
+                }
+                if (snapshot(dpm).assignments != before.assignments) {
+                        changes++;
+                }
+                state.restore();
+                state.commit();
+
+                if (!compare(before, snapshot(dpm), trial)) {
+                        failures++;
+                }
+        }
+        cout << boost::format("%d of %d proposals changed the partition, %d restored states differ")
+                % changes % trials % failures << endl;
+
+        return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -21,6 +21,8 @@
 
 #include <algorithm>
 
+#include <boost/math/special_functions/gamma.hpp>
+
 #include <tfbayes/dpm/dpm-tfbs-state.hh>
 
 using namespace std;
@@ -33,9 +35,14 @@ dpm_tfbs_state_t::dpm_tfbs_state_t(
         , tfbs_start_positions (data.sizes(), 0)
           // number of transcription factor binding sites
         , num_tfbs             (0)
-          // auxiliary variables
-        , state_p              (NULL)
         , m_data               (&data)
+          // statistics of the empty state
+        , m_log_likelihood     (0.0)
+        , m_log_gamma_sizes    (0.0)
+        , m_background_size    (0)
+          // no transaction is open
+        , m_journal            ()
+        , m_journaling         (false)
 {
         assert(options.baseline_lengths.size() > 0);
         // find minimum and maximum lengths of the foreground model
@@ -55,16 +62,19 @@ dpm_tfbs_state_t::dpm_tfbs_state_t(const dpm_tfbs_state_t& state)
           // length of tfbs
         , min_foreground_length (state.min_foreground_length)
         , max_foreground_length (state.max_foreground_length)
-          // initialize saved state to NULL
-        , state_p               (NULL)
         , m_data                (state.m_data)
         , bg_cluster_tags       (state.bg_cluster_tags)
+        , m_cluster_statistics  (state.m_cluster_statistics)
+        , m_log_likelihood      (state.m_log_likelihood)
+        , m_log_gamma_sizes     (state.m_log_gamma_sizes)
+        , m_background_size     (state.m_background_size)
+        , m_foreground_sizes    (state.m_foreground_sizes)
+          // transactions are not copied
+        , m_journal             ()
+        , m_journaling          (false)
 { }
 
 dpm_tfbs_state_t::~dpm_tfbs_state_t() {
-        if (state_p != NULL) {
-                delete(state_p);
-        }
 }
 
 void swap(dpm_tfbs_state_t& first, dpm_tfbs_state_t& second)
@@ -77,6 +87,13 @@ void swap(dpm_tfbs_state_t& first, dpm_tfbs_state_t& second)
         swap(first.max_foreground_length,  second.max_foreground_length);
         swap(first.m_data,                 second.m_data);
         swap(first.bg_cluster_tags,        second.bg_cluster_tags);
+        swap(first.m_journal,              second.m_journal);
+        swap(first.m_journaling,           second.m_journaling);
+        swap(first.m_cluster_statistics,   second.m_cluster_statistics);
+        swap(first.m_log_likelihood,       second.m_log_likelihood);
+        swap(first.m_log_gamma_sizes,      second.m_log_gamma_sizes);
+        swap(first.m_background_size,      second.m_background_size);
+        swap(first.m_foreground_sizes,     second.m_foreground_sizes);
 }
 
 dpm_tfbs_state_t*
@@ -150,6 +167,32 @@ dpm_tfbs_state_t::get_free_range(const index_t& index, size_t& length)
 
 void
 dpm_tfbs_state_t::add(const range_t& range, cluster_tag_t cluster_tag)
+{
+        if (m_journaling) {
+                journal_entry_t entry = { true, range, cluster_tag };
+                m_journal.push_back(entry);
+        }
+        m_add(range, cluster_tag);
+}
+
+void
+dpm_tfbs_state_t::remove(const range_t& range)
+{
+        if (m_journaling) {
+                const index_t& index = range.index();
+                journal_entry_t entry = { false, range, operator[](index) };
+                // foreground sites are removed with the orientation
+                // that was used when they were added
+                if (!is_background(index)) {
+                        entry.range.reverse() = tfbs_start_positions[index] == -1;
+                }
+                m_journal.push_back(entry);
+        }
+        m_remove(range);
+}
+
+void
+dpm_tfbs_state_t::m_add(const range_t& range, cluster_tag_t cluster_tag)
 {
         if (is_background(cluster_tag)) {
                 operator[](cluster_tag).add_observations(range);
@@ -172,7 +215,7 @@ dpm_tfbs_state_t::add(const range_t& range, cluster_tag_t cluster_tag)
                         cluster.add_observations(range1);
                         // add remaining observations to the
                         // background model
-                        add(range2, bg_cluster_tags[0]);
+                        m_add(range2, bg_cluster_tags[0]);
                 }
                 else {
                         cluster.add_observations(range);
@@ -183,7 +226,7 @@ dpm_tfbs_state_t::add(const range_t& range, cluster_tag_t cluster_tag)
 }
 
 void
-dpm_tfbs_state_t::remove(const range_t& range)
+dpm_tfbs_state_t::m_remove(const range_t& range)
 {
         const index_t& index = range.index();
         // cluster of the foreground model starting at the
@@ -216,7 +259,7 @@ dpm_tfbs_state_t::remove(const range_t& range)
                         cluster.remove_observations(range1);
                         // remove remaining observations
                         assert(is_background(range2.index()));
-                        remove(range2);
+                        m_remove(range2);
                 }
                 else {
                         range_t range1(range);
@@ -232,15 +275,30 @@ dpm_tfbs_state_t::remove(const range_t& range)
 
 void
 dpm_tfbs_state_t::save(cluster_tag_t cluster_tag, cluster_tag_t bg_cluster_tag) {
-        if (state_p != NULL) {
-                delete(state_p);
-        }
-        state_p = this->clone();
+        m_journal.clear();
+        m_journaling = true;
 }
 
 void
 dpm_tfbs_state_t::restore() {
-        operator=(*state_p);
+        // undo all operations in reverse order, the transaction
+        // stays open so that the state can be restored again
+        for (journal_t::const_reverse_iterator it = m_journal.rbegin();
+             it != m_journal.rend(); it++) {
+                if (it->add) {
+                        m_remove(it->range);
+                }
+                else {
+                        m_add(it->range, it->cluster_tag);
+                }
+        }
+        m_journal.clear();
+}
+
+void
+dpm_tfbs_state_t::commit() {
+        m_journal.clear();
+        m_journaling = false;
 }
 
 bool
@@ -391,7 +449,7 @@ dpm_tfbs_state_t::is_tfbs_start_position(const index_t& index) const
 bool
 dpm_tfbs_state_t::is_background(const index_t& index) const
 {
-        return cluster_assignments()[index] == 0;
+        return cluster_assignments().element(index) == 0;
 }
 
 bool
@@ -415,3 +473,90 @@ dpm_tfbs_state_t::add_background_cluster(component_model_t& component_model)
         return cluster_tag;
 }
 
+
+void
+dpm_tfbs_state_t::update(Observed<cluster_event_t>* observed, cluster_event_t event)
+{
+        mixture_state_t::update(observed, event);
+
+        if (event == cluster_event_update) {
+                m_update_statistics(*static_cast<cluster_t*>(observed));
+        }
+}
+
+void
+dpm_tfbs_state_t::update(Observed<cluster_event_t>* observed, cluster_event_t event, const range_t& range)
+{
+        mixture_state_t::update(observed, event, range);
+
+        // cluster statistics are already updated when the
+        // observer is notified, component models keep track of
+        // their log likelihood as counts are added or removed, so
+        // that this costs only the change of the model
+        m_update_statistics(*static_cast<cluster_t*>(observed));
+}
+
+void
+dpm_tfbs_state_t::m_update_statistics(const cluster_t& cluster)
+{
+        const size_t tag = cluster.cluster_tag();
+
+        if (tag >= m_cluster_statistics.size()) {
+                cluster_statistics_t tmp = { 0, 0.0, 0.0 };
+                m_cluster_statistics.resize(tag+1, tmp);
+        }
+        cluster_statistics_t& old_statistics = m_cluster_statistics[tag];
+        cluster_statistics_t  new_statistics = { cluster.size(), 0.0, 0.0 };
+
+        // only used clusters contribute to the likelihood
+        if (cluster.size() > 0 || !cluster.destructible()) {
+                new_statistics.log_likelihood = cluster.model().log_likelihood();
+        }
+        if (is_background(cluster)) {
+                m_background_size -= old_statistics.size;
+                m_background_size += new_statistics.size;
+        }
+        else {
+                const size_t baseline_tag = cluster.baseline_tag();
+                if (baseline_tag >= m_foreground_sizes.size()) {
+                        m_foreground_sizes.resize(baseline_tag+1, 0);
+                }
+                m_foreground_sizes[baseline_tag] -= old_statistics.size;
+                m_foreground_sizes[baseline_tag] += new_statistics.size;
+
+                if (cluster.size() > 0) {
+                        new_statistics.log_gamma_size = boost::math::lgamma<double>(cluster.size());
+                }
+        }
+        m_log_likelihood  += new_statistics.log_likelihood - old_statistics.log_likelihood;
+        m_log_gamma_sizes += new_statistics.log_gamma_size - old_statistics.log_gamma_size;
+
+        old_statistics = new_statistics;
+}
+
+double
+dpm_tfbs_state_t::log_likelihood() const
+{
+        return m_log_likelihood;
+}
+
+double
+dpm_tfbs_state_t::log_gamma_sizes() const
+{
+        return m_log_gamma_sizes;
+}
+
+size_t
+dpm_tfbs_state_t::background_size() const
+{
+        return m_background_size;
+}
+
+size_t
+dpm_tfbs_state_t::foreground_size(baseline_tag_t baseline_tag) const
+{
+        if (size_t(baseline_tag) >= m_foreground_sizes.size()) {
+                return 0;
+        }
+        return m_foreground_sizes[baseline_tag];
+}
@@ -62,8 +62,12 @@ public:
         bool move_left (cluster_t& cluster, cluster_tag_t bg_cluster_tag, size_t n = 1);
         bool move_right(cluster_t& cluster, cluster_tag_t bg_cluster_tag, size_t n = 1);
 
+        // save() opens a transaction, i.e. all subsequent add and
+        // remove operations are recorded so that restore() can roll
+        // the state back; commit() closes the transaction
         void save(cluster_tag_t cluster_tag, cluster_tag_t bg_cluster_tag);
         void restore();
+        void commit();
 
         // access to cluster assignments, the data type might be
         // different in child classes, so make this virtual
@@ -83,6 +87,18 @@ public:
         cluster_tag_t add_background_cluster(component_model_t& component_model);
         bool set_length(cluster_t& cluster, cluster_tag_t bg_cluster_tag, size_t n);
 
+        // observe clusters to keep track of statistics required for
+        // computing the posterior
+        void update(Observed<cluster_event_t>* cluster, cluster_event_t event);
+        void update(Observed<cluster_event_t>* cluster, cluster_event_t event, const range_t& range);
+
+        // statistics of the current state, which are updated
+        // whenever a cluster changes
+        double log_likelihood() const;
+        double log_gamma_sizes() const;
+        size_t background_size() const;
+        size_t foreground_size(baseline_tag_t baseline_tag) const;
+
         // data
         ////////////////////////////////////////////////////////////////////////
 
@@ -95,15 +111,47 @@ public:
         size_t min_foreground_length;
         size_t max_foreground_length;
 
-        // auxiliary variables to save the current state
-        dpm_tfbs_state_t* state_p;
-
         const data_tfbs_t* m_data;
 
         // the bg_cluster_tag is determined after the state is
         // initialize, so this can't be a constant
         typedef std::vector<cluster_tag_t> bg_cluster_tags_t;
         bg_cluster_tags_t bg_cluster_tags;
+
+protected:
+        void m_add   (const range_t& range, cluster_tag_t tag);
+        void m_remove(const range_t& range);
+        void m_update_statistics(const cluster_t& cluster);
+
+        // contribution of a single cluster to the statistics
+        typedef struct {
+                size_t size;
+                double log_likelihood;
+                double log_gamma_size;
+        } cluster_statistics_t;
+
+        std::vector<cluster_statistics_t> m_cluster_statistics;
+        // sum of all log likelihoods
+        double m_log_likelihood;
+        // sum of log Gamma(n) over the sizes n of foreground clusters
+        double m_log_gamma_sizes;
+        // number of positions assigned to the background and number
+        // of sites assigned to each baseline model
+        size_t m_background_size;
+        std::vector<size_t> m_foreground_sizes;
+
+        // journal of operations performed since the last call to
+        // save(), a removal also records the cluster tag and
+        // orientation of the range so that it can be undone
+        typedef struct {
+                bool          add;
+                range_t       range;
+                cluster_tag_t cluster_tag;
+        } journal_entry_t;
+        typedef std::vector<journal_entry_t> journal_t;
+
+        journal_t m_journal;
+        bool      m_journaling;
 };
 
 #endif /* __TFBAYES_DPM_DPM_TFBS_STATE_HH__ */
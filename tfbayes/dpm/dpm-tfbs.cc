@@ -44,6 +44,7 @@ dpm_tfbs_t::dpm_tfbs_t(const tfbs_options_t& options,
         , m_lambda         (options.lambda)
         , m_lambda_log     (log(options.lambda))
         , m_lambda_inv_log (log(1-options.lambda))
+        , m_threads        (options.threads)
 {
         ////////////////////////////////////////////////////////////////////////////////
         // check that the alignment data matches the phylogenetic data
@@ -145,7 +146,7 @@ dpm_tfbs_t::dpm_tfbs_t(const tfbs_options_t& options,
                                 funlockfile(stderr);
                         }
                         model_id_t model_id = {*is, size_t(length)};
-                        product_dirichlet_t* dirichlet = new product_dirichlet_t(model_id, *it, *iq, data, data.complements());
+                        product_dirichlet_t* dirichlet = new product_dirichlet_t(model_id, *it, *iq, data);
                         m_baseline_tags   .push_back(m_state.add_baseline_model(dirichlet));
                         // the weight consists of the individual
                         // weight of the baseline component and a
@@ -206,6 +207,7 @@ dpm_tfbs_t::dpm_tfbs_t(const dpm_tfbs_t& dpm)
         , m_lambda_inv_log   (dpm.m_lambda_inv_log)
         // process prios
         , m_process_prior    (dpm.m_process_prior->clone())
+        , m_threads          (dpm.m_threads)
 { }
 
 dpm_tfbs_t::~dpm_tfbs_t() {
@@ -229,6 +231,7 @@ swap(dpm_tfbs_t& first, dpm_tfbs_t& second)
         swap(first.m_lambda_log,       second.m_lambda_log);
         swap(first.m_lambda_inv_log,   second.m_lambda_inv_log);
         swap(first.m_process_prior,    second.m_process_prior);
+        swap(first.m_threads,          second.m_threads);
 }
 
 dpm_tfbs_t&
@@ -403,11 +406,9 @@ dpm_tfbs_t::mixture_weights(const vector<range_t>& range_set, double log_weights
 
 double
 dpm_tfbs_t::likelihood() const {
-        double result = 0;
+        // the state keeps track of the likelihood of all clusters
+        double result = m_state.log_likelihood();
 
-        BOOST_FOREACH (const cluster_t* cluster, m_state) {
-                result += cluster->model().log_likelihood();
-        }
         assert(!std::isnan(result));
 
         return result;
@@ -420,16 +421,13 @@ double
 dpm_tfbs_t::posterior() const {
         double result = likelihood();
 
-        BOOST_FOREACH (const cluster_t* cluster, m_state) {
-                if (m_state.is_background(*cluster)) {
-                        // background prior
-                        result += cluster->size()*m_lambda_inv_log;
-                }
-                else {
-                        // foreground weight
-                        result += cluster->size()*m_lambda_log;
-                        result += cluster->size()*m_baseline_weights[cluster->baseline_tag()];
-                }
+        // background prior
+        result += m_state.background_size()*m_lambda_inv_log;
+        // foreground weights
+        for (size_t i = 0; i < m_baseline_tags.size(); i++) {
+                const size_t n = m_state.foreground_size(m_baseline_tags[i]);
+                result += n*m_lambda_log;
+                result += n*m_baseline_weights[i];
         }
         // process prior
         result += m_process_prior->joint(m_state);
@@ -126,6 +126,9 @@ protected:
 
         // process priors
         dpm_tfbs_prior_t* m_process_prior;
+
+        // number of threads for computing point estimates
+        size_t m_threads;
 };
 
 #endif /* __TFBAYES_DPM_DPM_TFBS_HH__ */
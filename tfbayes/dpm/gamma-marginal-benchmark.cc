@@ -0,0 +1,133 @@
+/* Copyright (C) 2013 Philipp Benner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <tfbayes/config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <set>
+#include <vector>
+
+#include <sys/time.h>
+
+#include <tfbayes/dpm/data-tfbs.hh>
+#include <tfbayes/dpm/gamma-marginal.hh>
+#include <tfbayes/utility/thread-pool.hh>
+
+using namespace std;
+
+// compare the numerical integration of the gamma marginal with the
+// previous Monte Carlo integration, and measure the time to
+// precompute the background of a data set (e.g. the output of
+// tfbayes-approximate for test-dpm-tfbs.fa)
+////////////////////////////////////////////////////////////////////////////////
+
+typedef gamma_marginal_t::counts_t counts_t;
+
+static double
+elapsed(const struct timeval& start)
+{
+        struct timeval end;
+        gettimeofday(&end, NULL);
+
+        return (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec)/1000000.0;
+}
+
+class precompute_t {
+public:
+        precompute_t(const vector<counts_t>& counts, vector<double>& result, gamma_marginal_cache_t& cache)
+                : counts(counts), result(result), cache(cache)
+                { }
+        void operator()(size_t i) const {
+                result[i] = cache(counts[i]);
+        }
+protected:
+        const vector<counts_t>& counts;
+        vector<double>& result;
+        gamma_marginal_cache_t& cache;
+};
+
+int main(int argc, char *argv[])
+{
+        if (argc < 2 || argc > 4) {
+                cerr << "Usage: gamma-marginal-benchmark FASTA [SAMPLES [THREADS]]"
+                     << endl;
+                exit(EXIT_FAILURE);
+        }
+        const size_t n       = argc >= 3 ? atoi(argv[2]) : 10;
+        const size_t threads = argc >= 4 ? atoi(argv[3]) : 1;
+
+        const sequence_data_t<data_tfbs_t::code_t> data = data_tfbs_t::read(argv[1]);
+        const vector<double> parameters = {5.0, 0.2};
+        counts_t alpha;
+        fill(alpha.begin(), alpha.end(), -1.0);
+
+        const gamma_marginal_t gamma_marginal(alpha, parameters);
+
+        // all positions of the data set in linear order
+        vector<counts_t> counts(data.linear_begin(), data.linear_end());
+        set<counts_t> distinct, canonical;
+        for (size_t i = 0; i < counts.size(); i++) {
+                distinct .insert(counts[i]);
+                canonical.insert(gamma_marginal.canonicalize(counts[i]));
+        }
+        cout << counts.size()    << " positions, "
+             << distinct.size()  << " distinct count vectors, "
+             << canonical.size() << " up to permutations:" << endl;
+
+        // integrate the first count vectors with both methods
+        struct timeval start;
+        double t_miser = 0.0, t_quadrature = 0.0, difference = 0.0;
+        size_t samples = 0;
+        for (set<counts_t>::const_iterator it = canonical.begin();
+             it != canonical.end() && samples < n; it++, samples++) {
+                gettimeofday(&start, NULL);
+                const double result1 = gamma_marginal_miser(*it, alpha, parameters);
+                t_miser += elapsed(start);
+
+                gettimeofday(&start, NULL);
+                const double result2 = gamma_marginal(*it);
+                t_quadrature += elapsed(start);
+
+                difference = max(difference, abs(result1 - result2));
+        }
+        if (samples > 0) {
+                cout << "  miser     : " << 1000.0*t_miser/samples      << " ms/vector" << endl
+                     << "  quadrature: " << 1000.0*t_quadrature/samples << " ms/vector" << endl
+                     << "  difference: " << difference << " (max. absolute, log scale)" << endl;
+        }
+
+        // precompute the background of all positions
+        thread_pool_t thread_pool(threads);
+        gamma_marginal_cache_t cache(gamma_marginal);
+        vector<double> result(counts.size(), 0.0);
+
+        gettimeofday(&start, NULL);
+        thread_pool.parallel_for(0, counts.size(), 64, precompute_t(counts, result, cache));
+        const double t_cache = elapsed(start);
+
+        cout << "  precomputing all positions with " << threads << " thread(s):" << endl
+             << "    cache     : " << t_cache << " s (" << cache.size() << " entries)" << endl;
+        if (samples > 0) {
+                cout << "    miser     : " << t_miser/samples*distinct.size()
+                     << " s (estimated, one integral per distinct count vector)" << endl;
+        }
+        return EXIT_SUCCESS;
+}
@@ -0,0 +1,487 @@
+/* Copyright (C) 2013 Philipp Benner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <tfbayes/config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+#include <gsl/gsl_monte.h>
+#include <gsl/gsl_monte_miser.h>
+
+#include <boost/math/distributions/gamma.hpp>
+#include <boost/math/special_functions/gamma.hpp>
+#include <boost/math/special_functions/digamma.hpp>
+#include <boost/math/special_functions/trigamma.hpp>
+
+#include <tfbayes/dpm/gamma-marginal.hh>
+#include <tfbayes/fastarithmetics/fast-lnbeta.hh>
+
+using namespace std;
+
+// Gauss-Laguerre rules
+////////////////////////////////////////////////////////////////////////////////
+
+/* nodes and weights of the n-point Gauss rule for the weight function
+ * t^alpha exp(-t) on [0, inf), the roots of the Laguerre polynomial
+ * are found with Newton's method from the usual initial guesses, the
+ * weights are normalized to one */
+static void
+gauss_laguerre(size_t n, double alpha, vector<double>& nodes, vector<double>& weights)
+{
+        nodes  .resize(n);
+        weights.resize(n);
+
+        double z = 0.0, sum = 0.0;
+
+        for (size_t i = 0; i < n; i++) {
+                if (i == 0) {
+                        z = (1.0+alpha)*(3.0+0.92*alpha)/(1.0+2.4*n+1.8*alpha);
+                }
+                else if (i == 1) {
+                        z += (15.0+6.25*alpha)/(1.0+0.9*alpha+2.5*n);
+                }
+                else {
+                        const double a = i-1.0;
+                        z += ((1.0+2.55*a)/(1.9*a) + 1.26*a*alpha/(1.0+3.5*a))
+                                *(z-nodes[i-2])/(1.0+0.3*alpha);
+                }
+                double p1 = 1.0, p2 = 0.0, pp = 1.0;
+                for (size_t it = 0; it < 100; it++) {
+                        p1 = 1.0; p2 = 0.0;
+                        for (size_t j = 1; j <= n; j++) {
+                                const double p3 = p2;
+                                p2 = p1;
+                                p1 = ((2.0*j-1.0+alpha-z)*p2 - (j-1.0+alpha)*p3)/j;
+                        }
+                        pp = (n*p1 - (n+alpha)*p2)/z;
+                        const double tmp = z;
+                        z = tmp - p1/pp;
+                        if (abs(z-tmp) <= 1e-15*z) {
+                                break;
+                        }
+                }
+                nodes  [i] = z;
+                weights[i] = -1.0/(pp*p2);
+                sum       += weights[i];
+        }
+        for (size_t i = 0; i < n; i++) {
+                weights[i] /= sum;
+        }
+}
+
+/* number of nodes for a count, Gauss-Laguerre rules with m nodes are
+ * exact for integer counts n <= 2m-1 */
+static size_t
+laguerre_nodes(double n)
+{
+        return static_cast<size_t>(n/2.0) + 4;
+}
+
+// Gamma marginal
+////////////////////////////////////////////////////////////////////////////////
+
+gamma_marginal_t::gamma_marginal_t(const counts_t& alpha, const vector<double>& parameters)
+        : m_alpha     (alpha),
+          m_parameters(parameters),
+          m_k         (parameters[0]),
+          m_theta     (parameters[1]),
+          m_rules     (max_nodes+1)
+{
+        assert(parameters.size() == 2);
+
+        for (size_t i = 1; i <= max_nodes; i++) {
+                gauss_laguerre(i, m_k-1.0, m_rules[i].nodes, m_rules[i].weights);
+        }
+}
+
+gamma_marginal_t::counts_t
+gamma_marginal_t::canonicalize(const counts_t& counts) const
+{
+        counts_t result;
+
+        for (size_t i = 0; i < data_tfbs_t::alphabet_size; i++) {
+                // also replace -0.0 by 0.0
+                result[i] = counts[i] + 0.0;
+        }
+        // sort counts of equal pseudocounts in decreasing order
+        for (size_t i = 0; i < data_tfbs_t::alphabet_size; i++) {
+                for (size_t j = i+1; j < data_tfbs_t::alphabet_size; j++) {
+                        if (m_alpha[i] == m_alpha[j] && result[j] > result[i]) {
+                                swap(result[i], result[j]);
+                        }
+                }
+        }
+        return result;
+}
+
+/* log of the integral
+ *
+ *   int a^(k-1) exp(-lambda a) Gamma(n+a)/Gamma(a) da
+ *
+ * for large n with Laplace's method in u = log a, where the Gaussian
+ * approximation is corrected by a trapezoidal sum on a grid around
+ * the mode, whose step size is given by the curvature at the mode */
+double
+gamma_marginal_t::m_log_laplace(double n, double lambda) const
+{
+        using boost::math::digamma;
+        using boost::math::lgamma;
+        using boost::math::trigamma;
+
+        // the first derivative of the exponent is positive for
+        // small and negative for large u
+        double lo = -50.0, hi = 50.0, u = log(n/lambda), d2 = -1.0;
+        for (size_t it = 0; it < 100; it++) {
+                const double a  = exp(u);
+                const double h0 = digamma(n+a) - digamma(a) - lambda;
+                const double h1 = trigamma(n+a) - trigamma(a);
+                const double d1 = m_k + a*h0;
+                d2 = a*h0 + a*a*h1;
+                if (d1 > 0.0) lo = u;
+                else          hi = u;
+                double tmp = u - d1/d2;
+                // fall back to bisection if Newton leaves the bracket
+                if (!(tmp > lo && tmp < hi)) {
+                        tmp = (lo+hi)/2.0;
+                }
+                if (abs(tmp-u) < 1e-10) {
+                        u = tmp;
+                        break;
+                }
+                u = tmp;
+        }
+        // exponent of the integrand relative to the mode
+        const double g0 = m_k*u - lambda*exp(u) + lgamma(n+exp(u)) - lgamma(exp(u));
+        const double h  = 0.5/sqrt(max(-d2, 1e-8));
+        double sum = 1.0;
+        for (double sign = -1.0; sign <= 1.0; sign += 2.0) {
+                for (size_t j = 1; j < 1000; j++) {
+                        const double v = u + sign*j*h;
+                        const double a = exp(v);
+                        const double g = m_k*v - lambda*a + lgamma(n+a) - lgamma(a) - g0;
+                        sum += exp(g);
+                        if (g < -40.0) {
+                                break;
+                        }
+                }
+        }
+        return g0 + log(h*sum);
+}
+
+/* log of the expectation of Gamma(n+a)/Gamma(a), where a has a gamma
+ * distribution with shape k and rate lambda, computed with the
+ * Gauss-Laguerre rule with m nodes */
+double
+gamma_marginal_t::m_log_laguerre(double n, size_t m, double lambda) const
+{
+        using boost::math::lgamma;
+
+        const rule_t& rule = m_rules[m];
+        double tmp[max_nodes];
+        double max = -numeric_limits<double>::infinity();
+
+        for (size_t j = 0; j < m; j++) {
+                const double a = rule.nodes[j]/lambda;
+                tmp[j] = lgamma(n+a) - lgamma(a);
+                max    = std::max(max, tmp[j]);
+        }
+        double sum = 0.0;
+        for (size_t j = 0; j < m; j++) {
+                sum += rule.weights[j]*exp(tmp[j]-max);
+        }
+        return max + log(sum);
+}
+
+/* number of Gauss-Laguerre nodes for a count, which is doubled until
+ * the result at s = 0, where the error is largest, does not change
+ * anymore (this is only necessary for non-integer counts), a number
+ * larger than max_nodes selects the Laplace approximation */
+size_t
+gamma_marginal_t::m_nodes(double n) const
+{
+        size_t m = laguerre_nodes(n);
+
+        if (n == 0.0 || m > max_nodes) {
+                return m;
+        }
+        double result = m_log_laguerre(n, m, 1.0/m_theta);
+        while (m < max_nodes) {
+                const size_t tmp1 = min(2*m, static_cast<size_t>(max_nodes));
+                const double tmp2 = m_log_laguerre(n, tmp1, 1.0/m_theta);
+                if (abs(tmp2 - result) < 1e-8) {
+                        break;
+                }
+                m      = tmp1;
+                result = tmp2;
+        }
+        return m;
+}
+
+/* log of the expectation of exp(-a s) Gamma(n+a)/Gamma(a) with
+ * respect to the gamma distribution of a */
+double
+gamma_marginal_t::m_log_inner(double n, size_t m, double s) const
+{
+        using boost::math::lgamma;
+
+        const double lambda = 1.0/m_theta + s;
+        // expectation of exp(-a s)
+        const double result = -m_k*log1p(m_theta*s);
+
+        if (n == 0.0) {
+                return result;
+        }
+        if (m > max_nodes) {
+                return m_log_laplace(n, lambda) - lgamma(m_k) - m_k*log(m_theta);
+        }
+        return result + m_log_laguerre(n, m, lambda);
+}
+
+/* log of the integrand on the scale y = log s, without terms that do
+ * not depend on y */
+double
+gamma_marginal_t::m_log_integrand(const counts_t& counts, const nodes_t& nodes, double sum, double y) const
+{
+        const double s = exp(y);
+        // log (1-exp(-s))^(N-1) s, where log(1-exp(-s)) is close to
+        // y for small s
+        double result = (sum-1.0)*(s < 1e-10 ? y - s/2.0 : log(-expm1(-s))) + y;
+
+        for (size_t i = 0; i < data_tfbs_t::alphabet_size; i++) {
+                if (m_alpha[i] == -1) {
+                        result += m_log_inner(counts[i], nodes[i], s);
+                }
+                else {
+                        result -= m_alpha[i]*s;
+                }
+        }
+        return result;
+}
+
+double
+gamma_marginal_t::operator()(const counts_t& counts) const
+{
+        using boost::math::lgamma;
+
+        double sum = 0.0, result = 0.0;
+
+        for (size_t i = 0; i < data_tfbs_t::alphabet_size; i++) {
+                sum += counts[i];
+                if (m_alpha[i] != -1) {
+                        result += lgamma(counts[i]+m_alpha[i]) - lgamma(m_alpha[i]);
+                }
+        }
+        // the prior integrates to one
+        if (sum == 0.0) {
+                return 0.0;
+        }
+        result -= lgamma(sum);
+
+        nodes_t nodes;
+        for (size_t i = 0; i < data_tfbs_t::alphabet_size; i++) {
+                nodes[i] = m_alpha[i] == -1 ? m_nodes(counts[i]) : 0;
+        }
+
+        // integrand values are stored relative to the value at y = 0,
+        // the integration stops where the integrand is negligible
+        const double threshold = -40.0;
+        const size_t max_steps = 1024;
+        const double h = 0.5;
+        const double f0 = m_log_integrand(counts, nodes, sum, 0.0);
+        double f_left = 0.0, f_right = 0.0, max = 0.0;
+        // sum of the integrand on the grid
+        double points = 1.0;
+        size_t left = 0, right = 0;
+
+        for (double f_prev = 0.0; right < max_steps; f_prev = f_right) {
+                f_right = m_log_integrand(counts, nodes, sum, (right+1.0)*h) - f0;
+                right++;
+                max     = std::max(max, f_right);
+                points += exp(f_right);
+                if (f_right < max + threshold && f_right < f_prev) {
+                        break;
+                }
+        }
+        for (double f_prev = 0.0; left < max_steps; f_prev = f_left) {
+                f_left = m_log_integrand(counts, nodes, sum, -(left+1.0)*h) - f0;
+                left++;
+                max     = std::max(max, f_left);
+                points += exp(f_left);
+                if (f_left < max + threshold && f_left < f_prev) {
+                        break;
+                }
+                // the integrand is proportional to exp(N y) for small
+                // s, which decays slowly if there are only few
+                // observations, in this case the sum over the
+                // remaining grid points is a geometric series
+                if (-(left*h) < log(1e-10)) {
+                        break;
+                }
+        }
+        // halve the step size until the sum converges, where the
+        // boundaries remain fixed
+        double step = h;
+        double estimate = step*(points + exp(f_left)/expm1(sum*step));
+        for (size_t n = 2; n <= max_steps; n *= 2) {
+                step = h/n;
+                for (size_t j = 0; j < (left+right)*n/2; j++) {
+                        points += exp(m_log_integrand(counts, nodes, sum, -(left*h) + (2.0*j+1.0)*step) - f0);
+                }
+                const double tmp = step*(points + exp(f_left)/expm1(sum*step));
+                if (abs(tmp - estimate) <= 1e-10*tmp) {
+                        estimate = tmp;
+                        break;
+                }
+                estimate = tmp;
+        }
+        return result + f0 + log(estimate);
+}
+
+// Monte Carlo integration
+////////////////////////////////////////////////////////////////////////////////
+
+struct gamma_marginal_data {
+        const data_tfbs_t::code_t& counts;
+        const data_tfbs_t::code_t& alpha;
+        const boost::math::gamma_distribution<> distribution;
+};
+
+GCC_ATTRIBUTE_HOT
+static double
+gamma_marginal_f(double * x, size_t dim, void * params)
+{
+        /* store the result on normal scale */
+        double result = 1.0;
+        /* casted parameters */
+        struct gamma_marginal_data* data = (gamma_marginal_data *)params;
+
+        /* pseudocounts */
+        data_tfbs_t::code_t alpha(data->alpha);
+
+        for (size_t i = 0, j = 0; i < data_tfbs_t::alphabet_size; i++) {
+                /* determine pseudocounts that are integrated out */
+                if (alpha[i] == -1) {
+                        assert(j < dim);
+                        /* copy pseudocounts */
+                        alpha[i] = x[j];
+                        /* multiply with gamma distribution */
+                        result  *= boost::math::pdf(data->distribution, x[j++]);
+                }
+        }
+
+        /* lnbeta(n, a) - lnbeta(a) */
+        result *= exp(fast_lnbeta_ratio(alpha, data->counts));
+
+        return result;
+}
+
+double
+gamma_marginal_miser(
+        const data_tfbs_t::code_t& counts,
+        const data_tfbs_t::code_t& alpha,
+        const vector<double>& parameters)
+{
+        size_t dim = count(alpha.begin(), alpha.end(), -1);
+        double xl[data_tfbs_t::alphabet_size];
+        double xu[data_tfbs_t::alphabet_size];
+        double k = parameters[0];
+        double g = parameters[1];
+        const gsl_rng_type *T;
+        gsl_rng *r;
+
+        size_t calls = 500000;
+        double result, err;
+
+        gsl_monte_function F;
+
+        struct gamma_marginal_data data = {
+                counts, alpha, boost::math::gamma_distribution<>(
+                        parameters[0], parameters[1])
+        };
+
+        /* begin at the mode and determine a point where the density
+         * function is below a certain threshold */
+        double thr;
+        for (thr = (k-1)*g; boost::math::pdf(data.distribution, thr) > 1e-8; thr += 1.0);
+
+        for (size_t i = 0; i < dim; i++) {
+                xl[i] = 0.0;
+                xu[i] = thr;
+        }
+
+        F.f      = gamma_marginal_f;
+        F.dim    = dim;
+        F.params = &data;
+
+        gsl_rng_env_setup();
+
+        T = gsl_rng_default;
+        r = gsl_rng_alloc(T);
+
+        gsl_monte_miser_state *s = gsl_monte_miser_alloc(dim);
+        gsl_monte_miser_integrate(&F, xl, xu, dim, calls, r, s,
+                                  &result, &err);
+        gsl_monte_miser_free(s);
+        gsl_rng_free(r);
+
+        return log(result);
+}
+
+// Cache
+////////////////////////////////////////////////////////////////////////////////
+
+double
+gamma_marginal_cache_t::operator()(const counts_t& counts)
+{
+        const counts_t key = m_gamma_marginal.canonicalize(counts);
+        const size_t hash  = hash_t()(key);
+        shard_t& shard     = m_shards[hash % n_shards];
+        {
+                // get read access to the shard
+                boost::shared_lock<boost::shared_mutex> lock(shard.mutex);
+                map_t::const_iterator it = shard.map.find(key);
+
+                if (it != shard.map.end()) {
+                        return it->second;
+                }
+        }
+        // compute value without holding the lock, the same value
+        // might be computed by several threads at once
+        const double result = m_gamma_marginal(key);
+        {
+                boost::unique_lock<boost::shared_mutex> lock(shard.mutex);
+                shard.map.insert(make_pair(key, result));
+        }
+        return result;
+}
+
+size_t
+gamma_marginal_cache_t::size() const
+{
+        size_t result = 0;
+
+        for (size_t i = 0; i < n_shards; i++) {
+                boost::shared_lock<boost::shared_mutex> lock(m_shards[i].mutex);
+                result += m_shards[i].map.size();
+        }
+        return result;
+}
@@ -0,0 +1,148 @@
+/* Copyright (C) 2013 Philipp Benner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __TFBAYES_DPM_GAMMA_MARGINAL_HH__
+#define __TFBAYES_DPM_GAMMA_MARGINAL_HH__
+
+#ifdef HAVE_CONFIG_H
+#include <tfbayes/config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <vector>
+
+#include <boost/array.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/thread/shared_mutex.hpp>
+#include <boost/unordered_map.hpp>
+
+#include <tfbayes/dpm/data-tfbs.hh>
+
+// Marginal likelihood of the counts at a single position under a
+// Dirichlet distribution, where all pseudocounts that are set to -1
+// are integrated out with respect to a Gamma(k, theta) prior, i.e.
+//
+//   log int prod_i Gamma(a_i; k, theta) B(n + a)/B(a) da
+//
+// Using Gamma(A)/Gamma(A+N) = 1/Gamma(N) int_0^inf exp(-A s) (1-exp(-s))^(N-1) ds
+// with A = sum_i a_i and N = sum_i n_i the integral factorizes for
+// every fixed s, so that each pseudocount is integrated separately
+// and only a one-dimensional integral over s remains. The inner
+// integrals are computed with generalized Gauss-Laguerre rules, where
+// the number of nodes grows with the count (the rule is exact for
+// integer counts), and with a corrected Laplace approximation if
+// counts are very large. The outer integral is computed with the
+// trapezoidal rule in log s, which is refined until it converges.
+////////////////////////////////////////////////////////////////////////////////
+
+class gamma_marginal_t {
+public:
+        typedef data_tfbs_t::code_t counts_t;
+
+        gamma_marginal_t(const counts_t& alpha, const std::vector<double>& parameters);
+
+        // log marginal likelihood of the counts
+        double operator()(const counts_t& counts) const;
+
+        // counts of dimensions with the same pseudocount are
+        // exchangeable, the result is the same for all counts with
+        // the same canonical form
+        counts_t canonicalize(const counts_t& counts) const;
+
+        const counts_t& alpha() const {
+                return m_alpha;
+        }
+        const std::vector<double>& parameters() const {
+                return m_parameters;
+        }
+
+        // largest Gauss-Laguerre rule, the Laplace approximation is used
+        // for larger counts
+        static const size_t max_nodes = 64;
+
+protected:
+        typedef struct {
+                std::vector<double> nodes;
+                std::vector<double> weights;
+        } rule_t;
+        typedef boost::array<size_t, data_tfbs_t::alphabet_size> nodes_t;
+
+        size_t m_nodes(double n) const;
+        double m_log_laguerre(double n, size_t m, double lambda) const;
+        double m_log_laplace(double n, double lambda) const;
+        double m_log_inner(double n, size_t m, double s) const;
+        double m_log_integrand(const counts_t& counts, const nodes_t& nodes, double sum, double y) const;
+
+        counts_t m_alpha;
+        std::vector<double> m_parameters;
+        // shape and scale of the gamma distribution
+        double m_k;
+        double m_theta;
+        // Gauss-Laguerre rules with weight function t^(k-1) exp(-t)
+        // for 1 to max_nodes nodes, the weights sum to one
+        std::vector<rule_t> m_rules;
+};
+
+// The previous Monte Carlo integration (GSL MISER), which is kept as
+// a reference
+double
+gamma_marginal_miser(
+        const data_tfbs_t::code_t& counts,
+        const data_tfbs_t::code_t& alpha,
+        const std::vector<double>& parameters);
+
+// Results of gamma_marginal_t for canonical count vectors. The map is
+// split into shards with separate locks, so that concurrent lookups
+// of different count vectors rarely wait for each other. Values are
+// computed without holding a lock.
+////////////////////////////////////////////////////////////////////////////////
+
+class gamma_marginal_cache_t {
+public:
+        typedef gamma_marginal_t::counts_t counts_t;
+
+        gamma_marginal_cache_t(const gamma_marginal_t& gamma_marginal)
+                : m_gamma_marginal(gamma_marginal)
+                { }
+
+        double operator()(const counts_t& counts);
+
+        // number of distinct count vectors
+        size_t size() const;
+
+        static const size_t n_shards = 64;
+
+protected:
+        typedef struct {
+                size_t operator()(const counts_t& counts) const {
+                        return boost::hash_range(counts.begin(), counts.end());
+                }
+        } hash_t;
+        typedef boost::unordered_map<counts_t, double, hash_t> map_t;
+        typedef struct {
+                mutable boost::shared_mutex mutex;
+                map_t map;
+        } shard_t;
+
+        // the cache can neither be copied nor assigned
+        gamma_marginal_cache_t(const gamma_marginal_cache_t& cache);
+        gamma_marginal_cache_t& operator=(const gamma_marginal_cache_t& cache);
+
+        const gamma_marginal_t& m_gamma_marginal;
+        boost::array<shard_t, n_shards> m_shards;
+};
+
+#endif /* __TFBAYES_DPM_GAMMA_MARGINAL_HH__ */
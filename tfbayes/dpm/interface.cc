@@ -32,6 +32,7 @@
 #include <tfbayes/dpm/sampler.hh>
 #include <tfbayes/dpm/dpm-partition.hh>
 #include <tfbayes/dpm/dpm-sampling-history.hh>
+#include <tfbayes/interface/gil.hh>
 
 using namespace boost::python;
 
@@ -61,6 +62,12 @@ void dpm_subset_t_insert(dpm_subset_t& dpm_subset, const range_t& range)
         dpm_subset.insert(range);
 }
 
+void gibbs_sampler_call(gibbs_sampler_t& sampler, size_t n, size_t burnin)
+{
+        release_gil_t gil;
+        sampler(n, burnin);
+}
+
 // interface
 // -----------------------------------------------------------------------------
 
@@ -126,6 +133,6 @@ BOOST_PYTHON_MODULE(interface)
         class_<gibbs_sampler_t>("gibbs_sampler_t", no_init)
                 .def(init<const mixture_model_t&,
                           const indexer_t&>())
-                .def("__call__", &gibbs_sampler_t::operator())
+                .def("__call__", &gibbs_sampler_call)
                 ;
 }
@@ -0,0 +1,143 @@
+/* Copyright (C) 2013 Philipp Benner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <tfbayes/config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <cmath>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <vector>
+
+#include <tfbayes/fasta/fasta.hh>
+#include <tfbayes/dpm/dpm-partition-distance.hh>
+
+using namespace std;
+
+// compare the dense distance function with the linear merge of
+// sorted labels on random partitions of a data set
+////////////////////////////////////////////////////////////////////////////////
+
+static vector<size_t>
+read_sizes(const string& fasta_file)
+{
+        FastaParser parser(fasta_file);
+        vector<size_t> sizes;
+
+        while (parser) {
+                sizes.push_back(parser().size());
+        }
+        return sizes;
+}
+
+static dpm_partition_t
+random_partition(const vector<size_t>& sizes, size_t length)
+{
+        sequence_data_t<cluster_tag_t> used(sizes, 0);
+        dpm_partition_t partition;
+
+        for (size_t k = 1 + rand() % 8; k > 0; k--) {
+                model_id_t model_id = { "baseline-default", length };
+                dpm_subset_t subset(model_id);
+                for (size_t r = 1 + rand() % 20; r > 0; r--) {
+                        const size_t sequence = rand() % sizes.size();
+                        if (sizes[sequence] < length) {
+                                continue;
+                        }
+                        const size_t position = rand() % (sizes[sequence]-length+1);
+                        bool free = true;
+                        for (size_t i = 0; i < length; i++) {
+                                free = free && !used[sequence][position+i];
+                        }
+                        if (!free) {
+                                continue;
+                        }
+                        for (size_t i = 0; i < length; i++) {
+                                used[sequence][position+i] = 1;
+                        }
+                        subset.insert(range_t(index_t(sequence, position), length, rand() % 2));
+                }
+                if (subset.size() > 0) {
+                        partition.push_back(subset);
+                }
+        }
+        return partition;
+}
+
+int main(int argc, char *argv[])
+{
+        if (argc != 2 && argc != 3) {
+                cerr << "Usage: partition-distance-benchmark FASTA [PARTITIONS]"
+                     << endl;
+                exit(EXIT_FAILURE);
+        }
+        const vector<size_t> sizes = read_sizes(argv[1]);
+        const size_t n = argc == 3 ? atoi(argv[2]) : 200;
+        const size_t length = 8;
+
+        size_t elements = 0;
+        for (size_t i = 0; i < sizes.size(); i++) {
+                elements += sizes[i];
+        }
+        dpm_partition_list_t partitions;
+        for (size_t i = 0; i < n; i++) {
+                partitions.push_back(random_partition(sizes, length));
+        }
+        vector<double> result1, result2;
+
+        // dense auxiliary arrays
+        clock_t t1 = clock();
+        sequence_data_t<cluster_tag_t> a(sizes, 0);
+        sequence_data_t<cluster_tag_t> b(sizes, 0);
+        for (size_t i = 0; i < n; i++) {
+                for (size_t j = i+1; j < n; j++) {
+                        result1.push_back(partition_distance_dense(partitions[i], partitions[j], a, b, elements));
+                }
+        }
+        // linear merge, including the conversion of partitions
+        clock_t t2 = clock();
+        vector<partition_labels_t> labels;
+        vector<uint64_t> scratch;
+        for (size_t i = 0; i < n; i++) {
+                labels.push_back(partition_labels_t(partitions[i]));
+        }
+        for (size_t i = 0; i < n; i++) {
+                for (size_t j = i+1; j < n; j++) {
+                        result2.push_back(partition_distance(labels[i], labels[j], elements, scratch));
+                }
+        }
+        clock_t t3 = clock();
+
+        double difference = 0.0;
+        for (size_t i = 0; i < result1.size(); i++) {
+                difference = max(difference, abs(result1[i] - result2[i]));
+        }
+        const double pairs = n*(n-1)/2;
+        const double d1 = 1e9*(t2-t1)/CLOCKS_PER_SEC/pairs;
+        const double d2 = 1e9*(t3-t2)/CLOCKS_PER_SEC/pairs;
+
+        cout << sizes.size() << " sequences, " << elements << " positions, "
+             << n << " partitions:" << endl
+             << "  dense arrays: " << d1 << " ns/pair" << endl
+             << "  linear merge: " << d2 << " ns/pair" << endl
+             << "  speedup     : " << d1/d2 << endl
+             << "  difference  : " << difference << endl;
+
+        return difference == 0.0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -123,8 +123,9 @@ population_mcmc_t::update_sampling_history()
                         m_population[i]->sampling_history().temperature[0].begin(),
                         m_population[i]->sampling_history().temperature[0].end());
         }
-        // copy cluster sizes
-        for (size_t j = 0; j < m_population[0]->sampling_history().partitions.size(); j++) {
+        // copy cluster sizes (partitions might have been streamed to
+        // disk, so use the number of cluster sizes here)
+        for (size_t j = 0; j < m_population[0]->sampling_history().cluster_sizes.size(); j++) {
                 for (size_t i = 0; i < m_size; i++) {
                         assert(j < m_population[i]->sampling_history().cluster_sizes.size());
                         m_sampling_history.cluster_sizes.push_back(
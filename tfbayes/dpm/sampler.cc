@@ -20,13 +20,10 @@
 #endif /* HAVE_CONFIG_H */
 
 #include <sstream>
-#include <sys/time.h>
-
-#include <boost/thread/thread.hpp>
-#include <boost/date_time/posix_time/posix_time.hpp>
 
 #include <tfbayes/dpm/sampler.hh>
 #include <tfbayes/dpm/state.hh>
+#include <tfbayes/utility/boost-random-shuffle.hh>
 #include <tfbayes/utility/statistics.hh>
 
 using namespace std;
@@ -37,13 +34,8 @@ using namespace std;
 sampler_t::sampler_t(const string& name)
         : m_name (name)
         , m_gen  () {
-        /* sleep for a millisecond to make sure that we get
-         * a unique seed */
-        boost::this_thread::sleep(boost::posix_time::milliseconds(1));
         /* seed generator */
-        struct timeval tv;
-        gettimeofday(&tv, NULL);
-        m_gen.seed(tv.tv_sec*tv.tv_usec);
+        seed_rng(m_gen);
 }
 
 // Gibbs Sampler
@@ -135,7 +127,7 @@ gibbs_sampler_t::m_gibbs_sample() {
         // processes, so to shuffle the indices we first need to
         // obtain a copy
         vector<index_t> indices(m_indexer->sampling_begin(), m_indexer->sampling_end());
-        random_shuffle(indices.begin(), indices.end());
+        boost::random::random_shuffle(indices.begin(), indices.end(), gen());
         // now sample
         for (vector<index_t>::const_iterator it = indices.begin();
              it != indices.end(); it++) {
@@ -22,14 +22,13 @@
 #include <tfbayes/config.h>
 #endif /* HAVE_CONFIG_H */
 
-#include <boost/random/mersenne_twister.hpp>
-
 #include <tfbayes/dpm/datatypes.hh>
 #include <tfbayes/dpm/dpm-sampling-history.hh>
 #include <tfbayes/dpm/indexer.hh>
 #include <tfbayes/dpm/mixture-model.hh>
 #include <tfbayes/dpm/state.hh>
 #include <tfbayes/utility/clonable.hh>
+#include <tfbayes/utility/random.hh>
 
 class sampler_t : public virtual clonable {
 public:
@@ -53,10 +52,10 @@ public:
         virtual       sampling_history_t& sampling_history() = 0;
         virtual const std::string& name() const { return m_name; }
         virtual       std::string& name()       { return m_name; }
-        virtual boost::random::mt19937& gen()   { return m_gen;  }
+        virtual rng_t& gen()                    { return m_gen;  }
 protected:
         std::string m_name;
-        boost::random::mt19937 m_gen;
+        rng_t m_gen;
 };
 
 class gibbs_sampler_t : public sampler_t {
@@ -0,0 +1,243 @@
+/* Copyright (C) 2013 Philipp Benner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <tfbayes/config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <vector>
+
+#include <boost/scoped_ptr.hpp>
+
+#include <tfbayes/dpm/data.hh>
+#include <tfbayes/dpm/data-tfbs.hh>
+
+using namespace std;
+
+// compare a full sweep over the data set on the flat storage of
+// sequence_data_t with the previous layout, where each sequence was
+// stored in a separate vector and all elements were accessed through
+// the virtual operator[]
+////////////////////////////////////////////////////////////////////////////////
+
+template <typename T>
+class nested_sequence_data_t : public data_i<T>, public std::vector<std::vector<T> >
+{
+public:
+        typedef std::vector<std::vector<T> > base_t;
+        typedef typename data_i<T>::iterator_t iterator_t;
+        typedef typename data_i<T>::const_iterator_t const_iterator_t;
+        using base_t::size;
+        using base_t::operator[];
+
+        nested_sequence_data_t(const sequence_data_t<T>& sequence_data)
+                : base_t() {
+                for (size_t i = 0; i < sequence_data.size(); i++) {
+                        base_t::push_back(sequence_data[i]);
+                }
+        }
+        virtual nested_sequence_data_t<T>* clone() const {
+                return new nested_sequence_data_t<T>(*this);
+        }
+        virtual const_iterator_t operator[](const range_t& range) const {
+                return const_iterator_t(*this, range.index(), range.length());
+        }
+        virtual iterator_t operator[](const range_t& range) {
+                return iterator_t(*this, range.index(), range.length());
+        }
+        virtual const T& operator[](const index_t& index) const {
+                return base_t::operator[](index[0])[index[1]];
+        }
+        virtual T& operator[](const index_t& index) {
+                return base_t::operator[](index[0])[index[1]];
+        }
+};
+
+// access elements as the sampler did before, i.e. through the
+// data_i interface
+template <typename T>
+struct virtual_access_t {
+        typedef data_i<T> data_t;
+        static const T& get(const data_t& data, const index_t& index) {
+                return data[index];
+        }
+        static T& get(data_t& data, const index_t& index) {
+                return data[index];
+        }
+};
+
+template <typename T>
+struct flat_access_t {
+        typedef sequence_data_t<T> data_t;
+        static const T& get(const data_t& data, const index_t& index) {
+                return data.element(index);
+        }
+        static T& get(data_t& data, const index_t& index) {
+                return data.element(index);
+        }
+};
+
+// visit all positions in the given order and compute the quantities of
+// the background and foreground models for a window of the given
+// length, as the Gibbs sampler does
+template <template <typename> class A>
+static double
+sweep(const vector<index_t>& indices,
+      const vector<size_t>& sizes,
+      const typename A<data_tfbs_t::code_t>::data_t& data,
+      const typename A<double>::data_t& marginal,
+      typename A<cluster_tag_t>::data_t& cluster_assignments,
+      typename A<short>::data_t& start_positions,
+      size_t length)
+{
+        data_tfbs_t::code_t counts;
+        double result = 0.0;
+
+        fill(counts.begin(), counts.end(), 0.0);
+
+        for (size_t i = 0; i < indices.size(); i++) {
+                const index_t& index = indices[i];
+                if (index[1] + length > sizes[index[0]]) {
+                        continue;
+                }
+                bool free = true;
+                for (size_t j = 0; j < length && free; j++) {
+                        free = A<cluster_tag_t>::get(cluster_assignments, index_t(index[0], index[1]+j)) == 0;
+                }
+                if (!free) {
+                        continue;
+                }
+                double bg = 0.0;
+                for (size_t j = 0; j < length; j++) {
+                        const index_t tmp(index[0], index[1]+j);
+                        const data_tfbs_t::code_t& entry = A<data_tfbs_t::code_t>::get(data, tmp);
+                        for (size_t k = 0; k < data_tfbs_t::alphabet_size; k++) {
+                                counts[k] += entry[k];
+                        }
+                        bg += A<double>::get(marginal, tmp);
+                }
+                result += bg;
+                // mark every 16th window as a binding site to
+                // simulate writes to the state
+                if (i % 16 == 0) {
+                        A<cluster_tag_t>::get(cluster_assignments, index) = 1;
+                        A<short>::get(start_positions, index) = 1;
+                }
+        }
+        for (size_t k = 0; k < data_tfbs_t::alphabet_size; k++) {
+                result += counts[k];
+        }
+        return result;
+}
+
+// the sampler accesses the state through pointers to clones of the
+// data, hence the same is done here
+template <typename T>
+static T* clone(const T& data)
+{
+        return static_cast<T*>(data.clone());
+}
+
+template <template <typename> class A, template <typename> class S>
+static double
+run(const vector<index_t>& indices,
+    const vector<size_t>& sizes,
+    const sequence_data_t<data_tfbs_t::code_t>& data,
+    const sequence_data_t<double>& marginal,
+    size_t n, size_t length)
+{
+        boost::scoped_ptr<S<data_tfbs_t::code_t> > data_ptr(clone(S<data_tfbs_t::code_t>(data)));
+        boost::scoped_ptr<S<double> > marginal_ptr(clone(S<double>(marginal)));
+        double result = 0.0;
+
+        for (size_t i = 0; i < n; i++) {
+                boost::scoped_ptr<S<cluster_tag_t> > cluster_assignments(
+                        clone(S<cluster_tag_t>(sequence_data_t<cluster_tag_t>(sizes, 0))));
+                boost::scoped_ptr<S<short> > start_positions(
+                        clone(S<short>(sequence_data_t<short>(sizes, 0))));
+                result += sweep<A>(indices, sizes, *data_ptr, *marginal_ptr,
+                                   *cluster_assignments, *start_positions, length);
+        }
+        return result;
+}
+
+static void
+benchmark(const char* name,
+          const vector<index_t>& indices,
+          const vector<size_t>& sizes,
+          const sequence_data_t<data_tfbs_t::code_t>& data,
+          const sequence_data_t<double>& marginal,
+          size_t n, size_t length,
+          double& difference)
+{
+        clock_t t1 = clock();
+        const double result1 = run<virtual_access_t, nested_sequence_data_t>(indices, sizes, data, marginal, n, length);
+        clock_t t2 = clock();
+        const double result2 = run<flat_access_t, sequence_data_t>(indices, sizes, data, marginal, n, length);
+        clock_t t3 = clock();
+
+        const double positions = n*data.linear_size();
+        const double d1 = 1e9*(t2-t1)/CLOCKS_PER_SEC/positions;
+        const double d2 = 1e9*(t3-t2)/CLOCKS_PER_SEC/positions;
+
+        cout << "  " << name << ":" << endl
+             << "    nested layout: " << d1 << " ns/position" << endl
+             << "    flat layout  : " << d2 << " ns/position" << endl
+             << "    speedup      : " << d1/d2 << endl;
+
+        difference = max(difference, abs(result1 - result2));
+}
+
+int main(int argc, char *argv[])
+{
+        if (argc != 2 && argc != 3) {
+                cerr << "Usage: sequence-data-benchmark FASTA [SWEEPS]"
+                     << endl;
+                exit(EXIT_FAILURE);
+        }
+        const size_t n      = argc == 3 ? atoi(argv[2]) : 20;
+        const size_t length = 10;
+
+        const sequence_data_t<data_tfbs_t::code_t> data = data_tfbs_t::read(argv[1]);
+        const vector<size_t> sizes = data.sizes();
+        sequence_data_t<double> marginal(sizes, 0.0);
+        vector<index_t> indices;
+
+        for (size_t i = 0; i < sizes.size(); i++) {
+                for (size_t j = 0; j < sizes[i]; j++) {
+                        marginal[i][j] = -log(1.0 + i + j);
+                        indices.push_back(index_t(i, j));
+                }
+        }
+        double difference = 0.0;
+
+        cout << sizes.size() << " sequences, " << data.linear_size() << " positions, "
+             << n << " sweeps:" << endl;
+
+        benchmark("sequential order", indices, sizes, data, marginal, n, length, difference);
+        random_shuffle(indices.begin(), indices.end());
+        benchmark("random order", indices, sizes, data, marginal, n, length, difference);
+
+        cout << "  difference: " << difference << endl;
+
+        return difference == 0.0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,90 @@
+/* Copyright (C) 2012 Philipp Benner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <tfbayes/config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <cmath>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <vector>
+
+#include <boost/array.hpp>
+
+#include <fast-lngamma.hh>
+#include <fast-lnbeta.hh>
+
+using namespace std;
+
+// compare the generic fast_lnbeta template with the kernels that are
+// specialized on the alphabet size
+////////////////////////////////////////////////////////////////////////////////
+
+template <size_t N>
+void benchmark(size_t n, size_t k)
+{
+        typedef boost::array<double, N> counts_t;
+
+        // counts of a cluster and single observations
+        vector<counts_t> counts(n);
+        vector<counts_t> x(n);
+        for (size_t i = 0; i < n; i++) {
+                for (size_t j = 0; j < N; j++) {
+                        counts[i][j] = 0.5 + 100.0*rand()/RAND_MAX;
+                        x     [i][j] = 0.0;
+                }
+                x[i][rand() % N] = 1.0;
+        }
+        double result1 = 0.0, result2 = 0.0;
+
+        clock_t t1 = clock();
+        for (size_t l = 0; l < k; l++) {
+                for (size_t i = 0; i < n; i++) {
+                        result1 += fast_lnbeta<counts_t>(counts[i], x[i])
+                                 - fast_lnbeta<counts_t>(counts[i]);
+                }
+        }
+        clock_t t2 = clock();
+        for (size_t l = 0; l < k; l++) {
+                for (size_t i = 0; i < n; i++) {
+                        result2 += fast_lnbeta_ratio(counts[i], x[i]);
+                }
+        }
+        clock_t t3 = clock();
+
+        const double d1 = 1e9*(t2-t1)/CLOCKS_PER_SEC/(n*k);
+        const double d2 = 1e9*(t3-t2)/CLOCKS_PER_SEC/(n*k);
+
+        cout << "alphabet size " << N << ":" << endl
+             << "  generic template: " << d1 << " ns/call" << endl
+             << "  fused kernel    : " << d2 << " ns/call" << endl
+             << "  speedup         : " << d1/d2 << endl
+             << "  difference      : " << abs(result1 - result2)/abs(result1) << endl;
+}
+
+int main(void)
+{
+#if defined(__AVX2__) && defined(__FMA__)
+        cout << "using AVX2" << endl;
+#endif /* __AVX2__ && __FMA__ */
+        benchmark< 5>(1000, 10000);
+        benchmark<21>(1000,  2000);
+
+        return 0;
+}
@@ -22,40 +22,252 @@
 #include <tfbayes/config.h>
 #endif /* HAVE_CONFIG_H */
 
+#include <cassert>
+#include <vector>
+
 #include <boost/array.hpp>
 
 #include <tfbayes/fastarithmetics/fast-lngamma.hh>
 
+// generic versions for alphabets of arbitrary size, see below for
+// fixed alphabet sizes
+////////////////////////////////////////////////////////////////////////////////
+
 template <class T>
-typename T::value_type fast_lnbeta(
+double fast_lnbeta(
         const T& alpha)
 {
-        typename T::value_type sum1 = 0;
-        typename T::value_type sum2 = 0;
+        // the last element holds the sum of all arguments
+        const size_t n = alpha.size();
+        std::vector<double> x(n+1), y(n+1);
+        double sum = 0;
 
-        for (size_t i = 0; i < alpha.size(); i++) {
-                sum1 += alpha[i];
-                sum2 += fast_lngamma(alpha[i]);
+        x[n] = 0.0;
+        for (size_t i = 0; i < n; i++) {
+                x[i]  = alpha[i];
+                x[n] += alpha[i];
         }
+        fast_lngamma(&x[0], &y[0], n+1);
 
-        return sum2 - fast_lngamma(sum1);
+        for (size_t i = 0; i < n; i++) {
+                sum += y[i];
+        }
+        return sum - y[n];
 }
 
 template <class T>
-typename T::value_type fast_lnbeta(
+double fast_lnbeta(
         const T& counts,
         const T& alpha)
 {
         assert(counts.size() == alpha.size());
-        typename T::value_type sum1 = 0;
-        typename T::value_type sum2 = 0;
+        // the last element holds the sum of all arguments
+        const size_t n = alpha.size();
+        std::vector<double> x(n+1), y(n+1);
+        double sum = 0;
+
+        x[n] = 0.0;
+        for (size_t i = 0; i < n; i++) {
+                x[i]  = counts[i] + alpha[i];
+                x[n] += counts[i] + alpha[i];
+        }
+        fast_lngamma(&x[0], &y[0], n+1);
 
-        for (size_t i = 0; i < alpha.size(); i++) {
-                sum1 += counts[i] + alpha[i];
-                sum2 += fast_lngamma(counts[i] + alpha[i]);
+        for (size_t i = 0; i < n; i++) {
+                sum += y[i];
         }
+        return sum - y[n];
+}
+
+// log B(counts + x) - log B(counts), which is the logarithm of the
+// predictive distribution of a dirichlet-multinomial model
+template <class T>
+double fast_lnbeta_ratio(
+        const T& counts,
+        const T& x)
+{
+        assert(counts.size() == x.size());
+        // arguments are stored as [counts+x, sum(counts+x), counts, sum(counts)]
+        const size_t n = counts.size();
+        std::vector<double> z(2*n+2), y(2*n+2);
+        double sum = 0;
+
+        z[n] = z[2*n+1] = 0.0;
+        for (size_t i = 0; i < n; i++) {
+                z[i]       = counts[i] + x[i];
+                z[n]      += counts[i] + x[i];
+                z[n+i+1]   = counts[i];
+                z[2*n+1]  += counts[i];
+        }
+        fast_lngamma(&z[0], &y[0], 2*n+2);
+
+        for (size_t i = 0; i < n; i++) {
+                sum += y[i] - y[n+i+1];
+        }
+        return sum - y[n] + y[2*n+1];
+}
+
+// log B(counts + x) - log B(counts), where the sum of all counts and
+// log B(counts) are given
+template <class T>
+double fast_lnbeta_ratio(
+        const T& counts,
+        const T& x,
+        double counts_sum,
+        double counts_lnbeta)
+{
+        assert(counts.size() == x.size());
+        const size_t n = counts.size();
+        std::vector<double> z(n+1), y(n+1);
+        double sum = 0;
+
+        z[n] = counts_sum;
+        for (size_t i = 0; i < n; i++) {
+                z[i]  = counts[i] + x[i];
+                z[n] += x[i];
+        }
+        fast_lngamma(&z[0], &y[0], n+1);
+
+        for (size_t i = 0; i < n; i++) {
+                sum += y[i];
+        }
+        return sum - y[n] - counts_lnbeta;
+}
+
+// specializations for fixed alphabet sizes, where buffers are padded
+// to a multiple of four so that the lngamma evaluation does not
+// require any scalar code
+////////////////////////////////////////////////////////////////////////////////
+
+template <size_t N>
+double fast_lnbeta_fixed(
+        const boost::array<double, N>& alpha)
+{
+        const size_t m = ((N+1)+3)/4*4;
+        double x[m], y[m];
+        double sum = 0;
+
+        x[N] = 0.0;
+        for (size_t i = 0; i < N; i++) {
+                x[i]  = alpha[i];
+                x[N] += alpha[i];
+        }
+        for (size_t i = N+1; i < m; i++) {
+                x[i]  = 1.0;
+        }
+        fast_lngamma(x, y, m);
+
+        for (size_t i = 0; i < N; i++) {
+                sum += y[i];
+        }
+        return sum - y[N];
+}
 
-        return sum2 - fast_lngamma(sum1);
+template <size_t N>
+double fast_lnbeta_fixed(
+        const boost::array<double, N>& counts,
+        const boost::array<double, N>& alpha)
+{
+        const size_t m = ((N+1)+3)/4*4;
+        double x[m], y[m];
+        double sum = 0;
+
+        x[N] = 0.0;
+        for (size_t i = 0; i < N; i++) {
+                x[i]  = counts[i] + alpha[i];
+                x[N] += counts[i] + alpha[i];
+        }
+        for (size_t i = N+1; i < m; i++) {
+                x[i]  = 1.0;
+        }
+        fast_lngamma(x, y, m);
+
+        for (size_t i = 0; i < N; i++) {
+                sum += y[i];
+        }
+        return sum - y[N];
+}
+
+template <size_t N>
+double fast_lnbeta_ratio_fixed(
+        const boost::array<double, N>& counts,
+        const boost::array<double, N>& x)
+{
+        const size_t m = (2*(N+1)+3)/4*4;
+        double z[m], y[m];
+        double sum = 0;
+
+        z[N] = z[2*N+1] = 0.0;
+        for (size_t i = 0; i < N; i++) {
+                z[i]      = counts[i] + x[i];
+                z[N]     += counts[i] + x[i];
+                z[N+i+1]  = counts[i];
+                z[2*N+1] += counts[i];
+        }
+        for (size_t i = 2*N+2; i < m; i++) {
+                z[i]      = 1.0;
+        }
+        fast_lngamma(z, y, m);
+
+        for (size_t i = 0; i < N; i++) {
+                sum += y[i] - y[N+i+1];
+        }
+        return sum - y[N] + y[2*N+1];
+}
+
+template <size_t N>
+double fast_lnbeta_ratio_fixed(
+        const boost::array<double, N>& counts,
+        const boost::array<double, N>& x,
+        double counts_sum,
+        double counts_lnbeta)
+{
+        const size_t m = ((N+1)+3)/4*4;
+        double z[m], y[m];
+        double sum = 0;
+
+        z[N] = counts_sum;
+        for (size_t i = 0; i < N; i++) {
+                z[i]  = counts[i] + x[i];
+                z[N] += x[i];
+        }
+        for (size_t i = N+1; i < m; i++) {
+                z[i]  = 1.0;
+        }
+        fast_lngamma(z, y, m);
+
+        for (size_t i = 0; i < N; i++) {
+                sum += y[i];
+        }
+        return sum - y[N] - counts_lnbeta;
+}
+
+// nucleotide alphabet (including gaps)
+inline double fast_lnbeta(const boost::array<double, 5>& alpha) {
+        return fast_lnbeta_fixed<5>(alpha);
+}
+inline double fast_lnbeta(const boost::array<double, 5>& counts, const boost::array<double, 5>& alpha) {
+        return fast_lnbeta_fixed<5>(counts, alpha);
+}
+inline double fast_lnbeta_ratio(const boost::array<double, 5>& counts, const boost::array<double, 5>& x) {
+        return fast_lnbeta_ratio_fixed<5>(counts, x);
+}
+inline double fast_lnbeta_ratio(const boost::array<double, 5>& counts, const boost::array<double, 5>& x, double counts_sum, double counts_lnbeta) {
+        return fast_lnbeta_ratio_fixed<5>(counts, x, counts_sum, counts_lnbeta);
+}
+
+// protein alphabet (including gaps)
+inline double fast_lnbeta(const boost::array<double, 21>& alpha) {
+        return fast_lnbeta_fixed<21>(alpha);
+}
+inline double fast_lnbeta(const boost::array<double, 21>& counts, const boost::array<double, 21>& alpha) {
+        return fast_lnbeta_fixed<21>(counts, alpha);
+}
+inline double fast_lnbeta_ratio(const boost::array<double, 21>& counts, const boost::array<double, 21>& x) {
+        return fast_lnbeta_ratio_fixed<21>(counts, x);
+}
+inline double fast_lnbeta_ratio(const boost::array<double, 21>& counts, const boost::array<double, 21>& x, double counts_sum, double counts_lnbeta) {
+        return fast_lnbeta_ratio_fixed<21>(counts, x, counts_sum, counts_lnbeta);
 }
 
 #endif /* __TFBAYES_FASTARITHMETICS_FAST_LNBETA_HH__ */
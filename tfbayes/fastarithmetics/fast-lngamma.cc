@@ -1,4 +1,4 @@
-/* Copyright (C) 2012 Philipp Benner
+/* Copyright (C) 2012-2013 Philipp Benner
  *
  * This program is free software; you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -19,25 +19,226 @@
 #include <tfbayes/config.h>
 #endif /* HAVE_CONFIG_H */
 
+#include <cmath>
 #include <cstdlib>
 
-#include <boost/math/special_functions/digamma.hpp>
 #include <boost/math/special_functions/gamma.hpp>
 
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#endif /* __AVX2__ && __FMA__ */
+
 #include <fast-lngamma.hh>
-#include <fast-lngamma-table.hh>
+
+// Values of log Gamma(x) are obtained from a small table (values
+// only) by cubic interpolation for 1 <= x < FAST_LNGAMMA_TABLE_MAX,
+// where the interpolation error is below 1e-9. Larger arguments are
+// computed with Stirling's series, which is accurate to about 1e-13
+// in this range, and for x < 1 the recurrence
+//
+//   log Gamma(x) = log Gamma(x+1) - log(x)
+//
+// is used.
+////////////////////////////////////////////////////////////////////////////////
+
+#define FAST_LNGAMMA_TABLE_MAX        16
+#define FAST_LNGAMMA_TABLE_RESOLUTION 128
+#define FAST_LNGAMMA_TABLE_SIZE       ((FAST_LNGAMMA_TABLE_MAX-1)*FAST_LNGAMMA_TABLE_RESOLUTION+4)
+
+// fast_lngamma_table[i] = log Gamma(1 + (i-1)/FAST_LNGAMMA_TABLE_RESOLUTION),
+// the first entry and the last three entries are required for interpolation at
+// the boundaries
+static double fast_lngamma_table[FAST_LNGAMMA_TABLE_SIZE];
+
+static struct fast_lngamma_table_init_t {
+        fast_lngamma_table_init_t() {
+                for (size_t i = 0; i < FAST_LNGAMMA_TABLE_SIZE; i++) {
+                        const double x = 1.0 + (i-1.0)/FAST_LNGAMMA_TABLE_RESOLUTION;
+                        fast_lngamma_table[i] = boost::math::lgamma(x);
+                }
+        }
+} fast_lngamma_table_init;
+
+static inline
+double fast_lngamma_stirling(double x)
+{
+        // 0.5*log(2 pi)
+        const double c  = 0.91893853320467274178;
+        const double r  = 1.0/x;
+        const double r2 = r*r;
+        // 1/(12x) - 1/(360x^3) + 1/(1260x^5) - 1/(1680x^7)
+        const double s  = r*(1.0/12.0 - r2*(1.0/360.0 - r2*(1.0/1260.0 - r2*(1.0/1680.0))));
+
+        return (x - 0.5)*std::log(x) - x + c + s;
+}
+
+static inline
+double fast_lngamma_table_lookup(double x)
+{
+        // position within the table
+        const double z = (x - 1.0)*FAST_LNGAMMA_TABLE_RESOLUTION;
+        const int    k = static_cast<int>(z);
+        const double t = z - k;
+        // values at the four surrounding grid points
+        const double* y = fast_lngamma_table + k;
+        // cubic Lagrange interpolation
+        const double w0 = -t*(t-1.0)*(t-2.0)/6.0;
+        const double w1 =  (t+1.0)*(t-1.0)*(t-2.0)/2.0;
+        const double w2 = -(t+1.0)*t*(t-2.0)/2.0;
+        const double w3 =  (t+1.0)*t*(t-1.0)/6.0;
+
+        return w0*y[0] + w1*y[1] + w2*y[2] + w3*y[3];
+}
+
+static inline
+double fast_lngamma_inline(double x)
+{
+        if (x >= FAST_LNGAMMA_TABLE_MAX) {
+                return fast_lngamma_stirling(x);
+        }
+        if (x >= 1.0) {
+                return fast_lngamma_table_lookup(x);
+        }
+        if (x > 0.0) {
+                return fast_lngamma_table_lookup(x + 1.0) - std::log(x);
+        }
+        return boost::math::lgamma(x);
+}
+
+#if defined(__AVX2__) && defined(__FMA__)
+
+// AVX2 (and FMA) implementation that evaluates four values at once
+////////////////////////////////////////////////////////////////////////////////
+
+// split positive normalized numbers into x = m 2^e with
+// sqrt(1/2) <= m < sqrt(2)
+static inline
+void fast_frexp_pd(__m256d x, __m256d& m, __m256d& e)
+{
+        const __m256d one   = _mm256_set1_pd(1.0);
+        const __m256d sqrt2 = _mm256_set1_pd(1.41421356237309504880);
+        // 2^52 as double and as integer
+        const __m256i magic = _mm256_set1_epi64x(0x4330000000000000LL);
+        const __m256i mmask = _mm256_set1_epi64x(0x000FFFFFFFFFFFFFLL);
+
+        const __m256i bits = _mm256_castpd_si256(x);
+        // biased exponent converted to double
+        e = _mm256_sub_pd(
+                _mm256_castsi256_pd(_mm256_or_si256(_mm256_srli_epi64(bits, 52), magic)),
+                _mm256_castsi256_pd(magic));
+        e = _mm256_sub_pd(e, _mm256_set1_pd(1023.0));
+        // mantissa in [1, 2)
+        m = _mm256_castsi256_pd(
+                _mm256_or_si256(_mm256_and_si256(bits, mmask), _mm256_castpd_si256(one)));
+        // move mantissa to [sqrt(1/2), sqrt(2))
+        const __m256d c = _mm256_cmp_pd(m, sqrt2, _CMP_GE_OQ);
+        m = _mm256_blendv_pd(m, _mm256_mul_pd(m, _mm256_set1_pd(0.5)), c);
+        e = _mm256_add_pd   (e, _mm256_and_pd(c, one));
+}
+
+// all arguments must be positive
+static inline
+__m256d fast_lngamma_pd(__m256d x)
+{
+        const __m256d one  = _mm256_set1_pd(1.0);
+        const __m256d tmax = _mm256_set1_pd(FAST_LNGAMMA_TABLE_MAX);
+
+        const __m256d lt1  = _mm256_cmp_pd(x, one, _CMP_LT_OQ);
+        const __m256d y    = _mm256_blendv_pd(x, _mm256_add_pd(x, one), lt1);
+        const __m256d ge16 = _mm256_cmp_pd(y, tmax, _CMP_GE_OQ);
+
+        // the logarithm is either required for Stirling's series
+        // (y >= FAST_LNGAMMA_TABLE_MAX) or for the recurrence (x < 1),
+        // but never for both, so that it is computed only once
+        __m256d m, e;
+        fast_frexp_pd(_mm256_blendv_pd(_mm256_blendv_pd(one, x, lt1), y, ge16), m, e);
+        // log(m) = 2 atanh(u) with u = (m-1)/(m+1), both divisions
+        // u and 1/y are obtained from a single reciprocal
+        const __m256d mp1 = _mm256_add_pd(m, one);
+        const __m256d q   = _mm256_div_pd(one, _mm256_mul_pd(mp1, y));
+        const __m256d u   = _mm256_mul_pd(_mm256_sub_pd(m, one), _mm256_mul_pd(q, y));
+        const __m256d u2  = _mm256_mul_pd(u, u);
+        // |u| < 0.172, hence eleven terms are sufficient
+        __m256d p = _mm256_set1_pd(1.0/21.0);
+        p = _mm256_fmadd_pd(p, u2, _mm256_set1_pd(1.0/19.0));
+        p = _mm256_fmadd_pd(p, u2, _mm256_set1_pd(1.0/17.0));
+        p = _mm256_fmadd_pd(p, u2, _mm256_set1_pd(1.0/15.0));
+        p = _mm256_fmadd_pd(p, u2, _mm256_set1_pd(1.0/13.0));
+        p = _mm256_fmadd_pd(p, u2, _mm256_set1_pd(1.0/11.0));
+        p = _mm256_fmadd_pd(p, u2, _mm256_set1_pd(1.0/9.0));
+        p = _mm256_fmadd_pd(p, u2, _mm256_set1_pd(1.0/7.0));
+        p = _mm256_fmadd_pd(p, u2, _mm256_set1_pd(1.0/5.0));
+        p = _mm256_fmadd_pd(p, u2, _mm256_set1_pd(1.0/3.0));
+        p = _mm256_fmadd_pd(p, u2, one);
+        const __m256d l = _mm256_fmadd_pd(
+                e, _mm256_set1_pd(0.69314718055994530942), _mm256_mul_pd(_mm256_add_pd(u, u), p));
+
+        // table lookup with cubic interpolation
+        const __m256d z = _mm256_mul_pd(
+                _mm256_sub_pd(_mm256_min_pd(y, tmax), one),
+                _mm256_set1_pd(FAST_LNGAMMA_TABLE_RESOLUTION));
+        const __m128i k  = _mm256_cvttpd_epi32(z);
+        const __m256d t  = _mm256_sub_pd(z, _mm256_cvtepi32_pd(k));
+        // masked gathers with a defined source, the unmasked
+        // variant leaves the destination formally uninitialized
+        const __m256d src  = _mm256_setzero_pd();
+        const __m256d mask = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+        const __m256d y0 = _mm256_mask_i32gather_pd(src, fast_lngamma_table+0, k, mask, 8);
+        const __m256d y1 = _mm256_mask_i32gather_pd(src, fast_lngamma_table+1, k, mask, 8);
+        const __m256d y2 = _mm256_mask_i32gather_pd(src, fast_lngamma_table+2, k, mask, 8);
+        const __m256d y3 = _mm256_mask_i32gather_pd(src, fast_lngamma_table+3, k, mask, 8);
+        const __m256d tp1 = _mm256_add_pd(t, one);
+        const __m256d tm1 = _mm256_sub_pd(t, one);
+        const __m256d tm2 = _mm256_sub_pd(t, _mm256_set1_pd(2.0));
+        const __m256d a   = _mm256_mul_pd(t,   tm1);
+        const __m256d b   = _mm256_mul_pd(tp1, tm2);
+        const __m256d w0  = _mm256_mul_pd(_mm256_mul_pd(a, tm2), _mm256_set1_pd(-1.0/6.0));
+        const __m256d w1  = _mm256_mul_pd(_mm256_mul_pd(b, tm1), _mm256_set1_pd( 1.0/2.0));
+        const __m256d w2  = _mm256_mul_pd(_mm256_mul_pd(b, t  ), _mm256_set1_pd(-1.0/2.0));
+        const __m256d w3  = _mm256_mul_pd(_mm256_mul_pd(a, tp1), _mm256_set1_pd( 1.0/6.0));
+        __m256d r1 = _mm256_mul_pd(w0, y0);
+        r1 = _mm256_fmadd_pd(w1, y1, r1);
+        r1 = _mm256_fmadd_pd(w2, y2, r1);
+        r1 = _mm256_fmadd_pd(w3, y3, r1);
+        r1 = _mm256_sub_pd  (r1, _mm256_and_pd(lt1, l));
+
+        // Stirling's series
+        const __m256d r  = _mm256_mul_pd(q, mp1);
+        const __m256d r2 = _mm256_mul_pd(r, r);
+        __m256d s = _mm256_set1_pd(-1.0/1680.0);
+        s = _mm256_fmadd_pd(s, r2, _mm256_set1_pd( 1.0/1260.0));
+        s = _mm256_fmadd_pd(s, r2, _mm256_set1_pd(-1.0/360.0));
+        s = _mm256_fmadd_pd(s, r2, _mm256_set1_pd( 1.0/12.0));
+        s = _mm256_mul_pd  (s, r);
+        __m256d r3 = _mm256_fmadd_pd(_mm256_sub_pd(y, _mm256_set1_pd(0.5)), l, _mm256_sub_pd(s, y));
+        r3 = _mm256_add_pd(r3, _mm256_set1_pd(0.91893853320467274178));
+
+        return _mm256_blendv_pd(r1, r3, ge16);
+}
+
+#endif /* __AVX2__ && __FMA__ */
 
 double fast_lngamma(double x)
 {
-        if (x <= 1000.0) {
-                // static casting uses a simple trunc() to
-                // convert a double to integer, therefore add
-                // 0.5 to reduce the numerical error
-                size_t n = static_cast<size_t>(x*100.0-1.0+0.5);
+        return fast_lngamma_inline(x);
+}
+
+void fast_lngamma(const double* x, double* out, size_t n)
+{
+        size_t i = 0;
+#if defined(__AVX2__) && defined(__FMA__)
+        const __m256d zero = _mm256_setzero_pd();
 
-                return fast_lngamma_table[n][1];
+        for (; i+4 <= n; i += 4) {
+                const __m256d v = _mm256_loadu_pd(x+i);
+                // non-positive arguments are handled by the scalar code
+                if (_mm256_movemask_pd(_mm256_cmp_pd(v, zero, _CMP_LE_OQ))) {
+                        break;
+                }
+                _mm256_storeu_pd(out+i, fast_lngamma_pd(v));
         }
-        else {
-                return boost::math::lgamma(x);
+#endif /* __AVX2__ && __FMA__ */
+        for (; i < n; i++) {
+                out[i] = fast_lngamma_inline(x[i]);
         }
 }
@@ -1,4 +1,4 @@
-/* Copyright (C) 2012 Philipp Benner
+/* Copyright (C) 2012-2013 Philipp Benner
  *
  * This program is free software; you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -22,6 +22,11 @@
 #include <tfbayes/config.h>
 #endif /* HAVE_CONFIG_H */
 
+#include <cstddef>
+
+// compute log Gamma(x) for a single value
 double fast_lngamma(double x);
+// compute out[i] = log Gamma(x[i]) for i = 0, ..., n-1
+void   fast_lngamma(const double* x, double* out, size_t n);
 
 #endif /* __TFBAYES_FASTARITHMETICS_FAST_LNGAMMA_HH__ */
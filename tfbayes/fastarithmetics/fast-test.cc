@@ -19,9 +19,11 @@
 #include <tfbayes/config.h>
 #endif /* HAVE_CONFIG_H */
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <vector>
 
-#include <boost/math/special_functions/digamma.hpp>
 #include <boost/math/special_functions/gamma.hpp>
 
 #include <fast-lngamma.hh>
@@ -31,19 +33,41 @@ using namespace std;
 
 int main(void)
 {
-        // for (size_t i = 1; i <= 100000; i++)
-        // {
-        //         cout << "       {";
-        //         cout.precision(5);
-        //         cout.width(8);
-        //         cout << 0.01*i
-        //              << ", ";
-        //         cout.precision(5);
-        //         cout.width(8);
-        //         cout << gsl_sf_lngamma(0.01*i)
-        //              << "},"
-        //              << endl;
-        // }
+        double max_error = 0.0;
+        double max_x     = 0.0;
+
+        // compare against boost over the range that is relevant for
+        // dirichlet-multinomial marginals
+        for (double x = 0.001; x < 10000.0; x *= 1.001) {
+                const double a = boost::math::lgamma(x);
+                const double b = fast_lngamma(x);
+                const double e = std::abs(a - b)/std::max(1.0, std::abs(a));
+                if (e > max_error) {
+                        max_error = e;
+                        max_x     = x;
+                }
+        }
+        cout << "maximum relative error: " << max_error
+             << " (at x = " << max_x << ")" << endl;
+
+        // the batched version must agree with the scalar one
+        vector<double> x, y;
+        for (double z = 0.001; z < 10000.0; z *= 1.001) {
+                x.push_back(z);
+        }
+        y.resize(x.size());
+        fast_lngamma(&x[0], &y[0], x.size());
+        for (size_t i = 0; i < x.size(); i++) {
+                const double a = boost::math::lgamma(x[i]);
+                const double e = std::abs(a - y[i])/std::max(1.0, std::abs(a));
+                if (e > max_error) {
+                        max_error = e;
+                        max_x     = x[i];
+                }
+        }
+        cout << "maximum relative error (batched): " << max_error
+             << " (at x = " << max_x << ")" << endl;
+
         cout << "     lngamma: " << boost::math::lgamma(1000) << endl;
         cout << "fast_lngamma: " <<        fast_lngamma(1000) << endl;
 
@@ -55,4 +79,6 @@ int main(void)
         alpha[4] = 50;
 
         cout << "fast_lnbeta : " <<   fast_lnbeta(alpha) << endl;
+
+        return max_error < 1e-8 ? 0 : 1;
 }
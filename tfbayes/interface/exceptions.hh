@@ -56,4 +56,11 @@ void raise_TypeError(const std::string& msg)
         throw boost::python::error_already_set();
 }
 
+static inline
+void raise_ValueError(const std::string& msg)
+{
+        PyErr_SetString(PyExc_ValueError, msg.c_str());
+        throw boost::python::error_already_set();
+}
+
 #endif /* __TFBAYES_INTERFACE_INTERFACE_EXCEPTIONS_HH__ */
@@ -0,0 +1,48 @@
+/* Copyright (C) 2013 Philipp Benner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __TFBAYES_INTERFACE_INTERFACE_GIL_HH__
+#define __TFBAYES_INTERFACE_INTERFACE_GIL_HH__
+
+#ifdef HAVE_CONFIG_H
+#include <tfbayes/config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <Python.h>
+
+#include <boost/utility.hpp>
+
+// Release the global interpreter lock for the lifetime of this
+// object, so that other Python threads can run while a binding does
+// native work. The lock is acquired again when the object goes out
+// of scope, also if an exception is thrown. No Python object and no
+// Python error function (see exceptions.hh) may be used while the
+// lock is released, so arguments must be converted and checked
+// before the guard is created.
+class release_gil_t : boost::noncopyable {
+public:
+        release_gil_t()
+                : m_state(PyEval_SaveThread())
+                { }
+        ~release_gil_t() {
+                PyEval_RestoreThread(m_state);
+        }
+protected:
+        PyThreadState* m_state;
+};
+
+#endif /* __TFBAYES_INTERFACE_INTERFACE_GIL_HH__ */
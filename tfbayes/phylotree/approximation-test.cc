@@ -107,6 +107,43 @@ void test_line_search(
 
 }
 
+double elapsed(const struct timeval& start)
+{
+        struct timeval end;
+        gettimeofday(&end, NULL);
+
+        return (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec)/1000000.0;
+}
+
+// compare both methods for computing the Kullback-Leibler
+// divergence, results are printed as Mathematica comments
+void test_dkl_methods(
+        const polynomial_t<alphabet_size>& variational,
+        const polynomial_t<alphabet_size>& result,
+        const exponent_t<alphabet_size>& alpha)
+{
+        struct timeval start;
+        double kl_miser, kl_quadrature, kl_quadrature_2n;
+        double t_miser, t_quadrature;
+
+        gettimeofday(&start, NULL);
+        kl_miser = dkl<alphabet_size>(variational, result.normalize(), alpha, dkl_method_miser);
+        t_miser  = elapsed(start);
+
+        gettimeofday(&start, NULL);
+        kl_quadrature = dkl<alphabet_size>(variational, result.normalize(), alpha, dkl_method_quadrature);
+        t_quadrature  = elapsed(start);
+
+        // the quadrature with twice the number of nodes shows
+        // whether the default number of nodes is sufficient
+        kl_quadrature_2n = dkl<alphabet_size>(variational, result.normalize(), alpha, dkl_method_quadrature,
+                                              2*DKL_QUADRATURE_NODES);
+
+        cout << "(* miser     : " << kl_miser      << " (" << t_miser      << "s) *)" << endl
+             << "(* quadrature: " << kl_quadrature << " (" << t_quadrature << "s) *)" << endl
+             << "(* quadrature: " << kl_quadrature_2n << " (" << 2*DKL_QUADRATURE_NODES << " nodes) *)" << endl;
+}
+
 int main(void)
 {
         init();
@@ -152,6 +189,8 @@ int main(void)
              << ";"
              << endl;
 
+        test_dkl_methods(approximation, result, alpha);
+
         //test_line_search(result, alpha);
 
         variational = dkl_optimize(result, alpha);
@@ -161,5 +200,7 @@ int main(void)
              << ";"
              << endl;
 
+        test_dkl_methods(variational, result, alpha);
+
         return 0.0;
 }
@@ -22,7 +22,10 @@
 #include <tfbayes/config.h>
 #endif /* HAVE_CONFIG_H */
 
+#include <algorithm>
+#include <cmath>
 #include <limits>
+#include <vector>
 
 #include <gsl/gsl_math.h>
 #include <gsl/gsl_monte.h>
@@ -100,6 +103,17 @@ dkl_variational_entropy(
         return result;
 }
 
+/* Methods for computing the integral Int Q Log P dw in dkl(). */
+typedef enum {
+        /* Monte Carlo integration (GSL MISER) */
+        dkl_method_miser,
+        /* closed form expectations and Gauss-Jacobi quadrature */
+        dkl_method_quadrature
+} dkl_method_t;
+
+/* Default number of quadrature nodes per dimension. */
+#define DKL_QUADRATURE_NODES 10
+
 /* Compute the Kullback-Leibler divergence * D(q||p), where q is the
  * variational distribution and p the actual distribution. This
  * function uses numerical integration to solve the integral. The
@@ -107,7 +121,7 @@ dkl_variational_entropy(
  */
 template <size_t AS, typename PC>
 double
-dkl(
+dkl_miser(
         const polynomial_t<AS, PC>& variational,
         const polynomial_t<AS, PC>& likelihood,
         const exponent_t<AS, PC>& alpha)
@@ -159,6 +173,238 @@ dkl(
         return -result;
 }
 
+/* Nodes and weights of the n-point Gauss quadrature rule for the
+ * beta distribution with parameters a and b, i.e. the Gauss-Jacobi
+ * rule on [0,1]. The nodes are the eigenvalues of the Jacobi matrix
+ * of the orthogonal polynomials and the weights are the squared
+ * first components of the normalized eigenvectors (Golub-Welsch),
+ * which are computed with the implicit QL algorithm. The weights sum
+ * to one.
+ */
+inline
+void
+dkl_gauss_jacobi(
+        size_t n, double a, double b,
+        std::vector<double>& nodes,
+        std::vector<double>& weights)
+{
+        /* Jacobi polynomials on [-1,1] with weight
+         * (1-t)^(b-1) (1+t)^(a-1) */
+        const double p = b - 1.0;
+        const double q = a - 1.0;
+        std::vector<double>& d = nodes;
+        std::vector<double>  e(n, 0.0);
+        std::vector<double>& z = weights;
+
+        d.assign(n, 0.0);
+        z.assign(n, 0.0);
+        z[0] = 1.0;
+        d[0] = (q - p)/(p + q + 2.0);
+        for (size_t i = 1; i < n; i++) {
+                const double k = i;
+                const double s = 2.0*k + p + q;
+                d[i]   = (q*q - p*p)/(s*(s + 2.0));
+                /* the general formula is singular for i == 1 and
+                 * p + q == -1 */
+                if (i == 1) {
+                        e[i-1] = 4.0*(1.0 + p)*(1.0 + q)/((2.0 + p + q)*(2.0 + p + q)*(3.0 + p + q));
+                }
+                else {
+                        e[i-1] = 4.0*k*(k + p)*(k + q)*(k + p + q)/(s*s*(s + 1.0)*(s - 1.0));
+                }
+                e[i-1] = std::sqrt(e[i-1]);
+        }
+        /* implicit QL iterations with shifts, only the first
+         * component of each eigenvector is updated */
+        for (size_t l = 0; l < n; l++) {
+                for (size_t iter = 0; iter < 100; iter++) {
+                        size_t m;
+                        for (m = l; m+1 < n; m++) {
+                                const double dd = std::fabs(d[m]) + std::fabs(d[m+1]);
+                                if (std::fabs(e[m]) <= std::numeric_limits<double>::epsilon()*dd) {
+                                        break;
+                                }
+                        }
+                        if (m == l) {
+                                break;
+                        }
+                        double g = (d[l+1] - d[l])/(2.0*e[l]);
+                        double r = std::sqrt(g*g + 1.0);
+                        g = d[m] - d[l] + e[l]/(g + (g >= 0.0 ? r : -r));
+                        double s = 1.0, c = 1.0, h = 0.0;
+                        size_t i;
+                        for (i = m; i-- > l;) {
+                                double f  = s*e[i];
+                                double ce = c*e[i];
+                                r = std::sqrt(f*f + g*g);
+                                e[i+1] = r;
+                                if (r == 0.0) {
+                                        d[i+1] -= h;
+                                        e[m]    = 0.0;
+                                        break;
+                                }
+                                s = f/r;
+                                c = g/r;
+                                g = d[i+1] - h;
+                                r = (d[i] - g)*s + 2.0*c*ce;
+                                h = s*r;
+                                d[i+1] = g + h;
+                                g = c*r - ce;
+                                f = z[i+1];
+                                z[i+1] = s*z[i] + c*f;
+                                z[i]   = c*z[i] - s*f;
+                        }
+                        if (r == 0.0 && i+1 > l) {
+                                continue;
+                        }
+                        d[l] -= h;
+                        e[l]  = g;
+                        e[m]  = 0.0;
+                }
+        }
+        /* map the nodes to [0,1] */
+        for (size_t i = 0; i < n; i++) {
+                nodes  [i] = (1.0 + nodes[i])/2.0;
+                weights[i] = weights[i]*weights[i];
+        }
+}
+
+/* Compute Int Q Log P dw without sampling. The density of the
+ * actual distribution is P(w) = L(w) Dir(w|alpha)/Z, where L is the
+ * likelihood polynomial, so that
+ *
+ *   Int Q Log P dw = Sum_i (m_i + alpha_i - 1) E_Q[Log w_i] - Log B(alpha) - Log Z
+ *                  + E_Q[Log L'(w)],
+ *
+ * where w^m is the largest monomial that divides L and L = w^m L'.
+ * The expectations E_Q[Log w_i] = psi(a_i) - psi(a_0) of the
+ * Dirichlet distribution Q with parameters a are given in closed
+ * form. The remaining expectation is computed with a tensor product
+ * of Gauss-Jacobi rules, where w is given by independent beta
+ * distributed variables (stick-breaking representation of Q), so
+ * that the rule uses n^(AS-1) evaluations of L'. After removing w^m
+ * the polynomial L' is positive at the faces of the simplex except
+ * at their intersections, where Log L' is only weakly singular.
+ */
+template <size_t AS, typename PC>
+double
+dkl_quadrature(
+        const polynomial_t<AS, PC>& variational,
+        const polynomial_t<AS, PC>& likelihood,
+        const exponent_t<AS, PC>& alpha,
+        size_t n = DKL_QUADRATURE_NODES)
+{
+        assert(variational.size() == 1);
+
+        /* parameters of the variational distribution */
+        exponent_t<AS, PC> a;
+        double a_sum = 0.0;
+        for (size_t i = 0; i < AS; i++) {
+                a[i]   = variational.begin()->exponent()[i] + alpha[i];
+                a_sum += a[i];
+        }
+        /* largest common monomial of the likelihood */
+        exponent_t<AS, PC> m(likelihood.begin()->exponent());
+        for (typename polynomial_t<AS, PC>::const_iterator it = likelihood.begin();
+             it != likelihood.end(); it++) {
+                for (size_t i = 0; i < AS; i++) {
+                        m[i] = std::min(m[i], it->exponent()[i]);
+                }
+        }
+        /* closed form terms */
+        double result = -mbeta_log(alpha) - pt_marginal_likelihood<AS, PC>(likelihood, alpha);
+        for (size_t i = 0; i < AS; i++) {
+                result += (m[i] + alpha[i] - 1.0)*(gsl_sf_psi(a[i]) - gsl_sf_psi(a_sum));
+        }
+        /* terms of L' on log scale */
+        std::vector<double> log_coefficients;
+        std::vector<boost::array<double, AS> > exponents;
+        for (typename polynomial_t<AS, PC>::const_iterator it = likelihood.begin();
+             it != likelihood.end(); it++) {
+                boost::array<double, AS> exponent;
+                for (size_t i = 0; i < AS; i++) {
+                        exponent[i] = it->exponent()[i] - m[i];
+                }
+                log_coefficients.push_back(std::log(it->coefficient()));
+                exponents.push_back(exponent);
+        }
+        /* quadrature rules for the stick-breaking variables, where
+         * v_i ~ Beta(a_i, a_i+1 + ... + a_AS-1) */
+        std::vector<std::vector<double> > nodes  (AS-1);
+        std::vector<std::vector<double> > weights(AS-1);
+        for (size_t i = 0; i < AS-1; i++) {
+                a_sum -= a[i];
+                dkl_gauss_jacobi(n, a[i], a_sum, nodes[i], weights[i]);
+        }
+        /* loop over all points of the tensor product rule */
+        std::vector<size_t> index(AS-1, 0);
+        boost::array<double, AS> log_w;
+        double expectation = 0.0;
+        for (;;) {
+                double weight = 1.0;
+                double rest   = 0.0;
+                for (size_t i = 0; i < AS-1; i++) {
+                        const double v = nodes[i][index[i]];
+                        log_w[i] = rest + std::log(v);
+                        rest    += std::log(1.0 - v);
+                        weight  *= weights[i][index[i]];
+                }
+                log_w[AS-1] = rest;
+                /* Log L'(w) */
+                double log_max = -std::numeric_limits<double>::infinity();
+                std::vector<double> log_terms(exponents.size());
+                for (size_t k = 0; k < exponents.size(); k++) {
+                        log_terms[k] = log_coefficients[k];
+                        for (size_t i = 0; i < AS; i++) {
+                                if (exponents[k][i] != 0.0) {
+                                        log_terms[k] += exponents[k][i]*log_w[i];
+                                }
+                        }
+                        log_max = std::max(log_max, log_terms[k]);
+                }
+                double sum = 0.0;
+                for (size_t k = 0; k < exponents.size(); k++) {
+                        sum += std::exp(log_terms[k] - log_max);
+                }
+                expectation += weight*(log_max + std::log(sum));
+                /* next point */
+                size_t i;
+                for (i = 0; i < AS-1 && ++index[i] == n; i++) {
+                        index[i] = 0;
+                }
+                if (i == AS-1) {
+                        break;
+                }
+        }
+        result += expectation;
+
+        /* add - Int Q Log Q dw                                                *
+         ***********************************************************************/
+        result += dkl_variational_entropy<AS, PC>(variational, alpha);
+
+        return -result;
+}
+
+/* Compute D(q||p) with the given method, where n is the number of
+ * quadrature nodes per dimension (ignored by MISER).
+ */
+template <size_t AS, typename PC>
+double
+dkl(
+        const polynomial_t<AS, PC>& variational,
+        const polynomial_t<AS, PC>& likelihood,
+        const exponent_t<AS, PC>& alpha,
+        dkl_method_t method = dkl_method_miser,
+        size_t n = DKL_QUADRATURE_NODES)
+{
+        switch (method) {
+        case dkl_method_quadrature:
+                return dkl_quadrature<AS, PC>(variational, likelihood, alpha, n);
+        default:
+                return dkl_miser<AS, PC>(variational, likelihood, alpha);
+        }
+}
+
 /* Define a line that goes through the origin and the approximated
  * minimum (lower bound) of the Kullback-Leibler divergence. The
  * actual minimum is assumed to be somewhere on this line close to
@@ -190,7 +436,9 @@ dkl_line_search(
         const polynomial_t<AS, PC>& variational,
         const polynomial_t<AS, PC>& likelihood,
         const exponent_t<AS, PC>& alpha,
-        const size_t n)
+        const size_t n,
+        dkl_method_t method = dkl_method_miser,
+        size_t nodes = DKL_QUADRATURE_NODES)
 {
         polynomial_t<AS, PC> result = dkl_line<AS, PC>(variational, alpha, 1.0);
         /* step size */
@@ -200,12 +448,12 @@ dkl_line_search(
         double eta2    = 0.50;
         /* position on the line */
         double lambda  = 1.0;
-        double kl = dkl<AS, PC>(result, likelihood, alpha);
+        double kl = dkl<AS, PC>(result, likelihood, alpha, method, nodes);
         double kl_new;
 
         for (size_t i = 0; i < n; i++) {
                 result = dkl_line<AS, PC>(variational, alpha, lambda);
-                kl_new = dkl<AS, PC>(result, likelihood, alpha);
+                kl_new = dkl<AS, PC>(result, likelihood, alpha, method, nodes);
                 if (kl_new < kl) {
                         /* go faster */
                         epsilon *= eta1;
@@ -250,6 +498,40 @@ dkl_approximate(
         return result;
 }
 
+/* Function object that returns the counts of dkl_approximate(), as
+ * used with pt_column_cache_t::approximation(). If steps is not zero,
+ * the approximation is refined by a line search of the given number
+ * of steps, which evaluates the Kullback-Leibler divergence with the
+ * given method and number of quadrature nodes under a flat prior.
+ */
+template <size_t AS, typename PC>
+class dkl_approximate_t
+{
+public:
+        dkl_approximate_t(
+                size_t steps = 0,
+                dkl_method_t method = dkl_method_quadrature,
+                size_t nodes = DKL_QUADRATURE_NODES)
+                : m_steps(steps), m_method(method), m_nodes(nodes) {
+                for (size_t i = 0; i < AS; i++) {
+                        m_alpha[i] = 1.0;
+                }
+        }
+        exponent_t<AS, PC> operator()(const polynomial_t<AS, PC>& likelihood) const {
+                polynomial_t<AS, PC> result = dkl_approximate<AS, PC>(likelihood);
+                if (m_steps > 0) {
+                        result = dkl_line_search<AS, PC>(result, likelihood.normalize(), m_alpha,
+                                                         m_steps, m_method, m_nodes);
+                }
+                return result.begin()->exponent();
+        }
+protected:
+        size_t m_steps;
+        dkl_method_t m_method;
+        size_t m_nodes;
+        exponent_t<AS, PC> m_alpha;
+};
+
 #include <gsl/gsl_vector.h>
 #include <gsl/gsl_multiroots.h>
 
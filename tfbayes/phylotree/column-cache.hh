@@ -0,0 +1,469 @@
+/* Copyright (C) 2013 Philipp Benner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __TFBAYES_PHYLOTREE_COLUMN_CACHE_HH__
+#define __TFBAYES_PHYLOTREE_COLUMN_CACHE_HH__
+
+#ifdef HAVE_CONFIG_H
+#include <tfbayes/config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+#include <boost/format.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
+
+#include <tfbayes/phylotree/phylotree.hh>
+#include <tfbayes/phylotree/polynomial.hh>
+#include <tfbayes/phylotree/marginal-likelihood.hh>
+#include <tfbayes/utility/polynomial.hh>
+
+/* AS: ALPHABET SIZE
+ * AC: ALPHABET CODE TYPE
+ * PC: POLYNOMIAL CODE TYPE
+ */
+
+// fingerprint of a tree
+////////////////////////////////////////////////////////////////////////////////
+
+// The fingerprint covers the topology, the branch lengths, and the
+// names and ids of all nodes, i.e. everything that determines the
+// likelihood of a column. It is computed with FNV-1a, so that it does
+// not change between runs and can be stored in files.
+
+namespace tfbayes_detail {
+
+inline
+void fnv1a(boost::uint64_t& h, const void* data, size_t n)
+{
+        const unsigned char* p = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < n; i++) {
+                h ^= p[i];
+                h *= 1099511628211ULL;
+        }
+}
+
+inline
+void pt_fingerprint(boost::uint64_t& h, const pt_node_t& node)
+{
+        const unsigned char leaf = node.leaf();
+        const boost::int64_t id  = node.id;
+        const boost::uint64_t n  = node.name.size();
+        fnv1a(h, &leaf,  sizeof(leaf));
+        fnv1a(h, &id,    sizeof(id));
+        fnv1a(h, &node.d, sizeof(node.d));
+        fnv1a(h, &n,     sizeof(n));
+        fnv1a(h, node.name.data(), node.name.size());
+        if (!node.leaf()) {
+                pt_fingerprint(h, node.left ());
+                pt_fingerprint(h, node.right());
+        }
+}
+
+}
+
+inline
+boost::uint64_t pt_fingerprint(const pt_root_t& tree)
+{
+        boost::uint64_t h = 14695981039346656037ULL;
+        tfbayes_detail::pt_fingerprint(h, tree);
+        if (tree.outgroup()) {
+                tfbayes_detail::pt_fingerprint(h, *tree.outgroup());
+        }
+        return h;
+}
+
+// cache of column likelihoods
+////////////////////////////////////////////////////////////////////////////////
+
+// Alignments contain many identical columns, for which the likelihood
+// polynomial, the marginal likelihood under a given prior, and the
+// approximated counts have to be computed only once. The cache stores
+// all three, keyed by the column and (for marginal likelihoods) the
+// pseudocounts.
+//
+// A cache belongs to the tree it was created for. Every call must
+// pass this tree, which is checked only by valid(), because the
+// fingerprint is too expensive to compute for every column.
+//
+// The memory used by the cache is bounded by an estimate of the size
+// of all entries. Entries are kept in two generations. When the
+// current generation has used half of the budget it becomes the old
+// generation and the previous old generation is dropped. Entries of
+// the old generation are moved back to the current generation when
+// they are used, so frequent columns stay in the cache.
+//
+// The cache may be shared by several threads. Likelihoods are
+// computed without holding the lock, so two threads may compute the
+// same entry at the same time.
+
+template <size_t AS, typename AC = alphabet_code_t, typename PC = double>
+class pt_column_cache_t
+{
+public:
+        typedef std::vector<AC> column_t;
+        typedef polynomial_t<AS, PC> poly_t;
+        typedef exponent_t<AS, PC> alpha_t;
+
+        pt_column_cache_t(const pt_root_t& tree, size_t max_bytes = 64*1024*1024)
+                : m_fingerprint(pt_fingerprint(tree)),
+                  m_max_bytes(max_bytes), m_hits(0), m_misses(0)
+                { }
+        // the source may be used by other threads, so its entries
+        // are copied while holding its lock
+        pt_column_cache_t(const pt_column_cache_t& cache)
+                : m_fingerprint(cache.m_fingerprint),
+                  m_max_bytes  (cache.m_max_bytes) {
+                boost::lock_guard<boost::mutex> guard(cache.m_mtx);
+                m_current  = cache.m_current;
+                m_previous = cache.m_previous;
+                m_hits     = cache.m_hits;
+                m_misses   = cache.m_misses;
+        }
+
+        // likelihood polynomial of a column (see pt_likelihood)
+        poly_t likelihood(const pt_root_t& tree, const column_t& column) {
+                return m_likelihood(tree, column, true);
+        }
+        // log marginal likelihood of a column given the pseudocounts
+        // alpha (see pt_marginal_likelihood)
+        double marginal_likelihood(const pt_root_t& tree, const column_t& column, const alpha_t& alpha) {
+                const marginal_key_t key(column, alpha);
+                {
+                        boost::lock_guard<boost::mutex> guard(m_mtx);
+                        if (const double* result = m_find(&generation_t::marginals, key, true)) {
+                                return *result;
+                        }
+                }
+                // the polynomial is not counted as a separate
+                // lookup
+                const double result = pt_marginal_likelihood<AS, PC>(m_likelihood(tree, column, false), alpha);
+                boost::lock_guard<boost::mutex> guard(m_mtx);
+                m_insert(&generation_t::marginals, key, result);
+                return result;
+        }
+
+        // approximated counts of a column, which are computed by f
+        // from the likelihood polynomial (see dkl_approximate_t); all
+        // calls on a cache must use the same approximation, since
+        // approximations are not part of the key and are not saved
+        template <typename F>
+        alpha_t approximation(const pt_root_t& tree, const column_t& column, const F& f) {
+                {
+                        boost::lock_guard<boost::mutex> guard(m_mtx);
+                        if (const alpha_t* result = m_find(&generation_t::approximations, column, true)) {
+                                return *result;
+                        }
+                }
+                const alpha_t result = f(m_likelihood(tree, column, false));
+                boost::lock_guard<boost::mutex> guard(m_mtx);
+                m_insert(&generation_t::approximations, column, result);
+                return result;
+        }
+
+        // check that the cache belongs to the given tree
+        bool valid(const pt_root_t& tree) const {
+                return pt_fingerprint(tree) == m_fingerprint;
+        }
+        void clear() {
+                boost::lock_guard<boost::mutex> guard(m_mtx);
+                m_current .clear();
+                m_previous.clear();
+        }
+        // number of cached likelihoods, marginal likelihoods, and
+        // approximations
+        size_t size() const {
+                boost::lock_guard<boost::mutex> guard(m_mtx);
+                return m_current .likelihoods.size() + m_current .marginals.size() +
+                       m_current .approximations.size() +
+                       m_previous.likelihoods.size() + m_previous.marginals.size() +
+                       m_previous.approximations.size();
+        }
+        // estimated memory used by the cache
+        size_t bytes() const {
+                boost::lock_guard<boost::mutex> guard(m_mtx);
+                return m_current.bytes + m_previous.bytes;
+        }
+        size_t max_bytes() const {
+                return m_max_bytes;
+        }
+        size_t hits() const {
+                boost::lock_guard<boost::mutex> guard(m_mtx);
+                return m_hits;
+        }
+        size_t misses() const {
+                boost::lock_guard<boost::mutex> guard(m_mtx);
+                return m_misses;
+        }
+        double hit_rate() const {
+                boost::lock_guard<boost::mutex> guard(m_mtx);
+                return m_hits + m_misses == 0 ? 0.0 :
+                        static_cast<double>(m_hits)/static_cast<double>(m_hits + m_misses);
+        }
+
+        // The file starts with the magic string "TFBC", the format
+        // version, the alphabet size, the sizes of the alphabet and
+        // polynomial codes (uint32 each), and the fingerprint of the
+        // tree (uint64). It is followed by the number of likelihoods
+        // (uint64), each given by the length of the column (uint64),
+        // the column, the number of terms (uint64) and the terms
+        // (exponent and coefficient), and by the number of marginal
+        // likelihoods (uint64), each given by the length of the
+        // column, the column, the pseudocounts and the value. Numbers
+        // are stored in the byte order of the machine. Approximations
+        // are not saved.
+        void save(const std::string& filename) const {
+                std::ofstream file(filename.c_str(), std::ios::binary);
+                if (!file) {
+                        throw std::runtime_error((boost::format("Could not open `%s'.") % filename).str());
+                }
+                boost::lock_guard<boost::mutex> guard(m_mtx);
+                file.write(magic(), 4);
+                m_write(file, static_cast<boost::uint32_t>(version));
+                m_write(file, static_cast<boost::uint32_t>(AS));
+                m_write(file, static_cast<boost::uint32_t>(sizeof(AC)));
+                m_write(file, static_cast<boost::uint32_t>(sizeof(PC)));
+                m_write(file, m_fingerprint);
+                m_write(file, static_cast<boost::uint64_t>(
+                                m_current.likelihoods.size() + m_previous.likelihoods.size()));
+                m_save_likelihoods(file, m_current .likelihoods);
+                m_save_likelihoods(file, m_previous.likelihoods);
+                m_write(file, static_cast<boost::uint64_t>(
+                                m_current.marginals.size() + m_previous.marginals.size()));
+                m_save_marginals(file, m_current .marginals);
+                m_save_marginals(file, m_previous.marginals);
+                if (!file) {
+                        throw std::runtime_error((boost::format("Writing `%s' failed.") % filename).str());
+                }
+        }
+        // add the entries of a file to the cache, returns false if
+        // the file does not exist or belongs to another tree
+        bool load(const std::string& filename) {
+                std::ifstream file(filename.c_str(), std::ios::binary);
+                if (!file) {
+                        return false;
+                }
+                char header[4];
+                boost::uint32_t file_version, alphabet_size, ac_size, pc_size;
+                boost::uint64_t fingerprint;
+                file.read(header, 4);
+                m_read(file, file_version);
+                m_read(file, alphabet_size);
+                m_read(file, ac_size);
+                m_read(file, pc_size);
+                m_read(file, fingerprint);
+                if (!file || std::memcmp(header, magic(), 4) != 0 || file_version != version ||
+                    alphabet_size != AS || ac_size != sizeof(AC) || pc_size != sizeof(PC)) {
+                        throw std::runtime_error((boost::format("`%s' is not a column cache file.") % filename).str());
+                }
+                if (fingerprint != m_fingerprint) {
+                        return false;
+                }
+                boost::uint64_t n;
+                m_read(file, n);
+                for (boost::uint64_t i = 0; i < n && file; i++) {
+                        column_t column;
+                        m_read(file, column);
+                        boost::uint64_t m;
+                        m_read(file, m);
+                        poly_t poly;
+                        for (boost::uint64_t j = 0; j < m && file; j++) {
+                                polynomial_term_t<AS, PC> term;
+                                m_read(file, term.exponent());
+                                m_read(file, term.coefficient());
+                                poly += term;
+                        }
+                        boost::lock_guard<boost::mutex> guard(m_mtx);
+                        m_insert(&generation_t::likelihoods, column, poly);
+                }
+                m_read(file, n);
+                for (boost::uint64_t i = 0; i < n && file; i++) {
+                        marginal_key_t key;
+                        double value;
+                        m_read(file, key.first);
+                        m_read(file, key.second);
+                        m_read(file, value);
+                        boost::lock_guard<boost::mutex> guard(m_mtx);
+                        m_insert(&generation_t::marginals, key, value);
+                }
+                if (!file) {
+                        throw std::runtime_error((boost::format("`%s' is truncated.") % filename).str());
+                }
+                return true;
+        }
+
+protected:
+        static const boost::uint32_t version = 1;
+        static const char* magic() {
+                return "TFBC";
+        }
+
+        typedef std::pair<column_t, alpha_t> marginal_key_t;
+        typedef boost::unordered_map<column_t, poly_t> likelihood_map_t;
+        typedef boost::unordered_map<marginal_key_t, double> marginal_map_t;
+        typedef boost::unordered_map<column_t, alpha_t> approximation_map_t;
+
+        struct generation_t {
+                generation_t()
+                        : bytes(0)
+                        { }
+                void swap(generation_t& generation) {
+                        likelihoods   .swap(generation.likelihoods);
+                        marginals     .swap(generation.marginals);
+                        approximations.swap(generation.approximations);
+                        std::swap(bytes, generation.bytes);
+                }
+                void clear() {
+                        likelihoods   .clear();
+                        marginals     .clear();
+                        approximations.clear();
+                        bytes = 0;
+                }
+                likelihood_map_t likelihoods;
+                marginal_map_t marginals;
+                approximation_map_t approximations;
+                size_t bytes;
+        };
+
+        poly_t m_likelihood(const pt_root_t& tree, const column_t& column, bool count) {
+                {
+                        boost::lock_guard<boost::mutex> guard(m_mtx);
+                        if (const poly_t* result = m_find(&generation_t::likelihoods, column, count)) {
+                                return *result;
+                        }
+                }
+                const poly_t result = pt_likelihood<AS, AC, PC>(tree, column);
+                boost::lock_guard<boost::mutex> guard(m_mtx);
+                m_insert(&generation_t::likelihoods, column, result);
+                return result;
+        }
+
+        // estimated size of an entry, including the nodes of the
+        // hash map
+        static size_t m_bytes(const column_t& column) {
+                return column.size()*sizeof(AC) + sizeof(column_t) + 4*sizeof(void*);
+        }
+        static size_t m_bytes(const column_t& column, const poly_t& poly) {
+                return m_bytes(column) + sizeof(poly_t) +
+                        poly.size()*(sizeof(typename poly_t::value_type) + 2*sizeof(void*));
+        }
+        static size_t m_bytes(const marginal_key_t& key, double value) {
+                return m_bytes(key.first) + sizeof(alpha_t) + sizeof(double);
+        }
+        static size_t m_bytes(const column_t& column, const alpha_t& alpha) {
+                return m_bytes(column) + sizeof(alpha_t);
+        }
+
+        // look up an entry and move it to the current generation if
+        // it is found in the old one, the lookup is counted in the
+        // statistics if count is true
+        template <typename M>
+        const typename M::mapped_type* m_find(M generation_t::*map, const typename M::key_type& key, bool count) {
+                typename M::iterator it = (m_current.*map).find(key);
+                if (it != (m_current.*map).end()) {
+                        m_hits += count;
+                        return &it->second;
+                }
+                it = (m_previous.*map).find(key);
+                if (it != (m_previous.*map).end()) {
+                        m_hits += count;
+                        // the entry is inserted before the old
+                        // generation might be dropped
+                        const typename M::mapped_type value = it->second;
+                        m_insert(map, key, value);
+                        return &(m_current.*map)[key];
+                }
+                m_misses += count;
+                return NULL;
+        }
+        template <typename M>
+        void m_insert(M generation_t::*map, const typename M::key_type& key,
+                      const typename M::mapped_type& value) {
+                const size_t bytes = m_bytes(key, value);
+                if (m_current.bytes + bytes > m_max_bytes/2) {
+                        m_previous.swap(m_current);
+                        m_current .clear();
+                }
+                if ((m_current.*map).insert(std::make_pair(key, value)).second) {
+                        m_current.bytes += bytes;
+                }
+        }
+
+        template <typename T>
+        static void m_write(std::ostream& file, const T& value) {
+                file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+        }
+        static void m_write(std::ostream& file, const column_t& column) {
+                m_write(file, static_cast<boost::uint64_t>(column.size()));
+                if (!column.empty()) {
+                        file.write(reinterpret_cast<const char*>(&column[0]), column.size()*sizeof(AC));
+                }
+        }
+        template <typename T>
+        static void m_read(std::istream& file, T& value) {
+                file.read(reinterpret_cast<char*>(&value), sizeof(T));
+        }
+        static void m_read(std::istream& file, column_t& column) {
+                boost::uint64_t n = 0;
+                m_read(file, n);
+                // a column has one entry per species
+                if (!file || n > 1024*1024) {
+                        file.setstate(std::ios::failbit);
+                        return;
+                }
+                column.resize(n);
+                if (n > 0) {
+                        file.read(reinterpret_cast<char*>(&column[0]), n*sizeof(AC));
+                }
+        }
+        static void m_save_likelihoods(std::ostream& file, const likelihood_map_t& map) {
+                for (typename likelihood_map_t::const_iterator it = map.begin(); it != map.end(); it++) {
+                        m_write(file, it->first);
+                        m_write(file, static_cast<boost::uint64_t>(it->second.size()));
+                        for (typename poly_t::const_iterator is = it->second.begin(); is != it->second.end(); is++) {
+                                m_write(file, is->exponent());
+                                m_write(file, is->coefficient());
+                        }
+                }
+        }
+        static void m_save_marginals(std::ostream& file, const marginal_map_t& map) {
+                for (typename marginal_map_t::const_iterator it = map.begin(); it != map.end(); it++) {
+                        m_write(file, it->first.first);
+                        m_write(file, it->first.second);
+                        m_write(file, it->second);
+                }
+        }
+
+        boost::uint64_t m_fingerprint;
+        size_t m_max_bytes;
+        // protects the following members
+        mutable boost::mutex m_mtx;
+        generation_t m_current;
+        generation_t m_previous;
+        size_t m_hits;
+        size_t m_misses;
+};
+
+#endif /* __TFBAYES_PHYLOTREE_COLUMN_CACHE_HH__ */
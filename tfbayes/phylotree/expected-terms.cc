@@ -20,7 +20,10 @@
 #endif /* HAVE_CONFIG_H */
 
 #include <iostream>
+#include <iomanip>
 #include <cassert>
+#include <cstring>
+#include <ctime>
 
 #include <sys/time.h>
 
@@ -79,6 +82,48 @@ double expected_terms(size_t n, bool felsenstein = false)
         return result;
 }
 
+// compare the running time of the likelihood on hashed and on
+// flat polynomials
+double benchmark(size_t n, size_t samples)
+{
+        const pt_root_t tree = create_tree(n);
+        std::vector<std::vector<alphabet_code_t> > observations(
+                samples, std::vector<alphabet_code_t>(tree.n_leaves));
+        flat_workspace_t<alphabet_size> workspace;
+        boost::array<double, alphabet_size> x;
+        x.fill(1.0/alphabet_size);
+        double result1 = 0.0, result2 = 0.0, terms = 0.0;
+
+        for (size_t i = 0; i < samples; i++) {
+                random_init(observations[i]);
+        }
+        clock_t t1 = clock();
+        for (size_t i = 0; i < samples; i++) {
+                polynomial_t<alphabet_size> poly = tfbayes_detail::poly_sum<alphabet_size, alphabet_code_t, double>(
+                        tfbayes_detail::likelihood_root<alphabet_size, alphabet_code_t, double>(tree, observations[i]));
+                result1 += poly.eval(x);
+                terms   += poly.size();
+        }
+        clock_t t2 = clock();
+        for (size_t i = 0; i < samples; i++) {
+                polynomial_t<alphabet_size> poly = pt_flat_likelihood<alphabet_size, alphabet_code_t>(
+                        tree, observations[i], workspace).polynomial<double>();
+                result2 += poly.eval(x);
+        }
+        clock_t t3 = clock();
+        const double d1 = 1e6*(t2-t1)/CLOCKS_PER_SEC/samples;
+        const double d2 = 1e6*(t3-t2)/CLOCKS_PER_SEC/samples;
+
+        cout << setw(8)  << 2*n-1
+             << setw(10) << terms/samples
+             << setw(14) << d1
+             << setw(14) << d2
+             << setw(10) << d1/d2
+             << endl;
+
+        return std::abs(result1 - result2)/std::abs(result1);
+}
+
 void init() {
         struct timeval tv;
         gettimeofday(&tv, NULL);
@@ -87,10 +132,22 @@ void init() {
         srand(seed);
 }
 
-int main(void)
+int main(int argc, char *argv[])
 {
         init();
 
+        if (argc == 2 && strcmp(argv[1], "--benchmark") == 0) {
+                double difference = 0.0;
+                cout << "vertices     terms   hashed (us)     flat (us)   speedup"
+                     << endl;
+                for (size_t i = 1; i <= 20; i++) {
+                        difference = max(difference, benchmark(i, 1000));
+                }
+                cout << "relative difference: " << difference << endl;
+
+                return difference < 1e-12 ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+
         size_t n1 = 5;
         size_t n2 = 20;
         size_t n  = max(n1,n2);
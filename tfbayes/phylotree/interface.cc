@@ -26,11 +26,14 @@
 #include <boost/python/make_constructor.hpp>
 #include <boost/python/iterator.hpp>
 #include <boost/python/suite/indexing/vector_indexing_suite.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
 
 #include <tfbayes/phylotree/parser.hh>
 #include <tfbayes/phylotree/phylotree.hh>
 #include <tfbayes/phylotree/treespace.hh>
 #include <tfbayes/interface/exceptions.hh>
+#include <tfbayes/interface/gil.hh>
 #include <tfbayes/interface/utility.hh>
 
 using namespace boost::python;
@@ -65,8 +68,20 @@ pt_root_t* parse_tree_file_ref(const std::string& filename, const pt_root_t& ref
         return new pt_root_t(tree_list.front());
 }
 
-pt_root_t geodesic_call(geodesic_t geodesic, double lambda)
+// the interpreter lock is released while geodesics are computed,
+// but glpk, which is used to find the geodesic, is not reentrant
+static boost::mutex geodesic_mtx;
+
+geodesic_t* geodesic_constructor(const pt_root_t& t1, const pt_root_t& t2)
+{
+        release_gil_t gil;
+        boost::lock_guard<boost::mutex> guard(geodesic_mtx);
+        return new geodesic_t(t1, t2);
+}
+
+pt_root_t geodesic_call(const geodesic_t& geodesic, double lambda)
 {
+        release_gil_t gil;
         return geodesic(lambda).export_tree();
 }
 
@@ -94,7 +109,7 @@ BOOST_PYTHON_MODULE(interface)
                 .def("get_leaf_id", &pt_root_t::get_leaf_id)
                 ;
         class_<geodesic_t>("geodesic_t", no_init)
-                .def(init<pt_root_t, pt_root_t>())
+                .def("__init__", make_constructor(geodesic_constructor))
                 .def("__call__", &geodesic_call)
                 .def("length",   &geodesic_t::length)
                 ;
@@ -22,7 +22,14 @@
 #include <tfbayes/config.h>
 #endif /* HAVE_CONFIG_H */
 
+#include <algorithm>
+#include <cmath>
+#include <functional>
 #include <limits>
+#include <vector>
+
+#include <boost/array.hpp>
+#include <boost/unordered_map.hpp>
 
 #include <tfbayes/alignment/alignment.hh>
 #include <tfbayes/phylotree/phylotree.hh>
@@ -81,6 +88,30 @@ double pt_marginal_likelihood(
         return n*pt_marginal_likelihood(tree, observations, alpha);
 }
 
+// marginal likelihood of a single column of the alignment, which is
+// called by the thread pool
+template <size_t AS, typename AC, typename PC>
+class pt_marginal_likelihood_column_t {
+public:
+        typedef typename alignment_map_t<AC>::const_iterator column_t;
+
+        pt_marginal_likelihood_column_t(
+                const pt_root_t& tree,
+                const std::vector<column_t>& columns,
+                const std::vector<exponent_t<AS, PC> >& alpha)
+                : tree(tree), columns(columns), alpha(alpha)
+                { }
+        double operator()(size_t i) const {
+                return pt_marginal_likelihood<AS, AC, PC>(
+                        static_cast<double>(columns[i]->second),
+                        tree, columns[i]->first, alpha[i%alpha.size()]);
+        }
+protected:
+        const pt_root_t& tree;
+        const std::vector<column_t>& columns;
+        const std::vector<exponent_t<AS, PC> >& alpha;
+};
+
 template <size_t AS, typename AC, typename PC>
 double pt_marginal_likelihood(
         const pt_root_t& tree,
@@ -88,30 +119,20 @@ double pt_marginal_likelihood(
         const std::vector<exponent_t<AS, PC> >& alpha,
         thread_pool_t& thread_pool
         ) {
-        // type of the marginal likelihood function that is called by
-        // the thread pool
-        typedef double (*mlf)(double, const pt_root_t&, const std::vector<AC>&, const exponent_t<AS, PC>&);
-        double result = 0;
-        // results for each column are stored in a vector of
-        // futures (with pre allocated capacity)
-        future_vector_t<double> futures(alignment.size());
-        // current position in the alignment
-        size_t i = 0;
-        // launch threads to compute the likelihood
+        typedef pt_marginal_likelihood_column_t<AS, AC, PC> column_likelihood_t;
+        // columns of the alignment in the order of the map
+        std::vector<typename column_likelihood_t::column_t> columns;
+        columns.reserve(alignment.size());
         for (typename alignment_map_t<AC>::const_iterator it = alignment.begin();
              it != alignment.end(); it++) {
-                boost::function<double ()> f = boost::bind(
-                        static_cast<mlf>(&pt_marginal_likelihood<AS, AC, PC>),
-                        static_cast<double>(it->second),
-                        boost::cref(tree),
-                        boost::cref(it->first),
-                        boost::cref(alpha[i%alpha.size()]));
-                futures[i++] = thread_pool.schedule(f);
-        }
-        for (size_t i = 0; i < futures.size(); i++) {
-                result += futures[i].get();
+                columns.push_back(it);
         }
-        return result;
+        // a single column is cheap, hence columns are processed in
+        // chunks to keep the scheduling overhead small
+        return thread_pool.parallel_reduce(
+                0, columns.size(), 8, 0.0,
+                column_likelihood_t(tree, columns, alpha),
+                std::plus<double>());
 }
 
 // derivative of the marginal likelihood
@@ -174,6 +195,284 @@ pt_marginal_derivative(
         return result;
 }
 
+namespace tfbayes_detail {
+        // Log marginal likelihood of a column and its derivatives
+        // with respect to all branch lengths on flat polynomials.
+        //
+        // The likelihood polynomial P is linear in each component of
+        // the carry of a node v, i.e. P = sum_c O_c(v)*carry_c(v),
+        // where the outside polynomials O_c(v) depend only on the
+        // tree outside the subtree of v. The carries are computed in
+        // an upward pass as for the likelihood. The outside
+        // polynomials of the children of a node are then computed
+        // from those of the node in a downward pass, which also
+        // gives the derivative of P with respect to the branch
+        // lengths of both children. Hence all derivatives cost two
+        // passes over the tree instead of one pass per branch. The
+        // marginal likelihood is a linear function of the
+        // polynomial, so it is applied to P and to the derivative of
+        // P for each branch.
+        template <size_t AS, typename AC, typename PC>
+        class flat_derivative_t {
+        public:
+                typedef flat_polynomial_t<AS> poly_t;
+                typedef typename poly_t::key_t key_t;
+
+                // add n times the log marginal likelihood of the
+                // column and its derivatives to result
+                void operator()(
+                        const pt_root_t& root,
+                        const std::vector<AC>& observations,
+                        const exponent_t<AS, PC>& alpha,
+                        double n,
+                        pt_marginal_derivative_t& result) {
+                        const size_t k = root.n_nodes;
+                        m_carry     .resize(k);
+                        m_sum       .resize(k);
+                        m_outside   .resize(k);
+                        m_derivative.assign(k, 0.0);
+                        m_marginals .clear();
+                        m_alpha       = &alpha;
+                        m_mbeta_alpha = mbeta_log(alpha);
+
+                        m_up(root, observations);
+                        // outside polynomials of the top node are
+                        // given by the poly sum
+                        flat_carry_t<AS> top;
+                        for (size_t i = 0; i < AS; i++) {
+                                top[i].clear();
+                                top[i].add(poly_t(1.0), 1.0, m_workspace, poly_t::key(i));
+                        }
+                        top[AS] = 1.0;
+                        if (root.outgroup()) {
+                                // the root is not separated from the
+                                // outgroup by a branch of its own
+                                m_up(*root.outgroup(), observations);
+                                flat_carry_t<AS> carry;
+                                flat_likelihood_node<AS>(
+                                        0.0, 1.0-std::exp(-root.outgroup()->d),
+                                        m_carry[root.id], m_carry[root.outgroup()->id],
+                                        carry, m_workspace);
+                                flat_poly_sum<AS>(carry, m_polynomial, m_workspace);
+                                m_down_step(0.0, 1.0-std::exp(-root.outgroup()->d),
+                                            top, root, *root.outgroup(), false);
+                        }
+                        else {
+                                flat_poly_sum<AS>(m_carry[root.id], m_polynomial, m_workspace);
+                                m_outside[root.id] = top;
+                        }
+                        const double marginal = m_marginal(m_polynomial);
+                        m_down(root);
+
+                        result += n*std::log(marginal);
+                        for (pt_node_t::nodes_t::const_iterator it = root.begin_nodes();
+                             it != root.end_nodes(); it++) {
+                                if (!(*it)->root()) {
+                                        result.derivative()[(*it)->id] += n*m_derivative[(*it)->id]/marginal;
+                                }
+                        }
+                }
+
+        protected:
+                void m_up(const pt_node_t& node, const std::vector<AC>& observations) {
+                        flat_carry_t<AS>& carry = m_carry[node.id];
+                        for (size_t i = 0; i <= AS; i++) {
+                                carry[i].clear();
+                        }
+                        if (node.leaf()) {
+                                flat_likelihood_leaf<AS, AC>(node, observations, carry);
+                        }
+                        else {
+                                m_up(node.left (), observations);
+                                m_up(node.right(), observations);
+                                flat_likelihood_node<AS>(
+                                        1.0-std::exp(-node.left ().d),
+                                        1.0-std::exp(-node.right().d),
+                                        m_carry[node.left().id], m_carry[node.right().id],
+                                        carry, m_workspace);
+                        }
+                        flat_poly_sum<AS>(carry, m_sum[node.id], m_workspace);
+                }
+                void m_down(const pt_node_t& node) {
+                        if (node.leaf()) {
+                                return;
+                        }
+                        m_down_step(1.0-std::exp(-node.left ().d),
+                                    1.0-std::exp(-node.right().d),
+                                    m_outside[node.id], node.left(), node.right(), true);
+                        m_down(node.left ());
+                        m_down(node.right());
+                }
+                // outside polynomials of both children and the
+                // derivatives with respect to their branch lengths,
+                // where the contribution of the children to P is
+                //
+                //   O_AS*A_l*A_r + sum_i O_i*(pn_l*L_i*(A_r + pn_r*R_i) + pn_r*R_i*A_l)
+                //
+                // with A_l = pn_l*L_AS + pm_l*S_l, A_r = pn_r*R_AS + pm_r*S_r,
+                // pn = 1-pm, the carries L and R of the children and their
+                // poly sums S_l and S_r (see likelihood_node)
+                void m_down_step(
+                        double pm_left, double pm_right,
+                        const flat_carry_t<AS>& outside,
+                        const pt_node_t& left, const pt_node_t& right,
+                        bool derive_left) {
+                        m_side(pm_left, pm_right, outside, left, right, derive_left);
+                        m_side(pm_right, pm_left, outside, right, left, true);
+                }
+                // compute the outside polynomials of node and the
+                // derivative with respect to its branch length, the
+                // contribution to P is symmetric in both children
+                // except for pn_l*pn_r*L_i*R_i, which is assigned to
+                // the left child
+                void m_side(
+                        double pm, double pm_sibling,
+                        const flat_carry_t<AS>& outside,
+                        const pt_node_t& node, const pt_node_t& sibling,
+                        bool derive) {
+                        const flat_carry_t<AS>& carry         = m_carry[node   .id];
+                        const flat_carry_t<AS>& carry_sibling = m_carry[sibling.id];
+                        const double pn         = 1.0-pm;
+                        const double pn_sibling = 1.0-pm_sibling;
+                        // A of both children
+                        poly_t& a = m_a;
+                        poly_t& a_sibling = m_a_sibling;
+                        a.clear();
+                        a.add(carry[AS], pn, m_workspace);
+                        a.add(m_sum[node.id], pm, m_workspace);
+                        a_sibling.clear();
+                        a_sibling.add(carry_sibling[AS], pn_sibling, m_workspace);
+                        a_sibling.add(m_sum[sibling.id], pm_sibling, m_workspace);
+                        // g = dP/dA
+                        poly_t& g = m_g;
+                        g.clear();
+                        g.add_product(outside[AS], a_sibling, 1.0, m_workspace);
+                        for (size_t i = 0; i < AS; i++) {
+                                g.add_product(outside[i], carry_sibling[i], pn_sibling, m_workspace);
+                        }
+                        // m_i = dP/dL_i/pn, which is needed for the
+                        // outside polynomials of inner nodes and
+                        // the derivative
+                        for (size_t i = 0; i < AS; i++) {
+                                m_m[i].clear();
+                                if (node.leaf() && carry[i].empty()) {
+                                        continue;
+                                }
+                                m_tmp.clear();
+                                m_tmp.add(a_sibling, 1.0, m_workspace);
+                                m_tmp.add(carry_sibling[i], pn_sibling, m_workspace);
+                                m_m[i].add_product(outside[i], m_tmp, 1.0, m_workspace);
+                        }
+                        if (derive) {
+                                // dP/dpm = g*(S - L_AS) - sum_i m_i*L_i
+                                // and dpm/dd = pn
+                                m_tmp.clear();
+                                m_tmp.add(m_sum[node.id], 1.0, m_workspace);
+                                m_tmp.add(carry[AS],     -1.0, m_workspace);
+                                m_d.clear();
+                                m_d.add_product(g, m_tmp, pn, m_workspace);
+                                for (size_t i = 0; i < AS; i++) {
+                                        m_d.add_product(m_m[i], carry[i], -pn, m_workspace);
+                                }
+                                m_derivative[node.id] = m_marginal(m_d);
+                        }
+                        if (!node.leaf()) {
+                                flat_carry_t<AS>& result = m_outside[node.id];
+                                for (size_t i = 0; i < AS; i++) {
+                                        result[i].clear();
+                                        result[i].add(m_m[i], pn, m_workspace);
+                                        result[i].add(g, pm, m_workspace, poly_t::key(i));
+                                }
+                                swap(result[AS], g);
+                        }
+                }
+                // marginal likelihood of a polynomial (see
+                // pt_marginal_likelihood), the beta functions are
+                // shared by all polynomials of a column
+                double m_marginal(const poly_t& polynomial) {
+                        double result = 0.0;
+                        for (typename poly_t::const_iterator it = polynomial.begin();
+                             it != polynomial.end(); it++) {
+                                typename boost::unordered_map<key_t, double>::iterator is = m_marginals.find(it->key);
+                                if (is == m_marginals.end()) {
+                                        exponent_t<AS, PC> exponent;
+                                        for (size_t i = 0; i < AS; i++) {
+                                                exponent[i] = poly_t::exponent(it->key, i);
+                                        }
+                                        is = m_marginals.insert(std::make_pair(it->key,
+                                                std::exp(mbeta_log(exponent, *m_alpha) - m_mbeta_alpha))).first;
+                                }
+                                result += it->coefficient*is->second;
+                        }
+                        return result;
+                }
+
+                // carries, poly sums and outside polynomials of all
+                // nodes
+                std::vector<flat_carry_t<AS> > m_carry;
+                std::vector<poly_t> m_sum;
+                std::vector<flat_carry_t<AS> > m_outside;
+                // derivative of the marginal likelihood for each
+                // branch
+                std::vector<double> m_derivative;
+                // likelihood polynomial
+                poly_t m_polynomial;
+                // temporary polynomials
+                poly_t m_a, m_a_sibling, m_g, m_d, m_tmp;
+                boost::array<poly_t, AS> m_m;
+                flat_workspace_t<AS> m_workspace;
+                // pseudocounts of the current column
+                const exponent_t<AS, PC>* m_alpha;
+                double m_mbeta_alpha;
+                boost::unordered_map<key_t, double> m_marginals;
+        };
+}
+
+// derivative of the log marginal likelihood of a range of columns,
+// which is computed by a single thread
+template <size_t AS, typename AC, typename PC>
+class pt_marginal_derivative_chunk_t {
+public:
+        typedef typename alignment_map_t<AC>::const_iterator column_t;
+
+        pt_marginal_derivative_chunk_t(
+                const pt_root_t& tree,
+                const std::vector<column_t>& columns,
+                const std::vector<exponent_t<AS, PC> >& alpha,
+                size_t grain,
+                std::vector<pt_marginal_derivative_t>& result)
+                : tree(tree), columns(columns), alpha(alpha), grain(grain), result(result)
+                { }
+        void operator()(size_t k) const {
+                const size_t first = k*grain;
+                const size_t last  = std::min(first + grain, columns.size());
+                pt_marginal_derivative_t& r = result[k];
+                if (tfbayes_detail::flat_likelihood_applicable<AS>(tree)) {
+                        tfbayes_detail::flat_derivative_t<AS, AC, PC> derivative;
+                        for (size_t i = first; i < last; i++) {
+                                derivative(tree, columns[i]->first, alpha[i%alpha.size()],
+                                           static_cast<double>(columns[i]->second), r);
+                        }
+                        return;
+                }
+                for (size_t i = first; i < last; i++) {
+                        pt_marginal_derivative_t tmp = pt_marginal_derivative<AS, AC, PC>(
+                                static_cast<double>(columns[i]->second),
+                                tree, columns[i]->first, alpha[i%alpha.size()]);
+                        r += tmp;
+                        for (size_t j = 0; j < r.d(); j++) {
+                                r.derivative()[j] += tmp.derivative()[j];
+                        }
+                }
+        }
+protected:
+        const pt_root_t& tree;
+        const std::vector<column_t>& columns;
+        const std::vector<exponent_t<AS, PC> >& alpha;
+        size_t grain;
+        std::vector<pt_marginal_derivative_t>& result;
+};
+
 template <size_t AS, typename AC, typename PC>
 pt_marginal_derivative_t
 pt_marginal_derivative(
@@ -182,36 +481,27 @@ pt_marginal_derivative(
         const std::vector<exponent_t<AS, PC> >& alpha,
         thread_pool_t& thread_pool
         ) {
-        // type of the marginal likelihood function that is called by
-        // the thread pool
-        typedef pt_marginal_derivative_t (*mlf)(
-                double, const pt_root_t&, const std::vector<AC>&, const exponent_t<AS, PC>&);
-        // resulting derivative
-        pt_marginal_derivative_t result(tree.n_nodes-1);
-        // results for each column are stored in a vector of
-        // futures (with pre allocated capacity)
-        future_vector_t<pt_marginal_derivative_t> futures(alignment.size());
-        // current position in the alignment
-        size_t i = 0;
-        // launch threads to compute the likelihood
+        typedef pt_marginal_derivative_chunk_t<AS, AC, PC> chunk_t;
+        // columns of the alignment in the order of the map
+        std::vector<typename chunk_t::column_t> columns;
+        columns.reserve(alignment.size());
         for (typename alignment_map_t<AC>::const_iterator it = alignment.begin();
              it != alignment.end(); it++) {
-                boost::function<pt_marginal_derivative_t ()> f = boost::bind(
-                        static_cast<mlf>(&pt_marginal_derivative<AS, AC, PC>),
-                        static_cast<double>(it->second),
-                        boost::cref(tree),
-                        boost::cref(it->first),
-                        boost::cref(alpha[i%alpha.size()]));
-                futures[i++] = thread_pool.schedule(f);
+                columns.push_back(it);
         }
-        // marginal likelihood
-        for (size_t i = 0; i < futures.size(); i++) {
-                result += futures[i].get();
-        }
-        // derivatives
-        for (size_t i = 0; i < result.d(); i++) {
-                for (size_t j = 0; j < futures.size(); j++) {
-                        result.derivative()[i] += futures[j].get().derivative()[i];
+        // every chunk of columns is processed by a single thread
+        // with its own storage for polynomials, partial results are
+        // added in a fixed order
+        const size_t grain = 8;
+        const size_t n     = (columns.size() + grain - 1)/grain;
+        std::vector<pt_marginal_derivative_t> partial(n, pt_marginal_derivative_t(tree.n_nodes-1));
+        thread_pool.parallel_for(0, n, 1, chunk_t(tree, columns, alpha, grain, partial));
+        // resulting derivative
+        pt_marginal_derivative_t result(tree.n_nodes-1);
+        for (size_t k = 0; k < n; k++) {
+                result += partial[k];
+                for (size_t i = 0; i < result.d(); i++) {
+                        result.derivative()[i] += partial[k].derivative()[i];
                 }
         }
         return result;
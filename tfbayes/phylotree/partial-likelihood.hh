@@ -0,0 +1,232 @@
+/* Copyright (C) 2013 Philipp Benner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __TFBAYES_PHYLOTREE_PARTIAL_LIKELIHOOD_HH__
+#define __TFBAYES_PHYLOTREE_PARTIAL_LIKELIHOOD_HH__
+
+#ifdef HAVE_CONFIG_H
+#include <tfbayes/config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <functional>
+#include <vector>
+
+#include <tfbayes/alignment/alignment.hh>
+#include <tfbayes/phylotree/phylotree.hh>
+#include <tfbayes/phylotree/polynomial.hh>
+#include <tfbayes/phylotree/marginal-likelihood.hh>
+#include <tfbayes/utility/thread-pool.hh>
+
+/* AS: ALPHABET SIZE
+ * AC: ALPHABET CODE TYPE
+ * PC: POLYNOMIAL CODE TYPE
+ */
+
+// Marginal likelihood of an alignment with cached partial
+// likelihoods. For every column of the alignment the carry of each
+// inner node (see polynomial.hh) is stored. The carry of a node
+// depends only on the subtree below it, including the branch lengths
+// of its children, so after changing a branch length or the topology
+// at a node only the carries on the path to the root have to be
+// recomputed, which must be announced with invalidate(). The carries
+// that were replaced by the last evaluation can be put back with
+// restore(), e.g. if a proposal is rejected and the tree is reset.
+//
+// The cache belongs to a single tree and the ids of its nodes. Copies
+// of a cache are empty.
+////////////////////////////////////////////////////////////////////////////////
+
+template <size_t AS, typename AC = alphabet_code_t, typename PC = double>
+class pt_partial_likelihood_t
+{
+public:
+        typedef tfbayes_detail::carry_t<AS, AC, PC> carry_t;
+        typedef typename alignment_map_t<AC>::const_iterator column_t;
+
+        pt_partial_likelihood_t()
+                : m_alignment(NULL), m_restorable(false)
+                { }
+        pt_partial_likelihood_t(const pt_partial_likelihood_t& partial_likelihood)
+                : m_alignment(NULL), m_restorable(false)
+                { }
+
+        friend void swap(pt_partial_likelihood_t& first, pt_partial_likelihood_t& second) {
+                using std::swap;
+                swap(first.m_alignment, second.m_alignment);
+                swap(first.m_columns,   second.m_columns);
+                swap(first.m_carries,   second.m_carries);
+                swap(first.m_valid,     second.m_valid);
+                swap(first.m_changed,   second.m_changed);
+                swap(first.m_saved,     second.m_saved);
+                swap(first.m_restorable, second.m_restorable);
+        }
+        pt_partial_likelihood_t& operator=(const pt_partial_likelihood_t& partial_likelihood) {
+                pt_partial_likelihood_t tmp(partial_likelihood);
+                swap(*this, tmp);
+                return *this;
+        }
+
+        // the carries of this node and all its ancestors must be
+        // recomputed
+        void invalidate(const pt_node_t& node) {
+                for (const pt_node_t* it = &node; it != NULL; it = it->root() ? NULL : &it->ancestor()) {
+                        if (static_cast<size_t>(it->id) < m_valid.size()) {
+                                m_valid[it->id] = false;
+                        }
+                }
+        }
+        // recompute everything
+        void clear() {
+                m_alignment = NULL;
+        }
+        // put back the carries that were replaced by the last
+        // evaluation, the tree must be in the state of the previous
+        // evaluation
+        void restore() {
+                // nothing to put back if the last evaluation started
+                // from scratch
+                if (!m_restorable) {
+                        for (size_t j = 0; j < m_changed.size(); j++) {
+                                m_valid[m_changed[j]] = false;
+                        }
+                        m_changed.clear();
+                        return;
+                }
+                for (size_t c = 0; c < m_saved.size(); c++) {
+                        for (size_t j = 0; j < m_changed.size(); j++) {
+                                std::swap(m_carries[c][m_changed[j]], m_saved[c][j]);
+                        }
+                }
+                m_changed.clear();
+        }
+
+        // log marginal likelihood of the alignment
+        double operator()(
+                const pt_root_t& tree,
+                const alignment_map_t<AC>& alignment,
+                const std::vector<exponent_t<AS, PC> >& alpha,
+                thread_pool_t& thread_pool) {
+                m_restorable = true;
+                if (m_alignment != &alignment || m_valid.size() != static_cast<size_t>(tree.n_nodes)) {
+                        m_reset(tree, alignment);
+                        m_restorable = false;
+                }
+                // inner nodes that are recomputed
+                m_changed.clear();
+                for (pt_node_t::nodes_t::const_iterator it = tree.begin_nodes();
+                     it != tree.end_nodes(); it++) {
+                        if (!(*it)->leaf() && !m_valid[(*it)->id]) {
+                                m_changed.push_back((*it)->id);
+                        }
+                }
+                m_saved.resize(m_columns.size());
+                const double result = thread_pool.parallel_reduce(
+                        0, m_columns.size(), 8, 0.0,
+                        column_likelihood_t(*this, tree, alpha),
+                        std::plus<double>());
+                std::fill(m_valid.begin(), m_valid.end(), true);
+                return result;
+        }
+
+protected:
+        class column_likelihood_t {
+        public:
+                column_likelihood_t(
+                        pt_partial_likelihood_t& partial_likelihood,
+                        const pt_root_t& tree,
+                        const std::vector<exponent_t<AS, PC> >& alpha)
+                        : partial_likelihood(partial_likelihood), tree(tree), alpha(alpha)
+                        { }
+                double operator()(size_t c) const {
+                        return partial_likelihood.m_column(tree, c, alpha[c%alpha.size()]);
+                }
+        protected:
+                pt_partial_likelihood_t& partial_likelihood;
+                const pt_root_t& tree;
+                const std::vector<exponent_t<AS, PC> >& alpha;
+        };
+
+        void m_reset(const pt_root_t& tree, const alignment_map_t<AC>& alignment) {
+                m_alignment = &alignment;
+                m_columns.clear();
+                m_columns.reserve(alignment.size());
+                for (column_t it = alignment.begin(); it != alignment.end(); it++) {
+                        m_columns.push_back(it);
+                }
+                m_carries = std::vector<std::vector<carry_t> >(
+                        m_columns.size(), std::vector<carry_t>(tree.n_nodes));
+                m_valid   = std::vector<bool>(tree.n_nodes, false);
+                m_changed.clear();
+                m_saved.clear();
+        }
+        // carry of a node, which is recomputed if necessary, leaves
+        // are not cached
+        const carry_t& m_carry(const pt_node_t& node, size_t c, carry_t& tmp) {
+                const std::vector<AC>& observations = m_columns[c]->first;
+                if (node.leaf()) {
+                        tmp = tfbayes_detail::likelihood_leaf<AS, AC, PC>(node, observations);
+                        return tmp;
+                }
+                carry_t& carry = m_carries[c][node.id];
+                if (!m_valid[node.id]) {
+                        carry_t tmp_left, tmp_right;
+                        const carry_t& carry_left  = m_carry(node.left (), c, tmp_left);
+                        const carry_t& carry_right = m_carry(node.right(), c, tmp_right);
+                        carry = tfbayes_detail::likelihood_node<AS, AC, PC>(
+                                node, carry_left, carry_right, observations);
+                }
+                return carry;
+        }
+        double m_column(const pt_root_t& tree, size_t c, const exponent_t<AS, PC>& alpha) {
+                // save the carries that are replaced
+                std::vector<carry_t>& saved = m_saved[c];
+                saved.resize(m_changed.size());
+                for (size_t j = 0; j < m_changed.size(); j++) {
+                        std::swap(saved[j], m_carries[c][m_changed[j]]);
+                }
+                carry_t tmp;
+                const carry_t& carry = m_carry(tree, c, tmp);
+                polynomial_t<AS, PC> polynomial;
+                if (tree.outgroup()) {
+                        const std::vector<AC>& observations = m_columns[c]->first;
+                        polynomial = tfbayes_detail::poly_sum<AS, AC, PC>(
+                                tfbayes_detail::likelihood_outgroup<AS, AC, PC>(
+                                        tree, carry,
+                                        tfbayes_detail::likelihood_leaf<AS, AC, PC>(*tree.outgroup(), observations)));
+                }
+                else {
+                        polynomial = tfbayes_detail::poly_sum<AS, AC, PC>(carry);
+                }
+                return static_cast<double>(m_columns[c]->second)*
+                        pt_marginal_likelihood<AS, PC>(polynomial, alpha);
+        }
+
+        const alignment_map_t<AC>* m_alignment;
+        // columns of the alignment in the order of the map
+        std::vector<column_t> m_columns;
+        // carries of all columns and nodes
+        std::vector<std::vector<carry_t> > m_carries;
+        // nodes with a valid carry
+        std::vector<bool> m_valid;
+        // nodes that were recomputed by the last evaluation and
+        // their previous carries for every column
+        std::vector<size_t> m_changed;
+        std::vector<std::vector<carry_t> > m_saved;
+        bool m_restorable;
+};
+
+#endif /* __TFBAYES_PHYLOTREE_PARTIAL_LIKELIHOOD_HH__ */
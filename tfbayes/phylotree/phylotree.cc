@@ -387,6 +387,9 @@ void swap(pt_root_t& first, pt_root_t&second)
         swap(first.leaves,    second.leaves);
         swap(first.nodes,     second.nodes);
         swap(first._outgroup, second._outgroup);
+        // relink outgroups
+        if (first .outgroup()) first .outgroup()->_ancestor = &first;
+        if (second.outgroup()) second.outgroup()->_ancestor = &second;
         // update maps
         if (first .name != "") first .node_map[first .name] = &first;
         if (second.name != "") second.node_map[second.name] = &second;
@@ -103,6 +103,7 @@ public:
 
         friend class pt_root_t;
         friend class pt_leaf_t;
+        friend void swap(pt_root_t& first, pt_root_t& second);
 
 protected:
         virtual void create_mappings(leaf_map_t& leaf_map, leaves_t& leaves,
@@ -27,6 +27,7 @@
 #include <tfbayes/phylotree/phylotree.hh>
 #include <tfbayes/uipac/alphabet.hh>
 #include <tfbayes/utility/polynomial.hh>
+#include <tfbayes/utility/flat-polynomial.hh>
 
 /* AS: ALPHABET SIZE
  * AC: ALPHABET CODE TYPE
@@ -115,18 +116,13 @@ namespace tfbayes_detail {
                         return likelihood_node<AS, AC, PC>(node, carry_left, carry_right, observations);
                 }
         }
+        // combine the carry of the root, which is treated as a simple
+        // node, with the carry of the outgroup
         template <size_t AS, typename AC, typename PC>
-        carry_t<AS, AC, PC> likelihood_root(
+        carry_t<AS, AC, PC> likelihood_outgroup(
                 const pt_root_t& root,
-                const std::vector<AC>& observations) {
-
-                // if the root has no outgroup then treat it as a
-                // simple node
-                if (!root.outgroup()) {
-                        return likelihood_rec<AS, AC, PC>(root, observations);
-                }
-                const carry_t<AS, AC, PC> carry_left  = likelihood_rec<AS, AC, PC>( root,            observations);
-                const carry_t<AS, AC, PC> carry_right = likelihood_rec<AS, AC, PC>(*root.outgroup(), observations);
+                const carry_t<AS, AC, PC>& carry_left,
+                const carry_t<AS, AC, PC>& carry_right) {
 
                 const polynomial_t<AS, PC> poly_sum_left  = poly_sum(carry_left);
                 const polynomial_t<AS, PC> poly_sum_right = poly_sum(carry_right);
@@ -145,6 +141,151 @@ namespace tfbayes_detail {
                 }
                 return carry;
         }
+        template <size_t AS, typename AC, typename PC>
+        carry_t<AS, AC, PC> likelihood_root(
+                const pt_root_t& root,
+                const std::vector<AC>& observations) {
+
+                // if the root has no outgroup then treat it as a
+                // simple node
+                if (!root.outgroup()) {
+                        return likelihood_rec<AS, AC, PC>(root, observations);
+                }
+                const carry_t<AS, AC, PC> carry_left  = likelihood_rec<AS, AC, PC>( root,            observations);
+                const carry_t<AS, AC, PC> carry_right = likelihood_rec<AS, AC, PC>(*root.outgroup(), observations);
+
+                return likelihood_outgroup<AS, AC, PC>(root, carry_left, carry_right);
+        }
+}
+
+namespace tfbayes_detail {
+        /******************************************************************************
+         * Same algorithm on flat polynomials
+         ******************************************************************************/
+
+        // The carries are stored in flat polynomials, which are
+        // computed with a single workspace. The products of the
+        // algorithm above are factored so that every carry[i] needs
+        // only two multiplications.
+
+        template <size_t AS>
+        class flat_carry_t : public boost::array<flat_polynomial_t<AS>, AS+1>
+        { };
+
+        template <size_t AS>
+        void flat_poly_sum(const flat_carry_t<AS>& carry, flat_polynomial_t<AS>& result, flat_workspace_t<AS>& workspace) {
+                result.clear();
+                for (size_t i = 0; i < AS; i++) {
+                        result.add(carry[i], 1.0, workspace, flat_polynomial_t<AS>::key(i));
+                }
+                result.add(carry[AS], 1.0, workspace);
+        }
+        template <size_t AS, typename AC>
+        void flat_likelihood_leaf(const pt_node_t& node, const std::vector<AC>& observations, flat_carry_t<AS>& carry) {
+                const pt_leaf_t& leaf = static_cast<const pt_leaf_t&>(node);
+                if (observations[leaf.id] == -1) {
+                        carry[AS] = 1.0;
+                }
+                else {
+                        carry[observations[leaf.id]] = 1.0;
+                }
+        }
+        // carry = the combination of carry_left and carry_right,
+        // where pm_left is zero for the root with an outgroup
+        template <size_t AS>
+        void flat_likelihood_node(
+                double pm_left, double pm_right,
+                const flat_carry_t<AS>& carry_left,
+                const flat_carry_t<AS>& carry_right,
+                flat_carry_t<AS>& carry,
+                flat_workspace_t<AS>& workspace) {
+                flat_polynomial_t<AS> poly_sum_left, poly_sum_right;
+                flat_poly_sum(carry_left,  poly_sum_left,  workspace);
+                flat_poly_sum(carry_right, poly_sum_right, workspace);
+
+                // the left and right factors of carry[AS]
+                flat_polynomial_t<AS> left, right;
+                left .add(carry_left [AS], 1.0-pm_left,  workspace);
+                left .add(poly_sum_left,       pm_left,  workspace);
+                right.add(carry_right[AS], 1.0-pm_right, workspace);
+                right.add(poly_sum_right,      pm_right, workspace);
+                carry[AS].add_product(left, right, 1.0, workspace);
+
+                // carry[i] = carry_left [i]*((1-pm_left)*right + (1-pm_left)*(1-pm_right)*carry_right[i])
+                //          + carry_right[i]*((1-pm_right)*((1-pm_left)*carry_left[AS] + pm_left*poly_sum_left))
+                flat_polynomial_t<AS> tmp;
+                for (size_t i = 0; i < AS; i++) {
+                        if (!carry_left[i].empty()) {
+                                tmp.clear();
+                                tmp.add(right, 1.0-pm_left, workspace);
+                                tmp.add(carry_right[i], (1.0-pm_left)*(1.0-pm_right), workspace);
+                                carry[i].add_product(carry_left[i], tmp, 1.0, workspace);
+                        }
+                        if (!carry_right[i].empty()) {
+                                tmp.clear();
+                                tmp.add(carry_left[AS], (1.0-pm_right)*(1.0-pm_left), workspace);
+                                tmp.add(poly_sum_left,  (1.0-pm_right)*     pm_left,  workspace);
+                                carry[i].add_product(carry_right[i], tmp, 1.0, workspace);
+                        }
+                }
+        }
+        template <size_t AS, typename AC>
+        void flat_likelihood_rec(
+                const pt_node_t& node,
+                const std::vector<AC>& observations,
+                flat_carry_t<AS>& carry,
+                flat_workspace_t<AS>& workspace) {
+                if (node.leaf()) {
+                        flat_likelihood_leaf<AS, AC>(node, observations, carry);
+                }
+                else {
+                        flat_carry_t<AS> carry_left, carry_right;
+                        flat_likelihood_rec<AS, AC>(node.left (), observations, carry_left,  workspace);
+                        flat_likelihood_rec<AS, AC>(node.right(), observations, carry_right, workspace);
+                        flat_likelihood_node<AS>(
+                                1.0-exp(-node.left ().d),
+                                1.0-exp(-node.right().d),
+                                carry_left, carry_right, carry, workspace);
+                }
+        }
+        template <size_t AS, typename AC>
+        void flat_likelihood_root(
+                const pt_root_t& root,
+                const std::vector<AC>& observations,
+                flat_carry_t<AS>& carry,
+                flat_workspace_t<AS>& workspace) {
+                if (!root.outgroup()) {
+                        flat_likelihood_rec<AS, AC>(root, observations, carry, workspace);
+                        return;
+                }
+                flat_carry_t<AS> carry_left, carry_right;
+                flat_likelihood_rec<AS, AC>( root,            observations, carry_left,  workspace);
+                flat_likelihood_rec<AS, AC>(*root.outgroup(), observations, carry_right, workspace);
+                // the root is not separated from the outgroup by a
+                // branch of its own
+                flat_likelihood_node<AS>(
+                        0.0, 1.0-exp(-root.outgroup()->d),
+                        carry_left, carry_right, carry, workspace);
+        }
+        // exponents of the flat polynomials must not overflow, the
+        // degree of each variable is bounded by the number of
+        // leaves
+        template <size_t AS>
+        bool flat_likelihood_applicable(const pt_root_t& root) {
+                return AS <= 8 && static_cast<size_t>(root.n_leaves) + 1 < flat_polynomial_t<AS>::max_exponent;
+        }
+}
+
+// likelihood with flat polynomials (see utility/flat-polynomial.hh),
+// the workspace may be reused for many columns
+template <size_t AS, typename AC>
+flat_polynomial_t<AS>
+pt_flat_likelihood(const pt_root_t& root, const std::vector<AC>& observations, flat_workspace_t<AS>& workspace) {
+        tfbayes_detail::flat_carry_t<AS> carry;
+        flat_polynomial_t<AS> result;
+        tfbayes_detail::flat_likelihood_root<AS, AC>(root, observations, carry, workspace);
+        tfbayes_detail::flat_poly_sum<AS>(carry, result, workspace);
+        return result;
 }
 
 template <size_t AS, typename PC = double>
@@ -158,6 +299,10 @@ public:
 template <size_t AS, typename AC, typename PC>
 pt_polynomial_t<AS, PC>
 pt_likelihood(const pt_root_t& root, const std::vector<AC>& observations) {
+        if (tfbayes_detail::flat_likelihood_applicable<AS>(root)) {
+                flat_workspace_t<AS> workspace;
+                return pt_flat_likelihood<AS, AC>(root, observations, workspace).template polynomial<PC>();
+        }
         return tfbayes_detail::poly_sum<AS, AC, PC>(
                 tfbayes_detail::likelihood_root<AS, AC, PC>(root, observations));
 }
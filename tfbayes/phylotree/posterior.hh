@@ -41,16 +41,13 @@
 // posterior distribution of branch lengths given a full alignment
 ////////////////////////////////////////////////////////////////////////////////
 
-template <size_t AS, typename AC, typename PC>
-double pt_posterior(
+// log prior density of branch lengths
+inline
+double pt_log_prior(
         const pt_root_t& tree,
-        const alignment_map_t<AC>& alignment,
-        const std::vector<exponent_t<AS, PC> >& alpha,
-        const boost::math::gamma_distribution<>& gamma_prior,
-        thread_pool_t& thread_pool
+        const boost::math::gamma_distribution<>& gamma_prior
         ) {
-        double result = pt_marginal_likelihood(tree, alignment, alpha, thread_pool);
-        // prior on branch lengths
+        double result = 0.0;
         for (pt_node_t::nodes_t::const_iterator it = tree.begin_nodes();
              it != tree.end_nodes(); it++) {
                 // skip the root
@@ -65,6 +62,18 @@ double pt_posterior(
         return result;
 }
 
+template <size_t AS, typename AC, typename PC>
+double pt_posterior(
+        const pt_root_t& tree,
+        const alignment_map_t<AC>& alignment,
+        const std::vector<exponent_t<AS, PC> >& alpha,
+        const boost::math::gamma_distribution<>& gamma_prior,
+        thread_pool_t& thread_pool
+        ) {
+        return pt_marginal_likelihood(tree, alignment, alpha, thread_pool)
+                + pt_log_prior(tree, gamma_prior);
+}
+
 template <size_t AS, typename AC, typename PC>
 pt_marginal_derivative_t
 pt_posterior_derivative(
@@ -40,6 +40,7 @@
 #include <boost/thread.hpp>
 
 #include <tfbayes/alignment/alignment.hh>
+#include <tfbayes/phylotree/partial-likelihood.hh>
 #include <tfbayes/phylotree/phylotree.hh>
 #include <tfbayes/phylotree/polynomial.hh>
 #include <tfbayes/phylotree/posterior.hh>
@@ -101,7 +102,7 @@ public:
         proposal_distribution_t* clone() const = 0;
 
         virtual double p(double d_old, double d_new) const = 0;
-        virtual double sample(threaded_rng_t& rng, double d_old) const = 0;
+        virtual double sample(rng_t& rng, double d_old) const = 0;
         virtual void increase_jump(double eta) = 0;
         virtual void decrease_jump(double eta) = 0;
 };
@@ -119,7 +120,7 @@ public:
         double p(double d_old, double d_new) const {
                 return 1.0;
         }
-        double sample(threaded_rng_t& rng, double d_old) const {
+        double sample(rng_t& rng, double d_old) const {
                 boost::random::normal_distribution<> dist(0.0, sigma);
                 return d_old+dist(rng);
         }
@@ -149,7 +150,7 @@ public:
                 return boost::math::pdf(gamma_distribution, d_old)/
                         boost::math::pdf(gamma_distribution, d_new);
         }
-        double sample(threaded_rng_t& rng, double d_old) const {
+        double sample(rng_t& rng, double d_old) const {
                 boost::random::gamma_distribution<> dist(
                         gamma_distribution.shape(),
                         gamma_distribution.scale());
@@ -199,7 +200,7 @@ public:
         virtual pt_sampler_t* clone() const = 0;
 
         // execute sampler
-        virtual double operator()(threaded_rng_t& rng, bool verbose = false) = 0;
+        virtual double operator()(rng_t& rng, bool verbose = false) = 0;
 
         // access methods
         virtual const history_t& history() const = 0;
@@ -232,7 +233,9 @@ public:
         public:
                 state_t(const pt_root_t& tree)
                         : q(tree, 0.0),
-                          p(tree.n_nodes-1)
+                          p(tree.n_nodes-1),
+                          gradient(),
+                          gradient_valid(false)
                         { }
 
                 virtual void swap(pt_sampler_t::state_t& state) {
@@ -242,6 +245,10 @@ public:
 
                 polymorphic_type_t<pt_root_t, double> q;
                 vector_t p;
+                // posterior value and derivative at q, which is
+                // recomputed after a change of the topology
+                pt_marginal_derivative_t gradient;
+                bool gradient_valid;
         };
 public:
         typedef boost::math::gamma_distribution<> gamma_distribution_t;
@@ -276,8 +283,11 @@ public:
                 // check parameters
                 assert(_momentum_refreshment_ >= -1.0);
                 assert(_momentum_refreshment_ <=  1.0);
-                // compute the posterior value for the initial tree
-                _state_.q = log_posterior(_state_.q);
+                // compute the posterior value and derivative for the
+                // initial tree
+                _state_.gradient       = log_posterior_derivative(_state_.q);
+                _state_.gradient_valid = true;
+                _state_.q = _state_.gradient;
         }
         pt_hamiltonian_t(const pt_hamiltonian_t& mh)
                 : _history_              (mh._history_),
@@ -319,9 +329,7 @@ public:
         pt_marginal_derivative_t log_posterior_derivative(const pt_root_t& tree) {
                 return pt_posterior_derivative<AS, AC, PC>(tree, _alignment_, _alpha_, _gamma_distribution_, _thread_pool_);
         }
-        void momentum_step(vector_t& p, pt_root_t& q, double epsilon) {
-                // current posterior value and derivative
-                pt_marginal_derivative_t U = log_posterior_derivative(q);
+        void momentum_step(vector_t& p, const pt_marginal_derivative_t& U, double epsilon) {
                 for (size_t i = 0; i < p.size(); i++) {
                         p[i] = p[i] + epsilon*U.derivative()[i];
                 }
@@ -331,27 +339,39 @@ public:
                         q[i]->d = std::max(1.0e-20, q[i]->d + epsilon*p[i]);
                 }
         }
-        void leapfrog(size_t n, vector_t& p, pt_root_t& q) {
+        // U is the posterior value and derivative at q, which is
+        // updated after every position step, so that every step
+        // requires a single evaluation
+        void leapfrog(size_t n, vector_t& p, pt_root_t& q, pt_marginal_derivative_t& U) {
                 assert(n > 0);
                 // half step for momentum
-                momentum_step(p, q, _step_size_/2.0);
+                momentum_step(p, U, _step_size_/2.0);
                 // full steps for momentum and position
                 for (size_t i = 0; i < n-1; i++) {
                         position_step(p, q, _step_size_);
-                        momentum_step(p, q, _step_size_);
+                        U = log_posterior_derivative(q);
+                        momentum_step(p, U, _step_size_);
                 }
                 // full step for position
                 position_step(p, q, _step_size_);
+                U = log_posterior_derivative(q);
                 // half step for momentum
-                momentum_step(p, q, _step_size_/2.0);
+                momentum_step(p, U, _step_size_/2.0);
         }
-        void sample_length(threaded_rng_t& rng) {
+        void sample_length(rng_t& rng) {
                 size_t n = static_cast<pt_root_t&>(_state_.q).n_nodes-1;
                 // distributions for drawing random numbers
                 boost::random::uniform_01<> uniform;
                 // state
                 vector_t  p(_state_.p);
                 pt_root_t q(_state_.q);
+                // the derivative at the current state is kept from
+                // the last accepted trajectory
+                if (!_state_.gradient_valid) {
+                        _state_.gradient       = log_posterior_derivative(_state_.q);
+                        _state_.gradient_valid = true;
+                }
+                pt_marginal_derivative_t U(_state_.gradient);
                 // sample a new momentum
                 boost::normal_distribution<> nd(0.0, 1.0);
                 for (size_t i = 0; i < n; i++) {
@@ -362,10 +382,12 @@ public:
                 double current_U = -_state_.q;
                 double current_K = std::accumulate(p.begin(), p.end(), 0.0, square<double>())/2.0;
                 // simulate Hamiltonian dynamics
-                leapfrog(_steps_, p, q);
+                leapfrog(_steps_, p, q, U);
                 std::transform(p.begin(), p.end(), p.begin(), std::negate<double>());
-                // Metropolis-Hastings acceptance probability
-                double proposed_U = -log_posterior(q);
+                // Metropolis-Hastings acceptance probability, the
+                // posterior value of the proposal is known from the
+                // last leapfrog step
+                double proposed_U = -U;
                 double proposed_K = std::accumulate(p.begin(), p.end(), 0.0, square<double>())/2.0;
                 double rho = std::exp(current_U - proposed_U + current_K - proposed_K);
                 if (uniform(rng) < rho) {
@@ -373,6 +395,7 @@ public:
                         _state_.p = p;
                         _state_.q = q;
                         _state_.q = -proposed_U;
+                        _state_.gradient = U;
                         _history_.accepted_lengths++;
                 }
                 std::transform(_state_.p.begin(), _state_.p.end(), _state_.p.begin(), std::negate<double>());
@@ -381,7 +404,7 @@ public:
                 _history_.values .push_back(_state_.q);
                 _history_.steps_length++;
         }
-        void sample_topology(pt_node_t& node, threaded_rng_t& rng) {
+        void sample_topology(pt_node_t& node, rng_t& rng) {
                 // can't sample leafs
                 if (node.leaf()) return;
                 double log_posterior_ref = _state_.q;
@@ -403,6 +426,7 @@ public:
                 if (x <= std::min(1.0, rho)) {
                         // sample accepted
                         _state_.q = log_posterior_new;
+                        _state_.gradient_valid = false;
                         _history_.accepted_topologies++;
                 }
                 else {
@@ -411,7 +435,7 @@ public:
                 }
                 _history_.steps_topology++;
         }
-        virtual double operator()(threaded_rng_t& rng, bool verbose = false) {
+        virtual double operator()(rng_t& rng, bool verbose = false) {
                 // sample branch lengths for the full tree
                 sample_length(rng);
                 // loop over nodes and sample topologies
@@ -477,7 +501,8 @@ class pt_metropolis_hastings_t : public pt_sampler_t
 {
 public:
         // the state of a sampler is a phylogenetic tree paired with its
-        // posterior value
+        // posterior value and the partial likelihoods of the tree,
+        // which are exchanged together with the tree
         class state_t : public pt_sampler_t::state_t, public polymorphic_type_t<pt_root_t, double>
         {
                 typedef polymorphic_type_t<pt_root_t, double> base_t;
@@ -498,8 +523,12 @@ public:
                         using std::swap;
                         swap(static_cast<base_t&>(*this),
                              static_cast<base_t&>(static_cast<state_t&>(state)));
+                        swap(partial_likelihood,
+                             static_cast<state_t&>(state).partial_likelihood);
                 }
                 using base_t::operator=;
+
+                pt_partial_likelihood_t<AS, AC, PC> partial_likelihood;
         };
 public:
         typedef boost::math::gamma_distribution<> gamma_distribution_t;
@@ -563,10 +592,13 @@ public:
                           << __line_del__ << std::endl
                           << __line_del__ << std::endl;
         }
+        // only the partial likelihoods that were invalidated since
+        // the last call are recomputed
         double log_posterior() {
-                return pt_posterior<AS, AC, PC>(_state_.tree(), _alignment_, _alpha_, _gamma_distribution_, _thread_pool_);
+                return _state_.partial_likelihood(_state_.tree(), _alignment_, _alpha_, _thread_pool_)
+                        + pt_log_prior(_state_.tree(), _gamma_distribution_);
         }
-        void sample_length(pt_node_t& node, threaded_rng_t& rng) {
+        void sample_length(pt_node_t& node, rng_t& rng) {
                 double log_posterior_ref = _state_;
                 // distributions for drawing random numbers
                 boost::random::uniform_01<> uniform;
@@ -580,6 +612,9 @@ public:
                         return;
                 }
                 node.d = d_new;
+                // the branch length affects the partial likelihoods
+                // from the ancestor to the root
+                _state_.partial_likelihood.invalidate(node.ancestor());
 
                 // compute new log likelihood
                 const double log_posterior_new = log_posterior();
@@ -596,10 +631,11 @@ public:
                 else {
                         // sample rejected
                         node.d = d_old;
+                        _state_.partial_likelihood.restore();
                 }
                 _history_.steps_length++;
         }
-        void sample_topology(pt_node_t& node, threaded_rng_t& rng) {
+        void sample_topology(pt_node_t& node, rng_t& rng) {
                 // can't sample leafs
                 if (node.leaf()) return;
                 double log_posterior_ref = _state_;
@@ -611,6 +647,9 @@ public:
 
                 // alter topology
                 node.move(which);
+                // the children of the node and of its ancestor have
+                // changed
+                _state_.partial_likelihood.invalidate(node);
 
                 // compute new log likelihood
                 const double log_posterior_new = log_posterior();
@@ -626,10 +665,11 @@ public:
                 else {
                         // sample rejected
                         node.move(which);
+                        _state_.partial_likelihood.restore();
                 }
                 _history_.steps_topology++;
         }
-        virtual double operator()(threaded_rng_t& rng, bool verbose = false) {
+        virtual double operator()(rng_t& rng, bool verbose = false) {
                 // loop over nodes
                 for (pt_node_t::nodes_t::const_iterator it = _state_.tree().begin_nodes();
                      it != _state_.tree().end_nodes(); it++) {
@@ -686,36 +726,67 @@ protected:
         proposal_distribution_t* _proposal_distribution_;
 };
 
+// Metropolis-coupled MCMC (parallel tempering). After every step of
+// all chains, states are swapped between neighbouring temperatures,
+// where even rounds propose swaps for the pairs (0,1), (2,3), ...
+// and odd rounds for the pairs (1,2), (3,4), ..., so that all swaps
+// of a round are independent. With adaptive temperatures the ladder
+// is tuned online such that all pairs have the same acceptance
+// probability, while the lowest (one) and highest temperatures are
+// fixed. The logarithmic temperature gaps are parametrized by
+// exp(rho_k), which moves towards larger gaps if pair k accepts more
+// often than the average pair. The step size of the adaptation
+// decreases with the number of rounds.
 template <typename T>
 class pt_mc3_t : public pt_sampler_t
 {
+        typedef std::vector<double> vector_t;
+public:
+        // swap statistics for every pair of neighbouring chains
         struct history_mc3_t
         {
                 history_mc3_t(size_t k)
                         : accepted_swaps(k, 0),
-                          steps         (k, 0)
+                          steps         (k, 0),
+                          probabilities (k, 0.0)
                         { }
 
                 std::vector<size_t> accepted_swaps;
                 std::vector<size_t> steps;
+                // sum of the acceptance probabilities
+                std::vector<double> probabilities;
         };
-        typedef std::vector<double> vector_t;
-public:
-        pt_mc3_t(const vector_t& temperatures, const T& mh)
-                : _history_     (temperatures.size()),
+
+        pt_mc3_t(const vector_t& temperatures, const T& mh, bool adaptive = false)
+                : _history_     (temperatures.size()-1),
                   _thread_pool_ (temperatures.size()),
-                  uniform_int   (0, temperatures.size()-1) {
+                  _adaptive_    (adaptive),
+                  _rounds_      (0),
+                  _rho_         (),
+                  _rate_        (temperatures.size()-1, 0.5) {
                 assert(temperatures.size() > 0);
                 assert(temperatures[0] == 1.0);
                 for (size_t i = 0; i < temperatures.size(); i++) {
                         _population_.push_back(mh.clone());
                         _population_[i].temperature() = temperatures[i];
                 }
+                // initialize the parametrization of the ladder
+                for (size_t k = 0; k+1 < temperatures.size(); k++) {
+                        assert(!_adaptive_ || temperatures[k] < temperatures[k+1]);
+                        if (_adaptive_) {
+                                _rho_.push_back(std::log(std::log(temperatures[k+1]/temperatures[k])));
+                        }
+                }
         }
+        // random number streams are not copied, a copy derives its
+        // own streams when it is executed
         pt_mc3_t(const pt_mc3_t& pt_mc3)
                 : _history_     (pt_mc3._history_),
                   _thread_pool_ (pt_mc3._thread_pool_),
-                  uniform_int   (pt_mc3.uniform_int) {
+                  _adaptive_    (pt_mc3._adaptive_),
+                  _rounds_      (pt_mc3._rounds_),
+                  _rho_         (pt_mc3._rho_),
+                  _rate_        (pt_mc3._rate_) {
                 for (size_t i = 0; i < pt_mc3._population_.size(); i++) {
                         _population_.push_back(pt_mc3._population_[i].clone());
                 }
@@ -731,7 +802,7 @@ public:
                 }
                 std::cerr << __line_up__
                           << __line_up__;
-                for (size_t i = 0; i < _population_.size(); i++) {
+                for (size_t k = 0; k+1 < _population_.size(); k++) {
                         std::cerr << __line_up__;
                 }
         }
@@ -740,54 +811,72 @@ public:
                         _population_[i].print_progress();
                 }
                 std::cerr << __line_del__"MC3 swap acceptance rates:" << std::endl;
-                for (size_t i = 0; i < _population_.size(); i++) {
-                        std::cerr << boost::format(__line_del__" -> sampler %3d: %f\n")
-                                % i % __rate__(_history_.accepted_swaps[i], _history_.steps[i]);
+                for (size_t k = 0; k+1 < _population_.size(); k++) {
+                        std::cerr << boost::format(__line_del__" -> samplers %3d <-> %3d (temperatures %8.4f, %8.4f): %f\n")
+                                % k % (k+1) % temperature(k) % temperature(k+1)
+                                % __rate__(_history_.accepted_swaps[k], _history_.steps[k]);
                 }
                 std::cerr << __line_del__ << std::endl;
         }
-        virtual double operator()(threaded_rng_t& rng, bool verbose = false) {
+        virtual double operator()(rng_t& rng, bool verbose = false) {
                 using std::swap;
                 // future log posterior values
                 future_vector_t<double> futures(_population_.size());
+                // every chain draws from its own stream, which is
+                // derived from rng on the first call
+                if (_streams_.size() != _population_.size()) {
+                        _streams_ = rng_streams(rng, _population_.size());
+                }
                 // execute the metropolis algorithm on each chain
                 for (size_t i = 0; i < _population_.size(); i++) {
                         boost::function<double ()> f = boost::bind(&pt_sampler_t::operator(),
                                                                    boost::ref(_population_[i]),
-                                                                   boost::ref(rng), false);
+                                                                   boost::ref(_streams_[i]), false);
                         // use local thread pool to execute samplers
                         futures[i] = _thread_pool_.schedule(f);
                 }
-                // select two chains at random
-                const size_t i = uniform_int(rng);
-                const size_t j = uniform_int(rng);
-                if (i != j) {
-                        // update history
-                        _history_.steps[i]++;
-                        _history_.steps[j]++;
-                        // get probabilities
-                        const double pi = futures[i].get();
-                        const double pj = futures[j].get();
-                        const double ti = _population_[i].temperature();
-                        const double tj = _population_[j].temperature();
+                // log posterior values of all chains
+                vector_t values(_population_.size());
+                // propose swaps for all pairs of this round, a pair is
+                // processed as soon as both of its chains are done
+                for (size_t k = _rounds_ % 2; k+1 < _population_.size(); k += 2) {
+                        values[k]   = futures[k  ].get();
+                        values[k+1] = futures[k+1].get();
+                        const double ti = _population_[k  ].temperature();
+                        const double tj = _population_[k+1].temperature();
                         // metropolis probability for accepting the swap
-                        const double r  = std::min(1.0, std::exp(pi/tj + pj/ti - pi/ti - pj/tj));
+                        const double r  = std::min(1.0, std::exp(
+                                values[k]/tj + values[k+1]/ti - values[k]/ti - values[k+1]/tj));
+                        // update history
+                        _history_.steps[k]++;
+                        _history_.probabilities[k] += r;
                         if (uniform_01(rng) <= r) {
-                                // update history
-                                _history_.accepted_swaps[i]++;
-                                _history_.accepted_swaps[j]++;
-                                if (verbose) {
-                                        print_progress();
-                                }
+                                _history_.accepted_swaps[k]++;
                                 // swap states of the two chains
-                                swap(_population_[i].state(),
-                                     _population_[j].state());
+                                swap(_population_[k  ].state(),
+                                     _population_[k+1].state());
+                                swap(values[k], values[k+1]);
+                        }
+                        if (_adaptive_) {
+                                _rate_[k] = r;
                         }
                 }
                 // wait for all processes to finish
                 futures.wait();
+                // the first chain is part of a pair only in even
+                // rounds
+                if (_rounds_ % 2 == 1 || _population_.size() == 1) {
+                        values[0] = futures[0].get();
+                }
+                if (_adaptive_) {
+                        m_adapt();
+                }
+                _rounds_++;
+                if (verbose) {
+                        print_progress();
+                }
                 // return log posterior
-                return futures[0].get();
+                return values[0];
         }
         // access methods
         ////////////////////////////////////////////////////////////////////////
@@ -797,15 +886,60 @@ public:
         virtual const state_t& state() const {
                 return _population_[0].state();
         }
+        const history_mc3_t& history_mc3() const {
+                return _history_;
+        }
+        double temperature(size_t i) const {
+                return _population_[i].temperature();
+        }
+        size_t size() const {
+                return _population_.size();
+        }
 protected:
+        // move the temperatures of the pairs of this round towards
+        // the average acceptance probability of all pairs
+        void m_adapt() {
+                const size_t n = _rho_.size();
+                if (n < 2) {
+                        return;
+                }
+                const double gamma = std::pow(_rounds_/2 + 1.0, -0.6);
+                const double mean  = std::accumulate(_rate_.begin(), _rate_.end(), 0.0)/n;
+                for (size_t k = _rounds_ % 2; k < n; k += 2) {
+                        _rho_[k] += gamma*(_rate_[k] - mean);
+                }
+                // the logarithm of the highest temperature is the sum
+                // of all gaps, which is kept fixed
+                double z = 0.0;
+                for (size_t k = 0; k < n; k++) {
+                        z += std::exp(_rho_[k]);
+                }
+                const double t = std::log(temperature(n));
+                double sum = 0.0;
+                for (size_t k = 0; k < n-1; k++) {
+                        sum += std::exp(_rho_[k]);
+                        _population_[k+1].temperature() = std::exp(t*sum/z);
+                }
+                // normalize rho to prevent a drift
+                for (size_t k = 0; k < n; k++) {
+                        _rho_[k] += std::log(t/z);
+                }
+        }
+
         // mc3 specific history
         history_mc3_t _history_;
         // a population of samplers
         boost::ptr_vector<T> _population_;
         // a local thread pool
         thread_pool_t _thread_pool_;
-        // distribution for randomly selecting two chains
-        boost::random::uniform_int_distribution<> uniform_int;
+        // random number streams of all chains
+        std::vector<rng_t> _streams_;
+        // adaptation of the temperatures
+        bool _adaptive_;
+        size_t _rounds_;
+        vector_t _rho_;
+        // last acceptance probability of every pair
+        vector_t _rate_;
         // distribution for the metropolis update
         boost::random::uniform_01<> uniform_01;
 };
@@ -820,6 +954,8 @@ public:
                         _population_.push_back(mh.clone());
                 }
         }
+        // random number streams are not copied, a copy derives its
+        // own streams when it is executed
         pt_pmcmc_t(const pt_pmcmc_t& pmcmc)
                 : _thread_pool_(pmcmc._thread_pool_) {
 
@@ -848,21 +984,26 @@ public:
                         _population_[i].print_progress();
                 }
         }
-        virtual double operator()(threaded_rng_t& rng, bool verbose = false) {
+        virtual double operator()(rng_t& rng, bool verbose = false) {
                 // future log posterior values
                 future_vector_t<double> futures(_population_.size());
+                // every sampler draws from its own stream, which is
+                // derived from rng on the first call
+                if (_streams_.size() != _population_.size()) {
+                        _streams_ = rng_streams(rng, _population_.size());
+                }
                 // loop over population and execute samplers
                 for (size_t i = 0; i < _population_.size(); i++) {
                         boost::function<double ()> f = boost::bind(&pt_sampler_t::operator(),
                                                                    boost::ref(_population_[i]),
-                                                                   boost::ref(rng), false);
+                                                                   boost::ref(_streams_[i]), false);
                         // use local thread pool to execute samplers
                         futures[i] = _thread_pool_.schedule(f);
                 }
                 futures.wait();
                 return futures[0].get();
         }
-        virtual void operator()(size_t n, threaded_rng_t& rng, bool verbose = false) {
+        virtual void operator()(size_t n, rng_t& rng, bool verbose = false) {
                 for (size_t i = 0; i < n; i++) {
                         operator()(rng, verbose);
                         if (verbose && i != 0)
@@ -887,6 +1028,9 @@ public:
         virtual const state_t& state(size_t i) const {
                 return _population_[i].state();
         }
+        const pt_sampler_t& sampler(size_t i) const {
+                return _population_[i];
+        }
         size_t size() const {
                 return _population_.size();
         }
@@ -895,6 +1039,8 @@ protected:
         thread_pool_t _thread_pool_;
         // a population of samplers
         boost::ptr_vector<pt_sampler_t> _population_;
+        // random number streams of all samplers
+        std::vector<rng_t> _streams_;
 };
 
 #endif /* __TFBAYES_PHYLOTREE_SAMPLER_HH__ */
@@ -0,0 +1,399 @@
+/* Copyright (C) 2013 Philipp Benner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <tfbayes/config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <boost/format.hpp>
+#include <boost/unordered_map.hpp>
+
+#include <tfbayes/alignment/alignment.hh>
+#include <tfbayes/phylotree/approximation.hh>
+#include <tfbayes/phylotree/column-cache.hh>
+#include <tfbayes/phylotree/parser.hh>
+#include <tfbayes/phylotree/phylotree.hh>
+#include <tfbayes/utility/linalg.hh>
+#include <tfbayes/utility/thread-pool.hh>
+
+#include <getopt.h>
+
+#define alphabet_size 5
+
+using namespace std;
+
+typedef pt_column_cache_t<alphabet_size> cache_t;
+typedef dkl_approximate_t<alphabet_size, double> approximation_t;
+typedef vector<alphabet_code_t> column_t;
+
+// Options
+////////////////////////////////////////////////////////////////////////////////
+
+typedef struct _options_t {
+        string cache;
+        string format;
+        size_t line_search;
+        dkl_method_t dkl_method;
+        size_t dkl_nodes;
+        size_t threads;
+        bool verbose;
+        _options_t()
+                : cache(),
+                  format("fasta"),
+                  line_search(0),
+                  dkl_method(dkl_method_quadrature),
+                  dkl_nodes(DKL_QUADRATURE_NODES),
+                  threads(1),
+                  verbose(false)
+                { }
+} options_t;
+
+static options_t options;
+
+// Main
+////////////////////////////////////////////////////////////////////////////////
+
+static
+void print_usage(char *pname, FILE *fp)
+{
+        (void)fprintf(fp, "\nUsage: %s [OPTION] TREE FASTA_ALIGNMENTS...\n\n", pname);
+        (void)fprintf(fp,
+                      "Given a set of alignments from the ChIP experiment, this\n"
+                      "program computes an approximation of the phylogenetic tree\n"
+                      "for each column of the multiple alignment. The result is\n"
+                      "used as input for the sampler. Alignments within a file are\n"
+                      "separated by a line of `>' characters or by a repeated\n"
+                      "taxon. Maf files have to be converted with tfbayes-maf-to-fasta.\n"
+                      "\n"
+                      "Options:\n"
+                      "         -j, -t, --threads=N - number of threads\n"
+                      "   --cache=FILE              - keep the likelihoods of alignment columns\n"
+                      "                               in FILE to reuse them in later runs on\n"
+                      "                               the same tree\n"
+                      "   --format=STR              - format of the input file(s), only fasta\n"
+                      "                               is supported [default: fasta]\n"
+                      "   --line-search=N           - refine each approximation by N steps of\n"
+                      "                               a line search that minimizes the Kullback-\n"
+                      "                               Leibler divergence [default: 0]\n"
+                      "   --dkl-method=STR          - method for computing the divergence in the\n"
+                      "                               line search, either `quadrature' or\n"
+                      "                               `miser' [default: quadrature]\n"
+                      "   --dkl-nodes=N             - number of quadrature nodes per dimension\n"
+                      "                               [default: %d]\n"
+                      "\n"
+                      "             -v              - be verbose\n"
+                      "   --help                    - print help and exit\n"
+                      "   --version                 - print version information and exit\n\n",
+                      DKL_QUADRATURE_NODES);
+}
+
+static
+void wrong_usage(const char *msg)
+{
+
+        if(msg != NULL) {
+                (void)fprintf(stderr, "%s\n", msg);
+        }
+        (void)fprintf(stderr,
+                      "Try `tfbayes-approximate --help' for more information.\n");
+
+        exit(EXIT_FAILURE);
+
+}
+
+static
+void print_version(FILE *fp)
+{
+        (void)fprintf(fp,
+                      "This is free software, and you are welcome to redistribute it\n"
+                      "under certain conditions; see the source for copying conditions.\n"
+                      "There is NO warranty; not even for MERCHANTABILITY or FITNESS\n"
+                      "FOR A PARTICULAR PURPOSE.\n\n");
+}
+
+static
+pt_root_t parse_tree_file(const string& filename)
+{
+        list<pt_root_t> tree_list = parse_tree_list(filename);
+        assert(tree_list.size() == 1);
+
+        return tree_list.front();
+}
+
+// check if the first line of a file is a maf header or the
+// beginning of a maf alignment block
+static
+bool is_maf_file(const string& filename)
+{
+        ifstream file(filename.c_str());
+        string line;
+
+        while (getline(file, line)) {
+                if (line.empty()) {
+                        continue;
+                }
+                return line.compare(0, 5, "##maf") == 0 ||
+                       line.compare(0, 2, "a ")    == 0;
+        }
+        return false;
+}
+
+static
+string file_basename(const string& filename)
+{
+        const size_t pos = filename.find_last_of('/');
+
+        return pos == string::npos ? filename : filename.substr(pos+1);
+}
+
+// Approximation
+////////////////////////////////////////////////////////////////////////////////
+
+// identical columns of a block of alignments are approximated only
+// once
+class block_t {
+public:
+        block_t()
+                : columns(), approximations(), m_index()
+                { }
+
+        void push_back(const alignment_t<>& alignment) {
+                indices.push_back(vector<size_t>(alignment.length()));
+                for (size_t i = 0; i < alignment.length(); i++) {
+                        const column_t& column = alignment[i];
+                        index_t::const_iterator it = m_index.find(column);
+                        if (it == m_index.end()) {
+                                it = m_index.insert(make_pair(column, columns.size())).first;
+                                columns.push_back(column);
+                        }
+                        indices.back()[i] = it->second;
+                }
+        }
+        size_t size() const {
+                return indices.size();
+        }
+
+        // distinct columns and their approximations
+        vector<column_t> columns;
+        matrix<double> approximations;
+        // for each alignment the indices of its columns
+        vector<vector<size_t> > indices;
+
+protected:
+        typedef boost::unordered_map<column_t, size_t> index_t;
+        index_t m_index;
+};
+
+class approximate_t {
+public:
+        approximate_t(const pt_root_t& tree, block_t& block, cache_t& cache,
+                      const approximation_t& approximation)
+                : tree(tree), block(block), cache(cache), approximation(approximation)
+                { }
+        void operator()(size_t i) const {
+                const exponent_t<alphabet_size, double> counts =
+                        cache.approximation(tree, block.columns[i], approximation);
+
+                for (size_t j = 0; j < alphabet_size; j++) {
+                        block.approximations[i][j] = counts[j];
+                }
+        }
+protected:
+        const pt_root_t& tree;
+        block_t& block;
+        cache_t& cache;
+        const approximation_t& approximation;
+};
+
+static
+void print_result(const string& filename, const block_t& block)
+{
+        for (size_t k = 0; k < block.size(); k++) {
+                cout << ">" << filename << endl;
+                for (size_t i = 0; i < block.indices[k].size(); i++) {
+                        const vector<double>& approximation =
+                                block.approximations[block.indices[k][i]];
+                        for (size_t j = 0; j < approximation.size(); j++) {
+                                cout << boost::format("%11.8f ") % approximation[j];
+                        }
+                        cout << ";" << endl;
+                }
+        }
+}
+
+static
+void approximate(const pt_root_t& tree, const char* file_alignment,
+                 cache_t& cache, thread_pool_t& thread_pool)
+{
+        const approximation_t approximation(options.line_search,
+                                            options.dkl_method,
+                                            options.dkl_nodes);
+        alignment_reader_t<> reader(file_alignment, tree);
+
+        /* process alignments in blocks to keep the memory small,
+         * each block is large enough to keep all threads busy */
+        const size_t n = 16*max(options.threads, static_cast<size_t>(1));
+
+        while (reader) {
+                block_t block;
+                while (reader && block.size() < n) {
+                        block.push_back(reader());
+                }
+                if (options.verbose) {
+                        cerr << boost::format("Processing %d alignments with %d distinct columns from %s.")
+                                % block.size() % block.columns.size() % file_alignment
+                             << endl;
+                }
+                block.approximations = matrix<double>(block.columns.size(), alphabet_size);
+                thread_pool.parallel_for(0, block.columns.size(), 16,
+                                         approximate_t(tree, block, cache, approximation));
+                print_result(file_basename(file_alignment), block);
+        }
+}
+
+int main(int argc, char *argv[])
+{
+        for(;;) {
+                int c, option_index = 0;
+                static struct option long_options[] = {
+                        { "cache",           1, 0, 'c' },
+                        { "format",          1, 0, 'f' },
+                        { "line-search",     1, 0, 'l' },
+                        { "dkl-method",      1, 0, 'm' },
+                        { "dkl-nodes",       1, 0, 'n' },
+                        { "threads",         1, 0, 'j' },
+                        { "help",            0, 0, 'h' },
+                        { "version",         0, 0, 'x' },
+                        { 0,                 0, 0,  0  }
+                };
+
+                c = getopt_long(argc, argv, "j:t:vh",
+                                long_options, &option_index);
+
+                if(c == -1) {
+                        break;
+                }
+
+                switch(c) {
+                case 'c':
+                        options.cache = string(optarg);
+                        break;
+                case 'f':
+                        options.format = string(optarg);
+                        break;
+                case 'l':
+                        options.line_search = atoi(optarg);
+                        break;
+                case 'm':
+                        if (string(optarg) == "quadrature") {
+                                options.dkl_method = dkl_method_quadrature;
+                        }
+                        else if (string(optarg) == "miser") {
+                                options.dkl_method = dkl_method_miser;
+                        }
+                        else {
+                                wrong_usage("Unknown method for computing the divergence.");
+                                exit(EXIT_FAILURE);
+                        }
+                        break;
+                case 'n':
+                        options.dkl_nodes = atoi(optarg);
+                        break;
+                case 'j':
+                case 't':
+                        options.threads = atoi(optarg);
+                        break;
+                case 'v':
+                        options.verbose = true;
+                        break;
+                case 'h':
+                        print_usage(argv[0], stdout);
+                        exit(EXIT_SUCCESS);
+                case 'x':
+                        print_version(stdout);
+                        exit(EXIT_SUCCESS);
+                default:
+                        wrong_usage(NULL);
+                        exit(EXIT_FAILURE);
+                }
+        }
+        if(optind+2 > argc) {
+                wrong_usage("Wrong number of arguments.");
+                exit(EXIT_FAILURE);
+        }
+        if(options.threads < 1) {
+                wrong_usage("Number of threads must be positive.");
+                exit(EXIT_FAILURE);
+        }
+        if(options.dkl_nodes < 1) {
+                wrong_usage("Number of quadrature nodes must be positive.");
+                exit(EXIT_FAILURE);
+        }
+        if(options.format == "maf") {
+                wrong_usage("Maf files are not supported, convert them with tfbayes-maf-to-fasta.");
+                exit(EXIT_FAILURE);
+        }
+        if(options.format != "fasta") {
+                wrong_usage("Unknown input format.");
+                exit(EXIT_FAILURE);
+        }
+        for (int i = optind+1; i < argc; i++) {
+                if (is_maf_file(argv[i])) {
+                        cerr << boost::format("`%s' is a maf file, convert it with tfbayes-maf-to-fasta.")
+                                % argv[i]
+                             << endl;
+                        exit(EXIT_FAILURE);
+                }
+        }
+        try {
+                /* phylogenetic tree */
+                pt_root_t pt_root = parse_tree_file(argv[optind]);
+
+                /* the cache is shared by all threads and files */
+                cache_t cache(pt_root);
+                if (options.cache != "") {
+                        cache.load(options.cache);
+                }
+                /* the calling thread also processes columns */
+                thread_pool_t thread_pool(options.threads-1);
+
+                for (int i = optind+1; i < argc; i++) {
+                        approximate(pt_root, argv[i], cache, thread_pool);
+                }
+                if (options.verbose) {
+                        cerr << boost::format("Column cache: %d entries, hit rate %.3f.")
+                                % cache.size() % cache.hit_rate()
+                             << endl;
+                }
+                if (options.cache != "") {
+                        cache.save(options.cache);
+                }
+        }
+        catch (const runtime_error& e) {
+                cerr << e.what() << endl;
+                exit(EXIT_FAILURE);
+        }
+
+        return 0;
+}
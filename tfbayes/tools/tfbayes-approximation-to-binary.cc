@@ -0,0 +1,142 @@
+/* Copyright (C) 2013 Philipp Benner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <tfbayes/config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <iostream>
+#include <stdexcept>
+
+#include <cstdio>
+#include <cstdlib>
+#include <getopt.h>
+
+#include <tfbayes/dpm/data-tfbs.hh>
+#include <tfbayes/dpm/data-tfbs-file.hh>
+
+using namespace std;
+
+// Options
+////////////////////////////////////////////////////////////////////////////////
+
+typedef struct _options_t {
+        bool verbose;
+        _options_t()
+                : verbose(false)
+                { }
+} options_t;
+
+static options_t options;
+
+// Main
+////////////////////////////////////////////////////////////////////////////////
+
+static
+void print_usage(char *pname, FILE *fp)
+{
+        (void)fprintf(fp, "\nUsage: %s [OPTION]... INPUT OUTPUT\n\n", pname);
+        (void)fprintf(fp,
+                      "Convert the output of tfbayes-approximate to a binary data file,\n"
+                      "which the sampler maps into memory instead of parsing it.\n"
+                      "\n"
+                      "Options:\n"
+                      "             -v              - be verbose"
+                      "\n"
+                      "   --help                    - print help and exit\n"
+                      "   --version                 - print version information and exit\n\n");
+}
+
+static
+void wrong_usage(const char *msg)
+{
+
+        if(msg != NULL) {
+                (void)fprintf(stderr, "%s\n", msg);
+        }
+        (void)fprintf(stderr,
+                      "Try `tfbayes-approximation-to-binary --help' for more information.\n");
+
+        exit(EXIT_FAILURE);
+
+}
+
+static
+void print_version(FILE *fp)
+{
+        (void)fprintf(fp,
+                      "This is free software, and you are welcome to redistribute it\n"
+                      "under certain conditions; see the source for copying conditions.\n"
+                      "There is NO warranty; not even for MERCHANTABILITY or FITNESS\n"
+                      "FOR A PARTICULAR PURPOSE.\n\n");
+}
+
+int main(int argc, char *argv[])
+{
+        for(;;) {
+                int c, option_index = 0;
+                static struct option long_options[] = {
+                        { "help",            0, 0, 'h' },
+                        { "version",         0, 0, 'q' },
+                        { 0,                 0, 0,  0  }
+                };
+
+                c = getopt_long(argc, argv, "v",
+                                long_options, &option_index);
+
+                if(c == -1) {
+                        break;
+                }
+
+                switch(c) {
+                case 'v':
+                        options.verbose = true;
+                        break;
+                case 'h':
+                        print_usage(argv[0], stdout);
+                        exit(EXIT_SUCCESS);
+                case 'q':
+                        print_version(stdout);
+                        exit(EXIT_SUCCESS);
+                default:
+                        wrong_usage(NULL);
+                        exit(EXIT_FAILURE);
+                }
+        }
+        if(optind+2 != argc) {
+                wrong_usage("Wrong number of arguments.");
+                exit(EXIT_FAILURE);
+        }
+        const string input (argv[optind]);
+        const string output(argv[optind+1]);
+
+        try {
+                const sequence_data_t<data_tfbs_t::code_t> data = data_tfbs_t::read_fasta(input);
+                save_data_tfbs_file(output, data);
+                if (options.verbose) {
+                        cerr << "Wrote " << data.size() << " sequences with "
+                             << data.linear_size() << " positions to `"
+                             << output << "'." << endl;
+                }
+        }
+        catch (const exception& e) {
+                cerr << e.what() << endl;
+                exit(EXIT_FAILURE);
+        }
+
+        return 0;
+}
@@ -23,9 +23,12 @@
 #include <iomanip>
 #include <string>
 
+#include <boost/format.hpp>
+
 #include <tfbayes/alignment/alignment-hmm.hh>
 #include <tfbayes/utility/linalg.hh>
 #include <tfbayes/utility/strtools.hh>
+#include <tfbayes/utility/thread-pool.hh>
 
 #include <getopt.h>
 
@@ -83,12 +86,14 @@ typedef struct _options_t {
         phylotree_hmm_t<alphabet_size>::priors_t priors;
         double scale;
         matrix<double> transition;
+        size_t threads;
         bool verbose;
         _options_t()
                 : dimension(2),
                   priors(),
                   scale(1.0),
                   transition(),
+                  threads(1),
                   verbose(false) {
 
                 exponent_t<alphabet_size> alpha_0;
@@ -119,18 +124,21 @@ static options_t options;
 static
 void print_usage(char *pname, FILE *fp)
 {
-        (void)fprintf(fp, "\nUsage: %s [OPTION] TREE FASTA_ALIGNMENT\n\n", pname);
+        (void)fprintf(fp, "\nUsage: %s [OPTION] TREE FASTA_ALIGNMENTS\n\n", pname);
         (void)fprintf(fp,
                       "Given a phylogenetic tree and a sequence alignment, this program\n"
                       "computes the marginal probability distributions of a hidden Markov\n"
                       "model (HMM). Each state of the HMM is assiciated with a different\n"
                       "set of Dirichlet pseudocounts for the stationary distribution\n"
-                      "of the evolutionary model."
+                      "of the evolutionary model. The input file may contain several\n"
+                      "alignments, which are processed in parallel. Results are\n"
+                      "separated by empty lines.\n"
                       "\n"
                       "Options:\n"
                       "             -a VECTOR       - pseudo count (e.g. 10.0,0.1 for an HMM\n"
                       "                               with two dimensions)\n"
                       "             -d DIMENSION    - dimension\n"
+                      "             -j THREADS      - number of threads\n"
                       "             -s FLOAT        - scale tree by a given factor\n"
                       "             -t MATRIX       - transition matrix\n"
                       "\n"
@@ -174,6 +182,20 @@ pt_root_t parse_tree_file(const string& filename)
         return tree_list.front();
 }
 
+static
+void print_result(const matrix<double>& result)
+{
+        for (size_t i = 0; i < result.size(); i++) {
+                for (size_t j = 0; j < result[i].size(); j++) {
+                        cout << setprecision(8)
+                             << fixed
+                             << (j == 0 ? "" : " ")
+                             << result[i][j];
+                }
+                cout << endl;
+        }
+}
+
 static
 void run_hmm(const char* file_tree, const char* file_alignment)
 {
@@ -185,20 +207,36 @@ void run_hmm(const char* file_tree, const char* file_alignment)
         /* scale tree */
         pt_root.scale(options.scale);
 
-        /* alignment */
-        alignment_t<> alignment(file_alignment, pt_root);
+        /* alignments */
+        alignment_set_t<> alignment_set(file_alignment, pt_root);
 
         /* uniform distribution on the initial state */
         vector<double> px_0(dimension, 1.0/(double)dimension);
 
         phylotree_hmm_t<alphabet_size> hmm(px_0, options.transition, options.priors);
-        hmm.run(pt_root, alignment);
-
-        for (size_t i = 0; i < hmm.size(); i++) {
-                cout << setprecision(8)
-                     << fixed
-                     << hmm[i][0] << " "
-                     << hmm[i][1]
+        /* identical columns of different alignments share their
+         * likelihoods */
+        phylotree_hmm_t<alphabet_size>::cache_t cache(pt_root);
+        /* the calling thread also takes part in parallel loops */
+        thread_pool_t thread_pool(max(options.threads, static_cast<size_t>(1))-1);
+
+        /* process alignments in blocks to keep the memory for the
+         * results small */
+        const size_t block = 16*max(options.threads, static_cast<size_t>(1));
+
+        for (size_t i = 0; i < alignment_set.size(); i += block) {
+                const size_t last = min(i + block, alignment_set.size());
+                vector<matrix<double> > result;
+                hmm.posterior(pt_root, alignment_set, i, last, cache, thread_pool, result);
+                for (size_t j = 0; j < result.size(); j++) {
+                        if (i + j > 0) {
+                                cout << endl;
+                        }
+                        print_result(result[j]);
+                }
+        }
+        if (options.verbose) {
+                cerr << boost::format("column cache hit rate: %.3f") % cache.hit_rate()
                      << endl;
         }
 }
@@ -289,7 +327,7 @@ int main(int argc, char *argv[])
                         { 0,                 0, 0,  0  }
                 };
 
-                c = getopt_long(argc, argv, "a:d:s:t:vh",
+                c = getopt_long(argc, argv, "a:d:j:s:t:vh",
                                 long_options, &option_index);
 
                 if(c == -1) {
@@ -303,6 +341,9 @@ int main(int argc, char *argv[])
                 case 'd':
                         options.dimension = atoi(optarg);
                         break;
+                case 'j':
+                        options.threads = atoi(optarg);
+                        break;
                 case 's':
                         options.scale = atof(optarg);
                         break;
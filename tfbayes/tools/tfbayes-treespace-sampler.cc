@@ -167,9 +167,12 @@ typedef struct _options_t {
         double step_size;
         double proposal_variance;
         string save_posterior;
+        string save_swaps;
         size_t chains;
         size_t threads;
         vector<double> temperatures;
+        bool   adaptive_temperatures;
+        size_t seed;
         bool   verbose;
         _options_t()
                 : alphabet(nucleotide_alphabet_t()),
@@ -183,9 +186,12 @@ typedef struct _options_t {
                   step_size(0.001),
                   proposal_variance(0.01),
                   save_posterior(""),
+                  save_swaps(""),
                   chains(1),
                   threads(1),
                   temperatures(1,1),
+                  adaptive_temperatures(false),
+                  seed(0),
                   verbose(false)
                 { }
 } options_t;
@@ -228,7 +234,10 @@ operator<<(ostream& o, const options_t& options) {
           << "-> parallel chains       = " << options.chains               << endl
           << "-> number of threads     = " << options.threads              << endl
           << "-> temperatures          = " << options.temperatures         << endl
+          << "-> adaptive temperatures = " << options.adaptive_temperatures << endl
           << "-> save posterior values = " << options.save_posterior       << endl
+          << "-> save swap statistics  = " << options.save_swaps           << endl
+          << "-> seed                  = " << options.seed                 << endl
           << "-> verbose               = " << options.verbose              << endl;
         return o;
 }
@@ -263,7 +272,15 @@ void print_usage(char *pname, FILE *fp)
                       "      --step-size=float         - gradient ascent step size\n"
                       "      --threads=integer         - number of threads\n"
                       "      --temperatures=f:f:...    - a list of temperatures for the mc3\n"
+                      "      --adaptive-temperatures   - tune the temperatures between the lowest\n"
+                      "                                  and highest temperature such that all\n"
+                      "                                  neighbouring chains swap equally often\n"
                       "      --save-posterior=file     - save the value of the log posterior\n"
+                      "      --save-swaps=file         - save the swap acceptance rates and the\n"
+                      "                                  final temperatures of the mc3\n"
+                      "      --seed=integer            - seed for the random number generator,\n"
+                      "                                  where zero means that the seed is\n"
+                      "                                  obtained from the system clock\n"
                       "   -v                           - be verbose\n"
                       "\n"
                       "      --help                    - print help and exit\n"
@@ -319,6 +336,38 @@ void save_posterior_values(const T& t)
         }
 }
 
+// for every pair of neighbouring mc3 chains the number of proposed
+// and accepted swaps, and the average acceptance probability
+template<typename T>
+void save_swap_statistics(const pt_pmcmc_t& pmcmc)
+{
+        if (options.save_swaps == "") {
+                return;
+        }
+        ofstream csv(options.save_swaps.c_str());
+        if (!csv.is_open()) {
+                cerr << "Unable to open file: "
+                     << options.save_swaps
+                     << endl;
+                exit(EXIT_FAILURE);
+        }
+        csv << "chain pair temperature1 temperature2 steps accepted rate probability" << endl;
+        for (size_t i = 0; i < pmcmc.size(); i++) {
+                const pt_mc3_t<T>& pt_mc3 = static_cast<const pt_mc3_t<T>&>(pmcmc.sampler(i));
+                const typename pt_mc3_t<T>::history_mc3_t& history = pt_mc3.history_mc3();
+                for (size_t k = 0; k+1 < pt_mc3.size(); k++) {
+                        csv << boost::format("%d %d %f %f %d %d %f %f")
+                                % (i+1) % (k+1)
+                                % pt_mc3.temperature(k) % pt_mc3.temperature(k+1)
+                                % history.steps[k] % history.accepted_swaps[k]
+                                % __rate__(history.accepted_swaps[k], history.steps[k])
+                                % (history.steps[k] == 0 ? 0.0 : history.probabilities[k]/history.steps[k])
+                            << endl;
+                }
+        }
+        csv.close();
+}
+
 // gradient ascent
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -355,20 +404,21 @@ void run_metropolis_hastings(
 {
         typedef pt_metropolis_hastings_t<AS> pt_mc_t;
 
-        threaded_rng_t rng;
+        rng_t rng;
         seed_rng(rng);
         // proposal distribution
         normal_proposal_t proposal(options.proposal_variance);
         // the metropolis sampler
         pt_mc_t pt_mc(pt_root, alignment_map, options.alpha, gamma_distribution, proposal, thread_pool);
         // parallel chains with different temperatures
-        pt_mc3_t<pt_mc_t> pt_mc3(options.temperatures, pt_mc);
+        pt_mc3_t<pt_mc_t> pt_mc3(options.temperatures, pt_mc, options.adaptive_temperatures);
         // run several mc3 chains in parallel
         pt_pmcmc_t pmcmc(options.chains, pt_mc3);
         // execute the sampler
         pmcmc(options.max_steps, rng, options.verbose);
         // print posterior values to separate file
         save_posterior_values(pmcmc);
+        save_swap_statistics<pt_mc_t>(pmcmc);
         // print tree samples
         cout << print_posterior_samples(pmcmc);
 }
@@ -382,20 +432,21 @@ void run_hamiltonian_mcmc(
 {
         typedef pt_hamiltonian_t<AS> pt_ham_t;
 
-        threaded_rng_t rng;
+        rng_t rng;
         seed_rng(rng);
         // the metropolis sampler
         pt_ham_t pt_ham(pt_root, alignment_map, options.alpha, gamma_distribution,
                         options.leapfrog_step_size, options.leapfrog_steps,
                         options.momentum_refreshment, thread_pool);
         // parallel chains with different temperatures
-        pt_mc3_t<pt_ham_t> pt_mc3(options.temperatures, pt_ham);
+        pt_mc3_t<pt_ham_t> pt_mc3(options.temperatures, pt_ham, options.adaptive_temperatures);
         // run several mc3 chains in parallel
         pt_pmcmc_t pmcmc(options.chains, pt_mc3);
         // execute the sampler
         pmcmc(options.max_steps, rng, options.verbose);
         // print posterior values to separate file
         save_posterior_values(pmcmc);
+        save_swap_statistics<pt_ham_t>(pmcmc);
         // print tree samples
         cout << print_posterior_samples(pmcmc);
 }
@@ -472,8 +523,11 @@ int main(int argc, char *argv[])
                         { "steps",                1, 0, 'm' },
                         { "step-size",            1, 0, 'e' },
                         { "temperatures",         1, 0, 'u' },
+                        { "adaptive-temperatures",0, 0, 'f' },
                         { "threads",              1, 0, 't' },
                         { "save-posterior",       1, 0, 'p' },
+                        { "save-swaps",           1, 0, 'w' },
+                        { "seed",                 1, 0, 'g' },
                         { "help",                 0, 0, 'h' },
                         { "version",              0, 0, 'x' },
                         { 0,                      0, 0,  0  }
@@ -527,12 +581,21 @@ int main(int argc, char *argv[])
                 case 'p':
                         options.save_posterior = string(optarg);
                         break;
+                case 'w':
+                        options.save_swaps = string(optarg);
+                        break;
+                case 'f':
+                        options.adaptive_temperatures = true;
+                        break;
                 case 'j':
                         options.chains = atoi(optarg);
                         break;
                 case 't':
                         options.threads = atoi(optarg);
                         break;
+                case 'g':
+                        options.seed = strtoul(optarg, NULL, 10);
+                        break;
                 case 'u':
                         tokens1 = token(string(optarg), ':');
                         options.temperatures = vector<double>();
@@ -582,6 +645,18 @@ int main(int argc, char *argv[])
                 }
         }
 
+        // check the temperatures of the mc3
+        if (options.temperatures.size() == 0 || options.temperatures[0] != 1.0) {
+                wrong_usage("The first temperature must be one.");
+                exit(EXIT_FAILURE);
+        }
+        for (size_t i = 1; options.adaptive_temperatures && i < options.temperatures.size(); i++) {
+                if (options.temperatures[i] <= options.temperatures[i-1]) {
+                        wrong_usage("Adaptive temperatures must be increasing.");
+                        exit(EXIT_FAILURE);
+                }
+        }
+
         string method(argv[optind]);
         file_tree      = argv[optind+1];
         file_alignment = argv[optind+2];
@@ -589,6 +664,10 @@ int main(int argc, char *argv[])
         // print options
         if (options.verbose)
                 cerr << options << endl;
+        // all random number streams are derived from this seed
+        if (options.seed != 0) {
+                rng_seed_t::set(options.seed);
+        }
 
         run_optimization(method, file_tree, file_alignment);
 
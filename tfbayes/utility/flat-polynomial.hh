@@ -0,0 +1,290 @@
+/* Copyright (C) 2013 Philipp Benner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _FLAT_POLYNOMIAL_H_
+#define _FLAT_POLYNOMIAL_H_
+
+#ifdef HAVE_CONFIG_H
+#include <tfbayes/config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <algorithm>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+
+#include <tfbayes/utility/polynomial.hh>
+
+/* Polynomials with small non-negative integer exponents. All S
+ * exponents of a term are packed into a single 64 bit key, where the
+ * first variable occupies the most significant bits. Terms are kept
+ * in a vector sorted by their key. Multiplying two terms adds their
+ * keys, as long as no exponent exceeds max_exponent, and it preserves
+ * the order of keys, so that sums are computed by merging and
+ * products by sorting or, if the exponents are small, by
+ * accumulating the coefficients in a dense array.
+ *
+ * All temporary storage is taken from a workspace, which should be
+ * reused for all operations of a computation (e.g. the likelihood of
+ * a column), so that memory is allocated only while the workspace
+ * grows.
+ */
+
+template <size_t S, typename C = double>
+class flat_workspace_t;
+
+template <size_t S, typename C = double>
+class flat_polynomial_t
+{
+public:
+        typedef boost::uint64_t key_t;
+        typedef flat_workspace_t<S, C> workspace_t;
+
+        struct term_t {
+                term_t()
+                        : key(0), coefficient(0.0)
+                        { }
+                term_t(key_t key, const C& coefficient)
+                        : key(key), coefficient(coefficient)
+                        { }
+                bool operator<(const term_t& term) const {
+                        return key < term.key;
+                }
+                key_t key;
+                C coefficient;
+        };
+        typedef std::vector<term_t> terms_t;
+        typedef typename terms_t::const_iterator const_iterator;
+
+        static const size_t bits = 64/S;
+        static const key_t max_exponent = (static_cast<key_t>(1) << bits) - 1;
+
+        flat_polynomial_t()
+                : m_terms()
+                { }
+        flat_polynomial_t(const C& constant)
+                : m_terms() {
+                if (constant != 0.0) {
+                        m_terms.push_back(term_t(0, constant));
+                }
+        }
+
+        friend void swap(flat_polynomial_t& first, flat_polynomial_t& second) {
+                first.m_terms.swap(second.m_terms);
+        }
+
+        // key of the monomial x_i^e
+        static key_t key(size_t i, key_t e = 1) {
+                return e << (bits*(S-1-i));
+        }
+        static key_t exponent(key_t key, size_t i) {
+                return (key >> (bits*(S-1-i))) & max_exponent;
+        }
+
+        size_t size() const {
+                return m_terms.size();
+        }
+        bool empty() const {
+                return m_terms.empty();
+        }
+        const_iterator begin() const {
+                return m_terms.begin();
+        }
+        const_iterator end() const {
+                return m_terms.end();
+        }
+        void clear() {
+                m_terms.clear();
+        }
+
+        // this += c*x^k*p, where x^k is the monomial with key k
+        void add(const flat_polynomial_t& p, const C& c, workspace_t& workspace, key_t k = 0) {
+                if (p.empty() || c == 0.0) {
+                        return;
+                }
+                if (empty()) {
+                        m_terms.reserve(p.size());
+                        for (const_iterator it = p.begin(); it != p.end(); it++) {
+                                m_terms.push_back(term_t(it->key + k, c*it->coefficient));
+                        }
+                        return;
+                }
+                terms_t& result = workspace.merge;
+                result.clear();
+                const_iterator it = begin();
+                const_iterator is = p.begin();
+                while (it != end() || is != p.end()) {
+                        if (is == p.end() || (it != end() && it->key < is->key + k)) {
+                                result.push_back(*it++);
+                        }
+                        else if (it == end() || is->key + k < it->key) {
+                                result.push_back(term_t(is->key + k, c*is->coefficient));
+                                is++;
+                        }
+                        else {
+                                const C coefficient = it->coefficient + c*is->coefficient;
+                                if (coefficient != 0.0) {
+                                        result.push_back(term_t(it->key, coefficient));
+                                }
+                                it++; is++;
+                        }
+                }
+                // the old terms remain in the workspace and their
+                // memory is reused by the next merge
+                m_terms.swap(result);
+        }
+        // this += c*p*q
+        void add_product(const flat_polynomial_t& p, const flat_polynomial_t& q, const C& c, workspace_t& workspace) {
+                if (p.empty() || q.empty() || c == 0.0) {
+                        return;
+                }
+                if (p.size() == 1) {
+                        add(q, c*p.m_terms[0].coefficient, workspace, p.m_terms[0].key);
+                        return;
+                }
+                if (q.size() == 1) {
+                        add(p, c*q.m_terms[0].coefficient, workspace, q.m_terms[0].key);
+                        return;
+                }
+                flat_polynomial_t& product = workspace.product;
+                product.clear();
+                if (!m_multiply_dense(p, q, c, workspace)) {
+                        m_multiply_sort(p, q, c, workspace);
+                }
+                add(product, 1.0, workspace);
+        }
+
+        template <typename T>
+        polynomial_t<S, T, C> polynomial() const {
+                polynomial_t<S, T, C> result;
+                for (const_iterator it = begin(); it != end(); it++) {
+                        polynomial_term_t<S, T, C> term(it->coefficient);
+                        for (size_t i = 0; i < S; i++) {
+                                term.exponent()[i] = exponent(it->key, i);
+                        }
+                        result += term;
+                }
+                return result;
+        }
+
+protected:
+        // the dense array must not be much larger than the number of
+        // products
+        bool m_multiply_dense(const flat_polynomial_t& p, const flat_polynomial_t& q, const C& c, workspace_t& workspace) {
+                size_t stride[S];
+                size_t n = 1;
+                for (size_t i = S; i-- > 0;) {
+                        const size_t d = m_max_exponent(p, i) + m_max_exponent(q, i) + 1;
+                        stride[i] = n;
+                        n *= d;
+                        if (n > 16*p.size()*q.size() || n > workspace.max_dense) {
+                                return false;
+                        }
+                }
+                std::vector<size_t>& index = workspace.index;
+                std::vector<C>& dense = workspace.dense;
+                index.resize(p.size() + q.size());
+                dense.assign(n, 0.0);
+                for (size_t j = 0; j < p.size(); j++) {
+                        index[j] = m_index(p.m_terms[j].key, stride);
+                }
+                for (size_t j = 0; j < q.size(); j++) {
+                        index[p.size()+j] = m_index(q.m_terms[j].key, stride);
+                }
+                for (size_t j = 0; j < p.size(); j++) {
+                        const C a = c*p.m_terms[j].coefficient;
+                        C* row = &dense[index[j]];
+                        for (size_t k = 0; k < q.size(); k++) {
+                                row[index[p.size()+k]] += a*q.m_terms[k].coefficient;
+                        }
+                }
+                // the dense array is ordered like the keys
+                terms_t& result = workspace.product.m_terms;
+                for (size_t j = 0; j < n; j++) {
+                        if (dense[j] != 0.0) {
+                                key_t k = 0;
+                                size_t r = j;
+                                for (size_t i = 0; i < S; i++) {
+                                        k += key(i, r/stride[i]);
+                                        r %= stride[i];
+                                }
+                                result.push_back(term_t(k, dense[j]));
+                        }
+                }
+                return true;
+        }
+        void m_multiply_sort(const flat_polynomial_t& p, const flat_polynomial_t& q, const C& c, workspace_t& workspace) {
+                terms_t& buffer = workspace.buffer;
+                buffer.clear();
+                for (const_iterator it = p.begin(); it != p.end(); it++) {
+                        const C a = c*it->coefficient;
+                        for (const_iterator is = q.begin(); is != q.end(); is++) {
+                                buffer.push_back(term_t(it->key + is->key, a*is->coefficient));
+                        }
+                }
+                std::sort(buffer.begin(), buffer.end());
+                terms_t& result = workspace.product.m_terms;
+                for (typename terms_t::const_iterator it = buffer.begin(); it != buffer.end(); it++) {
+                        if (!result.empty() && result.back().key == it->key) {
+                                result.back().coefficient += it->coefficient;
+                        }
+                        else {
+                                result.push_back(*it);
+                        }
+                }
+        }
+        static size_t m_max_exponent(const flat_polynomial_t& p, size_t i) {
+                // terms are sorted by the first exponent
+                if (i == 0) {
+                        return exponent(p.m_terms.back().key, 0);
+                }
+                key_t result = 0;
+                for (const_iterator it = p.begin(); it != p.end(); it++) {
+                        result = std::max(result, exponent(it->key, i));
+                }
+                return result;
+        }
+        static size_t m_index(key_t k, const size_t* stride) {
+                size_t result = 0;
+                for (size_t i = 0; i < S; i++) {
+                        result += exponent(k, i)*stride[i];
+                }
+                return result;
+        }
+
+        terms_t m_terms;
+};
+
+template <size_t S, typename C>
+class flat_workspace_t
+{
+public:
+        flat_workspace_t(size_t max_dense = 4096)
+                : max_dense(max_dense)
+                { }
+
+        friend class flat_polynomial_t<S, C>;
+protected:
+        typename flat_polynomial_t<S, C>::terms_t merge;
+        typename flat_polynomial_t<S, C>::terms_t buffer;
+        flat_polynomial_t<S, C> product;
+        std::vector<size_t> index;
+        std::vector<C> dense;
+        size_t max_dense;
+};
+
+#endif /* _FLAT_POLYNOMIAL_H_ */
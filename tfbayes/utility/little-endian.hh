@@ -0,0 +1,84 @@
+/* Copyright (C) 2013 Philipp Benner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __TFBAYES_UTILITY_LITTLE_ENDIAN_HH__
+#define __TFBAYES_UTILITY_LITTLE_ENDIAN_HH__
+
+#ifdef HAVE_CONFIG_H
+#include <tfbayes/config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <cstddef>
+#include <string>
+
+#include <boost/cstdint.hpp>
+
+// Encoding of fixed size numbers in little endian byte order, which
+// is used by all binary file formats independently of the host
+////////////////////////////////////////////////////////////////////////////////
+
+inline
+void write_uint8(std::string& buffer, boost::uint8_t x)
+{
+        buffer.push_back(static_cast<char>(x));
+}
+
+inline
+void write_uint32(std::string& buffer, boost::uint32_t x)
+{
+        for (size_t i = 0; i < 4; i++) {
+                buffer.push_back(static_cast<char>((x >> 8*i) & 0xFF));
+        }
+}
+
+inline
+void write_uint64(std::string& buffer, boost::uint64_t x)
+{
+        for (size_t i = 0; i < 8; i++) {
+                buffer.push_back(static_cast<char>((x >> 8*i) & 0xFF));
+        }
+}
+
+inline
+void write_double(std::string& buffer, double x)
+{
+        union { double d; boost::uint64_t i; } u;
+        u.d = x;
+        write_uint64(buffer, u.i);
+}
+
+inline
+boost::uint32_t read_uint32(const char* buffer)
+{
+        boost::uint32_t x = 0;
+        for (size_t i = 0; i < 4; i++) {
+                x |= static_cast<boost::uint32_t>(static_cast<unsigned char>(buffer[i])) << 8*i;
+        }
+        return x;
+}
+
+inline
+boost::uint64_t read_uint64(const char* buffer)
+{
+        boost::uint64_t x = 0;
+        for (size_t i = 0; i < 8; i++) {
+                x |= static_cast<boost::uint64_t>(static_cast<unsigned char>(buffer[i])) << 8*i;
+        }
+        return x;
+}
+
+#endif /* __TFBAYES_UTILITY_LITTLE_ENDIAN_HH__ */
@@ -0,0 +1,129 @@
+/* Copyright (C) 2013 Philipp Benner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <tfbayes/config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+#include <sys/time.h>
+
+#include <boost/bind.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/normal_distribution.hpp>
+#include <boost/ref.hpp>
+#include <boost/thread.hpp>
+
+#include <tfbayes/utility/random.hh>
+
+using namespace std;
+
+// compare a single generator that is shared by all threads and
+// protected by a mutex, as it was used by the phylogenetic samplers,
+// with independent streams for every thread
+////////////////////////////////////////////////////////////////////////////////
+
+class locked_rng_t : public boost::random::mt19937
+{
+        typedef boost::random::mt19937 base_t;
+public:
+        result_type operator()() {
+                boost::lock_guard<boost::mutex> guard(mtx);
+                return base_t::operator()();
+        }
+protected:
+        boost::mutex mtx;
+};
+
+template <typename T>
+static void
+draw(T& rng, size_t n, double* result)
+{
+        boost::random::normal_distribution<> dist(0.0, 1.0);
+        double sum = 0.0;
+
+        for (size_t i = 0; i < n; i++) {
+                sum += dist(rng);
+        }
+        *result = sum;
+}
+
+static double
+now()
+{
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        return tv.tv_sec + 1e-6*tv.tv_usec;
+}
+
+// returns the wall clock time per draw in nanoseconds
+template <typename T>
+static double
+run(vector<T*>& rngs, size_t n)
+{
+        vector<double> results(rngs.size(), 0.0);
+        boost::thread_group threads;
+
+        const double t1 = now();
+        for (size_t i = 0; i < rngs.size(); i++) {
+                threads.create_thread(boost::bind(&draw<T>, boost::ref(*rngs[i]), n, &results[i]));
+        }
+        threads.join_all();
+        const double t2 = now();
+
+        return 1e9*(t2-t1)/(n*rngs.size());
+}
+
+int main(int argc, char *argv[])
+{
+        if (argc != 1 && argc != 2) {
+                cerr << "Usage: random-benchmark [DRAWS]"
+                     << endl;
+                exit(EXIT_FAILURE);
+        }
+        // number of draws per thread
+        const size_t n = argc == 2 ? atoi(argv[1]) : 1000000;
+
+        cout << "threads   shared (ns/draw)   streams (ns/draw)   speedup" << endl;
+
+        for (size_t k = 1; k <= 64; k *= 2) {
+                // a single locked generator
+                locked_rng_t locked;
+                seed_rng(locked);
+                vector<locked_rng_t*> shared(k, &locked);
+                // independent streams
+                rng_t rng;
+                seed_rng(rng);
+                vector<rng_t> streams = rng_streams(rng, k);
+                vector<rng_t*> independent(k);
+                for (size_t i = 0; i < k; i++) {
+                        independent[i] = &streams[i];
+                }
+                const double d1 = run(shared, n);
+                const double d2 = run(independent, n);
+
+                cout << setw(7)  << k
+                     << setw(19) << d1
+                     << setw(20) << d2
+                     << setw(10) << d1/d2
+                     << endl;
+        }
+        return EXIT_SUCCESS;
+}
@@ -22,34 +22,156 @@
 #include <tfbayes/config.h>
 #endif /* HAVE_CONFIG_H */
 
+#include <vector>
+#include <stdint.h>
 #include <sys/time.h>
 
-#include <boost/date_time/posix_time/posix_time.hpp>
-#include <boost/random/mersenne_twister.hpp>
-#include <boost/thread.hpp>
+#include <boost/config.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
 
-class threaded_rng_t : public boost::random::mt19937
+// Random number generator with independent streams, which is used
+// instead of sharing a single generator between threads. It
+// implements xoshiro256** (Blackman and Vigna, Scrambled linear
+// pseudorandom number generators, 2018), which has a period of
+// 2^256-1 and allows to jump ahead by 2^128 steps, so that streams
+// obtained with split() never overlap in practice.
+////////////////////////////////////////////////////////////////////////////////
+
+class rng_t
 {
-        typedef boost::random::mt19937 base_t;
 public:
+        typedef uint64_t result_type;
+        BOOST_STATIC_CONSTANT(bool, has_fixed_range = false);
+
+        explicit rng_t(uint64_t s = 5489) {
+                seed(s);
+        }
+
+        // the seed is expanded with splitmix64 so that similar
+        // seeds result in unrelated states
+        void seed(uint64_t s) {
+                for (size_t i = 0; i < 4; i++) {
+                        m_s[i] = splitmix64(s);
+                }
+        }
         result_type operator()() {
-                boost::lock_guard<boost::mutex> guard(mtx);
-                return base_t::operator()();
+                const uint64_t result = rotl(m_s[1]*5, 7)*9;
+                const uint64_t t      = m_s[1] << 17;
+
+                m_s[2] ^= m_s[0];
+                m_s[3] ^= m_s[1];
+                m_s[1] ^= m_s[2];
+                m_s[0] ^= m_s[3];
+                m_s[2] ^= t;
+                m_s[3]  = rotl(m_s[3], 45);
+
+                return result;
+        }
+        static result_type min BOOST_PREVENT_MACRO_SUBSTITUTION () {
+                return 0;
+        }
+        static result_type max BOOST_PREVENT_MACRO_SUBSTITUTION () {
+                return ~static_cast<result_type>(0);
+        }
+        // advance the generator by 2^128 steps
+        void jump() {
+                static const uint64_t table[] = {
+                        0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL,
+                        0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL };
+                uint64_t s[4] = { 0, 0, 0, 0 };
+
+                for (size_t i = 0; i < 4; i++) {
+                        for (size_t b = 0; b < 64; b++) {
+                                if (table[i] & (static_cast<uint64_t>(1) << b)) {
+                                        for (size_t j = 0; j < 4; j++) {
+                                                s[j] ^= m_s[j];
+                                        }
+                                }
+                                operator()();
+                        }
+                }
+                for (size_t j = 0; j < 4; j++) {
+                        m_s[j] = s[j];
+                }
+        }
+        // return a generator that continues with the current state
+        // and move this generator to the next stream
+        rng_t split() {
+                rng_t rng(*this);
+                jump();
+                return rng;
+        }
+        // splitmix64 (Steele, Lea, and Flood, Fast splittable
+        // pseudorandom number generators, 2014)
+        static uint64_t splitmix64(uint64_t& x) {
+                uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+                z = (z ^ (z >> 30))*0xbf58476d1ce4e5b9ULL;
+                z = (z ^ (z >> 27))*0x94d049bb133111ebULL;
+                return z ^ (z >> 31);
         }
 protected:
-        boost::mutex mtx;
+        static uint64_t rotl(uint64_t x, int k) {
+                return (x << k) | (x >> (64 - k));
+        }
+        uint64_t m_s[4];
+};
+
+// create n independent streams from the given generator
+inline
+std::vector<rng_t> rng_streams(rng_t& rng, size_t n)
+{
+        std::vector<rng_t> streams;
+        for (size_t i = 0; i < n; i++) {
+                streams.push_back(rng.split());
+        }
+        return streams;
+}
+
+// Seeds
+////////////////////////////////////////////////////////////////////////////////
+
+// All seeds are derived from a global seed. If no seed is set, the
+// global seed is initialized from the clock, otherwise runs with the
+// same seed are reproducible as long as generators are seeded in
+// the same order.
+class rng_seed_t
+{
+public:
+        static void set(uint64_t seed) {
+                rng_seed_t& state = instance();
+                boost::lock_guard<boost::mutex> guard(state.m_mtx);
+                state.m_seed = seed;
+                state.m_init = true;
+        }
+        static uint64_t next() {
+                rng_seed_t& state = instance();
+                boost::lock_guard<boost::mutex> guard(state.m_mtx);
+                if (!state.m_init) {
+                        struct timeval tv;
+                        gettimeofday(&tv, NULL);
+                        state.m_seed = tv.tv_sec*1000000 + tv.tv_usec;
+                        state.m_init = true;
+                }
+                return rng_t::splitmix64(state.m_seed);
+        }
+protected:
+        rng_seed_t()
+                : m_seed(0), m_init(false)
+                { }
+        static rng_seed_t& instance() {
+                static rng_seed_t state;
+                return state;
+        }
+        boost::mutex m_mtx;
+        uint64_t m_seed;
+        bool m_init;
 };
 
 template <typename T>
 void seed_rng(T& rng)
 {
-        // sleep for a millisecond to make sure that we get
-        // a unique seed with repeated calls
-        boost::this_thread::sleep(boost::posix_time::milliseconds(1));
-        // initialize random generator
-        struct timeval tv;
-        gettimeofday(&tv, NULL);
-        rng.seed(tv.tv_sec*tv.tv_usec);
+        rng.seed(static_cast<typename T::result_type>(rng_seed_t::next()));
 }
 
 #endif /* __TFBAYES_UTILITY_RANDOM_HH__ */
@@ -0,0 +1,67 @@
+/* Copyright (C) 2015 Philipp Benner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <tfbayes/config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include <tfbayes/utility/sha256.hh>
+
+using namespace std;
+
+static bool
+test(const string& name, const string& result, const string& expected)
+{
+        cout << name << ": " << result
+             << (result == expected ? " ok" : " FAILED") << endl;
+        return result == expected;
+}
+
+int
+main(void)
+{
+        bool ok = true;
+
+        // test vectors of FIPS 180-4
+        ok &= test("empty string",
+                   sha256_t::hex(sha256_t().digest()),
+                   "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+        ok &= test("abc",
+                   sha256_t::hex(sha256_t().update("abc").digest()),
+                   "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+        ok &= test("two blocks",
+                   sha256_t::hex(sha256_t().update("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq").digest()),
+                   "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+
+        // one million times `a', fed in pieces that are not aligned
+        // to blocks
+        sha256_t sha256;
+        const string a(999, 'a');
+        for (size_t i = 0; i < 1000; i++) {
+                sha256.update(a);
+        }
+        sha256.update(string(1000, 'a'));
+        ok &= test("million a",
+                   sha256_t::hex(sha256.digest()),
+                   "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
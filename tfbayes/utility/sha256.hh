@@ -0,0 +1,152 @@
+/* Copyright (C) 2013 Philipp Benner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __TFBAYES_UTILITY_SHA256_HH__
+#define __TFBAYES_UTILITY_SHA256_HH__
+
+#ifdef HAVE_CONFIG_H
+#include <tfbayes/config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <cstddef>
+#include <string>
+
+#include <boost/array.hpp>
+#include <boost/cstdint.hpp>
+
+// SHA-256 (FIPS 180-4) of a stream of bytes, which is used to
+// identify the contents of files
+////////////////////////////////////////////////////////////////////////////////
+
+class sha256_t {
+public:
+        typedef boost::array<unsigned char, 32> digest_t;
+
+        sha256_t()
+                : m_length(0), m_size(0) {
+                static const boost::uint32_t init[8] = {
+                        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+                for (size_t i = 0; i < 8; i++) {
+                        m_state[i] = init[i];
+                }
+        }
+
+        sha256_t& update(const void* data, size_t n) {
+                const unsigned char* ptr = static_cast<const unsigned char*>(data);
+                m_length += n;
+                // complete the current block
+                while (n > 0 && m_size > 0) {
+                        m_buffer[m_size++] = *ptr++; n--;
+                        if (m_size == 64) {
+                                m_compress(m_buffer);
+                                m_size = 0;
+                        }
+                }
+                // process full blocks directly
+                for (; n >= 64; ptr += 64, n -= 64) {
+                        m_compress(ptr);
+                }
+                for (; n > 0; n--) {
+                        m_buffer[m_size++] = *ptr++;
+                }
+                return *this;
+        }
+        sha256_t& update(const std::string& str) {
+                return update(str.data(), str.size());
+        }
+
+        // the digest of all bytes so far, the object should not be
+        // updated afterwards
+        digest_t digest() {
+                const boost::uint64_t bits = 8*m_length;
+                const unsigned char pad = 0x80, zero = 0x00;
+                update(&pad, 1);
+                while (m_size != 56) {
+                        update(&zero, 1);
+                }
+                unsigned char length[8];
+                for (size_t i = 0; i < 8; i++) {
+                        length[i] = static_cast<unsigned char>(bits >> 8*(7-i));
+                }
+                update(length, 8);
+
+                digest_t result;
+                for (size_t i = 0; i < 32; i++) {
+                        result[i] = static_cast<unsigned char>(m_state[i/4] >> 8*(3-i%4));
+                }
+                return result;
+        }
+
+        static std::string hex(const digest_t& digest) {
+                static const char digits[] = "0123456789abcdef";
+                std::string result;
+                for (size_t i = 0; i < digest.size(); i++) {
+                        result.push_back(digits[digest[i] >> 4]);
+                        result.push_back(digits[digest[i] & 15]);
+                }
+                return result;
+        }
+
+protected:
+        static boost::uint32_t m_rotr(boost::uint32_t x, size_t n) {
+                return (x >> n) | (x << (32-n));
+        }
+        void m_compress(const unsigned char* block) {
+                static const boost::uint32_t k[64] = {
+                        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+                        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+                        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+                        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+                        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+                        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+                        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+                        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2 };
+                boost::uint32_t w[64];
+                for (size_t i = 0; i < 16; i++) {
+                        w[i] = (static_cast<boost::uint32_t>(block[4*i  ]) << 24) |
+                               (static_cast<boost::uint32_t>(block[4*i+1]) << 16) |
+                               (static_cast<boost::uint32_t>(block[4*i+2]) <<  8) |
+                               (static_cast<boost::uint32_t>(block[4*i+3]));
+                }
+                for (size_t i = 16; i < 64; i++) {
+                        const boost::uint32_t s0 = m_rotr(w[i-15],  7) ^ m_rotr(w[i-15], 18) ^ (w[i-15] >>  3);
+                        const boost::uint32_t s1 = m_rotr(w[i- 2], 17) ^ m_rotr(w[i- 2], 19) ^ (w[i- 2] >> 10);
+                        w[i] = w[i-16] + s0 + w[i-7] + s1;
+                }
+                boost::uint32_t a = m_state[0], b = m_state[1], c = m_state[2], d = m_state[3];
+                boost::uint32_t e = m_state[4], f = m_state[5], g = m_state[6], h = m_state[7];
+                for (size_t i = 0; i < 64; i++) {
+                        const boost::uint32_t t1 = h + (m_rotr(e, 6) ^ m_rotr(e, 11) ^ m_rotr(e, 25))
+                                + ((e & f) ^ (~e & g)) + k[i] + w[i];
+                        const boost::uint32_t t2 = (m_rotr(a, 2) ^ m_rotr(a, 13) ^ m_rotr(a, 22))
+                                + ((a & b) ^ (a & c) ^ (b & c));
+                        h = g; g = f; f = e; e = d + t1;
+                        d = c; c = b; b = a; a = t1 + t2;
+                }
+                m_state[0] += a; m_state[1] += b; m_state[2] += c; m_state[3] += d;
+                m_state[4] += e; m_state[5] += f; m_state[6] += g; m_state[7] += h;
+        }
+
+        boost::uint32_t m_state[8];
+        // total number of bytes and the bytes of the current block
+        boost::uint64_t m_length;
+        unsigned char m_buffer[64];
+        size_t m_size;
+};
+
+#endif /* __TFBAYES_UTILITY_SHA256_HH__ */
@@ -0,0 +1,158 @@
+/* Copyright (C) 2013 Philipp Benner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <tfbayes/config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sys/time.h>
+
+#include <boost/asio/io_service.hpp>
+
+#include <tfbayes/utility/thread-pool.hh>
+
+using namespace std;
+
+// compare the previous thread pool, which posted every task to an
+// io_service, with the work stealing pool on many cheap tasks, as
+// they occur when computing the likelihood of alignment columns or
+// when precomputing the background model
+////////////////////////////////////////////////////////////////////////////////
+
+class asio_thread_pool_t {
+public:
+        asio_thread_pool_t(size_t n = 1)
+                : work(io_service) {
+                for (size_t i = 0; i < n; i++) {
+                        threads.create_thread(
+                                boost::bind(&boost::asio::io_service::run, &io_service)
+                                );
+                }
+        }
+        virtual ~asio_thread_pool_t() {
+                io_service.stop();
+                threads.join_all();
+        }
+
+        template <typename T>
+        boost::unique_future<T> schedule(boost::function<T ()> f) {
+                boost::lock_guard<boost::mutex> guard(mtx);
+                typedef boost::packaged_task<T> task_t;
+                boost::shared_ptr<task_t> tmp = boost::make_shared<task_t>(boost::move(f));
+                io_service.post(boost::bind(&task_t::operator(), tmp));
+                return tmp->get_future();
+        }
+protected:
+        boost::mutex mtx;
+        boost::thread_group threads;
+        boost::asio::io_service io_service;
+        boost::asio::io_service::work work;
+};
+
+// a cheap task of roughly the cost of evaluating the likelihood of a
+// small alignment column
+static double
+task(size_t i)
+{
+        double result = 0.0;
+        for (size_t j = 1; j <= 20; j++) {
+                result += log(static_cast<double>(i + j));
+        }
+        return result;
+}
+
+struct task_t {
+        double operator()(size_t i) const {
+                return task(i);
+        }
+};
+
+static double
+now()
+{
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        return tv.tv_sec + 1e-6*tv.tv_usec;
+}
+
+// one future per task
+template <typename P>
+static double
+run_futures(P& pool, size_t n)
+{
+        future_vector_t<double> futures(n);
+        double result = 0.0;
+
+        for (size_t i = 0; i < n; i++) {
+                boost::function<double ()> f = boost::bind(&task, i);
+                futures[i] = pool.schedule(f);
+        }
+        for (size_t i = 0; i < n; i++) {
+                result += futures[i].get();
+        }
+        return result;
+}
+
+int main(int argc, char *argv[])
+{
+        if (argc != 1 && argc != 2) {
+                cerr << "Usage: thread-pool-benchmark [TASKS]"
+                     << endl;
+                exit(EXIT_FAILURE);
+        }
+        const size_t n     = argc == 2 ? atoi(argv[1]) : 1000000;
+        const size_t grain = 64;
+
+        double difference = 0.0;
+        double reference  = 0.0;
+        for (size_t i = 0; i < n; i++) {
+                reference += task(i);
+        }
+
+        cout << "threads   asio (ns/task)   stealing (ns/task)   parallel_reduce (ns/task)" << endl;
+
+        for (size_t k = 1; k <= 16; k *= 2) {
+                asio_thread_pool_t asio_pool(k);
+                thread_pool_t pool(k);
+
+                const double t1 = now();
+                const double result1 = run_futures(asio_pool, n);
+                const double t2 = now();
+                const double result2 = run_futures(pool, n);
+                const double t3 = now();
+                const double result3 = pool.parallel_reduce(0, n, grain, 0.0, task_t(), std::plus<double>());
+                const double t4 = now();
+
+                cout << setw(7)  << k
+                     << setw(17) << 1e9*(t2-t1)/n
+                     << setw(21) << 1e9*(t3-t2)/n
+                     << setw(28) << 1e9*(t4-t3)/n
+                     << endl;
+
+                difference = max(difference, abs(result1 - reference)/abs(reference));
+                difference = max(difference, abs(result2 - reference)/abs(reference));
+                difference = max(difference, abs(result3 - reference)/abs(reference));
+        }
+        cout << "relative difference: " << difference << endl;
+
+        return difference < 1e-12 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
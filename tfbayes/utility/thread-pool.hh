@@ -22,12 +22,18 @@
 #include <tfbayes/config.h>
 #endif /* HAVE_CONFIG_H */
 
-#include <boost/asio/io_service.hpp>
+#include <algorithm>
+#include <deque>
+#include <vector>
+
 #include <boost/thread/thread.hpp>
 #include <boost/thread/future.hpp>
+#include <boost/thread/tss.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/make_shared.hpp>
 #include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/functional/hash.hpp>
 #include <boost/ptr_container/ptr_vector.hpp>
 
 template<typename T>
@@ -52,42 +58,273 @@ public:
         }
 };
 
+// Thread pool with work stealing. Every worker has its own queue of
+// tasks, from which it takes the most recent task. Idle workers
+// steal the oldest task from the queues of other workers.
+//
+// Single tasks are submitted with schedule(), which returns a
+// future. Loops over a range of indices should use parallel_for()
+// or parallel_reduce(), which split the range into chunks of at
+// least grain indices and submit all chunks at once without
+// allocating a future for every index. The calling thread executes
+// tasks as well until the loop is done, so these functions may also
+// be called from within a task of the same pool. Loop bodies must
+// not throw.
+////////////////////////////////////////////////////////////////////////////////
+
 class thread_pool_t {
 public:
+        typedef boost::function<void ()> task_t;
+
         thread_pool_t(size_t n = 1)
-                : work(io_service) {
-                for (size_t i = 0; i < n; i++) {
-                        threads.create_thread(
-                                boost::bind(&boost::asio::io_service::run, &io_service)
-                                );
-                }
+                : m_stop(false), m_signal(0), m_idle(0) {
+                m_start(n);
         }
         thread_pool_t(const thread_pool_t& thread_pool)
-                : work(io_service) {
-                for (size_t i = 0; i < thread_pool.threads.size(); i++) {
-                        threads.create_thread(
-                                boost::bind(&boost::asio::io_service::run, &io_service)
-                                );
-                }
+                : m_stop(false), m_signal(0), m_idle(0) {
+                m_start(thread_pool.size());
         }
         virtual ~thread_pool_t() {
-                io_service.stop();
-                threads.join_all();
+                {
+                        boost::lock_guard<boost::mutex> guard(m_mtx);
+                        m_stop = true;
+                }
+                m_cond.notify_all();
+                m_threads.join_all();
+        }
+
+        size_t size() const {
+                return m_queues.size();
         }
 
         template <typename T>
         boost::unique_future<T> schedule(boost::function<T ()> f) {
-                boost::lock_guard<boost::mutex> guard(mtx);
                 typedef boost::packaged_task<T> task_t;
                 boost::shared_ptr<task_t> tmp = boost::make_shared<task_t>(boost::move(f));
-                io_service.post(boost::bind(&task_t::operator(), tmp));
-                return tmp->get_future();
+                boost::unique_future<T> future = tmp->get_future();
+                if (size() == 0) {
+                        (*tmp)();
+                        return future;
+                }
+                m_push(m_queue(), boost::bind(&task_t::operator(), tmp));
+                m_notify(false);
+                return future;
+        }
+
+        // call f(i) for all i in [first, last)
+        template <typename F>
+        void parallel_for(size_t first, size_t last, size_t grain, const F& f) {
+                if (first >= last) {
+                        return;
+                }
+                grain = std::max(grain, static_cast<size_t>(1));
+                const size_t n = (last - first + grain - 1)/grain;
+                // nothing to distribute
+                if (n == 1 || size() == 0) {
+                        for (size_t i = first; i < last; i++) {
+                                f(i);
+                        }
+                        return;
+                }
+                group_t group(n);
+                size_t* index = m_index.get();
+                for (size_t k = 0; k < n; k++) {
+                        const size_t lo = first + k*grain;
+                        const size_t hi = std::min(lo + grain, last);
+                        task_t task = boost::bind(&thread_pool_t::m_run_chunk<F>,
+                                                  boost::ref(group), boost::cref(f), lo, hi);
+                        // workers keep all chunks in their own
+                        // queue, other threads distribute them
+                        m_push(index ? *index : k % size(), task);
+                }
+                m_notify(true);
+                m_wait(group);
         }
+        // compute op(...op(op(identity, f(first)), f(first+1))..., f(last-1)),
+        // where identity must be the identity of op; the result does
+        // not depend on the scheduling of chunks
+        template <typename T, typename F, typename R>
+        T parallel_reduce(size_t first, size_t last, size_t grain, const T& identity, const F& f, const R& op) {
+                if (first >= last) {
+                        return identity;
+                }
+                grain = std::max(grain, static_cast<size_t>(1));
+                const size_t n = (last - first + grain - 1)/grain;
+                std::vector<T> partial(n, identity);
+                reduce_chunk_t<T, F, R> chunk(first, last, grain, f, op, partial);
+                parallel_for(0, n, 1, chunk);
+                T result = identity;
+                for (size_t k = 0; k < n; k++) {
+                        result = op(result, partial[k]);
+                }
+                return result;
+        }
+
 protected:
-        boost::mutex mtx;
-        boost::thread_group threads;
-        boost::asio::io_service io_service;
-        boost::asio::io_service::work work;
+        struct queue_t {
+                boost::mutex mtx;
+                std::deque<task_t> tasks;
+        };
+        // chunks of a parallel loop that are not yet finished
+        struct group_t {
+                group_t(size_t n)
+                        : remaining(n)
+                        { }
+                boost::mutex mtx;
+                boost::condition_variable cond;
+                size_t remaining;
+        };
+        template <typename T, typename F, typename R>
+        struct reduce_chunk_t {
+                reduce_chunk_t(size_t first, size_t last, size_t grain,
+                               const F& f, const R& op, std::vector<T>& partial)
+                        : first(first), last(last), grain(grain), f(f), op(op), partial(partial)
+                        { }
+                void operator()(size_t k) const {
+                        const size_t lo = first + k*grain;
+                        const size_t hi = std::min(lo + grain, last);
+                        T& result = partial[k];
+                        for (size_t i = lo; i < hi; i++) {
+                                result = op(result, f(i));
+                        }
+                }
+                size_t first;
+                size_t last;
+                size_t grain;
+                const F& f;
+                const R& op;
+                std::vector<T>& partial;
+        };
+
+        void m_start(size_t n) {
+                for (size_t i = 0; i < n; i++) {
+                        m_queues.push_back(new queue_t());
+                }
+                for (size_t i = 0; i < n; i++) {
+                        m_threads.create_thread(
+                                boost::bind(&thread_pool_t::m_work, this, i));
+                }
+        }
+        // queue for a single task, other threads than workers use
+        // a fixed queue so that tasks are executed roughly in the
+        // order of submission
+        size_t m_queue() {
+                if (size_t* index = m_index.get()) {
+                        return *index;
+                }
+                return boost::hash<boost::thread::id>()(boost::this_thread::get_id()) % size();
+        }
+        void m_push(size_t i, const task_t& task) {
+                boost::lock_guard<boost::mutex> guard(m_queues[i].mtx);
+                m_queues[i].tasks.push_back(task);
+        }
+        // take a task from queue i or steal one from another queue,
+        // threads that do not belong to the pool only steal
+        bool m_pop(size_t i, task_t& task) {
+                const size_t n = size();
+                if (i < n) {
+                        queue_t& queue = m_queues[i];
+                        boost::lock_guard<boost::mutex> guard(queue.mtx);
+                        if (!queue.tasks.empty()) {
+                                task.swap(queue.tasks.back());
+                                queue.tasks.pop_back();
+                                return true;
+                        }
+                }
+                for (size_t k = 1; k <= n; k++) {
+                        queue_t& queue = m_queues[(i+k) % n];
+                        boost::lock_guard<boost::mutex> guard(queue.mtx);
+                        if (!queue.tasks.empty()) {
+                                task.swap(queue.tasks.front());
+                                queue.tasks.pop_front();
+                                return true;
+                        }
+                }
+                return false;
+        }
+        void m_notify(bool all) {
+                boost::lock_guard<boost::mutex> guard(m_mtx);
+                m_signal++;
+                // wake up workers only if they are sleeping
+                if (m_idle == 0) {
+                        return;
+                }
+                if (all) {
+                        m_cond.notify_all();
+                }
+                else {
+                        m_cond.notify_one();
+                }
+        }
+        void m_work(size_t i) {
+                m_index.reset(new size_t(i));
+                size_t signal = 0;
+                task_t task;
+                for (;;) {
+                        if (m_pop(i, task)) {
+                                task();
+                                task.clear();
+                                continue;
+                        }
+                        boost::unique_lock<boost::mutex> lock(m_mtx);
+                        if (m_stop) {
+                                return;
+                        }
+                        // sleep only if no task was submitted since
+                        // the queues were checked the last time
+                        if (signal == m_signal) {
+                                m_idle++;
+                                m_cond.wait(lock);
+                                m_idle--;
+                        }
+                        signal = m_signal;
+                }
+        }
+        // execute tasks until all chunks of the group are done
+        void m_wait(group_t& group) {
+                size_t* index = m_index.get();
+                task_t task;
+                for (;;) {
+                        {
+                                boost::lock_guard<boost::mutex> guard(group.mtx);
+                                if (group.remaining == 0) {
+                                        return;
+                                }
+                        }
+                        if (m_pop(index ? *index : size(), task)) {
+                                task();
+                                task.clear();
+                                continue;
+                        }
+                        // all remaining chunks are being executed
+                        boost::unique_lock<boost::mutex> lock(group.mtx);
+                        while (group.remaining != 0) {
+                                group.cond.wait(lock);
+                        }
+                        return;
+                }
+        }
+        template <typename F>
+        static void m_run_chunk(group_t& group, const F& f, size_t lo, size_t hi) {
+                for (size_t i = lo; i < hi; i++) {
+                        f(i);
+                }
+                boost::lock_guard<boost::mutex> guard(group.mtx);
+                if (--group.remaining == 0) {
+                        group.cond.notify_all();
+                }
+        }
+
+        boost::ptr_vector<queue_t> m_queues;
+        boost::thread_group m_threads;
+        // index of the current thread if it belongs to the pool
+        boost::thread_specific_ptr<size_t> m_index;
+        // protects the following members
+        boost::mutex m_mtx;
+        boost::condition_variable m_cond;
+        bool m_stop;
+        size_t m_signal;
+        size_t m_idle;
 };
 
 #endif /* _TFBAYES_UTILITY_THREAD_POOL_H_ */